@@ -18,6 +18,7 @@
 #include "config.h"
 #include "libopenbios/openbios.h"
 #include "libopenbios/bindings.h"
+#include "libopenbios/adler32.h"
 #include "arch/common/nvram.h"
 #include "mol/mol.h"
 #include "libopenbios/ofmem.h"
@@ -116,4 +117,7 @@ arch_of_init( void )
 	/* hack */
 	device_end();
 	bind_func("molboot", boot );
+
+	/* Implementation of adler32 word (required by OS 9, BootX) */
+	bind_func("(adler32)", forth_adler32);
 }
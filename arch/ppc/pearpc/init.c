@@ -23,6 +23,7 @@
 #include "config.h"
 #include "libopenbios/openbios.h"
 #include "libopenbios/bindings.h"
+#include "libopenbios/adler32.h"
 #include "arch/common/nvram.h"
 #include "pearpc/pearpc.h"
 #include "libopenbios/ofmem.h"
@@ -133,4 +134,7 @@ arch_of_init( void )
 	/* hack */
 	device_end();
 	bind_func("pearpcboot", boot );
+
+	/* Implementation of adler32 word (required by OS 9, BootX) */
+	bind_func("(adler32)", forth_adler32);
 }
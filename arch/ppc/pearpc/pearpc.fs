@@ -114,3 +114,16 @@
   " /pci/isa/interrupt-controller" find-dev if encode-int " interrupt-controller" property then
   device-end
 ;
+
+\ -------------------------------------------------------------------------
+\ Adler-32 wrapper
+\ -------------------------------------------------------------------------
+
+: adler32 ( adler buf len -- checksum )
+  " (adler32)" $find if
+    execute
+  else
+    ." Can't find " ( adler32-name ) type cr
+    3drop 0
+  then
+;
@@ -28,20 +28,26 @@
 //
 static int cafe_putchar(int c) {
   //
-  // Send character over IPC to be displayed on gamepad console.
+  // Queue character over IPC to be displayed on gamepad console.
+  // Complete lines are pushed out so output is never left behind a stalled PPC.
   //
-  out_be32((volatile unsigned int*)CAFE_LATTE_IPCPPCMSG, CAFE_CMD_PRINT | ((uint32_t)c));
-  out_be32((volatile unsigned int*)CAFE_LATTE_IPCPPCCTRL, 0x1);
-
-  while (in_be32((volatile unsigned int*)CAFE_LATTE_IPCPPCCTRL) & 0x1);
+  wii_ipc_print(c);
+  if (c == '\n') {
+    wii_ipc_print_flush();
+  }
   return c;
 }
 
+//
+// Input is polled while waiting for a key, so push out any partial line such as a prompt.
+//
 static int cafe_availchar(void) {
+  wii_ipc_flush();
   return 0;
 }
 
 static int cafe_getchar(void) {
+  wii_ipc_flush();
   return 0;
 }
 
@@ -24,6 +24,7 @@
 #include "config.h"
 #include "libopenbios/openbios.h"
 #include "libopenbios/bindings.h"
+#include "libopenbios/adler32.h"
 #include "libopenbios/console.h"
 #include "drivers/usb.h"
 #include "arch/common/nvram.h"
@@ -104,17 +105,13 @@ int is_wii_cafe(void) {
 }
 
 static void cafe_reset_all(void) {
-    out_be32((volatile unsigned int*)CAFE_LATTE_IPCPPCMSG, CAFE_CMD_REBOOT);
-    out_be32((volatile unsigned int*)CAFE_LATTE_IPCPPCCTRL, 0x1);
-
-    while (in_be32((volatile unsigned int*)CAFE_LATTE_IPCPPCCTRL) & 0x1);
+    wii_ipc_send(CAFE_CMD_REBOOT);
+    wii_ipc_flush();
 }
 
 static void cafe_poweroff(void) {
-    out_be32((volatile unsigned int*)CAFE_LATTE_IPCPPCMSG, CAFE_CMD_POWEROFF);
-    out_be32((volatile unsigned int*)CAFE_LATTE_IPCPPCCTRL, 0x1);
-
-    while (in_be32((volatile unsigned int*)CAFE_LATTE_IPCPPCCTRL) & 0x1);
+    wii_ipc_send(CAFE_CMD_POWEROFF);
+    wii_ipc_flush();
 }
 
 void entry(void) {
@@ -363,60 +360,6 @@ static void ffilll(void)
     }   
 }
 
-/*
- * adler32        ( adler buf len -- checksum )
- *
- * Adapted from Mark Adler's original implementation (zlib license)
- *
- * Both OS 9 and BootX require this word for payload validation.
- */
-
-#define DO1(buf,i)  {s1 += buf[i]; s2 += s1;}
-#define DO2(buf,i)  DO1(buf,i); DO1(buf,i+1);
-#define DO4(buf,i)  DO2(buf,i); DO2(buf,i+2);
-#define DO8(buf,i)  DO4(buf,i); DO4(buf,i+4);
-#define DO16(buf)   DO8(buf,0); DO8(buf,8);
-
-static void adler32(void)
-{
-    uint32_t len = (uint32_t)POP();
-    char *buf = (char *)POP();
-    uint32_t adler = (uint32_t)POP();
-
-    if (buf == NULL) {
-        RET(-1);
-    }
-
-    uint32_t base = 65521;
-    uint32_t nmax = 5552;
-
-    uint32_t s1 = adler & 0xffff;
-    uint32_t s2 = (adler >> 16) & 0xffff;
-
-    uint32_t k;
-    while (len > 0) {
-        k = (len < nmax ? len : nmax);
-        len -= k;
-
-        while (k >= 16) {
-            DO16(buf);
-            buf += 16;
-            k -= 16;
-        }
-        if (k != 0) {
-            do {
-                s1 += *buf++;
-                s2 += s1;
-            } while (--k);
-        }
-
-        s1 %= base;
-        s2 %= base;
-    }
-
-    RET(s2 << 16 | s1);
-}
-
 /* ( size -- virt ) */
 static void
 dma_alloc(void)
@@ -623,6 +566,26 @@ arch_of_init(void)
         out_be32((volatile unsigned int*)0x0D0400CC, in_be32((volatile unsigned int*)0x0D0400CC) | 0xE9800);
     }
     
+#ifdef CONFIG_USB_EHCI
+    //
+    // Initialize EHCI controllers before OHCI, so low and full speed devices
+    // they hand over to their companions are found by the OHCI scan.
+    //
+    push_str("/usb@0d040000");
+    fword("find-device");
+    dnode = get_cur_dev();
+    ob_usb_ehci_init(get_path_from_ph(dnode), get_int_property(dnode, "reg", NULL));
+    if (wii_platform == WII_CAFE) {
+        //
+        // The second EHCI has no node of its own, disks on it appear under its OHCI companion.
+        //
+        push_str("/usb@0d130000");
+        fword("find-device");
+        dnode = get_cur_dev();
+        ob_usb_ehci_init(get_path_from_ph(dnode), 0x0D120000);
+        ehci_disable(0x0D140000);
+    }
+#else
     //
     // Reset EHCI controllers to force all devices to OHCI.
     //
@@ -631,6 +594,7 @@ arch_of_init(void)
         ehci_disable(0x0D120000);
         ehci_disable(0x0D140000);
     }
+#endif
 
     //
     // Initialize OHCI controllers.
@@ -675,11 +639,19 @@ arch_of_init(void)
         feval("['] ppc32-reset-all to reset-all");
     }
 
+    /* IPC mailbox statistics */
+    bind_func(".ipc-stats", wii_ipc_stats);
+
+#ifdef CONFIG_USB_MSC
+    /* USB mass storage statistics */
+    bind_func(".usbmsc-stats", usb_msc_stats);
+#endif
+
     /* Implementation of filll word (required by BootX) */
     bind_func("filll", ffilll);
 
     /* Implementation of adler32 word (required by OS 9, BootX) */
-    bind_func("(adler32)", adler32);
+    bind_func("(adler32)", forth_adler32);
     
     bind_func("platform-boot", boot);
     bind_func("(arch-go)", arch_go);
@@ -0,0 +1,278 @@
+/*
+ *      <ipc.c>
+ *
+ *      Queued PPC to ARM IPC mailbox
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation
+ *
+ */
+
+#include "config.h"
+#include "libopenbios/bindings.h"
+#include "drivers/drivers.h"
+#ifdef WII_IPC_HOST
+#include "ipc.h"
+#else
+#include "wii.h"
+#endif
+
+//
+// The loader takes one 32-bit message per doorbell, so messages are queued here and posted
+// whenever the mailbox is free. The PPC then only waits on the ARM when the queue fills up or
+// a caller needs everything delivered, instead of after every message.
+//
+// Console output goes through a ring shared with the loader if the loader supports it, so a
+// whole line costs one doorbell. Otherwise every character is a CAFE_CMD_PRINT message.
+//
+// The unix build compiles this file against a model of the mailbox and the loader, which
+// defines WII_IPC_HOST and supplies the hardware hooks below.
+//
+#define WII_IPC_QUEUE_SIZE      256
+#define WII_IPC_RING_BATCH      128     // ring doorbell at least every so many characters
+
+#ifndef WII_IPC_HOST
+extern void invalidate_dcache_range(char *start, char *stop);
+
+static inline int wii_ipc_busy(void) {
+  return in_be32((volatile unsigned int*)WII_IPCPPCCTRL) & 0x1;
+}
+
+static inline void wii_ipc_write(uint32_t msg) {
+  out_be32((volatile unsigned int*)WII_IPCPPCMSG, msg);
+  out_be32((volatile unsigned int*)WII_IPCPPCCTRL, 0x1);
+}
+
+static inline unsigned long wii_ipc_phys(void *ptr) {
+  return virt_to_phys(ptr);
+}
+
+static inline void wii_ipc_dc_flush(void *ptr, unsigned long len) {
+  flush_dcache_range((char*)ptr, (char*)ptr + len);
+}
+
+static inline void wii_ipc_dc_invalidate(void *ptr, unsigned long len) {
+  invalidate_dcache_range((char*)ptr, (char*)ptr + len);
+}
+#endif
+
+static uint32_t wii_ipc_queue[WII_IPC_QUEUE_SIZE];
+static unsigned int wii_ipc_head;
+static unsigned int wii_ipc_tail;
+
+enum {
+  WII_IPC_PRINT_UNKNOWN,
+  WII_IPC_PRINT_RING,
+  WII_IPC_PRINT_CHAR
+};
+
+static wii_ipc_ring_t wii_ipc_ring __attribute__((aligned(WII_IPC_RING_ALIGN)));
+static int wii_ipc_print_mode;
+static uint32_t wii_ipc_ring_flushed;   // head as last flushed to memory
+static uint32_t wii_ipc_ring_kicked;    // head as last announced to the loader
+static uint32_t wii_ipc_ring_seen;      // tail as last read from memory
+
+static struct {
+  uint32_t messages;
+  uint32_t flushes;
+  uint32_t stalls;
+  uint32_t ring_bytes;
+  uint32_t ring_kicks;
+  uint32_t ring_stalls;
+} wii_ipc_stats_data;
+
+static inline void wii_ipc_post(uint32_t msg) {
+  wii_ipc_write(msg);
+  wii_ipc_stats_data.messages++;
+}
+
+//
+// Waits for the ARM to take the message in the mailbox.
+//
+static void wii_ipc_wait(void) {
+  if (wii_ipc_busy()) {
+    wii_ipc_stats_data.stalls++;
+    while (wii_ipc_busy());
+  }
+}
+
+//
+// Posts the next queued message if the mailbox is free, without waiting.
+//
+void wii_ipc_kick(void) {
+  if ((wii_ipc_head != wii_ipc_tail) && !wii_ipc_busy()) {
+    wii_ipc_post(wii_ipc_queue[wii_ipc_tail]);
+    wii_ipc_tail = (wii_ipc_tail + 1) % WII_IPC_QUEUE_SIZE;
+  }
+}
+
+//
+// Queues a message, waiting for a slot only if the queue is full.
+//
+void wii_ipc_send(uint32_t msg) {
+  unsigned int next = (wii_ipc_head + 1) % WII_IPC_QUEUE_SIZE;
+
+  if (next == wii_ipc_tail) {
+    wii_ipc_wait();
+    wii_ipc_kick();
+  }
+
+  wii_ipc_queue[wii_ipc_head] = msg;
+  wii_ipc_head = next;
+  wii_ipc_kick();
+}
+
+//
+// Delivers all queued messages and waits until the ARM has taken the last one.
+//
+static void wii_ipc_drain(void) {
+  if (wii_ipc_head != wii_ipc_tail) {
+    wii_ipc_stats_data.flushes++;
+  }
+
+  while (wii_ipc_head != wii_ipc_tail) {
+    wii_ipc_wait();
+    wii_ipc_kick();
+  }
+  wii_ipc_wait();
+}
+
+//
+// Reads the loader's ring position.
+//
+static uint32_t wii_ipc_ring_tail(void) {
+  wii_ipc_dc_invalidate(&wii_ipc_ring.tail, WII_IPC_CACHE_LINE);
+  wii_ipc_ring_seen = wii_ipc_ring.tail;
+  return wii_ipc_ring_seen;
+}
+
+//
+// Offers the ring to the loader. The loader handles messages in order, so once it has taken
+// the doorbell that follows the ring command, a loader that supports the ring has acked it.
+//
+static void wii_ipc_ring_init(void) {
+  unsigned long phys = wii_ipc_phys(&wii_ipc_ring);
+
+  wii_ipc_print_mode = WII_IPC_PRINT_CHAR;
+  if ((phys & (WII_IPC_RING_ALIGN - 1)) != 0 || (phys >> 8) > 0xFFFFFF) {
+    return;
+  }
+
+  wii_ipc_ring.magic = WII_IPC_RING_MAGIC;
+  wii_ipc_ring.size  = WII_IPC_RING_SIZE;
+  wii_ipc_ring.head  = 0;
+  wii_ipc_ring.tail  = 0;
+  wii_ipc_ring.ack   = 0;
+  wii_ipc_ring_flushed = 0;
+  wii_ipc_ring_kicked = 0;
+  wii_ipc_ring_seen = 0;
+  wii_ipc_dc_flush(&wii_ipc_ring, sizeof (wii_ipc_ring));
+
+  wii_ipc_send(CAFE_CMD_PRINT_RING | (phys >> 8));
+  wii_ipc_send(CAFE_CMD_PRINT_KICK);
+  wii_ipc_drain();
+
+  wii_ipc_dc_invalidate(&wii_ipc_ring.tail, WII_IPC_CACHE_LINE);
+  if (wii_ipc_ring.ack == WII_IPC_RING_MAGIC) {
+    wii_ipc_print_mode = WII_IPC_PRINT_RING;
+  }
+}
+
+//
+// Writes the ring characters stored since the last call back to memory and rings the doorbell.
+//
+static void wii_ipc_ring_push(void) {
+  uint32_t start = wii_ipc_ring_flushed % WII_IPC_RING_SIZE;
+  uint32_t len   = wii_ipc_ring.head - wii_ipc_ring_flushed;
+
+  if (len == 0) {
+    return;
+  }
+
+  if (start + len > WII_IPC_RING_SIZE) {
+    wii_ipc_dc_flush(&wii_ipc_ring.data[start], WII_IPC_RING_SIZE - start);
+    wii_ipc_dc_flush(&wii_ipc_ring.data[0], start + len - WII_IPC_RING_SIZE);
+  } else {
+    wii_ipc_dc_flush(&wii_ipc_ring.data[start], len);
+  }
+  wii_ipc_dc_flush(&wii_ipc_ring.head, sizeof (wii_ipc_ring.head));
+  wii_ipc_ring_flushed = wii_ipc_ring.head;
+
+  wii_ipc_send(CAFE_CMD_PRINT_KICK);
+  wii_ipc_ring_kicked = wii_ipc_ring.head;
+  wii_ipc_stats_data.ring_kicks++;
+}
+
+//
+// Queues a character for the console.
+//
+void wii_ipc_print(int c) {
+  if (wii_ipc_print_mode == WII_IPC_PRINT_UNKNOWN) {
+    wii_ipc_ring_init();
+  }
+
+  if (wii_ipc_print_mode != WII_IPC_PRINT_RING) {
+    wii_ipc_send(CAFE_CMD_PRINT | ((uint32_t)c & 0xFF));
+    return;
+  }
+
+  //
+  // The loader's position is only read back from memory once the ring looks full.
+  //
+  if (wii_ipc_ring.head - wii_ipc_ring_seen == WII_IPC_RING_SIZE &&
+      wii_ipc_ring.head - wii_ipc_ring_tail() == WII_IPC_RING_SIZE) {
+    wii_ipc_stats_data.ring_stalls++;
+    wii_ipc_ring_push();
+    while (wii_ipc_ring.head - wii_ipc_ring_tail() == WII_IPC_RING_SIZE) {
+      wii_ipc_kick();
+    }
+  }
+
+  wii_ipc_ring.data[wii_ipc_ring.head % WII_IPC_RING_SIZE] = (uint8_t)c;
+  wii_ipc_ring.head++;
+  wii_ipc_stats_data.ring_bytes++;
+
+  if (wii_ipc_ring.head - wii_ipc_ring_kicked >= WII_IPC_RING_BATCH) {
+    wii_ipc_ring_push();
+  }
+}
+
+//
+// Sends the console output queued so far, such as a complete line. With the ring this only
+// rings the doorbell; per-character output waits until the ARM has taken every character.
+//
+void wii_ipc_print_flush(void) {
+  if (wii_ipc_print_mode == WII_IPC_PRINT_RING) {
+    wii_ipc_ring_push();
+  } else {
+    wii_ipc_drain();
+  }
+}
+
+//
+// Delivers all queued messages and console output, and waits until the ARM has taken them.
+//
+void wii_ipc_flush(void) {
+  if (wii_ipc_print_mode == WII_IPC_PRINT_RING) {
+    wii_ipc_ring_push();
+    wii_ipc_drain();
+    while (wii_ipc_ring_tail() != wii_ipc_ring.head);
+  } else {
+    wii_ipc_drain();
+  }
+}
+
+//
+// Prints IPC statistics.
+//
+void wii_ipc_stats(void) {
+  printk("ipc: %u message(s), %u flush(es), %u stall(s), %u queued\n",
+         wii_ipc_stats_data.messages, wii_ipc_stats_data.flushes, wii_ipc_stats_data.stalls,
+         (wii_ipc_head - wii_ipc_tail) % WII_IPC_QUEUE_SIZE);
+  printk("console: %s, %u ring byte(s), %u doorbell(s), %u ring stall(s)\n",
+         wii_ipc_print_mode == WII_IPC_PRINT_RING ? "ring" :
+         wii_ipc_print_mode == WII_IPC_PRINT_CHAR ? "per character" : "not used",
+         wii_ipc_stats_data.ring_bytes, wii_ipc_stats_data.ring_kicks,
+         wii_ipc_stats_data.ring_stalls);
+}
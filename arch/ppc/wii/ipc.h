@@ -0,0 +1,52 @@
+/*
+ *      <ipc.h>
+ *
+ *      PPC to ARM IPC mailbox and loader commands
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation
+ *
+ */
+
+#ifndef _H_WII_IPC
+#define _H_WII_IPC
+
+#define WII_IPCPPCMSG               0x0D800000
+#define WII_IPCPPCCTRL              0x0D800004
+
+#define CAFE_CMD_POWEROFF           0xCAFE0001
+#define CAFE_CMD_REBOOT             0xCAFE0002
+#define CAFE_CMD_PRINT_KICK         0xCAFE0003
+#define CAFE_CMD_PRINT              0xCAFE6400
+#define CAFE_CMD_PRINT_RING         0xA3000000  // | physical ring address >> 8
+
+//
+// Console ring shared with the loader. The PPC stores characters at data[head % size] and
+// advances head, then sends CAFE_CMD_PRINT_KICK. The loader prints everything up to head and
+// advances tail. A loader that supports the ring sets ack to the magic value when it gets
+// CAFE_CMD_PRINT_RING; older loaders ignore the command and the console falls back to one
+// CAFE_CMD_PRINT per character. Fields written by the PPC and by the loader sit in separate
+// cache lines, as the PPC flushes and invalidates them by line.
+//
+#define WII_IPC_RING_MAGIC          0x52494E47  // "RING"
+#define WII_IPC_RING_SIZE           4096
+#define WII_IPC_RING_ALIGN          256
+#define WII_IPC_CACHE_LINE          32
+
+typedef struct {
+  // Written by the PPC.
+  uint32_t magic;
+  uint32_t size;
+  uint32_t head;
+  uint32_t pad0[(WII_IPC_CACHE_LINE / 4) - 3];
+
+  // Written by the loader.
+  uint32_t tail;
+  uint32_t ack;
+  uint32_t pad1[(WII_IPC_CACHE_LINE / 4) - 2];
+
+  uint8_t data[WII_IPC_RING_SIZE];
+} wii_ipc_ring_t;
+
+#endif   /* _H_WII_IPC */
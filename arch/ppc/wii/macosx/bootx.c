@@ -70,77 +70,84 @@ static int macosx_check_verbose_bootargs(void) {
 }
 
 //
-// Patch BootX.
+// BootX patch table, applied in a single pass.
 //
-int macosx_patch_bootx(char *base, unsigned long length) {
-    int is_bootx;
-
-    static const char bootx_log_find[] = "\n\nMac OS X Loader";
-    static const char bootx_kernelcache_find[] = "kernelcache.%08lX";
-    static const char bootx_msr_find[] = { 0x38, 0x00, 0x10, 0x00 };
-    static const char bootx_msr_repl[] = { 0x38, 0x00, 0x10, 0x30 };
-
-    int found_verbose;
-    static const char bootx_kernelcache_repl[] = "zznoprelink.%08lX";
-    static const char bootx_verbose_find1[] = { 0x38, 0x60, 0x00, 0x10, 0x48 };
-    static const char bootx_verbose_find2[] = { 0x38, 0x60, 0x00, 0x00 }; 
-    static const char bootx_verbose_repl2[] = { 0x38, 0x60, 0x00, 0x10 }; 
-
+enum {
+    BOOTX_PATCH_LOG,
+    BOOTX_PATCH_MSR,
+    BOOTX_PATCH_KERNELCACHE,
+    BOOTX_PATCH_VERBOSE_CHECK,
+    BOOTX_PATCH_VERBOSE,
+    BOOTX_PATCH_COUNT
+};
+
+static const char bootx_log_find[] = "\n\nMac OS X Loader";
+static const char bootx_kernelcache_find[] = "kernelcache.%08lX";
+static const char bootx_kernelcache_repl[] = "zznoprelink.%08lX";
+static const char bootx_msr_find[] = { 0x38, 0x00, 0x10, 0x00 };
+static const char bootx_msr_repl[] = { 0x38, 0x00, 0x10, 0x30 };
+static const char bootx_verbose_find1[] = { 0x38, 0x60, 0x00, 0x10, 0x48 };
+static const char bootx_verbose_find2[] = { 0x38, 0x60, 0x00, 0x00 };
+static const char bootx_verbose_repl2[] = { 0x38, 0x60, 0x00, 0x10 };
+
+static const macosx_patch_t bootx_patches[BOOTX_PATCH_COUNT] = {
     //
     // Check that this is actually BootX.
     // Some versions have a newline at the end, must search without null terminator.
     //
-    is_bootx = 0;
-    for (int i = 0; i < length - strlen (bootx_log_find); i++) {
-        if (memcmp(&base[i], bootx_log_find, strlen (bootx_log_find)) == 0) {
-            is_bootx = 1;
-            break;
-        }
-    }
-
-    if (!is_bootx) {
-        printk("Failed to find BootX pattern\n");
-        return 1;
-    }
-    printk("Patching BootX\n");
-
+    [BOOTX_PATCH_LOG] = {
+        .name = "loader string", .find = bootx_log_find, .length = sizeof (bootx_log_find) - 1,
+        .min_hits = 1, .max_hits = 1
+    },
     //
     // Patch MSR bits to prevent IR/DR from being disabled.
     //
-    for (int i = 0; i < length - sizeof (bootx_msr_find); i+=4) {
-        if (memcmp(&base[i], bootx_msr_find, sizeof (bootx_msr_find)) == 0) {
-            memcpy(&base[i], bootx_msr_repl, sizeof (bootx_msr_repl));
-            printk("Patched BootX MSR pattern at %p\n", &base[i]);
-        }
-    }
-
+    [BOOTX_PATCH_MSR] = {
+        .name = "MSR", .find = bootx_msr_find, .length = sizeof (bootx_msr_find),
+        .replace = bootx_msr_repl, .replace_length = sizeof (bootx_msr_repl), .align = 4
+    },
     //
     // Prevent prelinked kernelcache from being loaded, the supplemental mkext cannot be linked in that state.
     //
-    for (int i = 0; i < length - sizeof (bootx_kernelcache_find); i++) {
-        if (memcmp(&base[i], bootx_kernelcache_find, sizeof (bootx_kernelcache_find)) == 0) {
-            memcpy(&base[i], bootx_kernelcache_repl, sizeof (bootx_kernelcache_repl));
-            printk("Patched BootX kernelcache pattern at %p\n", &base[i]);
-            break;
-        }
+    [BOOTX_PATCH_KERNELCACHE] = {
+        .name = "kernelcache", .find = bootx_kernelcache_find, .length = sizeof (bootx_kernelcache_find),
+        .replace = bootx_kernelcache_repl, .replace_length = sizeof (bootx_kernelcache_repl), .max_hits = 1
+    },
+    //
+    // Patch check to force enable verbose mode, only used if the boot args ask for it.
+    //
+    [BOOTX_PATCH_VERBOSE_CHECK] = {
+        .name = "verbose check", .find = bootx_verbose_find1, .length = sizeof (bootx_verbose_find1),
+        .align = 4, .max_hits = 1
+    },
+    [BOOTX_PATCH_VERBOSE] = {
+        .name = "verbose", .find = bootx_verbose_find2, .length = sizeof (bootx_verbose_find2),
+        .replace = bootx_verbose_repl2, .replace_length = sizeof (bootx_verbose_repl2), .align = 4,
+        .max_hits = 1, .flags = MACOSX_PATCH_AFTER_PREVIOUS
     }
+};
 
-    if (macosx_check_verbose_bootargs()) {
-        //
-        // Patch check to force enable verbose mode.
-        //
-        found_verbose = 0;
-        for (int i = 0; i < length - sizeof (bootx_verbose_find1); i+=4) {
-            if (memcmp(&base[i], bootx_verbose_find1, sizeof (bootx_verbose_find1)) == 0) {
-                found_verbose = 1;
-                continue;
-            } else if (found_verbose && (memcmp(&base[i], bootx_verbose_find2, sizeof (bootx_verbose_find2)) == 0)) {
-                memcpy(&base[i], bootx_verbose_repl2, sizeof (bootx_verbose_repl2));
-                printk("Patched BootX verbose at %p\n", &base[i]);
-                break;
-            }
-        }
+//
+// Patch BootX.
+//
+int macosx_patch_bootx(char *base, unsigned long length) {
+    macosx_patch_hits_t hits[BOOTX_PATCH_COUNT];
+    int                 count;
+
+    //
+    // Verbose patterns are last in the table and only scanned for when requested.
+    //
+    count = macosx_check_verbose_bootargs() ? BOOTX_PATCH_COUNT : BOOTX_PATCH_VERBOSE_CHECK;
+    macosx_patch_scan(base, length, bootx_patches, hits, count);
+
+    if (hits[BOOTX_PATCH_LOG].hits == 0) {
+        printk("Failed to find BootX pattern\n");
+        return 1;
     }
+    printk("Patching BootX\n");
+
+    macosx_patch_report("BootX", bootx_patches, hits, count);
+    macosx_patch_apply(bootx_patches, hits, count);
 
     flush_dcache_range(base, base + length);
     flush_icache_range(base, base + length);
@@ -55,21 +55,137 @@ unsigned long macho_get_top(void *macho) {
 }
 
 //
-// Resolves a symbol from a Mach-O binary.
+// Hashes a symbol name (FNV-1a).
 //
-unsigned long macho_resolve_symbol(macho_sym_context_t *context, const char *symbolName) {
-    const char *symStr;
+static uint32_t macho_hash_name(const char *name) {
+    uint32_t hash = 2166136261U;
+
+    while (*name != '\0') {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+//
+// Builds an open-addressed hash index over the symbol table so lookups no longer
+// scan every nlist entry. Slots hold the symbol index plus one, zero is empty.
+// Symbols are inserted in table order, so the first of any duplicate names is
+// found first, matching a linear scan.
+//
+int macho_index_symbols(macho_sym_context_t *context) {
+    unsigned long   hashSize;
+    unsigned long   slot;
+    unsigned long   strx;
+
+    context->symbol_hash = NULL;
+    context->hash_mask   = 0;
+
+    //
+    // Size the table to a power of two at least twice the symbol count.
+    //
+    hashSize = 1;
+    while (hashSize < (context->symbol_count * 2)) {
+        hashSize <<= 1;
+    }
+
+    context->symbol_hash = malloc(hashSize * sizeof (uint32_t));
+    if (context->symbol_hash == NULL) {
+        printk("macho_index_symbols: no memory for %lu symbols, using linear lookups\n", context->symbol_count);
+        return 0;
+    }
+    memset(context->symbol_hash, 0, hashSize * sizeof (uint32_t));
+    context->hash_mask = hashSize - 1;
+
     for (unsigned long i = 0; i < context->symbol_count; i++) {
-        //
-        // Get the symbol string for the symbol.
-        //
-        symStr = (const char*)(context->string_table + context->symbol_table[i].n_un.n_strx);
-        if (strcmp(symbolName, symStr) == 0) {
-        printk("macho_resolve_symbol: found symbol '%s' at 0x%lX\n", symbolName, context->symbol_table[i].n_value);
-        return context->symbol_table[i].n_value;
+        strx = context->symbol_table[i].n_un.n_strx;
+        if ((strx == 0) || (strx >= context->string_size)) {
+            continue;
         }
+
+        slot = macho_hash_name(context->string_table + strx) & context->hash_mask;
+        while (context->symbol_hash[slot] != 0) {
+            slot = (slot + 1) & context->hash_mask;
+        }
+        context->symbol_hash[slot] = i + 1;
     }
 
-    printk("macho_resolve_symbol: failed to locate symbol '%s'\n", symbolName);
-    return 0;
+    return 1;
+}
+
+//
+// Frees the symbol index.
+//
+void macho_free_symbol_index(macho_sym_context_t *context) {
+    if (context->symbol_hash != NULL) {
+        free(context->symbol_hash);
+    }
+    context->symbol_hash = NULL;
+    context->hash_mask   = 0;
+}
+
+//
+// Looks up a symbol, returns its nlist entry or NULL.
+//
+static struct nlist *macho_lookup_symbol(macho_sym_context_t *context, const char *symbolName) {
+    struct nlist    *sym;
+    unsigned long   slot;
+
+    //
+    // Fall back to a linear scan if there is no index.
+    //
+    if (context->symbol_hash == NULL) {
+        for (unsigned long i = 0; i < context->symbol_count; i++) {
+            sym = &context->symbol_table[i];
+            if (strcmp(symbolName, context->string_table + sym->n_un.n_strx) == 0) {
+                return sym;
+            }
+        }
+        return NULL;
+    }
+
+    slot = macho_hash_name(symbolName) & context->hash_mask;
+    while (context->symbol_hash[slot] != 0) {
+        sym = &context->symbol_table[context->symbol_hash[slot] - 1];
+        if (strcmp(symbolName, context->string_table + sym->n_un.n_strx) == 0) {
+            return sym;
+        }
+        slot = (slot + 1) & context->hash_mask;
+    }
+    return NULL;
+}
+
+//
+// Resolves a symbol from a Mach-O binary.
+//
+unsigned long macho_resolve_symbol(macho_sym_context_t *context, const char *symbolName) {
+    struct nlist *sym;
+
+    sym = macho_lookup_symbol(context, symbolName);
+    if (sym == NULL) {
+        printk("macho_resolve_symbol: failed to locate symbol '%s'\n", symbolName);
+        return 0;
+    }
+    return sym->n_value;
+}
+
+//
+// Resolves a set of symbols in one pass. Unresolved symbols are set to 0.
+// Returns the number of symbols resolved.
+//
+int macho_resolve_symbols(macho_sym_context_t *context, const char * const *symbolNames, unsigned long *symbolValues, int count) {
+    struct nlist    *sym;
+    int             resolved;
+
+    resolved = 0;
+    for (int i = 0; i < count; i++) {
+        sym = macho_lookup_symbol(context, symbolNames[i]);
+        if (sym == NULL) {
+            symbolValues[i] = 0;
+            continue;
+        }
+        symbolValues[i] = sym->n_value;
+        resolved++;
+    }
+    return resolved;
 }
@@ -21,8 +21,45 @@ typedef struct {
     unsigned long   symbol_count;
     const char*     string_table;
     unsigned long   string_size;
+    uint32_t*       symbol_hash;
+    unsigned long   hash_mask;
 } macho_sym_context_t;
 
+//
+// Binary patch table entry. Patterns are matched under mask (NULL for an exact match)
+// at offsets where (offset % align) == align_offset, align being a power of two.
+//
+#define MACOSX_PATCH_MAX_ENTRIES    32
+#define MACOSX_PATCH_MAX_HITS       16
+
+#define MACOSX_PATCH_AFTER_PREVIOUS 0x1     // Only match after the previous entry's first hit
+
+typedef struct {
+    const char*     name;
+    const char*     find;
+    const char*     mask;
+    unsigned long   length;
+    const char*     replace;            // NULL to only locate the pattern
+    unsigned long   replace_length;
+    unsigned long   align;
+    unsigned long   align_offset;
+    unsigned int    min_hits;
+    unsigned int    max_hits;           // 0 for all sites, see macosx_patch_hits_t
+    unsigned int    flags;
+} macosx_patch_t;
+
+//
+// Scan results for one entry. Only the first MACOSX_PATCH_MAX_HITS sites are recorded; for
+// max_hits 0 entries, total counts every site and the rest are patched in a second pass.
+//
+typedef struct {
+    unsigned int    hits;
+    unsigned int    total;
+    char*           sites[MACOSX_PATCH_MAX_HITS];
+    char*           base;
+    unsigned long   length;
+} macosx_patch_hits_t;
+
 //
 // Kernel versions.
 //
@@ -57,13 +94,25 @@ typedef struct {
 #define XNU_VERSION_TIGER_MAX               (XNU_VERSION_LEOPARD_MIN - 1)
 #define XNU_VERSION_LEOPARD_MAX             (XNU_VERSION_SNOW_LEOPARD_MIN - 1)
 
+extern int macho_index_symbols(macho_sym_context_t *context);
+extern void macho_free_symbol_index(macho_sym_context_t *context);
 extern unsigned long macho_resolve_symbol(macho_sym_context_t *context, const char *symbolName);
+extern int macho_resolve_symbols(macho_sym_context_t *context, const char * const *symbolNames, unsigned long *symbolValues, int count);
 extern unsigned long macho_get_top(void *macho);
 extern int macosx_patch_bootx(char *base, unsigned long length);
 extern int macosx_check_bootx(void);
 extern boot_args_ptr macosx_get_boot_args(void);
 extern int macosx_patch(void);
 
+//
+// patch.c
+//
+extern int macosx_patch_scan(char *base, unsigned long length, const macosx_patch_t *patches,
+                             macosx_patch_hits_t *hits, int count);
+extern int macosx_patch_report(const char *prefix, const macosx_patch_t *patches,
+                               const macosx_patch_hits_t *hits, int count);
+extern void macosx_patch_apply(const macosx_patch_t *patches, const macosx_patch_hits_t *hits, int count);
+
 //
 // xnu_version.c
 //
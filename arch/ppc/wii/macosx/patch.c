@@ -0,0 +1,196 @@
+/*
+ *	<patch.c>
+ *
+ *   Multi-pattern binary patch engine for BootX and XNU
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   version 2
+ *
+ */
+
+#include "config.h"
+#include "macosx.h"
+
+//
+// Checks a single pattern at a position.
+//
+static int macosx_patch_match(const unsigned char *ptr, const macosx_patch_t *patch) {
+    const unsigned char *find = (const unsigned char*)patch->find;
+    const unsigned char *mask = (const unsigned char*)patch->mask;
+
+    if (mask == NULL) {
+        return memcmp(ptr, find, patch->length) == 0;
+    }
+
+    for (unsigned long k = 0; k < patch->length; k++) {
+        if ((ptr[k] ^ find[k]) & mask[k]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//
+// Checks the alignment of a pattern at an image offset.
+//
+static int macosx_patch_aligned(unsigned long offset, const macosx_patch_t *patch) {
+    return (patch->align <= 1) || ((offset & (patch->align - 1)) == patch->align_offset);
+}
+
+//
+// Scans an image once for every pattern in a patch table, recording up to max_hits
+// sites for each. Patterns with max_hits 0 are counted over the whole image. Nothing is
+// written, so callers can check the hits before applying.
+// Returns the total number of hits, or -1 if the table is too large.
+//
+int macosx_patch_scan(char *base, unsigned long length, const macosx_patch_t *patches,
+                      macosx_patch_hits_t *hits, int count) {
+    const macosx_patch_t    *patch;
+    const unsigned char     *image;
+    uint32_t                firstByte[256];
+    uint32_t                active;
+    uint32_t                candidates;
+    unsigned int            limit[MACOSX_PATCH_MAX_ENTRIES];
+    unsigned char           firstMask;
+    unsigned char           first;
+    int                     total;
+
+    if (count > MACOSX_PATCH_MAX_ENTRIES) {
+        printk("macosx_patch_scan: too many patterns (%d)\n", count);
+        return -1;
+    }
+
+    //
+    // Compile the table: for each possible leading byte, the set of patterns that can start with it.
+    //
+    memset(firstByte, 0, sizeof (firstByte));
+    active = 0;
+    for (int j = 0; j < count; j++) {
+        patch = &patches[j];
+        hits[j].hits = 0;
+        hits[j].total = 0;
+        hits[j].base = base;
+        hits[j].length = length;
+
+        limit[j] = patch->max_hits;
+        if (limit[j] > MACOSX_PATCH_MAX_HITS) {
+            limit[j] = MACOSX_PATCH_MAX_HITS;
+        }
+        if (patch->length == 0) {
+            continue;
+        }
+
+        firstMask = (patch->mask != NULL) ? patch->mask[0] : 0xFF;
+        first = patch->find[0] & firstMask;
+        for (int v = 0; v < 256; v++) {
+            if ((v & firstMask) == first) {
+                firstByte[v] |= 1U << j;
+            }
+        }
+        active |= 1U << j;
+    }
+
+    //
+    // Single pass over the image, stopping once every pattern has all its hits.
+    //
+    image = (const unsigned char*)base;
+    total = 0;
+    for (unsigned long i = 0; (active != 0) && (i < length); i++) {
+        candidates = firstByte[image[i]] & active;
+
+        for (int j = 0; candidates != 0; j++, candidates >>= 1) {
+            if (!(candidates & 1)) {
+                continue;
+            }
+            patch = &patches[j];
+
+            if (!macosx_patch_aligned(i, patch)) {
+                continue;
+            }
+            if (patch->length > (length - i)) {
+                continue;
+            }
+            if (patch->flags & MACOSX_PATCH_AFTER_PREVIOUS) {
+                if ((j == 0) || (hits[j - 1].hits == 0) || (hits[j - 1].sites[0] >= &base[i])) {
+                    continue;
+                }
+            }
+            if (!macosx_patch_match(&image[i], patch)) {
+                continue;
+            }
+
+            if (hits[j].hits < MACOSX_PATCH_MAX_HITS) {
+                hits[j].sites[hits[j].hits++] = &base[i];
+            }
+            hits[j].total++;
+            total++;
+            if ((limit[j] != 0) && (hits[j].hits >= limit[j])) {
+                active &= ~(1U << j);
+            }
+        }
+    }
+
+    return total;
+}
+
+//
+// Prints a hit report for a patch table so patterns broken by new OS builds show up at once.
+// Returns 0 if any pattern fell short of its min_hits.
+//
+int macosx_patch_report(const char *prefix, const macosx_patch_t *patches,
+                        const macosx_patch_hits_t *hits, int count) {
+    int ok = 1;
+
+    for (int j = 0; j < count; j++) {
+        if (hits[j].hits < patches[j].min_hits) {
+            printk("%s: failed to locate %s pattern\n", prefix, patches[j].name);
+            ok = 0;
+            continue;
+        }
+        if (hits[j].hits == 0) {
+            printk("%s: %s pattern not present\n", prefix, patches[j].name);
+            continue;
+        }
+
+        printk("%s: %s pattern, %u hit(s) at", prefix, patches[j].name, hits[j].hits);
+        for (unsigned int h = 0; h < hits[j].hits; h++) {
+            printk(" %p", hits[j].sites[h]);
+        }
+        if (hits[j].total > hits[j].hits) {
+            printk(" and %u more", hits[j].total - hits[j].hits);
+        }
+        printk("\n");
+    }
+
+    return ok;
+}
+
+//
+// Writes the replacement of every pattern at each recorded site. Sites of max_hits 0 patterns
+// beyond the recorded ones are found again by a second pass after the last recorded site.
+//
+void macosx_patch_apply(const macosx_patch_t *patches, const macosx_patch_hits_t *hits, int count) {
+    const macosx_patch_t    *patch;
+    unsigned long           start;
+
+    for (int j = 0; j < count; j++) {
+        patch = &patches[j];
+        if (patch->replace == NULL) {
+            continue;
+        }
+        for (unsigned int h = 0; h < hits[j].hits; h++) {
+            memcpy(hits[j].sites[h], patch->replace, patch->replace_length);
+        }
+
+        if (hits[j].total <= hits[j].hits) {
+            continue;
+        }
+        start = (hits[j].sites[hits[j].hits - 1] - hits[j].base) + 1;
+        for (unsigned long i = start; (i < hits[j].length) && (patch->length <= (hits[j].length - i)); i++) {
+            if (macosx_patch_aligned(i, patch) && macosx_patch_match((const unsigned char*)&hits[j].base[i], patch)) {
+                memcpy(&hits[j].base[i], patch->replace, patch->replace_length);
+            }
+        }
+    }
+}
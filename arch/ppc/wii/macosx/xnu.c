@@ -32,6 +32,41 @@
 //
 #define XNU_PATCH_COLORTABLE            0
 
+//
+// Kernel symbols used by the patch set, resolved together through the symbol index.
+//
+enum {
+    XNU_SYM_START,
+    XNU_SYM_PPC_INIT,
+    XNU_SYM_PE_FIND_SCC,
+    XNU_SYM_DEBUGGER,
+    XNU_SYM_PRINT_BACKTRACE,
+    XNU_SYM_DRAW_PANIC_DIALOG,
+    XNU_SYM_CONSDEBUG_PUTC,
+    XNU_SYM_VC_COLORS,
+    XNU_SYM_COUNT
+};
+
+static const char * const xnu_symbol_names[XNU_SYM_COUNT] = {
+    [XNU_SYM_START]             = "__start",
+    [XNU_SYM_PPC_INIT]          = "_ppc_init",
+    [XNU_SYM_PE_FIND_SCC]       = "_PE_find_scc",
+    [XNU_SYM_DEBUGGER]          = "_Debugger",
+    [XNU_SYM_PRINT_BACKTRACE]   = "_print_backtrace",
+    [XNU_SYM_DRAW_PANIC_DIALOG] = "_draw_panic_dialog",
+    [XNU_SYM_CONSDEBUG_PUTC]    = "_consdebug_putc",
+    [XNU_SYM_VC_COLORS]         = "_vc_colors"
+};
+
+extern unsigned long timer_freq;
+
+static inline uint32_t xnu_read_tb(void) {
+    uint32_t tb;
+
+    asm volatile("mftb %0" : "=r"(tb));
+    return tb;
+}
+
 static int xnu_get_symtab(macho_sym_context_t *symContext) {
     phandle_t   memory_map;
     uint32_t*   prop;
@@ -55,6 +90,8 @@ static int xnu_get_symtab(macho_sym_context_t *symContext) {
     symContext->symbol_count    = symTabCommand->nsyms;
     symContext->string_table    = (const char*) symTabCommand->stroff;
     symContext->string_size     = symTabCommand->strsize;
+    symContext->symbol_hash     = NULL;
+    symContext->hash_mask       = 0;
 
     return 1;
 }
@@ -62,11 +99,7 @@ static int xnu_get_symtab(macho_sym_context_t *symContext) {
 //
 // Patch the CPU type checking to force the 750CX branch to match Espresso.
 //
-static int xnu_patch_cpu_check(macho_sym_context_t *symContext) {
-    unsigned long   kern_sym_start;
-    char            *base;
-    int             found;
-
+static int xnu_patch_cpu_check(unsigned long kern_sym_start) {
     static const char cpuFind[] = {
         0xFF, 0xFF, 0x0F, 0x00,     // Mask
         0x00, 0x08,                 // PROCESSOR_VERSION_750
@@ -78,44 +111,33 @@ static int xnu_patch_cpu_check(macho_sym_context_t *symContext) {
         0x00, 0x00                  // Version for mask
     };
 
-    //
-    // Get _start function location.
-    //
-    kern_sym_start = macho_resolve_symbol(symContext, "__start");
+    static const macosx_patch_t cpuPatch = {
+        .name = "CPU check", .find = cpuFind, .length = sizeof (cpuFind),
+        .replace = cpuReplace, .replace_length = sizeof (cpuReplace), .min_hits = 1, .max_hits = 1
+    };
+    macosx_patch_hits_t hits;
+
     if (kern_sym_start == 0) {
+        printk("xnu_patch_cpu_check: failed to locate symbol '__start'\n");
         return 0;
     }
-    base = (char*)kern_sym_start;
 
     //
     // Look for pattern at entry point (__start).
     //
-    found = 0;
-    for (int i = 0; i < 0x4000; i++, base++) {
-        if (memcmp(base, cpuFind, sizeof (cpuFind)) == 0) {
-            found = 1;
-            break;
-        }
-    }
-
-    if (!found) {
-        printk("xnu_patch_cpu_check: failed to locate CPU check patch pattern\n");
+    macosx_patch_scan((char*)kern_sym_start, 0x4000 + sizeof (cpuFind) - 1, &cpuPatch, &hits, 1);
+    if (!macosx_patch_report("xnu_patch_cpu_check", &cpuPatch, &hits, 1)) {
         return 0;
     }
 
-    memcpy(base, cpuReplace, sizeof (cpuReplace));
-    printk("xnu_patch_cpu_check: patched CPU check for Espresso at %p\n", base);
+    macosx_patch_apply(&cpuPatch, &hits, 1);
     return 1;
 }
 
 //
 // Patch the BAT setup to avoid conflicts with other BATs for the video DBAT3, and prevent DBAT2 from being filled.
 //
-static int xnu_patch_io_bats(macho_sym_context_t *symContext) {
-    unsigned long   kern_sym_ppc_init;
-    char            *base;
-    int             found;
-
+static int xnu_patch_io_bats(unsigned long kern_sym_ppc_init) {
     static const char videoBatFind1[] = {
         0xF0, 0x00,     // ... 0xF000
         0x41, 0x82      // beq ...
@@ -147,105 +169,70 @@ static int xnu_patch_io_bats(macho_sym_context_t *symContext) {
         0x2C, 0x03, 0x00, 0x00,     // cmpwi r3, 0x0000
     };
 
-    //
-    // Get ppc_init function. TODO: Might need to adjust for 10.0 and 10.1.
-    //
-    kern_sym_ppc_init = macho_resolve_symbol(symContext, "_ppc_init");
-    if (kern_sym_ppc_init == 0) {
-        return 0;
-    }
-    base = (char*)kern_sym_ppc_init;
-
-    //
-    // Do first video BAT patch. Change mask to 0xFF000000 to catch Wii U's FB.
-    // Start at 0x2 offset as patch starts halfway through an opcode.
-    //
-    found = 0;
-    for (int i = 2; i < 0x1000; i += 4) {
-        if (memcmp(&base[i], videoBatFind1, sizeof (videoBatFind1)) == 0) {
-            memcpy(&base[i], videoBatRepl1, sizeof (videoBatRepl1));
-            printk("xnu_patch_io_bats: patched video BAT pattern 1 at %p\n", &base[i]);
-            found = 1;
-            break;
-        }
-    }
-
-    if (!found) {
-        printk("xnu_patch_io_bats: failed to patch video BAT pattern 1\n");
-        return 0;
-    }
-
-    if (is_wii_rvl()) {
+    static const macosx_patch_t batPatches[] = {
         //
-        // Do second video BAT patch. Change size to 2MB to ensure regular MEM2 memory is not included in BAT.
+        // First video BAT patch. Change mask to 0xFF000000 to catch Wii U's FB.
+        // Matched at a 0x2 offset as patch starts halfway through an opcode.
         //
-        found = 0;
-        for (int i = 0; i < 0x1000; i += 4) {
-            if (memcmp(&base[i], videoBatFind2, sizeof (videoBatFind2)) == 0) {
-                memcpy(&base[i], videoBatRepl2, sizeof (videoBatRepl2));
-                printk("xnu_patch_io_bats: patched video BAT pattern 2 at %p\n", &base[i]);
-                found = 1;
-                break;
-            }
-        }
-
-        if (!found) {
-            printk("xnu_patch_io_bats: failed to patch video BAT pattern 2\n");
-            return 0;
+        {
+            .name = "video BAT 1", .find = videoBatFind1, .length = sizeof (videoBatFind1),
+            .replace = videoBatRepl1, .replace_length = sizeof (videoBatRepl1),
+            .align = 4, .align_offset = 2, .min_hits = 1, .max_hits = 1
+        },
+        //
+        // First I/O BAT patch. This calls _get_io_base_addr which will panic.
+        //
+        {
+            .name = "I/O BAT 1", .find = ioBatFind1, .length = sizeof (ioBatFind1),
+            .replace = ioBatRepl1, .replace_length = sizeof (ioBatRepl1),
+            .align = 4, .min_hits = 1, .max_hits = 1
+        },
+        //
+        // Second I/O BAT patch to prevent DBAT2 from being populated.
+        //
+        {
+            .name = "I/O BAT 2", .find = ioBatFind2, .length = sizeof (ioBatFind2),
+            .replace = ioBatRepl2, .replace_length = sizeof (ioBatRepl2),
+            .align = 4, .min_hits = 1, .max_hits = 1
+        },
+        //
+        // Second video BAT patch, RVL only. Change size to 2MB to ensure regular MEM2 memory is not included in BAT.
+        //
+        {
+            .name = "video BAT 2", .find = videoBatFind2, .length = sizeof (videoBatFind2),
+            .replace = videoBatRepl2, .replace_length = sizeof (videoBatRepl2),
+            .align = 4, .min_hits = 1, .max_hits = 1
         }
-    }
+    };
+    macosx_patch_hits_t hits[4];
+    int                 count;
 
     //
-    // Do first I/O BAT patch. This calls _get_io_base_addr which will panic.
+    // TODO: ppc_init might need to be adjusted for 10.0 and 10.1.
     //
-    found = 0;
-    for (int i = 0; i < 0x1000; i += 4) {
-        if (memcmp(&base[i], ioBatFind1, sizeof (ioBatFind1)) == 0) {
-            memcpy(&base[i], ioBatRepl1, sizeof (ioBatRepl1));
-            printk("xnu_patch_io_bats: patched I/O BAT pattern 1 at %p\n", &base[i]);
-            found = 1;
-            break;
-        }
-    }
-
-    if (!found) {
-        printk("xnu_patch_io_bats: failed to patch I/O BAT pattern 1\n");
+    if (kern_sym_ppc_init == 0) {
+        printk("xnu_patch_io_bats: failed to locate symbol '_ppc_init'\n");
         return 0;
     }
 
-    //
-    // Do second I/O BAT patch to prevent DBAT2 from being populated.
-    //
-    found = 0;
-    for (int i = 0; i < 0x1000; i += 4) {
-        if (memcmp(&base[i], ioBatFind2, sizeof (ioBatFind2)) == 0) {
-            memcpy(&base[i], ioBatRepl2, sizeof (ioBatRepl2));
-            printk("xnu_patch_io_bats: patched I/O BAT pattern 2 at %p\n", &base[i]);
-            found = 1;
-            break;
-        }
-    }
-
-    if (!found) {
-        printk("xnu_patch_io_bats: failed to patch I/O BAT pattern 2\n");
+    count = is_wii_rvl() ? 4 : 3;
+    macosx_patch_scan((char*)kern_sym_ppc_init, 0x1000, batPatches, hits, count);
+    if (!macosx_patch_report("xnu_patch_io_bats", batPatches, hits, count)) {
         return 0;
     }
 
+    macosx_patch_apply(batPatches, hits, count);
     return 1;
 }
 
 //
 // Patch function to return 0.
 //
-static int xnu_patch_disable_function(macho_sym_context_t *symContext, const char* funcName) {
-    unsigned long   sym;
+static int xnu_patch_disable_function(const char* funcName, unsigned long sym) {
     uint32_t        *func;
 
-    //
-    // Get _PE_find_scc function location.
-    //
-    sym = macho_resolve_symbol(symContext, funcName);
     if (sym == 0) {
+        printk("xnu_patch_disable_function: failed to locate symbol '%s'\n", funcName);
         return 0;
     }
     func = (uint32_t*)sym;
@@ -260,10 +247,7 @@ static int xnu_patch_disable_function(macho_sym_context_t *symContext, const cha
 }
 
 #if XNU_DISABLE_CONSDEBUG_PUTC
-static int xnu_patch_consdebug_putc(macho_sym_context_t *symContext) {
-    unsigned long   sym;
-    char            *base;
-
+static int xnu_patch_consdebug_putc(unsigned long sym) {
     static const char debugFind[] = {
         0x2F, 0x83, 0x00, 0x00,
         0x40, 0x9E
@@ -273,27 +257,24 @@ static int xnu_patch_consdebug_putc(macho_sym_context_t *symContext) {
         0x48, 0x00
     };
 
-    //
-    // Get _consdebug_putc function location.
-    //
-    sym = macho_resolve_symbol(symContext, "_consdebug_putc");
+    static const macosx_patch_t debugPatch = {
+        .name = "consdebug_putc", .find = debugFind, .length = sizeof (debugFind),
+        .replace = debugRepl, .replace_length = sizeof (debugRepl), .min_hits = 1, .max_hits = 1
+    };
+    macosx_patch_hits_t hits;
+
     if (sym == 0) {
+        printk("xnu_patch_consdebug_putc: failed to locate symbol '_consdebug_putc'\n");
         return 0;
     }
-    base = (char*)sym;
 
-    //
-    // Look for pattern.
-    //
-    for (int i = 0; i < 0x4000; i++, base++) {
-        if (memcmp(base, debugFind, sizeof (debugFind)) == 0) {
-            memcpy(base, debugRepl, sizeof (debugRepl));
-            return 1;
-        }
+    macosx_patch_scan((char*)sym, 0x4000 + sizeof (debugFind) - 1, &debugPatch, &hits, 1);
+    if (!macosx_patch_report("xnu_patch_consdebug_putc", &debugPatch, &hits, 1)) {
+        return 0;
     }
 
-    printk("xnu_patch_consdebug_putc: failed to locate patch pattern\n");
-    return 0;
+    macosx_patch_apply(&debugPatch, &hits, 1);
+    return 1;
 }
 #endif
 
@@ -304,15 +285,11 @@ typedef struct {
   uint32_t bit32;
 } xnu_color_table_entry_t;
 
-static int xnu_patch_colortable(macho_sym_context_t *symContext) {
-    unsigned long               sym;
+static int xnu_patch_colortable(unsigned long sym) {
     xnu_color_table_entry_t     *colorTable;
 
-    //
-    // Get _vc_colors structure location.
-    //
-    sym = macho_resolve_symbol(symContext, "_vc_colors");
     if (sym == 0) {
+        printk("xnu_patch_colortable: failed to locate symbol '_vc_colors'\n");
         return 0;
     }
     colorTable = (xnu_color_table_entry_t*)sym;
@@ -333,36 +310,33 @@ static int xnu_patch_colortable(macho_sym_context_t *symContext) {
 }
 #endif
 
-int xnu_patch(void) {
-    macho_sym_context_t kernel_syms;
+static int xnu_apply_patches(macho_sym_context_t *kernel_syms) {
     uint32_t            xnu_version;
+    unsigned long       syms[XNU_SYM_COUNT];
 
-    //
-    // Get the kernel symbol table.
-    //
-    if (!xnu_get_symtab(&kernel_syms)) {
-        printk("Failed to get kernel symbol table\n");
-        return 0;
-    }
-
-    xnu_version = xnu_read_darwin_version(&kernel_syms);
+    xnu_version = xnu_read_darwin_version(kernel_syms);
     if (xnu_version == 0) {
         return 0;
     }
     printk("XNU version: 0x%X\n", xnu_version);
 
-    if (!xnu_patch_disable_function(&kernel_syms, "_PE_find_scc")) {
+    //
+    // Resolve the whole patch set up front, each patch checks its own symbols.
+    //
+    macho_resolve_symbols(kernel_syms, xnu_symbol_names, syms, XNU_SYM_COUNT);
+
+    if (!xnu_patch_disable_function(xnu_symbol_names[XNU_SYM_PE_FIND_SCC], syms[XNU_SYM_PE_FIND_SCC])) {
         return 0;
     }
 
     if (is_wii_cafe()) {
-        if (!xnu_patch_cpu_check(&kernel_syms)) {
+        if (!xnu_patch_cpu_check(syms[XNU_SYM_START])) {
             return 0;
         }
     }
 
     if (xnu_match_darwin_version(xnu_version, 0, XNU_VERSION_JAGUAR_MAX)) {
-        if (!xnu_patch_io_bats(&kernel_syms)) {
+        if (!xnu_patch_io_bats(syms[XNU_SYM_PPC_INIT])) {
             return 0;
         }
     }
@@ -371,22 +345,60 @@ int xnu_patch(void) {
     // Clean up for panics.
     //
 #if XNU_DISABLE_DEBUG_STACKTRACE
-    xnu_patch_disable_function(&kernel_syms, "_Debugger");
-    xnu_patch_disable_function(&kernel_syms, "_print_backtrace");
-    xnu_patch_disable_function(&kernel_syms, "_draw_panic_dialog");
+    xnu_patch_disable_function(xnu_symbol_names[XNU_SYM_DEBUGGER], syms[XNU_SYM_DEBUGGER]);
+    xnu_patch_disable_function(xnu_symbol_names[XNU_SYM_PRINT_BACKTRACE], syms[XNU_SYM_PRINT_BACKTRACE]);
+    xnu_patch_disable_function(xnu_symbol_names[XNU_SYM_DRAW_PANIC_DIALOG], syms[XNU_SYM_DRAW_PANIC_DIALOG]);
 #endif
 
 #if XNU_DISABLE_CONSDEBUG_PUTC
     if (xnu_match_darwin_version(xnu_version, XNU_VERSION_TIGER_MIN, XNU_VERSION_TIGER_MAX)) {
-        xnu_patch_consdebug_putc(&kernel_syms);
+        xnu_patch_consdebug_putc(syms[XNU_SYM_CONSDEBUG_PUTC]);
     }
 #endif
 
 #if XNU_PATCH_COLORTABLE
     if (is_wii_rvl()) {
-        xnu_patch_colortable(&kernel_syms);
+        xnu_patch_colortable(syms[XNU_SYM_VC_COLORS]);
     }
 #endif
-    
+
     return 1;
-}
\ No newline at end of file
+}
+
+int xnu_patch(void) {
+    macho_sym_context_t kernel_syms;
+    uint32_t            startTb;
+    uint32_t            indexTb;
+    uint32_t            endTb;
+    unsigned long       ticksPerUs;
+    int                 result;
+
+    //
+    // Get the kernel symbol table.
+    //
+    if (!xnu_get_symtab(&kernel_syms)) {
+        printk("Failed to get kernel symbol table\n");
+        return 0;
+    }
+
+    //
+    // Index the symbol table once, all patches share it.
+    //
+    startTb = xnu_read_tb();
+    macho_index_symbols(&kernel_syms);
+    indexTb = xnu_read_tb();
+
+    result = xnu_apply_patches(&kernel_syms);
+    endTb = xnu_read_tb();
+
+    macho_free_symbol_index(&kernel_syms);
+
+    ticksPerUs = timer_freq / 1000000;
+    if (ticksPerUs == 0) {
+        ticksPerUs = 1;
+    }
+    printk("xnu_patch: %lu symbols indexed in %lu us, patched in %lu us\n", kernel_syms.symbol_count,
+        (unsigned long)(indexTb - startTb) / ticksPerUs, (unsigned long)(endTb - indexTb) / ticksPerUs);
+
+    return result;
+}
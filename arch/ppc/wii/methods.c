@@ -121,6 +121,9 @@ ciface_quiesce( unsigned long args[], unsigned long ret[] )
         printk("Handling Mac OS X patching/injection\n");
         macosx_patch();
     }
+
+    /* Deliver any queued console output before the OS takes over the mailbox */
+    wii_ipc_flush();
 }
 
 /* ( -- ms ) */
@@ -0,0 +1,234 @@
+/*
+ *  <arch/unix/bench.c>
+ *
+ *	checksum benchmarks for unix hosts
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   version 2
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "config.h"
+#include "libopenbios/bindings.h"
+#include "libopenbios/ipchecksum.h"
+#include "libopenbios/adler32.h"
+#include "bench.h"
+
+#define BENCH_BUF_SIZE	(1024 * 1024 + 8)
+#define BENCH_BYTES	(512ULL * 1024 * 1024)	/* summed per measurement */
+#define CHECK_RUNS	20000			/* random ipchksum comparisons */
+#define CHECK_MAX_LEN	(64 * 1024)
+#define CHECK_MAX_OFFS	32
+
+/* The original byte at a time ipchksum(), kept as the reference */
+static unsigned short
+ipchksum_ref( const void *data, unsigned long length )
+{
+	unsigned long sum;
+	unsigned long i;
+	const unsigned char *ptr;
+	union {
+	    unsigned char byte[2];
+	    unsigned short word;
+	} u;
+
+	sum = 0;
+	ptr = data;
+	for( i = 0; i < length; i++ ) {
+		unsigned long value;
+		value = ptr[i];
+		if( i & 1 )
+			value <<= 8;
+		sum += value;
+		if( sum > 0xFFFF )
+			sum = (sum + (sum >> 16)) & 0xFFFF;
+	}
+	u.byte[0] = (unsigned char) sum;
+	u.byte[1] = (unsigned char) (sum >> 8);
+	return (unsigned short) ~u.word;
+}
+
+/* Compares ipchksum() with the reference on random data, returns the mismatches */
+static int
+check_ipchksum( unsigned char *buf )
+{
+	unsigned long len;
+	unsigned short sum, ref;
+	int i, offs, failed = 0;
+
+	srand( 1 );
+	for( i = 0; i < CHECK_MAX_LEN + CHECK_MAX_OFFS; i++ )
+		buf[i] = (unsigned char)rand();
+
+	for( i = 0; i < CHECK_RUNS; i++ ) {
+		/* mostly short lengths, where the head and tail handling matters */
+		len = rand() % ((i & 3) ? 64 : CHECK_MAX_LEN + 1);
+		offs = rand() % CHECK_MAX_OFFS;
+		if( i % 1000 == 0 )
+			memset( buf + offs, 0xff, len );	/* worst case for the carries */
+
+		sum = ipchksum( buf + offs, len );
+		ref = ipchksum_ref( buf + offs, len );
+		if( sum != ref ) {
+			printk("checksum-bench: ipchksum %lu bytes +%d: %x, expected %x\n",
+			       len, offs, sum, ref);
+			failed++;
+		}
+	}
+	return failed;
+}
+
+/* Checks adler32() against zlib's values, returns the mismatches */
+static int
+check_adler32( unsigned char *buf )
+{
+	static const struct {
+		const char *data;
+		uint32_t sum;
+	} strings[] = {
+		{ "",		0x00000001 },
+		{ "a",		0x00620062 },
+		{ "abc",	0x024d0127 },
+		{ "Wikipedia",	0x11e60398 },
+	};
+	/* all 0xff, the largest sums, around multiples of NMAX (5552) */
+	static const struct {
+		unsigned long len;
+		uint32_t sum;
+	} ones[] = {
+		{ 5551,		0x56039a8d },
+		{ 5552,		0xf18f9b8c },
+		{ 5553,		0x8e299c8b },
+		{ 11104,	0xff6f3726 },
+		{ 11105,	0x37a33825 },
+		{ 1024 * 1024,	0x8e88ef11 },
+	};
+	/* the same data summed in pieces, carrying the running value */
+	static const unsigned long pieces[] = { 1, 5552, 7, 5553, 100000 };
+	uint32_t sum;
+	unsigned int i;
+	int failed = 0;
+
+	for( i = 0; i < sizeof(strings) / sizeof(strings[0]); i++ ) {
+		sum = adler32( 1, (const unsigned char *)strings[i].data, strlen(strings[i].data) );
+		if( sum != strings[i].sum ) {
+			printk("checksum-bench: adler32 \"%s\": %x, expected %x\n",
+			       strings[i].data, sum, strings[i].sum);
+			failed++;
+		}
+	}
+
+	memset( buf, 0xff, 1024 * 1024 );
+	for( i = 0; i < sizeof(ones) / sizeof(ones[0]); i++ ) {
+		sum = adler32( 1, buf, ones[i].len );
+		if( sum != ones[i].sum ) {
+			printk("checksum-bench: adler32 %lu bytes of ff: %x, expected %x\n",
+			       ones[i].len, sum, ones[i].sum);
+			failed++;
+		}
+	}
+
+	sum = 1;
+	for( i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++ )
+		sum = adler32( sum, buf, pieces[i] );
+	if( sum != 0xa6877048 ) {
+		printk("checksum-bench: adler32 111113 bytes of ff in pieces: %x, expected a6877048\n",
+		       sum);
+		failed++;
+	}
+	return failed;
+}
+
+static unsigned long long
+bench_usecs( void )
+{
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void
+bench_report( const char *name, unsigned long len, int offs,
+	      unsigned long long bytes, unsigned long long usecs, unsigned long result )
+{
+	/* hundredths of GB/s */
+	unsigned long rate = usecs ? bytes / 10 / usecs : 0;
+
+	printk("%-10s %8lu bytes +%d: %3lu.%02lu GB/s (%lx)\n",
+	       name, len, offs, rate / 100, rate % 100, result);
+}
+
+static void
+bench_ipchksum( const unsigned char *buf, unsigned long len, int offs )
+{
+	unsigned long long start, bytes = 0;
+	unsigned short sum = 0;
+
+	start = bench_usecs();
+	while( bytes < BENCH_BYTES ) {
+		sum = ipchksum( buf + offs, len );
+		bytes += len;
+	}
+	bench_report( "ipchksum", len, offs, bytes, bench_usecs() - start, sum );
+}
+
+static void
+bench_adler32( const unsigned char *buf, unsigned long len, int offs )
+{
+	unsigned long long start, bytes = 0;
+	uint32_t sum = 0;
+
+	start = bench_usecs();
+	while( bytes < BENCH_BYTES ) {
+		sum = adler32( 1, buf + offs, len );
+		bytes += len;
+	}
+	bench_report( "adler32", len, offs, bytes, bench_usecs() - start, sum );
+}
+
+/* ( -- ) */
+static void
+checksum_bench( void )
+{
+	static const unsigned long sizes[] = { 20, 1500, 64 * 1024, 1024 * 1024 };
+	unsigned char *buf;
+	unsigned int i;
+	int failed;
+
+	buf = malloc( BENCH_BUF_SIZE );
+	if( !buf ) {
+		printk("checksum-bench: no memory\n");
+		return;
+	}
+
+	failed = check_ipchksum( buf ) + check_adler32( buf );
+	if( failed ) {
+		printk("checksum-bench: %d checks FAILED, not benchmarking\n", failed);
+		free( buf );
+		return;
+	}
+	printk("checksum-bench: ipchksum matches the reference, adler32 matches zlib\n");
+
+	for( i = 0; i < BENCH_BUF_SIZE; i++ )
+		buf[i] = (unsigned char)(i * 7 + (i >> 8));
+
+	for( i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++ ) {
+		bench_ipchksum( buf, sizes[i], 0 );
+		bench_ipchksum( buf, sizes[i], 1 );
+	}
+	for( i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++ )
+		bench_adler32( buf, sizes[i], 0 );
+	free( buf );
+}
+
+void
+bench_init( void )
+{
+	bind_func( ".checksum-bench", checksum_bench );
+}
@@ -0,0 +1,6 @@
+#ifndef _H_BENCH
+#define _H_BENCH
+
+extern void	bench_init( void );
+
+#endif   /* _H_BENCH */
@@ -4,5 +4,6 @@
 
 extern void 	blk_init( void );
 extern int	read_from_disk( int channel, int unit, int blk, unsigned long mphys, int size );
+extern int	set_disk( int fd );
 
 #endif   /* _H_BLK */
@@ -0,0 +1,256 @@
+/*
+ *  <arch/unix/ipcbench.c>
+ *
+ *	Wii U console IPC benchmark for unix hosts
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   version 2
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "libopenbios/bindings.h"
+#include "ipcbench.h"
+
+/*
+ * arch/ppc/wii/ipc.c is built here against a model of the mailbox and
+ * the loader. Time is counted in units: the ARM takes a message
+ * SIM_TAKE_DELAY units after the doorbell, or once it has drawn the
+ * characters of the previous one at SIM_DRAW units each. A mailbox
+ * register access costs one unit and so does every cache line flushed
+ * or invalidated.
+ * The loader only sees what the PPC has flushed to memory, so a missing
+ * flush shows up as wrong output.
+ */
+#define WII_IPC_HOST
+
+#define SIM_TAKE_DELAY	40
+#define SIM_DRAW	4
+#define SIM_LINE	32
+#define SIM_RING_PHYS	0x01000000
+#define SIM_TEXT_LEN	8000
+
+static int wii_ipc_busy( void );
+static void wii_ipc_write( uint32_t msg );
+static unsigned long wii_ipc_phys( void *ptr );
+static void wii_ipc_dc_flush( void *ptr, unsigned long len );
+static void wii_ipc_dc_invalidate( void *ptr, unsigned long len );
+
+void wii_ipc_send( uint32_t msg );
+void wii_ipc_kick( void );
+void wii_ipc_flush( void );
+void wii_ipc_print( int c );
+void wii_ipc_print_flush( void );
+void wii_ipc_stats( void );
+
+#include "../ppc/wii/ipc.c"
+
+static struct {
+	unsigned long	now;
+	unsigned long	polling;	/* register reads that found the mailbox busy */
+	unsigned long	take_at;
+	unsigned long	draw_end;	/* the ARM is drawing until then */
+	int		busy;
+	uint32_t	msg;
+	int		ring_loader;	/* the loader knows CAFE_CMD_PRINT_RING */
+	int		ring_on;
+	char		*out;
+	unsigned long	out_len;
+	unsigned long	out_size;
+} sim;
+
+/* the ring as the loader sees it in memory */
+static wii_ipc_ring_t sim_mem;
+
+static void
+sim_putc( int c )
+{
+	if( sim.out_len < sim.out_size )
+		sim.out[sim.out_len] = (char)c;
+	sim.out_len++;
+	sim.draw_end += SIM_DRAW;
+}
+
+static void
+sim_loader( uint32_t msg )
+{
+	if( (msg & 0xFFFFFF00) == CAFE_CMD_PRINT ) {
+		sim_putc( msg & 0xFF );
+	} else if( (msg & 0xFF000000) == CAFE_CMD_PRINT_RING ) {
+		if( sim.ring_loader && (msg & 0xFFFFFF) << 8 == SIM_RING_PHYS
+		    && sim_mem.magic == WII_IPC_RING_MAGIC ) {
+			sim_mem.ack = WII_IPC_RING_MAGIC;
+			sim.ring_on = 1;
+		}
+	} else if( msg == CAFE_CMD_PRINT_KICK && sim.ring_on ) {
+		while( sim_mem.tail != sim_mem.head ) {
+			sim_putc( sim_mem.data[sim_mem.tail % sim_mem.size] );
+			sim_mem.tail++;
+		}
+	}
+}
+
+static void
+sim_step( unsigned long units )
+{
+	sim.now += units;
+	if( sim.busy && sim.now >= sim.take_at ) {
+		sim.busy = 0;
+		sim.draw_end = sim.take_at;
+		sim_loader( sim.msg );
+	}
+}
+
+static int
+wii_ipc_busy( void )
+{
+	sim_step( 1 );
+	if( sim.busy )
+		sim.polling++;
+	return sim.busy;
+}
+
+static void
+wii_ipc_write( uint32_t msg )
+{
+	sim_step( 1 );
+	if( sim.busy )
+		printk("ipc-bench: message %x posted to a busy mailbox\n", msg);
+	sim.busy = 1;
+	sim.msg = msg;
+	sim.take_at = sim.now + SIM_TAKE_DELAY;
+	if( sim.take_at < sim.draw_end )
+		sim.take_at = sim.draw_end;
+}
+
+static unsigned long
+wii_ipc_phys( void *ptr )
+{
+	return SIM_RING_PHYS + ((char *)ptr - (char *)&wii_ipc_ring);
+}
+
+/* Returns the ring offset of the first line of a range and the length in whole lines */
+static unsigned long
+sim_lines( void *ptr, unsigned long len, unsigned long *start )
+{
+	unsigned long offs = (char *)ptr - (char *)&wii_ipc_ring;
+	unsigned long end = offs + len;
+
+	*start = offs & ~(SIM_LINE - 1UL);
+	end = (end + SIM_LINE - 1) & ~(SIM_LINE - 1UL);
+	if( end > sizeof(sim_mem) )
+		end = sizeof(sim_mem);
+	sim_step( (end - *start) / SIM_LINE );
+	return end - *start;
+}
+
+static void
+wii_ipc_dc_flush( void *ptr, unsigned long len )
+{
+	unsigned long start;
+
+	len = sim_lines( ptr, len, &start );
+	memcpy( (char *)&sim_mem + start, (char *)&wii_ipc_ring + start, len );
+}
+
+static void
+wii_ipc_dc_invalidate( void *ptr, unsigned long len )
+{
+	unsigned long start;
+
+	len = sim_lines( ptr, len, &start );
+	memcpy( (char *)&wii_ipc_ring + start, (char *)&sim_mem + start, len );
+}
+
+static void
+sim_reset( int ring_loader, char *out, unsigned long out_size )
+{
+	memset( &sim, 0, sizeof(sim) );
+	memset( &sim_mem, 0, sizeof(sim_mem) );
+	sim.ring_loader = ring_loader;
+	sim.out = out;
+	sim.out_size = out_size;
+
+	memset( &wii_ipc_ring, 0, sizeof(wii_ipc_ring) );
+	memset( &wii_ipc_stats_data, 0, sizeof(wii_ipc_stats_data) );
+	wii_ipc_head = wii_ipc_tail = 0;
+	wii_ipc_print_mode = WII_IPC_PRINT_UNKNOWN;
+}
+
+/* Lines of 20 to 99 characters */
+static unsigned long
+sim_text( char *text )
+{
+	unsigned long len = 0, line;
+	int i, n;
+
+	for( line = 0; len < SIM_TEXT_LEN; line++ ) {
+		n = 20 + (line * 37) % 80;
+		for( i = 0; i < n && len < SIM_TEXT_LEN - 1; i++ )
+			text[len++] = 'a' + (line + i) % 26;
+		text[len++] = '\n';
+	}
+	return len;
+}
+
+/*
+ * Prints text the way cafe_putchar() does, with char_units of other
+ * work before every character and line_units before every line.
+ */
+static void
+sim_run( const char *name, int ring_loader, const char *text, unsigned long len,
+	 unsigned long char_units, unsigned long line_units )
+{
+	char out[SIM_TEXT_LEN];
+	unsigned long i;
+
+	sim_reset( ring_loader, out, sizeof(out) );
+	for( i = 0; i < len; i++ ) {
+		if( i == 0 || text[i - 1] == '\n' )
+			sim_step( line_units );
+		sim_step( char_units );
+		wii_ipc_print( text[i] );
+		if( text[i] == '\n' )
+			wii_ipc_print_flush();
+	}
+	wii_ipc_flush();
+
+	printk("%s, %s loader: %lu units, %lu polling a busy mailbox: %s\n",
+	       name, ring_loader ? "ring" : "old",
+	       sim.now, sim.polling,
+	       sim.out_len == len && !memcmp(out, text, len) ? "ok" : "OUTPUT DIFFERS");
+	wii_ipc_stats();
+}
+
+/* ( -- ) */
+static void
+ipc_bench( void )
+{
+	char *text;
+	unsigned long len;
+
+	text = malloc( SIM_TEXT_LEN );
+	if( !text ) {
+		printk("ipc-bench: no memory\n");
+		return;
+	}
+	len = sim_text( text );
+
+	sim_run( "steady, 25 units per character", 0, text, len, 25, 0 );
+	sim_run( "steady, 25 units per character", 1, text, len, 25, 0 );
+	sim_run( "bursty, 5 units per character, 2000 per line", 0, text, len, 5, 2000 );
+	sim_run( "bursty, 5 units per character, 2000 per line", 1, text, len, 5, 2000 );
+	sim_run( "flood, no other work", 0, text, len, 0, 0 );
+	sim_run( "flood, no other work", 1, text, len, 0, 0 );
+	free( text );
+}
+
+void
+ipcbench_init( void )
+{
+	bind_func( ".ipc-bench", ipc_bench );
+}
@@ -0,0 +1,6 @@
+#ifndef _H_IPCBENCH
+#define _H_IPCBENCH
+
+extern void	ipcbench_init( void );
+
+#endif   /* _H_IPCBENCH */
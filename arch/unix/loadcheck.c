@@ -0,0 +1,299 @@
+/*
+ *  <arch/unix/loadcheck.c>
+ *
+ *	ELF loader check for unix hosts
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   version 2
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "config.h"
+#include "libopenbios/bindings.h"
+#include "libopenbios/sys_info.h"
+#include "libopenbios/load.h"
+#include "libopenbios/elf_load.h"
+#include "libopenbios/ipchecksum.h"
+#include "arch/common/elf.h"
+#include "arch/common/elf_boot.h"
+#include "blk.h"
+#include "loadcheck.h"
+
+/*
+ * The image is a plain ELF file (header at offset 0) carrying ELFBoot
+ * name and checksum notes. The first PT_LOAD segment covers the headers
+ * and notes, like most linked kernels, so the checksum field is cleared
+ * while it is loaded. It is larger than the disk's max-transfer, so it is
+ * loaded in several chunks, and has an odd memory size, so the second
+ * segment is summed at an odd offset.
+ */
+#define CHECK_NOTES	0x100
+#define CHECK_FILESZ_A	(1536 * 1024 + 3)
+#define CHECK_MEMSZ_A	(CHECK_FILESZ_A + 4094)
+#define CHECK_OFFSET_B	((CHECK_FILESZ_A + 511) & ~511)
+#define CHECK_FILESZ_B	5001
+#define CHECK_MEMSZ_B	6000
+#define CHECK_ADDR_B	(2 * 1024 * 1024)
+#define CHECK_FILE_LEN	((CHECK_OFFSET_B + CHECK_FILESZ_B + 511) & ~511)
+#define CHECK_PHNUM	3
+
+#define CHECK_MAP_BASE	0x800000
+#define CHECK_MAP_SIZE	(4 * 1024 * 1024)
+
+static const char check_name[] = "load-check";
+
+/* Appends an ELFBoot note, returns the offset of its descriptor */
+static unsigned long
+check_add_note( unsigned char *image, unsigned long *pos, unsigned type,
+		const void *desc, unsigned descsz )
+{
+	Elf_Nhdr *nhdr = (Elf_Nhdr *)(image + *pos);
+	unsigned long desc_pos;
+
+	nhdr->n_namesz = sizeof(ELF_NOTE_BOOT);
+	nhdr->n_descsz = descsz;
+	nhdr->n_type = type;
+	*pos += sizeof(*nhdr);
+	memset( image + *pos, 0, (sizeof(ELF_NOTE_BOOT) + 3) & ~3 );
+	memcpy( image + *pos, ELF_NOTE_BOOT, sizeof(ELF_NOTE_BOOT) );
+	*pos += (sizeof(ELF_NOTE_BOOT) + 3) & ~3;
+	desc_pos = *pos;
+	memset( image + *pos, 0, (descsz + 3) & ~3 );
+	memcpy( image + *pos, desc, descsz );
+	*pos += (descsz + 3) & ~3;
+
+	return desc_pos;
+}
+
+static void
+check_set_phdr( Elf_phdr *phdr, unsigned type, unsigned long offset,
+		unsigned long paddr, unsigned long filesz, unsigned long memsz )
+{
+	phdr->p_type = type;
+	phdr->p_offset = offset;
+	phdr->p_vaddr = paddr;
+	phdr->p_paddr = paddr;
+	phdr->p_filesz = filesz;
+	phdr->p_memsz = memsz;
+	phdr->p_flags = PF_R | PF_W | PF_X;
+	phdr->p_align = type == PT_LOAD ? 4096 : 4;
+}
+
+/*
+ * Builds the image and returns the offset of its checksum field. The
+ * checksum is the old whole-image one: a single ipchksum() over the ELF
+ * header, the program headers and the memory image of every segment,
+ * taken with the checksum field cleared.
+ */
+static unsigned long
+check_build_image( unsigned char *image, unsigned long paddr )
+{
+	Elf_ehdr *ehdr = (Elf_ehdr *)image;
+	Elf_phdr *phdr = (Elf_phdr *)(image + sizeof(*ehdr));
+	unsigned long i, pos, sum_pos, len;
+	unsigned short sum = 0;
+	unsigned char *whole;
+
+	for( i = 0; i < CHECK_FILE_LEN; i++ )
+		image[i] = (unsigned char)(i * 13 + (i >> 9));
+
+	memset( ehdr, 0, sizeof(*ehdr) );
+	ehdr->e_ident[EI_MAG0] = ELFMAG0;
+	ehdr->e_ident[EI_MAG1] = ELFMAG1;
+	ehdr->e_ident[EI_MAG2] = ELFMAG2;
+	ehdr->e_ident[EI_MAG3] = ELFMAG3;
+	ehdr->e_ident[EI_CLASS] = ARCH_ELF_CLASS;
+	ehdr->e_ident[EI_DATA] = ARCH_ELF_DATA;
+	ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr->e_type = ET_EXEC;
+	ehdr->e_machine = EM_386;
+	ehdr->e_version = EV_CURRENT;
+	ehdr->e_entry = paddr;
+	ehdr->e_phoff = sizeof(*ehdr);
+	ehdr->e_ehsize = sizeof(*ehdr);
+	ehdr->e_phentsize = sizeof(*phdr);
+	ehdr->e_phnum = CHECK_PHNUM;
+
+	pos = CHECK_NOTES;
+	check_add_note( image, &pos, EIN_PROGRAM_NAME, check_name, sizeof(check_name) - 1 );
+	sum_pos = check_add_note( image, &pos, EIN_PROGRAM_CHECKSUM, &sum, sizeof(sum) );
+
+	check_set_phdr( &phdr[0], PT_NOTE, CHECK_NOTES, 0, pos - CHECK_NOTES, 0 );
+	check_set_phdr( &phdr[1], PT_LOAD, 0, paddr, CHECK_FILESZ_A, CHECK_MEMSZ_A );
+	check_set_phdr( &phdr[2], PT_LOAD, CHECK_OFFSET_B, paddr + CHECK_ADDR_B,
+			CHECK_FILESZ_B, CHECK_MEMSZ_B );
+
+	len = sizeof(*ehdr) + CHECK_PHNUM * sizeof(*phdr) + CHECK_MEMSZ_A + CHECK_MEMSZ_B;
+	whole = calloc( 1, len );
+	if( !whole )
+		return 0;
+	pos = 0;
+	memcpy( whole, ehdr, sizeof(*ehdr) + CHECK_PHNUM * sizeof(*phdr) );
+	pos += sizeof(*ehdr) + CHECK_PHNUM * sizeof(*phdr);
+	memcpy( whole + pos, image, CHECK_FILESZ_A );
+	pos += CHECK_MEMSZ_A;
+	memcpy( whole + pos, image + CHECK_OFFSET_B, CHECK_FILESZ_B );
+	sum = ipchksum( whole, len );
+	free( whole );
+
+	memcpy( image + sum_pos, &sum, sizeof(sum) );
+	return sum_pos;
+}
+
+static int
+check_write_image( const unsigned char *image )
+{
+	char name[] = "/tmp/openbios-load-XXXXXX";
+	int fd;
+
+	fd = mkstemp( name );
+	if( fd == -1 )
+		return -1;
+	unlink( name );
+
+	if( write(fd, image, CHECK_FILE_LEN) != CHECK_FILE_LEN ) {
+		close( fd );
+		return -1;
+	}
+	return fd;
+}
+
+/* Loads the image through load(), returns the size it reports */
+static ucell
+check_load( const unsigned char *image, unsigned char *target )
+{
+	struct memrange range, *old_memrange;
+	int old_n_memranges, fd, old_fd;
+	ihandle_t ih;
+	ucell size = 0;
+
+	fd = check_write_image( image );
+	if( fd == -1 ) {
+		printk("load-check: can't write the image\n");
+		return 0;
+	}
+	memset( target, 0xaa, CHECK_MAP_SIZE );
+	PUSH( 0 );
+	feval("load-state >ls.file-size !");
+
+	/* Only the load area counts as memory while the image is loaded */
+	range.base = virt_to_phys(target);
+	range.size = CHECK_MAP_SIZE;
+	old_memrange = sys_info.memrange;
+	old_n_memranges = sys_info.n_memranges;
+	sys_info.memrange = &range;
+	sys_info.n_memranges = 1;
+	old_fd = set_disk( fd );
+
+	ih = open_dev( "/unix/block/disk" );
+	if( ih ) {
+		PUSH( 0 );
+		load( ih );
+		size = POP();
+		close_dev( ih );
+	}
+
+	set_disk( old_fd );
+	sys_info.memrange = old_memrange;
+	sys_info.n_memranges = old_n_memranges;
+	close( fd );
+
+	return size;
+}
+
+static int
+check_segment( const char *name, const unsigned char *addr, const unsigned char *data,
+	       unsigned long filesz, unsigned long memsz )
+{
+	unsigned long i;
+
+	if( memcmp(addr, data, filesz) ) {
+		printk("load-check: segment %s data differs\n", name);
+		return 0;
+	}
+	for( i = filesz; i < memsz; i++ ) {
+		if( addr[i] ) {
+			printk("load-check: segment %s tail not cleared at +%lx\n", name, i);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* ( -- ) */
+static void
+load_check( void )
+{
+	unsigned char *image, *target;
+	unsigned long sum_pos;
+	ucell size;
+	int failed = 0;
+
+	if( !find_dev("/unix/block/disk") ) {
+		printk("load-check: needs a disk, start with -f <file>\n");
+		return;
+	}
+
+	/* The ELF loader only keeps the low 24 bits of segment addresses */
+	target = mmap( (void *)CHECK_MAP_BASE, CHECK_MAP_SIZE, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if( target == MAP_FAILED ) {
+		printk("load-check: can't map the load area\n");
+		return;
+	}
+	if( virt_to_phys(target) + CHECK_MAP_SIZE > 0x1000000 ) {
+		printk("load-check: load area %p is above 16MB\n", target);
+		munmap( target, CHECK_MAP_SIZE );
+		return;
+	}
+	image = malloc( CHECK_FILE_LEN );
+	if( !image ) {
+		printk("load-check: no memory\n");
+		munmap( target, CHECK_MAP_SIZE );
+		return;
+	}
+	sum_pos = check_build_image( image, virt_to_phys(target) );
+	if( !sum_pos ) {
+		printk("load-check: no memory\n");
+		goto out;
+	}
+
+	size = check_load( image, target );
+	if( size != CHECK_FILESZ_A + CHECK_FILESZ_B ) {
+		printk("load-check: loaded %lu bytes, expected %lu\n",
+		       (unsigned long)size, (unsigned long)(CHECK_FILESZ_A + CHECK_FILESZ_B));
+		failed = 1;
+	}
+
+	/* The loader clears the checksum field in memory */
+	memset( image + sum_pos, 0, sizeof(unsigned short) );
+	if( !check_segment("A", target, image, CHECK_FILESZ_A, CHECK_MEMSZ_A)
+	    || !check_segment("B", target + CHECK_ADDR_B, image + CHECK_OFFSET_B,
+			      CHECK_FILESZ_B, CHECK_MEMSZ_B) )
+		failed = 1;
+	printk("load-check: offset 0 ELF with checksum, %lu bytes: %s\n",
+	       (unsigned long)(CHECK_FILESZ_A + CHECK_FILESZ_B), failed ? "FAILED" : "ok");
+
+	/* A corrupted image has to fail verify_image() */
+	check_build_image( image, virt_to_phys(target) );
+	image[CHECK_OFFSET_B + 1234] ^= 0x10;
+	size = check_load( image, target );
+	printk("load-check: corrupted image %s\n", size ? "loaded, FAILED" : "rejected, ok");
+
+ out:
+	free( image );
+	munmap( target, CHECK_MAP_SIZE );
+}
+
+void
+loadcheck_init( void )
+{
+	bind_func( ".load-check", load_check );
+}
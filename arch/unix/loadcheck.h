@@ -0,0 +1,6 @@
+#ifndef _H_LOADCHECK
+#define _H_LOADCHECK
+
+extern void	loadcheck_init( void );
+
+#endif   /* _H_LOADCHECK */
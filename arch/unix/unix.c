@@ -37,6 +37,9 @@
 #include "openbios-version.h"
 
 #include "blk.h"
+#include "bench.h"
+#include "ipcbench.h"
+#include "loadcheck.h"
 #include "libopenbios/ofmem.h"
 
 #define MEMORY_SIZE	(4*1024*1024)	/* 4M ram for hosted system */
@@ -404,6 +407,11 @@ arch_init( void )
 
 	device_end();
         bind_func("platform-boot", boot);
+	bench_init();
+	ipcbench_init();
+#ifdef CONFIG_LOADER_ELF
+	loadcheck_init();
+#endif
 }
 
 int
@@ -424,6 +432,16 @@ read_from_disk( int channel, int unit, int blk, unsigned long mphys, int size )
 	return 0;
 }
 
+/* Points the disk emulation at another file, returns the previous one */
+int
+set_disk( int fd )
+{
+	int old = diskemu;
+
+	diskemu = fd;
+	return old;
+}
+
 /*
  * main loop
  */
@@ -33,9 +33,6 @@ of Crazy Nation and the GC Linux project.
 #include "flipper_vi.h"
 #include "wii_ave.h"
 
-#define WII_IPCPPCMSG      0x0D800000
-#define WII_IPCPPCCTRL     0x0D800004
-
 // These need to be in sync with the loader.
 #define CMD_START_FB    0xCAFE0010
 #define CMD_STOP_FB     0xCAFE0011
@@ -142,26 +139,19 @@ int ob_flipper_vi_init(const char *path, unsigned long xfb_base, unsigned long f
     //
     // Stop any current conversion.
     //
-    out_be32((volatile unsigned int*)WII_IPCPPCMSG, CMD_STOP_FB);
-    out_be32((volatile unsigned int*)WII_IPCPPCCTRL, 0x1);
-    while (in_be32((volatile unsigned int*)WII_IPCPPCCTRL) & 0x1);
+    wii_ipc_send(CMD_STOP_FB);
 
     //
     // Send addresses.
     //
-    out_be32((volatile unsigned int*)WII_IPCPPCMSG, CMD_SET_XFB | (xfb_base >> 8));
-    out_be32((volatile unsigned int*)WII_IPCPPCCTRL, 0x1);
-    while (in_be32((volatile unsigned int*)WII_IPCPPCCTRL) & 0x1);
-    out_be32((volatile unsigned int*)WII_IPCPPCMSG, CMD_SET_FB | (fb_base >> 8));
-    out_be32((volatile unsigned int*)WII_IPCPPCCTRL, 0x1);
-    while (in_be32((volatile unsigned int*)WII_IPCPPCCTRL) & 0x1);
+    wii_ipc_send(CMD_SET_XFB | (xfb_base >> 8));
+    wii_ipc_send(CMD_SET_FB | (fb_base >> 8));
 
     //
     // Start conversion.
     //
-    out_be32((volatile unsigned int*)WII_IPCPPCMSG, CMD_START_FB);
-    out_be32((volatile unsigned int*)WII_IPCPPCCTRL, 0x1);
-    while (in_be32((volatile unsigned int*)WII_IPCPPCCTRL) & 0x1);
+    wii_ipc_send(CMD_START_FB);
+    wii_ipc_flush();
   }
 
   return 0;
@@ -65,39 +65,6 @@ generic_hub_destroy(usbdev_t *const dev)
 	free(hub);
 }
 
-static int
-generic_hub_debounce(usbdev_t *const dev, const int port)
-{
-	generic_hub_t *const hub = GEN_HUB(dev);
-
-	const int step_ms	= 1;	/* linux uses 25ms, we're busy anyway */
-	const int at_least_ms	= 100;	/* 100ms as in usb20 spec 9.1.2 */
-	const int timeout_ms	= 1500;	/* linux uses this value */
-
-	int total_ms = 0;
-	int stable_ms = 0;
-	while (stable_ms < at_least_ms && total_ms < timeout_ms) {
-		mdelay(step_ms);
-
-		const int changed = hub->ops->port_status_changed(dev, port);
-		const int connected = hub->ops->port_connected(dev, port);
-		if (changed < 0 || connected < 0)
-			return -1;
-
-		if (!changed && connected) {
-			stable_ms += step_ms;
-		} else {
-			usb_debug("generic_hub: Unstable connection at %d\n",
-				  port);
-			stable_ms = 0;
-		}
-		total_ms += step_ms;
-	}
-	if (total_ms >= timeout_ms)
-		usb_debug("generic_hub: Debouncing timed out at %d\n", port);
-	return 0; /* ignore timeouts, try to always go on */
-}
-
 int
 generic_hub_wait_for_port(usbdev_t *const dev, const int port,
 			  const int wait_for,
@@ -126,7 +93,7 @@ generic_hub_resetport(usbdev_t *const dev, const int port)
 		return -1;
 
 	/* wait for 10ms (usb20 spec 11.5.1.5: reset should take 10 to 20ms) */
-	mdelay(10);
+	usb_delay_ms(dev->controller, 10);
 
 	/* now wait 12ms for the hub to finish the reset */
 	const int ret = generic_hub_wait_for_port(
@@ -156,8 +123,8 @@ generic_hub_attach_dev(usbdev_t *const dev, const int port)
 {
 	generic_hub_t *const hub = GEN_HUB(dev);
 
-	if (generic_hub_debounce(dev, port) < 0)
-		return -1;
+	if (!hub->ops->port_connected(dev, port))
+		return 0;
 
 	if (hub->ops->reset_port) {
 		if (hub->ops->reset_port(dev, port) < 0)
@@ -186,36 +153,66 @@ generic_hub_attach_dev(usbdev_t *const dev, const int port)
 	if (speed >= 0) {
 		usb_debug("generic_hub: Success at port %d\n", port);
 		if (hub->ops->reset_port)
-			mdelay(10); /* Reset recovery time
-				       (usb20 spec 7.1.7.5) */
+			usb_delay_ms(dev->controller, 10); /* Reset recovery time
+							      (usb20 spec 7.1.7.5) */
 		hub->ports[port] = usb_attach_device(
 				dev->controller, dev->address, port, speed);
 	}
 	return 0;
 }
 
+/*
+ * Rescans a set of ports. The connected ones are debounced together, then
+ * reset and addressed one by one, as a device answers at address 0 until
+ * it got its own. The array is reused to collect the connected ports.
+ */
 int
-generic_hub_scanport(usbdev_t *const dev, const int port)
+generic_hub_scanports(usbdev_t *const dev, int *const ports, const int count)
 {
 	generic_hub_t *const hub = GEN_HUB(dev);
+	int i, connected = 0;
 
-	if (hub->ports[port] >= 0) {
-		usb_debug("generic_hub: Detachment at port %d\n", port);
+	for (i = 0; i < count; ++i) {
+		const int port = ports[i];
 
-		const int ret = generic_hub_detach_dev(dev, port);
+		if (hub->ports[port] >= 0) {
+			usb_debug("generic_hub: Detachment at port %d\n", port);
+
+			const int ret = generic_hub_detach_dev(dev, port);
+			if (ret < 0)
+				return ret;
+		}
+
+		const int ret = hub->ops->port_connected(dev, port);
 		if (ret < 0)
 			return ret;
+		if (ret) {
+			usb_debug("generic_hub: Attachment at port %d\n", port);
+			ports[connected++] = port;
+		}
 	}
 
-	if (hub->ops->port_connected(dev, port)) {
-		usb_debug("generic_hub: Attachment at port %d\n", port);
+	if (usb_debounce_ports(dev, ports, connected,
+			       hub->ops->port_status_changed,
+			       hub->ops->port_connected) < 0)
+		return -1;
 
-		return generic_hub_attach_dev(dev, port);
+	for (i = 0; i < connected; ++i) {
+		if (generic_hub_attach_dev(dev, ports[i]) < 0)
+			return -1;
 	}
 
 	return 0;
 }
 
+int
+generic_hub_scanport(usbdev_t *const dev, const int port)
+{
+	int ports[1] = { port };
+
+	return generic_hub_scanports(dev, ports, 1);
+}
+
 static void
 generic_hub_poll(usbdev_t *const dev)
 {
@@ -228,17 +225,24 @@ generic_hub_poll(usbdev_t *const dev)
 		return;
 	}
 
-	int port;
+	int *const ports = malloc(sizeof(*ports) * hub->num_ports);
+	if (!ports)
+		return;
+
+	int port, count = 0;
 	for (port = 1; port <= hub->num_ports; ++port) {
 		const int ret = hub->ops->port_status_changed(dev, port);
 		if (ret < 0) {
+			free(ports);
 			return;
 		} else if (ret == 1) {
 			usb_debug("generic_hub: Port change at %d\n", port);
-			if (generic_hub_scanport(dev, port) < 0)
-				return;
+			ports[count++] = port;
 		}
 	}
+
+	generic_hub_scanports(dev, ports, count);
+	free(ports);
 }
 
 int
@@ -273,7 +277,7 @@ generic_hub_init(usbdev_t *const dev, const int num_ports,
 		for (port = 1; port <= num_ports; ++port)
 			ops->enable_port(dev, port);
 		/* wait once for all ports */
-		mdelay(20);
+		usb_delay_ms(dev->controller, 20);
 	}
 
 	return 0;
@@ -82,6 +82,7 @@ int generic_hub_wait_for_port(usbdev_t *const dev, const int port,
 			      int timeout_steps, const int step_us);
 int  generic_hub_resetport(usbdev_t *, int port);
 int  generic_hub_scanport(usbdev_t *, int port);
+int  generic_hub_scanports(usbdev_t *, int *ports, int count);
 /* the provided generic_hub_ops struct has to be static */
 int generic_hub_init(usbdev_t *, int num_ports, const generic_hub_ops_t *);
 
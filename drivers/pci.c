@@ -1214,6 +1214,17 @@ int usb_ohci_config_cb(const pci_config_t *config)
     return 0;
 }
 
+int usb_ehci_config_cb(const pci_config_t *config)
+{
+#ifdef CONFIG_USB_EHCI
+    pci_addr addr = PCI_ADDR(
+        PCI_BUS(config->dev), PCI_DEV(config->dev), PCI_FN(config->dev));
+
+    ob_usb_ehci_init(config->path, addr);
+#endif
+    return 0;
+}
+
 int lsi53c810_config_cb(const pci_config_t *config)
 {    
 #ifdef CONFIG_DRIVER_LSI_53C810
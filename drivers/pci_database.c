@@ -909,6 +909,26 @@ static const pci_dev_t usb_devices[] = {
     },
 };
 
+#ifdef CONFIG_USB_EHCI
+static const pci_dev_t usb_ehci_devices[] = {
+#if defined(CONFIG_QEMU)
+    {
+        PCI_VENDOR_ID_INTEL, PCI_DEVICE_ID_INTEL_82801DB_EHCI,
+        "usb", "usb", NULL,
+	"pci8086,24cd\0pciclass,0c0320\0",
+        1, 0, 0,
+        NULL, NULL,
+    },
+#endif
+    {
+        0xFFFF, 0xFFFF,
+        NULL, NULL, NULL, NULL,
+        -1, -1, -1,
+        NULL, NULL,
+    },
+};
+#endif
+
 static const pci_iface_t usb_iface[] = {
     {
         0x00, "UHCI USB controller", NULL,
@@ -920,7 +940,11 @@ static const pci_iface_t usb_iface[] = {
     },
     {
         0x20, "EHCI USB controller", NULL,
+#ifdef CONFIG_USB_EHCI
+        usb_ehci_devices, &usb_ehci_config_cb, NULL,
+#else
         NULL, NULL, NULL,
+#endif
     },
     {
         0x80, "misc USB controller", NULL,
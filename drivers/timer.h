@@ -55,6 +55,7 @@ extern unsigned long currticks(void);
 extern unsigned long get_timer_freq(void);
 
 /* arch/ppc/timebase.S */
+unsigned long long _get_ticks(void);
 void _wait_ticks(unsigned long nticks);
 
 #define TICKS_PER_SEC 1000
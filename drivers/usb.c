@@ -32,6 +32,7 @@
  */
 
 #include "config.h"
+#include "libopenbios/bindings.h"
 #include "drivers/usb.h"
 #include "usb.h"
 #include "timer.h"
@@ -142,10 +143,191 @@ init_device_entry (hci_t *controller, int i)
 	controller->devices[i]->address = -1;
 	controller->devices[i]->hub = -1;
 	controller->devices[i]->port = -1;
+	controller->devices[i]->enum_us = 0;
 	controller->devices[i]->init = usb_nop_init;
 	controller->devices[i]->init (controller->devices[i]);
 }
 
+#ifdef CONFIG_PPC
+extern unsigned long timer_freq;
+#endif
+
+/**
+ * Gets the time base in microseconds, for statistics and boot profiling
+ */
+u64
+usb_get_time_us (void)
+{
+#ifdef CONFIG_PPC
+	return _get_ticks () / (timer_freq / 1000000);
+#else
+	/* no timebase to read, times show up as 0 */
+	return 0;
+#endif
+}
+
+/* Returns the number of frames since *last and updates it */
+static int
+usb_frames_since (hci_t *controller, int *last)
+{
+	int now, frames;
+
+	if (!controller->frame_number)
+		return 1;
+	now = controller->frame_number (controller);
+	frames = (now - *last) & USB_FRAME_MASK;
+	*last = now;
+	return frames;
+}
+
+/**
+ * Waits for the given number of frame boundaries. The controller's frame
+ * counter keeps bus timings in step with the bus clock, whatever the
+ * calibration of the CPU timebase.
+ */
+void
+usb_wait_frames (hci_t *controller, int frames)
+{
+	int start, timeout;
+
+	if (!controller->frame_number) {
+		mdelay (frames);
+		return;
+	}
+
+	start = controller->frame_number (controller);
+	timeout = frames * 10 + 10; /* 100us steps, in case the frame counter stopped */
+	while (((controller->frame_number (controller) - start) & USB_FRAME_MASK) < frames
+			&& timeout--)
+		udelay (100);
+}
+
+/**
+ * Waits at least ms milliseconds. The next frame boundary may be just
+ * ahead, so one more is waited for.
+ */
+void
+usb_delay_ms (hci_t *controller, int ms)
+{
+	usb_wait_frames (controller, ms + 1);
+}
+
+/**
+ * Debounces a set of hub ports together: waits until each has been
+ * connected without a change for 100ms (usb20 spec 7.1.7.3), so devices
+ * found by the same scan share one interval rather than paying for it
+ * in turn. Ports that don't settle within 1.5s are let through anyway.
+ *
+ * @param hub hub (or root hub) the ports belong to
+ * @param ports port numbers to debounce
+ * @param count number of ports
+ * @param port_changed returns 1 if the port's connection changed and
+ *                     clears the change, negative on error
+ * @param port_connected returns 1 if something is connected to the port,
+ *                       negative on error
+ * @return 0 on success, -1 if a port status couldn't be read
+ */
+int
+usb_debounce_ports (usbdev_t *hub, const int *ports, int count,
+		    int (*port_changed) (usbdev_t *, int),
+		    int (*port_connected) (usbdev_t *, int))
+{
+	const int at_least_ms	= 100;	/* 100ms as in usb20 spec 7.1.7.3 */
+	const int timeout_ms	= 1500;	/* linux uses this value */
+
+	int *stable_ms;
+	int total_ms = 0, pending = count, last = 0;
+	int i, frames, ret = 0;
+
+	if (count == 0)
+		return 0;
+
+	stable_ms = malloc (sizeof (*stable_ms) * count);
+	if (!stable_ms)
+		return -1;
+	memset (stable_ms, 0, sizeof (*stable_ms) * count);
+
+	usb_frames_since (hub->controller, &last);
+	while (pending && total_ms < timeout_ms) {
+		usb_wait_frames (hub->controller, 1);
+		/* status reads take frames of their own, count them all */
+		frames = usb_frames_since (hub->controller, &last);
+		total_ms += frames;
+
+		pending = 0;
+		for (i = 0; i < count; i++) {
+			if (stable_ms[i] >= at_least_ms)
+				continue;
+
+			const int changed = port_changed (hub, ports[i]);
+			const int connected = port_connected (hub, ports[i]);
+			if (changed < 0 || connected < 0) {
+				ret = -1;
+				goto out;
+			}
+
+			if (!changed && connected) {
+				stable_ms[i] += frames;
+			} else {
+				usb_debug ("Unstable connection at port %d\n",
+					   ports[i]);
+				stable_ms[i] = 0;
+			}
+			if (stable_ms[i] < at_least_ms)
+				pending++;
+		}
+	}
+	if (pending)
+		usb_debug ("Debouncing timed out on %d port(s)\n", pending);
+
+out:
+	free (stable_ms);
+	return ret;
+}
+
+/**
+ * Records how long each device on the controller took to enumerate in
+ * the "enumeration-times" property of the controller node, for boot
+ * profiling. Each device adds (address, hub, port, microseconds) cells;
+ * the time of a hub includes the devices behind it. Controllers sharing a
+ * node, like an EHCI and its OHCI companion, append to the same property.
+ */
+void
+usb_set_enum_property (hci_t *controller, const char *path)
+{
+	phandle_t ph = find_dev (path);
+	const char *old;
+	u32 *props;
+	int i, len, oldlen = 0;
+
+	if (!ph)
+		return;
+
+	old = get_property (ph, "enumeration-times", &oldlen);
+	if (!old)
+		oldlen = 0;
+
+	props = malloc (oldlen + sizeof (u32) * 4 * 128);
+	if (!props)
+		return;
+	if (oldlen)
+		memcpy (props, old, oldlen);
+	len = oldlen / sizeof (u32);
+
+	for (i = 1; i < 128; i++) {
+		usbdev_t *dev = controller->devices[i];
+		if (!dev || dev->address <= 0)
+			continue;
+		props[len++] = __cpu_to_be32 (dev->address);
+		props[len++] = __cpu_to_be32 (dev->hub);
+		props[len++] = __cpu_to_be32 (dev->port);
+		props[len++] = __cpu_to_be32 (dev->enum_us);
+	}
+
+	set_property (ph, "enumeration-times", (char *)props, len * sizeof (u32));
+	free (props);
+}
+
 int
 set_feature (usbdev_t *dev, int endp, int feature, int rtype)
 {
@@ -300,11 +482,12 @@ generic_set_address (hci_t *controller, int speed, int hubport, int hubaddr)
 	dev->endpoints[0].maxpacketsize = 8;
 	dev->endpoints[0].toggle = 0;
 	dev->endpoints[0].direction = SETUP;
-	mdelay (50);
+	/* reset recovery was waited for by the hub */
 	if (dev->controller->control (dev, OUT, sizeof (dr), &dr, 0, 0)) {
 		return -1;
 	}
-	mdelay (50);
+	/* usb20 spec 9.2.6.3 allows 2ms, some devices want more (as in linux) */
+	usb_delay_ms (controller, 10);
 
 	return adr;
 }
@@ -558,6 +741,7 @@ usb_attach_device(hci_t *controller, int hubaddress, int port, int speed)
 	static const char* speeds[] = { "full", "low", "high" };
 	usb_debug ("%sspeed device\n", (speed <= 2) ? speeds[speed] : "invalid value - no");
 #endif
+	const u64 start = usb_get_time_us ();
 	int newdev = set_address (controller, speed, port, hubaddress);
 	if (newdev == -1)
 		return -1;
@@ -565,7 +749,10 @@ usb_attach_device(hci_t *controller, int hubaddress, int port, int speed)
 	// determine responsible driver - current done in set_address
 	newdev_t->init (newdev_t);
 	/* init() may have called usb_detach_device() yet, so check */
-	return controller->devices[newdev] ? newdev : -1;
+	if (!controller->devices[newdev])
+		return -1;
+	newdev_t->enum_us = usb_get_time_us () - start;
+	return newdev;
 }
 
 static void
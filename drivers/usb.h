@@ -34,6 +34,25 @@
 #ifndef __USB_H
 #define __USB_H
 #include <drivers/pci.h>
+#include "libc/byteorder.h"
+
+//
+// The Wii and Wii U do byteswapping on the bus side, all bus reads must be big endian.
+//
+#ifdef CONFIG_WII
+extern void flush_dcache_range(char *start, char *stop);
+extern void invalidate_dcache_range(char *start, char *stop);
+
+#define USBHC_TO_CPU(x)				__be32_to_cpu(x)
+#define CPU_TO_USBHC(x)				__cpu_to_be32(x)
+#define DC_FLUSH(b,l)				flush_dcache_range((char*)b, ((char*)b) + l)
+#define DC_INVALIDATE(b,l)			invalidate_dcache_range((char*)b, ((char*)b) + l)
+#else
+#define USBHC_TO_CPU(x)				__le32_to_cpu(x)
+#define CPU_TO_USBHC(x)				__cpu_to_le32(x)
+#define DC_FLUSH(b,l)
+#define DC_INVALIDATE(b,l)
+#endif
 
 typedef enum { host_to_device = 0, device_to_host = 1 } dev_req_dir;
 typedef enum { standard_type = 0, class_type = 1, vendor_type =
@@ -142,6 +161,7 @@ struct usbdev {
 	int port;		// port where device is attached
 	int speed;		// 1: lowspeed, 0: fullspeed, 2: highspeed
 	u32 quirks;		// quirks field. got to love usb
+	u32 enum_us;		// time taken to address and bind a driver
 	void *data;
 	u8 *descriptor;
 	u8 *configuration;
@@ -150,9 +170,19 @@ struct usbdev {
 	void (*poll) (usbdev_t *dev);
 };
 
+typedef struct {
+	u32 commands;
+	u32 retries;
+	u64 bytes;
+	u64 time_us;
+} usbmsc_stats_t;
+
+#define USB_MSC_STATS_LUNS	16	/* Bulk-Only devices have at most 16 LUNs */
+
 typedef struct {
 	unsigned int blocksize;
-	unsigned int numblocks;
+	u64 numblocks;
+	unsigned int max_chunk_bytes;	/* lowered when only smaller transfers succeed */
 	endpoint_t *bulk_in;
 	endpoint_t *bulk_out;
 	u8 quirks		: 7;
@@ -160,6 +190,7 @@ typedef struct {
 	s8 ready;
 	u8 lun;
 	u8 num_luns;
+	usbmsc_stats_t stats[USB_MSC_STATS_LUNS];	/* READ/WRITE commands per LUN */
 	void *data; /* For use by consumers of libpayload. */
 } usbmsc_inst_t;
 
@@ -185,8 +216,8 @@ enum {
 typedef enum { cbw_direction_data_in = 0x80, cbw_direction_data_out = 0
 } cbw_direction;
 
-int readwrite_blocks_512 (usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf);
-int readwrite_blocks (usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf);
+int readwrite_blocks_512 (usbdev_t *dev, u64 start, int n, cbw_direction dir, u8 *buf);
+int readwrite_blocks (usbdev_t *dev, u64 start, int n, cbw_direction dir, u8 *buf);
 
 /* Force a device to enumerate as MSC, without checking class/protocol types.
    It must still have a bulk endpoint pair and respond to MSC commands. */
@@ -236,8 +267,14 @@ struct usbdev_hc {
 					were allocated during set_address()
 					and finish_device_config(). */
 	void (*destroy_device) (hci_t *controller, int devaddr);
+	/* frame_number():		Current 1ms frame number, masked to
+					USB_FRAME_MASK. Optional, without it
+					bus timings fall back to mdelay(). */
+	int (*frame_number) (hci_t *controller);
 };
 
+#define USB_FRAME_MASK 0x7ff
+
 typedef struct {
 	unsigned char bDescLength;
 	unsigned char bDescriptorType;
@@ -331,6 +368,14 @@ void detach_controller (hci_t *controller);
 void usb_poll (void);
 void init_device_entry (hci_t *controller, int num);
 
+u64 usb_get_time_us (void);
+void usb_wait_frames (hci_t *controller, int frames);
+void usb_delay_ms (hci_t *controller, int ms);
+int usb_debounce_ports (usbdev_t *hub, const int *ports, int count,
+			int (*port_changed) (usbdev_t *, int),
+			int (*port_connected) (usbdev_t *, int));
+void usb_set_enum_property (hci_t *controller, const char *path);
+
 int set_feature (usbdev_t *dev, int endp, int feature, int rtype);
 int get_status (usbdev_t *dev, int endp, int rtype, int len, void *data);
 void set_configuration (usbdev_t *dev);
@@ -0,0 +1,994 @@
+/*
+ * Driver for USB EHCI ported from CoreBoot
+ *
+ * This file was part of the libpayload project.
+ *
+ * Copyright (C) 2010 coresystems GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+//#define USB_DEBUG_QTD
+
+#include "config.h"
+#include <asm/io.h>
+#include <libopenbios/ofmem.h>
+#include "timer.h"
+#include <drivers/usb.h>
+#include "usbehci_private.h"
+#include "usbehci.h"
+#ifdef CONFIG_DRIVER_PCI
+#include "drivers/pci.h"
+#include "pci.h"
+#endif
+
+static void ehci_start (hci_t *controller);
+static void ehci_stop (hci_t *controller);
+static void ehci_reset (hci_t *controller);
+static void ehci_reinit (hci_t *controller);
+static void ehci_shutdown (hci_t *controller);
+static int ehci_bulk (endpoint_t *ep, int size, u8 *data, int finalize);
+static int ehci_control (usbdev_t *dev, direction_t dir, int drlen, void *devreq,
+			 int dalen, u8 *data);
+static void* ehci_create_intr_queue (endpoint_t *ep, int reqsize, int reqcount, int reqtiming);
+static void ehci_destroy_intr_queue (endpoint_t *ep, void *queue);
+static u8* ehci_poll_intr_queue (void *queue);
+
+#ifdef USB_DEBUG_QTD
+static void
+dump_td (qtd_t *td)
+{
+	u32 token = __le32_to_cpu(td->token);
+
+	usb_debug("qTD at 0x%08lx: next 0x%08x alt 0x%08x token 0x%08x\n",
+		  virt_to_phys(td), __le32_to_cpu(td->next_qtd),
+		  __le32_to_cpu(td->alt_next_qtd), token);
+	usb_debug("    pid %d, %d bytes left, status 0x%02x%s\n",
+		  (token >> QTD_PID_SHIFT) & 3,
+		  (token & QTD_TOTAL_LEN_MASK) >> QTD_TOTAL_LEN_SHIFT,
+		  token & QTD_STATUS_MASK,
+		  (token & QTD_ACTIVE) ? ", active" : "");
+}
+#endif
+
+static void
+ehci_reset (hci_t *controller)
+{
+	ehci_t *const ehcic = EHCI_INST(controller);
+	int timeout;
+
+	ehci_stop(controller);
+
+	EHCI_WRITE_OPREG(ehcic, usbcmd, EHCI_READ_OPREG(ehcic, usbcmd) | HC_OP_HC_RESET);
+	/* wait at most 100ms for reset to complete (the controller clears the bit) */
+	timeout = 1000;
+	while ((EHCI_READ_OPREG(ehcic, usbcmd) & HC_OP_HC_RESET) && timeout--)
+		udelay(100);
+	if (timeout < 0)
+		usb_debug("Error: ehci: controller reset timed out.\n");
+}
+
+static void
+ehci_reinit (hci_t *controller)
+{
+}
+
+static int
+ehci_set_periodic_schedule (ehci_t *ehcic, int enable)
+{
+	u32 usbcmd = EHCI_READ_OPREG(ehcic, usbcmd);
+
+	/* Set periodic schedule status. */
+	if (enable)
+		usbcmd |= HC_OP_PERIODIC_SCHED_EN;
+	else
+		usbcmd &= ~HC_OP_PERIODIC_SCHED_EN;
+	EHCI_WRITE_OPREG(ehcic, usbcmd, usbcmd);
+
+	/* Wait for the controller to accept periodic schedule status.
+	 * This shouldn't take too long, but we should timeout nevertheless.
+	 */
+	enable = enable ? HC_OP_PERIODIC_SCHED_STAT : 0;
+	int timeout = 100; /* time out after 100ms */
+	while (((EHCI_READ_OPREG(ehcic, usbsts) & HC_OP_PERIODIC_SCHED_STAT) != enable)
+			&& timeout--)
+		mdelay(1);
+	if (timeout < 0) {
+		usb_debug("ehci periodic schedule status change timed out.\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int
+ehci_set_async_schedule (ehci_t *ehcic, int enable)
+{
+	u32 usbcmd = EHCI_READ_OPREG(ehcic, usbcmd);
+
+	/* Set async schedule status. */
+	if (enable)
+		usbcmd |= HC_OP_ASYNC_SCHED_EN;
+	else
+		usbcmd &= ~HC_OP_ASYNC_SCHED_EN;
+	EHCI_WRITE_OPREG(ehcic, usbcmd, usbcmd);
+
+	/* Wait for the controller to accept async schedule status. This
+	 * normally takes a microframe or two, so poll finely rather than
+	 * sleeping a whole millisecond per transfer.
+	 */
+	enable = enable ? HC_OP_ASYNC_SCHED_STAT : 0;
+	int timeout = 10000; /* time out after 100ms */
+	while (((EHCI_READ_OPREG(ehcic, usbsts) & HC_OP_ASYNC_SCHED_STAT) != enable)
+			&& timeout--)
+		udelay(10);
+	if (timeout < 0) {
+		usb_debug("ehci async schedule status change timed out.\n");
+		return 1;
+	}
+	return 0;
+}
+
+/* FRINDEX counts microframes, eight to a frame */
+static int
+ehci_frame_number (hci_t *controller)
+{
+	return (EHCI_READ_OPREG(EHCI_INST(controller), frindex) >> 3) & USB_FRAME_MASK;
+}
+
+hci_t *
+ehci_init (void *bar)
+{
+	int i;
+	ehci_t *ehcic;
+
+	hci_t *controller = new_controller ();
+
+	if (!controller) {
+		printk("Could not create USB controller instance.\n");
+		return NULL;
+	}
+
+	controller->instance = malloc (sizeof (ehci_t));
+	if (!controller->instance) {
+		printk("Not enough memory creating USB controller instance.\n");
+		return NULL;
+	}
+	ehcic = EHCI_INST(controller);
+	memset(ehcic, 0, sizeof (*ehcic));
+
+	controller->type = EHCI;
+
+	controller->start = ehci_start;
+	controller->stop = ehci_stop;
+	controller->reset = ehci_reset;
+	controller->init = ehci_reinit;
+	controller->shutdown = ehci_shutdown;
+	controller->bulk = ehci_bulk;
+	controller->control = ehci_control;
+	controller->set_address = generic_set_address;
+	controller->finish_device_config = NULL;
+	controller->destroy_device = NULL;
+	controller->frame_number = ehci_frame_number;
+	controller->create_intr_queue = ehci_create_intr_queue;
+	controller->destroy_intr_queue = ehci_destroy_intr_queue;
+	controller->poll_intr_queue = ehci_poll_intr_queue;
+	for (i = 0; i < 128; i++) {
+		controller->devices[i] = 0;
+	}
+	init_device_entry (controller, 0);
+	ehcic->roothub = controller->devices[0];
+
+	controller->reg_base = (u32)(unsigned long)bar;
+	ehcic->capabilities = (hc_cap_t*)phys_to_virt(controller->reg_base);
+	ehcic->operation = (hc_op_t*)((u8*)ehcic->capabilities +
+		HC_LENGTH(EHCI_READ_CAPREG(ehcic, caplength_hciversion)));
+	usb_debug("EHCI Version %x.%02x, %d ports, %d companion controllers\n",
+		  HC_VERSION(EHCI_READ_CAPREG(ehcic, caplength_hciversion)) >> 8,
+		  HC_VERSION(EHCI_READ_CAPREG(ehcic, caplength_hciversion)) & 0xff,
+		  EHCI_READ_CAPREG(ehcic, hcsparams) & HCS_NPORTS_MASK,
+		  (EHCI_READ_CAPREG(ehcic, hcsparams) & HCS_N_CC_MASK) >> HCS_N_CC_SHIFT);
+
+	/* Whoever ran before us may have left the controller running. */
+	controller->reset (controller);
+
+	/* Set the high address word (aka segment) if controller is 64-bit */
+	if (EHCI_READ_CAPREG(ehcic, hccparams) & HCC_64BIT_ADDRESSING)
+		EHCI_WRITE_OPREG(ehcic, ctrldssegment, 0);
+
+	/* No interrupts, everything is polled. */
+	EHCI_WRITE_OPREG(ehcic, usbintr, 0);
+	EHCI_WRITE_OPREG(ehcic, usbsts, EHCI_READ_OPREG(ehcic, usbsts));
+
+	/* Dummy QH the periodic frame list points at when nothing is scheduled */
+	ofmem_posix_memalign((void **)&ehcic->dummy_qh, sizeof(ehci_qh_t), sizeof(ehci_qh_t));
+	/* 1024 32-bit pointers, 4kb aligned */
+	ofmem_posix_memalign((void **)&ehcic->periodic_list, 4096, 1024 * sizeof(u32));
+	if (!ehcic->dummy_qh || !ehcic->periodic_list) {
+		printk("Not enough memory for EHCI schedules.\n");
+		return NULL;
+	}
+	memset((void *)ehcic->dummy_qh, 0, sizeof(*ehcic->dummy_qh));
+	ehcic->dummy_qh->horiz_link_ptr = __cpu_to_le32(PS_TERMINATE);
+	ehcic->dummy_qh->td.next_qtd = __cpu_to_le32(QTD_TERMINATE);
+	ehcic->dummy_qh->td.alt_next_qtd = __cpu_to_le32(QTD_TERMINATE);
+	DC_FLUSH(ehcic->dummy_qh, sizeof (*ehcic->dummy_qh));
+	for (i = 0; i < 1024; ++i)
+		ehcic->periodic_list[i] = __cpu_to_le32(virt_to_phys(ehcic->dummy_qh) | PS_TYPE_QH);
+	DC_FLUSH(ehcic->periodic_list, 1024 * sizeof(u32));
+
+	EHCI_WRITE_OPREG(ehcic, periodiclistbase, virt_to_phys(ehcic->periodic_list));
+	EHCI_WRITE_OPREG(ehcic, asynclistaddr, 0);
+
+	/* Enable operation of controller */
+	controller->start(controller);
+
+	/* Take over all ports. Full- and low-speed devices are handed back
+	   to the companion controllers by the root hub. */
+	EHCI_WRITE_OPREG(ehcic, configflag, 1);
+	mdelay(5);
+
+	/* Enable use of periodic schedule */
+	ehci_set_periodic_schedule(ehcic, 1);
+
+	controller->devices[0]->controller = controller;
+	controller->devices[0]->init = ehci_rh_init;
+	controller->devices[0]->init (controller->devices[0]);
+	return controller;
+}
+
+#ifdef CONFIG_DRIVER_PCI
+/* Take the controller from the BIOS/SMM if it claims it (EHCI spec 5.1) */
+static void
+ehci_pci_legacy_handoff (pci_addr addr, u32 hccparams)
+{
+	u8 eecp = (hccparams & HCC_EECP_MASK) >> HCC_EECP_SHIFT;
+	int timeout;
+	u32 legsup;
+
+	while (eecp >= 0x40) {
+		legsup = pci_config_read32(addr, eecp);
+		if ((legsup & 0xff) == EHCI_EECP_ID_LEGSUP)
+			break;
+		eecp = (legsup >> 8) & 0xff;
+	}
+	if (eecp < 0x40 || !(legsup & EHCI_LEGSUP_BIOS_OWNED))
+		return;
+
+	pci_config_write32(addr, eecp, legsup | EHCI_LEGSUP_OS_OWNED);
+	timeout = 1000;
+	while ((pci_config_read32(addr, eecp) & EHCI_LEGSUP_BIOS_OWNED) && timeout--)
+		mdelay(1);
+	if (timeout < 0)
+		usb_debug("Warning: ehci: BIOS did not release the controller.\n");
+
+	/* Disable SMIs */
+	pci_config_write32(addr, eecp + 4, 0);
+}
+#endif
+
+hci_t *
+ehci_pci_init (pci_addr addr)
+{
+#ifdef CONFIG_DRIVER_PCI
+	u32 reg_base;
+	uint16_t cmd;
+	ehci_t probe;
+
+	cmd = pci_config_read16(addr, PCI_COMMAND);
+	cmd |= PCI_COMMAND_BUS_MASTER | PCI_COMMAND_MEMORY;
+	pci_config_write16(addr, PCI_COMMAND, cmd);
+
+	/* EHCI mandates a 32-bit MMIO BAR at 0x10 (EHCI spec 2.1.3) */
+	reg_base = pci_config_read32 (addr, PCI_BASE_ADDR_0) & ~0xff;
+
+	/* the handoff has to happen before ehci_init() resets the controller */
+	probe.capabilities = (hc_cap_t*)phys_to_virt(reg_base);
+	ehci_pci_legacy_handoff(addr, EHCI_READ_CAPREG(&probe, hccparams));
+
+	return ehci_init((void *)(unsigned long)reg_base);
+#else
+	return NULL;
+#endif
+}
+
+static void
+ehci_shutdown (hci_t *controller)
+{
+	ehci_t *ehcic;
+
+	if (controller == 0)
+		return;
+	ehcic = EHCI_INST(controller);
+
+	detach_controller (controller);
+	ehcic->roothub->destroy (ehcic->roothub);
+
+	/* A reset also clears CONFIGFLAG, routing all ports back to the
+	   companion controllers for the OS. */
+	controller->reset (controller);
+
+	free ((void *)ehcic->periodic_list);
+	free ((void *)ehcic->dummy_qh);
+	free (ehcic);
+	free (controller);
+}
+
+static void
+ehci_start (hci_t *controller)
+{
+	ehci_t *const ehcic = EHCI_INST(controller);
+	int timeout = 100; /* time out after 100ms */
+
+	/* Interrupt threshold of one microframe */
+	EHCI_WRITE_OPREG(ehcic, usbcmd, (1 << HC_OP_ITC_SHIFT) | HC_OP_RS);
+	while ((EHCI_READ_OPREG(ehcic, usbsts) & HC_OP_HC_HALTED) && timeout--)
+		mdelay(1);
+	if (timeout < 0)
+		usb_debug("Error: ehci: controller did not start.\n");
+}
+
+static void
+ehci_stop (hci_t *controller)
+{
+	ehci_t *const ehcic = EHCI_INST(controller);
+	int timeout = 20; /* at most 16 microframes, EHCI spec 2.3.1 */
+
+	EHCI_WRITE_OPREG(ehcic, usbcmd, EHCI_READ_OPREG(ehcic, usbcmd) &
+		~(HC_OP_RS | HC_OP_ASYNC_SCHED_EN | HC_OP_PERIODIC_SCHED_EN));
+	while (!(EHCI_READ_OPREG(ehcic, usbsts) & HC_OP_HC_HALTED) && timeout--)
+		mdelay(1);
+	if (timeout < 0)
+		usb_debug("Error: ehci: controller did not halt.\n");
+}
+
+/*
+ * Full- and low-speed devices behind a high-speed hub are reached through
+ * split transactions addressed to the transaction translator of the closest
+ * high-speed hub.
+ */
+static int
+closest_usb2_hub (const usbdev_t *dev, int *const addr, int *const port)
+{
+	const usbdev_t *usb1dev;
+
+	do {
+		usb1dev = dev;
+		if ((dev->hub > 0) && (dev->hub < 128))
+			dev = dev->controller->devices[dev->hub];
+		else
+			dev = NULL;
+	} while (dev && (dev->speed != HIGH_SPEED));
+
+	if (dev) {
+		*addr = usb1dev->hub;
+		*port = usb1dev->port;
+		return 0;
+	}
+
+	usb_debug("Couldn't find closest USB2.0 hub.\n");
+	return 1;
+}
+
+static qtd_t *
+ehci_alloc_qtd (void)
+{
+	qtd_t *td;
+
+	ofmem_posix_memalign((void **)&td, sizeof(qtd_t), sizeof(qtd_t));
+	if (td)
+		memset((void *)td, 0, sizeof(*td));
+	return td;
+}
+
+static void
+ehci_free_tds (qtd_t *head)
+{
+	while (head) {
+		qtd_t *const cur = head;
+		u32 next = __le32_to_cpu(cur->next_qtd);
+
+		head = (next & QTD_TERMINATE) ? NULL : (qtd_t *)phys_to_virt(next & ~0x1f);
+		free((void *)cur);
+	}
+}
+
+/*
+ * Points a qTD at up to five pages of data and returns how much of datalen
+ * it covers. A qTD that doesn't take the rest of the transfer must end on a
+ * packet boundary, so it is trimmed to a multiple of the max packet size.
+ */
+static int
+fill_td (qtd_t *td, u8 *data, int datalen, int mps)
+{
+	u32 start = virt_to_phys(data);
+	u32 page = start & ~(QTD_PAGE_SIZE - 1);
+	int total_len = QTD_PAGE_SIZE - (start & (QTD_PAGE_SIZE - 1));
+	int page_no;
+
+	td->bufptrs[0] = __cpu_to_le32(start);
+	for (page_no = 1; page_no < QTD_MAX_PAGES && total_len < datalen; page_no++) {
+		page += QTD_PAGE_SIZE;
+		td->bufptrs[page_no] = __cpu_to_le32(page);
+		total_len += QTD_PAGE_SIZE;
+	}
+
+	if (total_len >= datalen)
+		total_len = datalen;
+	else
+		total_len -= total_len % mps;
+
+	td->token |= __cpu_to_le32(total_len << QTD_TOTAL_LEN_SHIFT);
+	return total_len;
+}
+
+/*
+ * Waits for a qTD chain. A short packet ends the transfer early: the
+ * controller then moves on to the inactive terminator qTD every qTD names as
+ * its alternate, so the remaining qTDs are left untouched.
+ */
+static int
+wait_for_tds (qtd_t *head)
+{
+	qtd_t *cur = head;
+	u32 token;
+
+	while (1) {
+		/* 2s per qTD, slow flash sticks can take that long to answer */
+		int timeout = 100000;
+		DC_INVALIDATE(cur, sizeof (*cur));
+		while (((token = __le32_to_cpu(cur->token)) & QTD_ACTIVE) &&
+		       !(token & QTD_HALTED) && timeout--) {
+			udelay(20);
+			DC_INVALIDATE(cur, sizeof (*cur));
+		}
+#ifdef USB_DEBUG_QTD
+		dump_td(cur);
+#endif
+		if (timeout < 0) {
+			usb_debug("Error: ehci: queue transfer processing timed out.\n");
+			return 1;
+		}
+		if (token & QTD_HALTED) {
+			usb_debug("Error: ehci: transfer halted, status 0x%02x\n",
+				  token & QTD_STATUS_MASK);
+			return 1;
+		}
+		/* short packet */
+		if (token & QTD_TOTAL_LEN_MASK)
+			return 0;
+		if (__le32_to_cpu(cur->next_qtd) & QTD_TERMINATE)
+			return 0;
+		cur = (qtd_t *)phys_to_virt(__le32_to_cpu(cur->next_qtd) & ~0x1f);
+	}
+}
+
+static int
+ehci_process_async_schedule (ehci_t *ehcic, ehci_qh_t *qhead, qtd_t *head)
+{
+	int result;
+
+	/* make sure async schedule is disabled */
+	if (ehci_set_async_schedule(ehcic, 0))
+		return 1;
+
+	/* hook up QH */
+	EHCI_WRITE_OPREG(ehcic, asynclistaddr, virt_to_phys(qhead));
+
+	/* start async schedule */
+	if (ehci_set_async_schedule(ehcic, 1))
+		return 1;
+
+	/* wait for result */
+	result = wait_for_tds(head);
+
+	/* disable async schedule */
+	ehci_set_async_schedule(ehcic, 0);
+
+	return result;
+}
+
+static ehci_qh_t *
+ehci_alloc_async_qh (usbdev_t *dev, int endp, int mps, int dtc,
+		     int hubaddr, int hubport, qtd_t *head)
+{
+	ehci_qh_t *qh;
+
+	ofmem_posix_memalign((void **)&qh, sizeof(ehci_qh_t), sizeof(ehci_qh_t));
+	if (!qh)
+		return NULL;
+	memset((void *)qh, 0, sizeof(*qh));
+
+	/* The only QH on the list, so it points at itself and heads the reclamation list */
+	qh->horiz_link_ptr = __cpu_to_le32(virt_to_phys(qh) | QH_QH);
+	/* EHCI speed encoding matches usbdev_t: 0 full, 1 low, 2 high */
+	qh->epchar = __cpu_to_le32(dev->address |
+		(endp << QH_EP_SHIFT) |
+		(dev->speed << QH_EPS_SHIFT) |
+		(dtc ? QH_DTC : 0) |
+		QH_RECLAIM_HEAD |
+		(mps << QH_MPS_SHIFT) |
+		((endp == 0 && dev->speed != HIGH_SPEED) ? QH_NON_HS_CTRL_EP : 0) |
+		(0 << QH_NAK_CNT_SHIFT));
+	qh->epcaps = __cpu_to_le32((1 << QH_PIPE_MULTIPLIER_SHIFT) |
+		(hubport << QH_PORT_NUMBER_SHIFT) |
+		(hubaddr << QH_HUB_ADDRESS_SHIFT));
+	qh->td.next_qtd = __cpu_to_le32(virt_to_phys(head));
+	qh->td.alt_next_qtd = __cpu_to_le32(QTD_TERMINATE);
+	return qh;
+}
+
+static int
+ehci_control (usbdev_t *dev, direction_t dir, int drlen, void *devreq, int dalen,
+	      unsigned char *data)
+{
+	int mps = dev->endpoints[0].maxpacketsize;
+	int hubaddr = 0, hubport = 0;
+	qtd_t *head, *cur, *next;
+	ehci_qh_t *qh;
+	int result;
+
+	if (dev->speed != HIGH_SPEED) {
+		if (closest_usb2_hub(dev, &hubaddr, &hubport))
+			return 1;
+	}
+	if (mps == 0)
+		mps = 8;
+
+#ifdef CONFIG_WII
+	unsigned char *dataAlignedBuf = NULL;
+	unsigned char *dataBuf = data;
+
+	// Ok to flush request, but data must be aligned to 32 bytes.
+	DC_FLUSH(devreq, drlen);
+	if (dalen > 0) {
+		ofmem_posix_memalign((void **)&dataAlignedBuf, 0x20, (dalen + 0x20) & ~(0x1F));
+		memcpy(dataAlignedBuf, data, dalen);
+		DC_FLUSH(dataAlignedBuf, dalen);
+		data = dataAlignedBuf;
+	}
+#endif
+
+	/* Setup stage, always DATA0. */
+	head = cur = ehci_alloc_qtd();
+	if (!head)
+		return 1;
+	cur->token = __cpu_to_le32(QTD_ACTIVE | (EHCI_SETUP << QTD_PID_SHIFT) | (3 << QTD_CERR_SHIFT));
+	cur->alt_next_qtd = __cpu_to_le32(QTD_TERMINATE);
+	fill_td(cur, devreq, drlen, mps);
+
+	/* Data stage, DATA1 first. Control payloads are small, one qTD covers them. */
+	if (dalen > 0) {
+		next = ehci_alloc_qtd();
+		cur->next_qtd = __cpu_to_le32(virt_to_phys(next));
+		DC_FLUSH(cur, sizeof (*cur));
+		cur = next;
+
+		cur->token = __cpu_to_le32(QTD_ACTIVE | QTD_TOGGLE_DATA1 |
+			(((dir == OUT) ? EHCI_OUT : EHCI_IN) << QTD_PID_SHIFT) |
+			(3 << QTD_CERR_SHIFT));
+		cur->alt_next_qtd = __cpu_to_le32(QTD_TERMINATE);
+		if (fill_td(cur, data, dalen, mps) != dalen) {
+			usb_debug("Error: ehci: control transfer of %d bytes too large\n", dalen);
+			ehci_free_tds(head);
+			result = 1;
+			goto out;
+		}
+	}
+
+	/* Status stage in the opposite direction, always DATA1. */
+	next = ehci_alloc_qtd();
+	cur->next_qtd = __cpu_to_le32(virt_to_phys(next));
+	DC_FLUSH(cur, sizeof (*cur));
+	cur = next;
+	cur->token = __cpu_to_le32(QTD_ACTIVE | QTD_TOGGLE_DATA1 | QTD_IOC |
+		(((dir == OUT || dalen == 0) ? EHCI_IN : EHCI_OUT) << QTD_PID_SHIFT) |
+		(3 << QTD_CERR_SHIFT));
+	cur->next_qtd = __cpu_to_le32(QTD_TERMINATE);
+	cur->alt_next_qtd = __cpu_to_le32(QTD_TERMINATE);
+	DC_FLUSH(cur, sizeof (*cur));
+
+	/* Control transfers take the toggle from the qTDs. */
+	qh = ehci_alloc_async_qh(dev, 0, mps, 1, hubaddr, hubport, head);
+	if (!qh) {
+		ehci_free_tds(head);
+		result = 1;
+		goto out;
+	}
+	DC_FLUSH(qh, sizeof (*qh));
+
+	result = ehci_process_async_schedule(EHCI_INST(dev->controller), qh, head);
+
+	ehci_free_tds(head);
+	free((void *)qh);
+
+out:
+#ifdef CONFIG_WII
+	if (dataAlignedBuf) {
+		// Copy data back to original buffer.
+		DC_INVALIDATE(dataAlignedBuf, dalen);
+		memcpy(dataBuf, dataAlignedBuf, dalen);
+		free(dataAlignedBuf);
+	}
+#endif
+	return result;
+}
+
+/* finalize == 1: if data is of packet aligned size, add a zero length packet */
+static int
+ehci_bulk (endpoint_t *ep, int size, u8 *data, int finalize)
+{
+	usbdev_t *dev = ep->dev;
+	int pid = (ep->direction == IN) ? EHCI_IN : EHCI_OUT;
+	int remaining = size;
+	int hubaddr = 0, hubport = 0;
+	qtd_t *head, *cur, *next, *term;
+	ehci_qh_t *qh;
+	u8 *ptr;
+	int result, zlp;
+
+	usb_debug("bulk: %x bytes from %p, finalize: %x, maxpacketsize: %x\n", size, data, finalize, ep->maxpacketsize);
+
+	if (dev->speed != HIGH_SPEED) {
+		/* we need a split transaction */
+		if (closest_usb2_hub(dev, &hubaddr, &hubport))
+			return 1;
+	}
+
+#ifdef CONFIG_WII
+	unsigned char *dataAlignedBuf = NULL;
+	unsigned char *dataBuf = data;
+
+	// DMA straight into the caller's buffer when it covers whole cache
+	// lines, otherwise bounce through an aligned copy.
+	if ((((unsigned long)data | size) & 0x1F) != 0) {
+		ofmem_posix_memalign((void **)&dataAlignedBuf, 0x20, (size + 0x20) & ~(0x1F));
+		memcpy(dataAlignedBuf, data, size);
+		data = dataAlignedBuf;
+	}
+	DC_FLUSH(data, size);
+#endif
+
+	/* Inactive qTD the controller falls through to after a short packet */
+	term = ehci_alloc_qtd();
+	if (!term) {
+		result = 1;
+		goto out;
+	}
+	term->next_qtd = __cpu_to_le32(QTD_TERMINATE);
+	term->alt_next_qtd = __cpu_to_le32(QTD_TERMINATE);
+	DC_FLUSH(term, sizeof (*term));
+
+	ptr = data;
+	head = cur = NULL;
+	/* if data is of packet aligned size, a zero length packet follows */
+	zlp = finalize && size > 0 && (size % ep->maxpacketsize) == 0;
+	do {
+		next = ehci_alloc_qtd();
+		if (!next) {
+			ehci_free_tds(head);
+			free((void *)term);
+			result = 1;
+			goto out;
+		}
+		if (cur) {
+			cur->next_qtd = __cpu_to_le32(virt_to_phys(next));
+			DC_FLUSH(cur, sizeof (*cur));
+		} else {
+			head = next;
+		}
+		cur = next;
+
+		cur->token = __cpu_to_le32(QTD_ACTIVE | (pid << QTD_PID_SHIFT) | (3 << QTD_CERR_SHIFT));
+		cur->next_qtd = __cpu_to_le32(QTD_TERMINATE);
+		cur->alt_next_qtd = __cpu_to_le32(virt_to_phys(term));
+		if (remaining > 0) {
+			int len = fill_td(cur, ptr, remaining, ep->maxpacketsize);
+			ptr += len;
+			remaining -= len;
+		} else {
+			zlp = 0;
+		}
+	} while (remaining > 0 || zlp);
+	cur->token |= __cpu_to_le32(QTD_IOC);
+	DC_FLUSH(cur, sizeof (*cur));
+
+	/* Bulk transfers keep the toggle in the QH overlay. */
+	qh = ehci_alloc_async_qh(dev, ep->endpoint & 0xf, ep->maxpacketsize, 0, hubaddr, hubport, head);
+	if (!qh) {
+		ehci_free_tds(head);
+		free((void *)term);
+		result = 1;
+		goto out;
+	}
+	qh->td.token = __cpu_to_le32(ep->toggle ? QTD_TOGGLE_DATA1 : 0);
+	DC_FLUSH(qh, sizeof (*qh));
+
+	usb_debug("doing bulk transfer with %x(%x). first_td at %lx\n",
+		dev->address, ep->endpoint & 0xf, virt_to_phys(head));
+
+	result = ehci_process_async_schedule(EHCI_INST(dev->controller), qh, head);
+
+	DC_INVALIDATE(qh, sizeof (*qh));
+	ep->toggle = (__le32_to_cpu(qh->td.token) & QTD_TOGGLE_DATA1) ? 1 : 0;
+
+	ehci_free_tds(head);
+	free((void *)term);
+	free((void *)qh);
+
+	if (result) {
+		/* try cleanup */
+		clear_stall(ep);
+	}
+
+out:
+#ifdef CONFIG_WII
+	DC_INVALIDATE(data, size);
+	if (dataAlignedBuf) {
+		// Copy data back to original buffer.
+		memcpy(dataBuf, dataAlignedBuf, size);
+		free(dataAlignedBuf);
+	}
+#endif
+	return result;
+}
+
+struct _intr_queue;
+
+/* qTD plus the software fields, padded to 64 bytes so each sits alone in its cache lines */
+struct _intr_qtd {
+	qtd_t			td;
+	u8			*data;
+	struct _intr_qtd	*next;
+	u32			pad[8 - 2 * sizeof(void *) / sizeof(u32)];
+} __attribute__ ((packed));
+
+typedef struct _intr_qtd intr_qtd_t;
+
+struct _intr_queue {
+	ehci_qh_t		qh;
+	intr_qtd_t		*head;
+	intr_qtd_t		*tail;
+	intr_qtd_t		*spare;
+	u8			*data;
+	endpoint_t		*endp;
+	int			reqsize;
+};
+
+typedef struct _intr_queue intr_queue_t;
+
+static void
+fill_intr_queue_td (intr_queue_t *const intrq, intr_qtd_t *const intr_qtd,
+		    u8 *const data)
+{
+	const int pid = (intrq->endp->direction == IN) ? EHCI_IN : EHCI_OUT;
+	const int cerr = (intrq->endp->dev->speed != HIGH_SPEED) ? 1 : 0;
+
+	memset((void *)intr_qtd, 0, sizeof(*intr_qtd));
+	intr_qtd->td.next_qtd = __cpu_to_le32(QTD_TERMINATE);
+	intr_qtd->td.alt_next_qtd = __cpu_to_le32(QTD_TERMINATE);
+	intr_qtd->td.token = __cpu_to_le32(QTD_ACTIVE |
+		(pid << QTD_PID_SHIFT) |
+		(cerr << QTD_CERR_SHIFT) |
+		((intrq->endp->toggle & 1) << QTD_TOGGLE_SHIFT));
+	fill_td(&intr_qtd->td, data, intrq->reqsize, intrq->endp->maxpacketsize);
+	intr_qtd->data = data;
+	intr_qtd->next = NULL;
+	DC_FLUSH(&intr_qtd->td, sizeof (intr_qtd->td));
+
+	intrq->endp->toggle ^= 1;
+}
+
+static void
+ehci_destroy_intr_queue (endpoint_t *const ep, void *const queue)
+{
+	intr_queue_t *const intrq = (intr_queue_t *)queue;
+	ehci_t *const ehcic = EHCI_INST(ep->dev->controller);
+	const u32 qh_ptr = __cpu_to_le32(virt_to_phys(&intrq->qh) | PS_TYPE_QH);
+	const u32 dummy_ptr = __cpu_to_le32(virt_to_phys(ehcic->dummy_qh) | PS_TYPE_QH);
+	int i;
+
+	/* remove QH from periodic schedule */
+	for (i = 0; i < 1024; ++i) {
+		if (ehcic->periodic_list[i] == qh_ptr)
+			ehcic->periodic_list[i] = dummy_ptr;
+	}
+	DC_FLUSH(ehcic->periodic_list, 1024 * sizeof(u32));
+
+	/* wait 1ms for frame to end */
+	mdelay(1);
+
+	while (intrq->head) {
+		/* disable qTD and destroy list */
+		intr_qtd_t *const cur = intrq->head;
+		intrq->head = cur->next;
+		free((void *)cur);
+	}
+	free((void *)intrq->spare);
+	free(intrq->data);
+	free((void *)intrq);
+}
+
+static void *
+ehci_create_intr_queue (endpoint_t *const ep, const int reqsize,
+			const int reqcount, const int reqtiming)
+{
+	int i;
+	int hubaddr = 0, hubport = 0;
+	intr_queue_t *intrq;
+	intr_qtd_t *cur;
+
+	if ((reqsize > (4 * QTD_PAGE_SIZE)) || (reqcount < 1))
+		return NULL;
+
+	if (ep->dev->speed != HIGH_SPEED) {
+		if (closest_usb2_hub(ep->dev, &hubaddr, &hubport))
+			return NULL;
+	}
+
+	ofmem_posix_memalign((void **)&intrq, sizeof(intrq->qh), sizeof(*intrq));
+	if (!intrq)
+		return NULL;
+	memset((void *)intrq, 0, sizeof(*intrq));
+	ofmem_posix_memalign((void **)&intrq->data, 0x20, ((reqcount * reqsize) + 0x20) & ~(0x1F));
+	if (!intrq->data) {
+		free((void *)intrq);
+		return NULL;
+	}
+	memset(intrq->data, 0, reqcount * reqsize);
+	DC_FLUSH(intrq->data, reqcount * reqsize);
+	intrq->endp = ep;
+	intrq->reqsize = reqsize;
+
+	/* create #reqcount transfer descriptors (qTDs) */
+	u8 *cur_data = intrq->data;
+	for (i = 0; i < reqcount; ++i) {
+		ofmem_posix_memalign((void **)&cur, sizeof(*cur), sizeof(*cur));
+		if (!cur) {
+			ehci_destroy_intr_queue(ep, intrq);
+			return NULL;
+		}
+		fill_intr_queue_td(intrq, cur, cur_data);
+		cur_data += reqsize;
+		if (!intrq->head) {
+			intrq->head = intrq->tail = cur;
+		} else {
+			intrq->tail->td.next_qtd = __cpu_to_le32(virt_to_phys(&cur->td));
+			intrq->tail->next = cur;
+			DC_FLUSH(&intrq->tail->td, sizeof (intrq->tail->td));
+			intrq->tail = cur;
+		}
+	}
+
+	/* spare qTD that gets swapped in as each completed one is requeued */
+	ofmem_posix_memalign((void **)&intrq->spare, sizeof(*intrq->spare), sizeof(*intrq->spare));
+	if (!intrq->spare) {
+		ehci_destroy_intr_queue(ep, intrq);
+		return NULL;
+	}
+	memset((void *)intrq->spare, 0, sizeof(*intrq->spare));
+
+	/* initialize QH */
+	intrq->qh.horiz_link_ptr = __cpu_to_le32(PS_TERMINATE);
+	intrq->qh.epchar = __cpu_to_le32(ep->dev->address |
+		((ep->endpoint & 0xf) << QH_EP_SHIFT) |
+		(ep->dev->speed << QH_EPS_SHIFT) |
+		(ep->maxpacketsize << QH_MPS_SHIFT) |
+		(0 << QH_NAK_CNT_SHIFT));
+	intrq->qh.epcaps = __cpu_to_le32((1 << QH_PIPE_MULTIPLIER_SHIFT) |
+		(hubport << QH_PORT_NUMBER_SHIFT) |
+		(hubaddr << QH_HUB_ADDRESS_SHIFT) |
+		(0xfe << QH_UFRAME_CMASK_SHIFT) |
+		(1 << QH_UFRAME_SMASK_SHIFT));
+	intrq->qh.td.next_qtd = __cpu_to_le32(virt_to_phys(&intrq->head->td));
+	intrq->qh.td.alt_next_qtd = __cpu_to_le32(QTD_TERMINATE);
+	DC_FLUSH(&intrq->qh, sizeof (intrq->qh));
+
+	/* insert QH into periodic schedule */
+	int nothing_placed = 1;
+	ehci_t *const ehcic = EHCI_INST(ep->dev->controller);
+	const u32 dummy_ptr = __cpu_to_le32(virt_to_phys(ehcic->dummy_qh) | PS_TYPE_QH);
+	for (i = 0; i < 1024; i += reqtiming) {
+		/* advance to the next free position */
+		while ((i < 1024) && (ehcic->periodic_list[i] != dummy_ptr)) ++i;
+		if (i < 1024) {
+			ehcic->periodic_list[i] = __cpu_to_le32(virt_to_phys(&intrq->qh) | PS_TYPE_QH);
+			nothing_placed = 0;
+		}
+	}
+	DC_FLUSH(ehcic->periodic_list, 1024 * sizeof(u32));
+	if (nothing_placed) {
+		usb_debug("Error: Failed to place ehci interrupt queue head "
+			"into periodic table: no space left\n");
+		ehci_destroy_intr_queue(ep, intrq);
+		return NULL;
+	}
+
+	return intrq;
+}
+
+static u8 *
+ehci_poll_intr_queue (void *const queue)
+{
+	intr_queue_t *const intrq = (intr_queue_t *)queue;
+	u32 token;
+	u8 *ret = NULL;
+
+	DC_INVALIDATE(&intrq->head->td, sizeof (intrq->head->td));
+	token = __le32_to_cpu(intrq->head->td.token);
+
+	/* if the head qTD has been processed, return its data and requeue it */
+	if (!(token & QTD_ACTIVE)) {
+		if (!(token & QTD_STATUS_MASK)) {
+			DC_INVALIDATE(intrq->head->data, intrq->reqsize);
+			ret = intrq->head->data;
+		} else {
+			usb_debug("ehci_poll_intr_queue: transfer failed, status == 0x%02x\n",
+				  token & QTD_STATUS_MASK);
+		}
+
+		/* insert a new qTD at the end of the queue */
+		fill_intr_queue_td(intrq, intrq->spare, intrq->head->data);
+		intrq->tail->td.next_qtd = __cpu_to_le32(virt_to_phys(&intrq->spare->td));
+		intrq->tail->next = intrq->spare;
+		DC_FLUSH(&intrq->tail->td, sizeof (intrq->tail->td));
+		intrq->tail = intrq->spare;
+
+		/* reuse the executed qTD as spare */
+		intrq->spare = intrq->head;
+
+		/* advance the head */
+		intrq->head = intrq->head->next;
+	} else {
+		/* reset the queue if the controller ran dry after an underrun */
+		DC_INVALIDATE(&intrq->qh, sizeof (intrq->qh));
+		if (__le32_to_cpu(intrq->qh.td.next_qtd) & QTD_TERMINATE) {
+			usb_debug("resetting underrun ehci interrupt queue.\n");
+			memset((void *)&intrq->qh.td, 0, sizeof(intrq->qh.td));
+			intrq->qh.td.next_qtd = __cpu_to_le32(virt_to_phys(&intrq->head->td));
+			DC_FLUSH(&intrq->qh, sizeof (intrq->qh));
+		}
+	}
+	return ret;
+}
+
+int ob_usb_ehci_init (const char *path, uint32_t addr)
+{
+	hci_t *ctrl;
+
+	usb_debug("ehci_init: %s addr = %x\n", path, addr);
+#ifdef CONFIG_WII
+	// No PCI on Wii, directly use the passed physical address.
+	ctrl = ehci_init((void *)addr);
+#else
+	ctrl = ehci_pci_init(addr);
+#endif
+	if (!ctrl)
+		return 0;
+
+	/* Init ports */
+	usb_poll();
+	usb_set_enum_property(ctrl, path);
+
+	return 1;
+}
@@ -0,0 +1,181 @@
+/*
+ * Driver for USB EHCI ported from CoreBoot
+ *
+ * This file was part of the libpayload project.
+ *
+ * Copyright (C) 2010 coresystems GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __EHCI_PRIVATE_H
+#define __EHCI_PRIVATE_H
+
+#include "libc/byteorder.h"
+#include "usb.h"
+
+#define EHCI_READ_CAPREG(ehci, field)		(USBHC_TO_CPU((ehci)->capabilities->field))
+#define EHCI_READ_OPREG(ehci, field)		(USBHC_TO_CPU((ehci)->operation->field))
+#define EHCI_WRITE_OPREG(ehci, field, val)	((ehci)->operation->field = CPU_TO_USBHC(val))
+
+typedef volatile u32 portsc_t;
+
+#define P_CURR_CONN_STATUS	(1 << 0)
+#define P_CONN_STATUS_CHANGE	(1 << 1)
+#define P_PORT_ENABLE		(1 << 2)
+#define P_PORT_ENABLE_CHANGE	(1 << 3)
+#define P_OVER_CURRENT_CHANGE	(1 << 5)
+#define P_PORT_RESET		(1 << 8)
+#define P_LINE_STATUS		(3 << 10)
+#define P_LINE_STATUS_LOWSPEED	(1 << 10)
+#define P_PP			(1 << 12)
+#define P_PORT_OWNER		(1 << 13)
+/* write-1-to-clear bits, masked out of every read-modify-write */
+#define P_RWC_BITS		(P_CONN_STATUS_CHANGE | P_PORT_ENABLE_CHANGE | P_OVER_CURRENT_CHANGE)
+
+typedef volatile struct {
+	u32 caplength_hciversion;	/* caplength in bits 0-7 */
+	u32 hcsparams;
+	u32 hccparams;
+	u32 hcsp_portroute[2];
+} __attribute__ ((packed)) hc_cap_t;
+
+#define HC_LENGTH(x)		((x) & 0xff)
+#define HC_VERSION(x)		(((x) >> 16) & 0xffff)
+
+#define HCS_NPORTS_MASK		0xf
+#define HCS_PORT_POWER_CONTROL	(1 << 4)
+#define HCS_N_CC_SHIFT		12
+#define HCS_N_CC_MASK		(0xf << HCS_N_CC_SHIFT)
+
+#define HCC_64BIT_ADDRESSING	(1 << 0)
+#define HCC_EECP_SHIFT		8
+#define HCC_EECP_MASK		(0xff << HCC_EECP_SHIFT)
+
+typedef volatile struct {
+	u32 usbcmd;
+	u32 usbsts;
+	u32 usbintr;
+	u32 frindex;
+	u32 ctrldssegment;
+	u32 periodiclistbase;
+	u32 asynclistaddr;
+	u32 reserved[9];
+	u32 configflag;
+	portsc_t portsc[0];
+} hc_op_t;
+
+#define HC_OP_RS		(1 << 0)
+#define HC_OP_HC_RESET		(1 << 1)
+#define HC_OP_PERIODIC_SCHED_EN	(1 << 4)
+#define HC_OP_ASYNC_SCHED_EN	(1 << 5)
+#define HC_OP_ITC_SHIFT		16
+
+#define HC_OP_HC_HALTED		(1 << 12)
+#define HC_OP_PERIODIC_SCHED_STAT (1 << 14)
+#define HC_OP_ASYNC_SCHED_STAT	(1 << 15)
+
+/* USBLEGSUP extended capability, handed over from BIOS on PCI controllers */
+#define EHCI_EECP_ID_LEGSUP	1
+#define EHCI_LEGSUP_BIOS_OWNED	(1 << 16)
+#define EHCI_LEGSUP_OS_OWNED	(1 << 24)
+
+/* Periodic frame list and horizontal link pointers */
+#define PS_TERMINATE		1
+#define PS_TYPE_QH		(1 << 1)
+#define PS_PTR_MASK		(~0x1f)
+
+/*
+ * Queue element transfer descriptor. 32 bytes, which is also the cache line
+ * size on the Wii, so each qTD can be flushed and invalidated on its own.
+ */
+typedef volatile struct {
+	u32 next_qtd;
+	u32 alt_next_qtd;
+	u32 token;
+	u32 bufptrs[5];
+} __attribute__ ((packed)) qtd_t;
+
+#define QTD_TERMINATE		1
+#define QTD_PING		(1 << 0)
+#define QTD_SPLIT_XACT_ERR	(1 << 1)
+#define QTD_MISSED_UFRAME	(1 << 2)
+#define QTD_XACT_ERR		(1 << 3)
+#define QTD_BABBLE		(1 << 4)
+#define QTD_DATA_BUF_ERR	(1 << 5)
+#define QTD_HALTED		(1 << 6)
+#define QTD_ACTIVE		(1 << 7)
+#define QTD_STATUS_MASK		0x7e	/* everything but ping state and active */
+#define QTD_PID_SHIFT		8
+#define QTD_CERR_SHIFT		10
+#define QTD_IOC			(1 << 15)
+#define QTD_TOTAL_LEN_SHIFT	16
+#define QTD_TOTAL_LEN_MASK	(0x7fff << QTD_TOTAL_LEN_SHIFT)
+#define QTD_TOGGLE_SHIFT	31
+#define QTD_TOGGLE_DATA1	(1 << QTD_TOGGLE_SHIFT)
+
+#define QTD_PAGE_SIZE		4096
+#define QTD_MAX_PAGES		5
+
+typedef enum { EHCI_OUT = 0, EHCI_IN = 1, EHCI_SETUP = 2 } ehci_pid_t;
+
+/*
+ * Queue head, with the transfer overlay area. Padded to 64 bytes so no other
+ * structure shares its cache lines.
+ */
+typedef volatile struct {
+	u32 horiz_link_ptr;
+	u32 epchar;
+	u32 epcaps;
+	u32 current_td_ptr;
+	qtd_t td;
+	u32 pad[4];
+} __attribute__ ((packed)) ehci_qh_t;
+
+#define QH_QH			(1 << 1)
+#define QH_EP_SHIFT		8
+#define QH_EPS_SHIFT		12
+#define QH_DTC			(1 << 14)
+#define QH_RECLAIM_HEAD		(1 << 15)
+#define QH_MPS_SHIFT		16
+#define QH_NON_HS_CTRL_EP	(1 << 27)
+#define QH_NAK_CNT_SHIFT	28
+
+#define QH_UFRAME_SMASK_SHIFT	0
+#define QH_UFRAME_CMASK_SHIFT	8
+#define QH_HUB_ADDRESS_SHIFT	16
+#define QH_PORT_NUMBER_SHIFT	23
+#define QH_PIPE_MULTIPLIER_SHIFT 30
+
+#define EHCI_INST(controller) ((ehci_t*)((controller)->instance))
+
+typedef struct ehci {
+	hc_cap_t *capabilities;
+	hc_op_t *operation;
+	ehci_qh_t *dummy_qh;
+	u32 *periodic_list;
+	usbdev_t *roothub;
+} ehci_t;
+
+#endif
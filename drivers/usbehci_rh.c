@@ -0,0 +1,242 @@
+/*
+ * Driver for USB EHCI ported from CoreBoot
+ *
+ * This file was part of the libpayload project.
+ *
+ * Copyright (C) 2010 coresystems GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "timer.h"
+#include "usbehci_private.h"
+#include "usbehci.h"
+
+typedef struct {
+	int n_ports;
+	/* typical C, n_ports is the number
+	 * of ports, while ports[] runs from
+	 * 0 to n_ports-1 */
+	portsc_t *ports;
+	int *devices;
+	int *scan;	/* ports to (re)attach together */
+} rh_inst_t;
+
+#define RH_INST(dev) ((rh_inst_t*)(dev)->data)
+
+#define READ_PORTSC(dev, port)		(USBHC_TO_CPU(RH_INST(dev)->ports[port]))
+#define WRITE_PORTSC(dev, port, val)	(RH_INST(dev)->ports[port] = CPU_TO_USBHC(val))
+
+/* Read-modify-write of a port register that leaves the change bits alone */
+static void
+ehci_rh_set_portsc (usbdev_t *dev, int port, u32 set, u32 clear)
+{
+	u32 portsc = READ_PORTSC(dev, port) & ~P_RWC_BITS;
+
+	WRITE_PORTSC(dev, port, (portsc & ~clear) | set);
+}
+
+/* Hand a port to the companion (OHCI) controller */
+static void
+ehci_rh_hand_over_port (usbdev_t *dev, int port)
+{
+	usb_debug("giving up port %x, it's USB1\n", port+1);
+
+	/* Lowspeed device. Hand over to companion */
+	ehci_rh_set_portsc(dev, port, P_PORT_OWNER, 0);
+	int timeout = 100; /* time out after 10ms */
+	while (!(READ_PORTSC(dev, port) & P_PORT_OWNER) && timeout--)
+		udelay(100);
+	if (timeout < 0)
+		usb_debug("Warning: port %d didn't go to its companion.\n", port+1);
+
+	/* clear connect status change */
+	WRITE_PORTSC(dev, port, (READ_PORTSC(dev, port) & ~P_RWC_BITS) | P_CONN_STATUS_CHANGE);
+}
+
+static int
+ehci_rh_port_status_changed (usbdev_t *dev, int port)
+{
+	if (!(READ_PORTSC(dev, port) & P_CONN_STATUS_CHANGE))
+		return 0;
+	/* RW/C register, so clear it by writing 1 */
+	WRITE_PORTSC(dev, port, (READ_PORTSC(dev, port) & ~P_RWC_BITS) | P_CONN_STATUS_CHANGE);
+	return 1;
+}
+
+static int
+ehci_rh_port_connected (usbdev_t *dev, int port)
+{
+	return (READ_PORTSC(dev, port) & P_CURR_CONN_STATUS) != 0;
+}
+
+static void
+ehci_rh_attach_port (usbdev_t *dev, int port)
+{
+	if (!ehci_rh_port_connected(dev, port))
+		return;
+
+	if ((READ_PORTSC(dev, port) & P_LINE_STATUS) == P_LINE_STATUS_LOWSPEED) {
+		ehci_rh_hand_over_port(dev, port);
+		return;
+	}
+
+	/* Reset the port for 50ms (usb20 spec 7.1.7.5). The controller
+	   completes the reset within 2ms once the bit is cleared. */
+	ehci_rh_set_portsc(dev, port, P_PORT_RESET, P_PORT_ENABLE);
+	usb_delay_ms(dev->controller, 50);
+	ehci_rh_set_portsc(dev, port, 0, P_PORT_RESET);
+	int timeout = 200; /* time out after 20ms */
+	while ((READ_PORTSC(dev, port) & P_PORT_RESET) && timeout--)
+		udelay(100);
+	if (timeout < 0) {
+		usb_debug("Error: ehci_rh: port reset timed out.\n");
+		return;
+	}
+
+	/* If the port isn't enabled after the reset, the device is
+	   full-speed and belongs to the companion (EHCI spec 4.2.2). */
+	if (!(READ_PORTSC(dev, port) & P_PORT_ENABLE)) {
+		ehci_rh_hand_over_port(dev, port);
+		return;
+	}
+	usb_debug("port %x hosts a USB2 device\n", port+1);
+
+	/* reset recovery time (usb20 spec 7.1.7.5) */
+	usb_delay_ms(dev->controller, 10);
+	RH_INST(dev)->devices[port] = usb_attach_device(dev->controller, dev->address, port, HIGH_SPEED);
+}
+
+/*
+ * Detaches whatever was on the given ports and attaches what is there now.
+ * The ports are debounced together, then reset and addressed one by one:
+ * a device answers at address 0 until it got its own, so only one port
+ * may come out of reset at a time.
+ */
+static void
+ehci_rh_scanports (usbdev_t *dev, int *ports, int count)
+{
+	int i, connected = 0;
+
+	for (i = 0; i < count; i++) {
+		if (RH_INST(dev)->devices[ports[i]]!=-1) {
+			usb_debug("Unregister device at port %x\n", ports[i]+1);
+			usb_detach_device(dev->controller, RH_INST(dev)->devices[ports[i]]);
+			RH_INST(dev)->devices[ports[i]]=-1;
+		}
+		if (ehci_rh_port_connected(dev, ports[i]))
+			ports[connected++] = ports[i];
+	}
+
+	if (usb_debounce_ports(dev, ports, connected,
+			       ehci_rh_port_status_changed, ehci_rh_port_connected) < 0)
+		return;
+
+	for (i = 0; i < connected; i++)
+		ehci_rh_attach_port(dev, ports[i]);
+}
+
+static void
+ehci_rh_destroy (usbdev_t *dev)
+{
+	int port;
+
+	/* Tear down devices on shutdown. */
+	for (port = 0; port < RH_INST(dev)->n_ports; ++port) {
+		if (RH_INST(dev)->devices[port] != -1) {
+			usb_debug("Unregister device at port %x\n", port+1);
+			usb_detach_device(dev->controller,
+					  RH_INST(dev)->devices[port]);
+			RH_INST(dev)->devices[port] = -1;
+		}
+	}
+
+	free(RH_INST(dev)->scan);
+	free(RH_INST(dev)->devices);
+	free(RH_INST(dev));
+}
+
+static void
+ehci_rh_poll (usbdev_t *dev)
+{
+	int port, count = 0;
+
+	/* Scan all ports with changed connection status at once. */
+	for (port = 0; port < RH_INST(dev)->n_ports; port++) {
+		if (ehci_rh_port_status_changed(dev, port))
+			RH_INST(dev)->scan[count++] = port;
+	}
+	if (count)
+		ehci_rh_scanports(dev, RH_INST(dev)->scan, count);
+}
+
+void
+ehci_rh_init (usbdev_t *dev)
+{
+	int i;
+
+	dev->destroy = ehci_rh_destroy;
+	dev->poll = ehci_rh_poll;
+
+	dev->data = malloc(sizeof(rh_inst_t));
+	if (!dev->data) {
+		printk("Not enough memory for EHCI RH.\n");
+		return;
+	}
+
+	RH_INST(dev)->n_ports = EHCI_READ_CAPREG(EHCI_INST(dev->controller), hcsparams) & HCS_NPORTS_MASK;
+	RH_INST(dev)->ports = EHCI_INST(dev->controller)->operation->portsc;
+
+	usb_debug("root hub has %x ports\n", RH_INST(dev)->n_ports);
+
+	/* If the controller has port power control, all ports start out unpowered */
+	if (EHCI_READ_CAPREG(EHCI_INST(dev->controller), hcsparams) & HCS_PORT_POWER_CONTROL) {
+		for (i=0; i < RH_INST(dev)->n_ports; i++)
+			ehci_rh_set_portsc(dev, i, P_PP, 0);
+		/* Wait for power good, 20ms is the usual worst case */
+		usb_delay_ms(dev->controller, 20);
+	}
+
+	/* split transactions look for the closest high-speed hub */
+	dev->speed = HIGH_SPEED;
+
+	RH_INST(dev)->devices = malloc(RH_INST(dev)->n_ports * sizeof(int));
+	RH_INST(dev)->scan = malloc(RH_INST(dev)->n_ports * sizeof(int));
+	for (i=0; i < RH_INST(dev)->n_ports; i++) {
+		RH_INST(dev)->devices[i] = -1;
+		RH_INST(dev)->scan[i] = i;
+		ehci_rh_port_status_changed(dev, i);
+	}
+
+	/* we can set them here because a root hub _really_ shouldn't
+	   appear elsewhere */
+	dev->address = 0;
+	dev->hub = -1;
+	dev->port = -1;
+
+	ehci_rh_scanports(dev, RH_INST(dev)->scan, RH_INST(dev)->n_ports);
+
+	usb_debug("rh init done\n");
+}
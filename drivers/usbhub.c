@@ -194,22 +194,24 @@ static const generic_hub_ops_t usb_hub_ops = {
 	.reset_port		= generic_hub_resetport,
 };
 
-/* Clear CSC if set and enumerate port if it's connected regardless of change
-   bits. Some broken hubs don't set CSC if already connected during reset. */
-static void
+/* Clear CSC if set and report the port for enumeration if it's connected
+   regardless of change bits. Some broken hubs don't set CSC if already
+   connected during reset. */
+static int
 usb_hub_port_initialize(usbdev_t *const dev, const int port)
 {
 	unsigned short buf[2];
 	int ret = get_status(dev, port, DR_PORT, sizeof(buf), buf);
 	if (ret < 0)
-		return;
+		return 0;
 
 	if (__le16_to_cpu(buf[1]) & PORT_CONNECTION)
 		clear_feature(dev, port, SEL_C_PORT_CONNECTION, DR_PORT);
 	if (__le16_to_cpu(buf[0]) & PORT_CONNECTION) {
 		usb_debug("usbhub: Port coldplug at %d\n", port);
-		generic_hub_scanport(dev, port);
+		return 1;
 	}
+	return 0;
 }
 
 static int
@@ -250,12 +252,12 @@ usb_hub_handle_port_change(usbdev_t *const dev, const int port)
 	if (buf[1] & ~checked_bits)
 		usb_debug("usbhub: Spurious change bit at port %d\n", port);
 
-	/* Now, handle connection changes. */
+	/* Connection changes are left to the caller, to scan them together. */
 	if (buf[1] & PORT_CONNECTION) {
 		usb_debug("usbhub: Port change at %d\n", port);
-		ret = generic_hub_scanport(dev, port);
+		return 1;
 	}
-	return ret;
+	return 0;
 }
 
 static void
@@ -273,13 +275,27 @@ usb_hub_poll(usbdev_t *const dev)
 			buf[i] |= ibuf[i];
 	}
 
+	int *const ports = malloc(sizeof(*ports) * GEN_HUB(dev)->num_ports);
+	int count = 0;
+	if (!ports)
+		return;
+
 	for (port = 1; port <= GEN_HUB(dev)->num_ports; ++port) {
 		/* ports start at bit1; bit0 is hub status change */
 		if (buf[port / 8] & (1 << (port % 8))) {
-			if (usb_hub_handle_port_change(dev, port) < 0)
+			const int ret = usb_hub_handle_port_change(dev, port);
+			if (ret < 0) {
+				free(ports);
 				return;
+			} else if (ret) {
+				ports[count++] = port;
+			}
 		}
 	}
+
+	if (count)
+		generic_hub_scanports(dev, ports, count);
+	free(ports);
 }
 
 static void
@@ -340,9 +356,15 @@ usb_hub_init(usbdev_t *const dev)
 		return;
 	}
 
-	int port;
-	for (port = 1; port <= num_ports; ++port)
-		usb_hub_port_initialize(dev, port);
+	int *const ports = malloc(sizeof(*ports) * num_ports);
+	int port, count = 0;
+	for (port = 1; port <= num_ports; ++port) {
+		if (usb_hub_port_initialize(dev, port) && ports)
+			ports[count++] = port;
+	}
+	if (count)
+		generic_hub_scanports(dev, ports, count);
+	free(ports);
 
 	GEN_HUB(dev)->data = intrq;
 	dev->poll = usb_hub_poll;
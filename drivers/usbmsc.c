@@ -84,8 +84,10 @@ static const char *msc_protocol_strings[0x51] = {
 
 const int DEV_RESET = 0xff;
 const int GET_MAX_LUN = 0xfe;
-/* Due to bounce buffer requirements, limit to 4KB chunk */
-const int MAX_CHUNK_BYTES = 1024 * 4;
+/* One CBW moves up to MAX_CHUNK_BYTES; devices that fail such transfers
+   are stepped down towards MIN_CHUNK_BYTES */
+const int MAX_CHUNK_BYTES = 1024 * 64;
+const int MIN_CHUNK_BYTES = 1024 * 4;
 
 const unsigned int cbw_signature = 0x43425355;
 const unsigned int csw_signature = 0x53425355;
@@ -128,6 +130,10 @@ static int
 request_sense_no_media(usbdev_t *dev);
 static void
 usb_msc_poll(usbdev_t *dev);
+static void
+usb_msc_destroy(usbdev_t *dev);
+
+extern hci_t *usb_hcs;
 
 static int
 reset_transport(usbdev_t *dev)
@@ -309,6 +315,15 @@ typedef struct {
 	unsigned char control;	//9 - the block is 10 bytes long
 } __attribute__ ((packed)) cmdblock_t;
 
+typedef struct {
+	unsigned char command;	//0
+	unsigned char service;	//1 - service action for READ CAPACITY(16)
+	u64 block;		//2-9
+	unsigned int numblocks;	//10-13 - allocation length for READ CAPACITY(16)
+	unsigned char res1;	//14
+	unsigned char control;	//15 - the block is 16 bytes long
+} __attribute__ ((packed)) cmdblock16_t;
+
 typedef struct {
 	unsigned char command;	//0
 	unsigned char res1;	//1
@@ -338,7 +353,7 @@ typedef struct {
  * @return 0 on success, 1 on failure
  */
 int
-readwrite_blocks_512(usbdev_t *dev, int start, int n,
+readwrite_blocks_512(usbdev_t *dev, u64 start, int n,
 	cbw_direction dir, u8 *buf)
 {
 	int blocksize_divider = MSC_INST(dev)->blocksize / 512;
@@ -346,44 +361,74 @@ readwrite_blocks_512(usbdev_t *dev, int start, int n,
 		n / blocksize_divider, dir, buf);
 }
 
+static usbmsc_stats_t *
+msc_stats(usbmsc_inst_t *msc)
+{
+	return &msc->stats[MIN(msc->lun, USB_MSC_STATS_LUNS - 1)];
+}
+
 /**
- * Reads or writes a number of sequential blocks on a USB storage device.
- * As it uses the READ(10) SCSI-2 command, it's limited to storage devices
- * of at most 2TB. It assumes sectors of 512 bytes.
+ * Reads or writes a number of sequential blocks on a USB storage device
+ * with a single command. READ(10)/WRITE(10) is used unless the range
+ * reaches past 2^32 blocks, which needs READ(16)/WRITE(16).
  *
  * @param dev device to access
  * @param start first sector to access
  * @param n number of sectors to access
  * @param dir direction of access: cbw_direction_data_in == read, cbw_direction_data_out == write
  * @param buf buffer to read into or write from. Must be at least n*sectorsize bytes
- * @return 0 on success, 1 on failure
+ * @return MSC_COMMAND_OK, MSC_COMMAND_FAIL or MSC_COMMAND_DETACHED
  */
 static int
-readwrite_chunk(usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf)
+readwrite_chunk(usbdev_t *dev, u64 start, int n, cbw_direction dir, u8 *buf)
 {
-	cmdblock_t cb;
-	memset(&cb, 0, sizeof(cb));
-	if (dir == cbw_direction_data_in) {
-		// read
-		cb.command = 0x28;
+	usbmsc_stats_t *stats = msc_stats(MSC_INST(dev));
+	int len = n * MSC_INST(dev)->blocksize;
+	u64 start_time;
+	int ret;
+
+	start_time = usb_get_time_us();
+	if (start + n > 0xffffffffULL) {
+		cmdblock16_t cb;
+		memset(&cb, 0, sizeof(cb));
+		cb.command = (dir == cbw_direction_data_in) ? 0x88 : 0x8a;
+		cb.block = __cpu_to_be64(start);
+		cb.numblocks = __cpu_to_be32(n);
+		ret = execute_command(dev, dir, (u8 *) &cb, sizeof(cb), buf,
+				      len, 0);
 	} else {
-		// write
-		cb.command = 0x2a;
+		cmdblock_t cb;
+		memset(&cb, 0, sizeof(cb));
+		if (dir == cbw_direction_data_in) {
+			// read
+			cb.command = 0x28;
+		} else {
+			// write
+			cb.command = 0x2a;
+		}
+		cb.block = __cpu_to_be32(start);
+		cb.numblocks = __cpu_to_be16(n);
+		ret = execute_command(dev, dir, (u8 *) &cb, sizeof(cb), buf,
+				      len, 0);
 	}
-	cb.block = __cpu_to_be32(start);
-	cb.numblocks = __cpu_to_be16(n);
 
-	return execute_command(dev, dir, (u8 *) &cb, sizeof(cb), buf,
-				n * MSC_INST(dev)->blocksize, 0)
-		!= MSC_COMMAND_OK ? 1 : 0;
+	/* only completed transfers count, failures show up as retries */
+	if (ret == MSC_COMMAND_OK) {
+		stats->commands++;
+		stats->time_us += usb_get_time_us() - start_time;
+		stats->bytes += len;
+	}
+	return ret;
 }
 
 /**
  * Reads or writes a number of sequential blocks on a USB storage device
- * that is split into MAX_CHUNK_BYTES size requests.
- *
- * As it uses the READ(10) SCSI-2 command, it's limited to storage devices
- * of at most 2TB. It assumes sectors of 512 bytes.
+ * that is split into requests of up to max_chunk_bytes. A failed request
+ * is retried once at the same size, then with the size halved down to
+ * MIN_CHUNK_BYTES, as some devices can't handle large transfers. The
+ * device's max_chunk_bytes only drops once the whole range that failed
+ * has been transferred at the smaller size, so a bad sector, which fails
+ * at any size, doesn't shrink later transfers.
  *
  * @param dev device to access
  * @param start first sector to access
@@ -395,27 +440,52 @@ readwrite_chunk(usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf)
  * @return 0 on success, 1 on failure
  */
 int
-readwrite_blocks(usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf)
+readwrite_blocks(usbdev_t *dev, u64 start, int n, cbw_direction dir, u8 *buf)
 {
-	int chunk_size = MAX_CHUNK_BYTES / MSC_INST(dev)->blocksize;
+	usbmsc_inst_t *msc = MSC_INST(dev);
+	unsigned int chunk_bytes = msc->max_chunk_bytes;
+	u64 failed_end = 0;	/* end of the ranges that failed at a larger size */
+	int retried = 0;
 	int chunk;
 
-	/* Read as many full chunks as needed. */
-	for (chunk = 0; chunk < (n / chunk_size); chunk++) {
-		if (readwrite_chunk(dev, start + (chunk * chunk_size),
-				     chunk_size, dir,
-				     buf + (chunk * MAX_CHUNK_BYTES))
-		    != MSC_COMMAND_OK)
-			return 1;
-	}
+	while (n > 0) {
+		chunk = MAX(chunk_bytes / msc->blocksize, 1);
+		if (chunk > n)
+			chunk = n;
 
-	/* Read any remaining partial chunk at the end. */
-	if (n % chunk_size) {
-		if (readwrite_chunk(dev, start + (chunk * chunk_size),
-				     n % chunk_size, dir,
-				     buf + (chunk * MAX_CHUNK_BYTES))
-		    != MSC_COMMAND_OK)
+		switch (readwrite_chunk(dev, start, chunk, dir, buf)) {
+		case MSC_COMMAND_OK:
+			if (chunk_bytes < msc->max_chunk_bytes &&
+			    start + chunk >= failed_end) {
+				msc->max_chunk_bytes = chunk_bytes;
+				usb_debug("MSC: stepped down to %u byte chunks\n",
+					msc->max_chunk_bytes);
+			}
+			retried = 0;
+			break;
+		case MSC_COMMAND_FAIL:
+			if (!retried) {
+				retried = 1;
+				msc_stats(msc)->retries++;
+				continue;
+			}
+			chunk_bytes = MIN(chunk_bytes, chunk * msc->blocksize);
+			if (chunk_bytes > MIN_CHUNK_BYTES) {
+				failed_end = MAX(failed_end, start + chunk);
+				chunk_bytes /= 2;
+				msc_stats(msc)->retries++;
+				usb_debug("MSC: retrying with %u byte chunks\n",
+					chunk_bytes);
+				continue;
+			}
 			return 1;
+		default:
+			return 1;
+		}
+
+		start += chunk;
+		buf += chunk * msc->blocksize;
+		n -= chunk;
 	}
 
 	return 0;
@@ -487,6 +557,30 @@ spin_up(usbdev_t *dev)
 				sizeof(cb), 0, 0, 0);
 }
 
+static int
+read_capacity16(usbdev_t *dev)
+{
+	cmdblock16_t cb;
+	u32 buf[8];
+	int ret;
+
+	memset(&cb, 0, sizeof(cb));
+	cb.command = 0x9e;	// service action in
+	cb.service = 0x10;	// read capacity (16)
+	cb.numblocks = __cpu_to_be32(sizeof(buf));
+
+	memset(buf, 0, sizeof(buf));
+	ret = execute_command(dev, cbw_direction_data_in, (u8 *) &cb,
+				sizeof(cb), (u8 *)buf, sizeof(buf), 1);
+	if (ret)
+		return ret;
+
+	MSC_INST(dev)->numblocks = ((((u64)__be32_to_cpu(buf[0])) << 32) |
+		__be32_to_cpu(buf[1])) + 1;
+	MSC_INST(dev)->blocksize = __be32_to_cpu(buf[2]);
+	return MSC_COMMAND_OK;
+}
+
 static int
 read_capacity(usbdev_t *dev)
 {
@@ -515,15 +609,22 @@ read_capacity(usbdev_t *dev)
 		usb_debug("  assuming 2 TB with 512-byte sectors as READ CAPACITY didn't answer.\n");
 		MSC_INST(dev)->numblocks = 0xffffffff;
 		MSC_INST(dev)->blocksize = 512;
+	} else if (__be32_to_cpu(buf[0]) == 0xffffffff) {
+		/* more than 2^32 blocks, the real size needs READ CAPACITY(16) */
+		ret = read_capacity16(dev);
+		if (ret == MSC_COMMAND_DETACHED)
+			return ret;
+		if (ret) {
+			usb_debug("  READ CAPACITY(16) failed, using the first 2^32 blocks.\n");
+			MSC_INST(dev)->numblocks = 0xffffffff;
+			MSC_INST(dev)->blocksize = __be32_to_cpu(buf[1]);
+		}
 	} else {
-		MSC_INST(dev)->numblocks = MIN(__be32_to_cpu(buf[0]), UINT_MAX - 1) + 1;
+		MSC_INST(dev)->numblocks = (u64)__be32_to_cpu(buf[0]) + 1;
 		MSC_INST(dev)->blocksize = __be32_to_cpu(buf[1]);
 	}
-	usb_debug("  %u %u-byte sectors (%u MB)\n", MSC_INST(dev)->numblocks,
+	usb_debug("  %llu %u-byte sectors (%llu MB)\n", MSC_INST(dev)->numblocks,
 		MSC_INST(dev)->blocksize,
-		/* round down high block counts to avoid integer overflow */
-		MSC_INST(dev)->numblocks > 1000000
-			? (MSC_INST(dev)->numblocks / 1000) * MSC_INST(dev)->blocksize / 1000 :
 		MSC_INST(dev)->numblocks * MSC_INST(dev)->blocksize / 1000 / 1000);
 	return MSC_COMMAND_OK;
 }
@@ -602,7 +703,8 @@ usb_msc_test_unit_ready(usbdev_t *dev)
 //
 static void ob_usbmsc_max_transfer(int *idx)
 {
-    PUSH(MAX_CHUNK_BYTES);
+    usbdev_t *dev = *(usbdev_t **)idx;
+    PUSH(MSC_INST(dev)->max_chunk_bytes);
 }
 
 //
@@ -625,6 +727,26 @@ static void ob_usbmsc_read_blocks(int *idx)
     PUSH(cnt);
 }
 
+//
+// OF: Write blocks.
+//
+static void ob_usbmsc_write_blocks(int *idx)
+{
+    cell n = POP(), cnt=n;
+    ucell blk = POP();
+    unsigned char *src = (unsigned char *)cell2pointer(POP());
+    usbdev_t *dev = *(usbdev_t **)idx;
+
+    usb_debug("ob_usbmsc_write_blocks: %lx block=%ld n=%ld\n", (unsigned long)src, (unsigned long)blk, (long)n);
+
+    if (readwrite_blocks(dev, blk, n, cbw_direction_data_out, src)) {
+        usb_debug("ob_usbmsc_write_blocks: error\n");
+        RET(0);
+    }
+
+    PUSH(cnt);
+}
+
 //
 // OF: Gets the block size.
 //
@@ -696,6 +818,7 @@ NODE_METHODS(ob_usbmsc) = {
     { "open",			ob_usbmsc_open			},
     { "close",			ob_usbmsc_close			},
     { "read-blocks",	ob_usbmsc_read_blocks	},
+    { "write-blocks",	ob_usbmsc_write_blocks	},
     { "block-size",		ob_usbmsc_block_size	},
     { "max-transfer",	ob_usbmsc_max_transfer	},
     { "dma-alloc",		ob_usbmsc_dma_alloc	    },
@@ -705,6 +828,38 @@ NODE_METHODS(ob_usbmsc) = {
     { "dma-sync",		ob_usbmsc_dma_sync		},
 };
 
+/* ( -- ) */
+void usb_msc_stats(void)
+{
+	hci_t *controller;
+	usbdev_t *dev;
+	usbmsc_stats_t *stats;
+	int i, lun, found = 0;
+
+	for (controller = usb_hcs; controller != NULL; controller = controller->next) {
+		for (i = 0; i < 128; i++) {
+			dev = controller->devices[i];
+			if (dev == NULL || dev->destroy != usb_msc_destroy || dev->data == NULL)
+				continue;
+
+			printk("usb %x device %d: %u byte chunks\n",
+			       controller->reg_base, dev->address,
+			       MSC_INST(dev)->max_chunk_bytes);
+			for (lun = 0; lun < MIN(MAX(MSC_INST(dev)->num_luns, 1), USB_MSC_STATS_LUNS); lun++) {
+				stats = &MSC_INST(dev)->stats[lun];
+				printk("  lun %d: %u commands, %lu KB, %u retries, %lu us average\n",
+				       lun, stats->commands, (unsigned long)(stats->bytes / 1024),
+				       stats->retries,
+				       (unsigned long)(stats->commands ? stats->time_us / stats->commands : 0));
+			}
+			found = 1;
+		}
+	}
+
+	if (!found)
+		printk("no USB mass storage devices\n");
+}
+
 static void set_ud_alias(const char *path)
 {
     phandle_t aliases;
@@ -818,6 +973,8 @@ void usb_msc_force_init(usbdev_t *dev, u32 quirks)
 	MSC_INST(dev)->bulk_out = 0;
 	MSC_INST(dev)->usbdisk_created = 0;
 	MSC_INST(dev)->quirks = quirks;
+	MSC_INST(dev)->max_chunk_bytes = MAX_CHUNK_BYTES;
+	memset(MSC_INST(dev)->stats, 0, sizeof(MSC_INST(dev)->stats));
 
 	for (i = 1; i <= dev->num_endp; i++) {
 		if (dev->endpoints[i].endpoint == 0)
@@ -49,6 +49,7 @@ static void ohci_start (hci_t *controller);
 static void ohci_stop (hci_t *controller);
 static void ohci_reset (hci_t *controller);
 static void ohci_shutdown (hci_t *controller);
+static void ohci_destroy_device (hci_t *controller, int devaddr);
 static int ohci_bulk (endpoint_t *ep, int size, u8 *data, int finalize);
 static int ohci_control (usbdev_t *dev, direction_t dir, int drlen, void *devreq,
 			 int dalen, u8 *data);
@@ -146,6 +147,90 @@ dump_ed (ed_t *cur)
 }
 #endif
 
+/*
+ * Every endpoint keeps one ED on the control or bulk list for as long as the
+ * device exists. Transfers are queued behind its dummy TD, so the lists never
+ * have to be stopped for a transfer.
+ */
+struct _async_ed {
+	ed_t			ed;
+	struct _async_ed	*next;
+	td_t			*tail;	/* current dummy TD */
+	u32			key;	/* function address, endpoint and direction */
+};
+
+typedef struct _async_ed async_ed_t;
+
+#define ED_KEY_MASK (ED_FUNC_MASK | ED_EP_MASK | ED_DIR_MASK)
+
+static u16
+ohci_frame_number (ohci_t *const ohci)
+{
+	return READ_OPREG(ohci, HcFmNumber) & 0xffff;
+}
+
+static int
+ohci_hc_frame_number (hci_t *controller)
+{
+	return ohci_frame_number(OHCI_INST(controller)) & USB_FRAME_MASK;
+}
+
+/* Waits for the given number of frame boundaries. */
+static void
+ohci_wait_frames (ohci_t *const ohci, const int frames)
+{
+	const u16 start = ohci_frame_number(ohci);
+	int timeout = frames * 10 + 10; /* 100us steps, in case the frame counter stopped */
+
+	while ((u16)(ohci_frame_number(ohci) - start) < frames && timeout--)
+		udelay(100);
+}
+
+static td_t *
+ohci_alloc_td (ohci_t *const ohci)
+{
+	td_t *td = ohci->td_free;
+
+	if (td) {
+		ohci->td_free = td->next_td ? (td_t *)phys_to_virt(td->next_td) : NULL;
+	} else if (ofmem_posix_memalign((void **)&td, sizeof(td_t), sizeof(td_t))) {
+		return NULL;
+	}
+	memset((void *)td, 0, sizeof(*td));
+	return td;
+}
+
+static void
+ohci_free_td (ohci_t *const ohci, td_t *const td)
+{
+	if (ohci->td_pool && (td >= ohci->td_pool) && (td < ohci->td_pool + OHCI_TD_POOL_SIZE)) {
+		/* The free list is only used by the CPU, so it stays in native byte order. */
+		td->next_td = ohci->td_free ? virt_to_phys(ohci->td_free) : 0;
+		ohci->td_free = td;
+	} else {
+		free((void *)td);
+	}
+}
+
+/*
+ * Gives back the TDs linked behind first_td up to last_td when a transfer
+ * can't be set up. first_td is the ED's dummy and stays with the ED.
+ */
+static void
+ohci_drop_tds (ohci_t *const ohci, td_t *const first_td, td_t *const last_td)
+{
+	td_t *td = first_td;
+
+	while (td != last_td) {
+		td_t *const next = (td_t *)phys_to_virt(__le32_to_cpu(td->next_td));
+		if (td != first_td)
+			ohci_free_td(ohci, td);
+		td = next;
+	}
+	if (last_td != first_td)
+		ohci_free_td(ohci, last_td);
+}
+
 static void
 ohci_reset (hci_t *controller)
 {
@@ -192,7 +277,8 @@ ohci_init (void *bar)
 	controller->control = ohci_control;
 	controller->set_address = generic_set_address;
 	controller->finish_device_config = NULL;
-	controller->destroy_device = NULL;
+	controller->destroy_device = ohci_destroy_device;
+	controller->frame_number = ohci_hc_frame_number;
 	controller->create_intr_queue = ohci_create_intr_queue;
 	controller->destroy_intr_queue = ohci_destroy_intr_queue;
 	controller->poll_intr_queue = ohci_poll_intr_queue;
@@ -244,9 +330,27 @@ ohci_init (void *bar)
 	DC_FLUSH(ohci->hcca, sizeof (ohci->hcca));
 	OHCI_INST (controller)->periodic_ed = periodic_ed;
 
+	/* TD pool for async transfers. Without it TDs are allocated one by one. */
+	ohci->td_free = NULL;
+	if (ofmem_posix_memalign((void **)&ohci->td_pool, sizeof(td_t), OHCI_TD_POOL_SIZE * sizeof(td_t))) {
+		ohci->td_pool = NULL;
+	} else {
+		for (i = OHCI_TD_POOL_SIZE - 1; i >= 0; --i)
+			ohci_free_td(ohci, &ohci->td_pool[i]);
+	}
+	ohci->control_eds = NULL;
+	ohci->bulk_eds = NULL;
+#if CONFIG_WII
+	ohci->bounce = NULL;
+	ohci->bounce_size = 0;
+#endif
+
 	OHCI_INST (controller)->opreg->HcHCCA = CPU_TO_USBHC(virt_to_phys(OHCI_INST(controller)->hcca));
-	/* Make sure periodic schedule is enabled. */
-	OHCI_INST (controller)->opreg->HcControl |= CPU_TO_USBHC(PeriodicListEnable);
+	/* Make sure periodic schedule is enabled. The control and bulk lists stay
+	   enabled too, endpoints without queued TDs are skipped by the HC. */
+	OHCI_INST (controller)->opreg->HcControlHeadED = 0;
+	OHCI_INST (controller)->opreg->HcBulkHeadED = 0;
+	OHCI_INST (controller)->opreg->HcControl |= CPU_TO_USBHC(PeriodicListEnable | ControlListEnable | BulkListEnable);
 	OHCI_INST (controller)->opreg->HcControl &= CPU_TO_USBHC(~IsochronousEnable); // unused by this driver
 	// disable everything, contrary to what OHCI spec says in 5.1.1.4, as we don't need IRQs
 	OHCI_INST (controller)->opreg->HcInterruptEnable = CPU_TO_USBHC(1<<31);
@@ -297,6 +401,23 @@ ohci_shutdown (hci_t *controller)
 	OHCI_INST (controller)->roothub->destroy (OHCI_INST (controller)->
 						  roothub);
 	controller->reset (controller);
+	while (OHCI_INST (controller)->control_eds) {
+		async_ed_t *const aed = OHCI_INST (controller)->control_eds;
+		OHCI_INST (controller)->control_eds = aed->next;
+		ohci_free_td (OHCI_INST (controller), aed->tail);
+		free ((void *)aed);
+	}
+	while (OHCI_INST (controller)->bulk_eds) {
+		async_ed_t *const aed = OHCI_INST (controller)->bulk_eds;
+		OHCI_INST (controller)->bulk_eds = aed->next;
+		ohci_free_td (OHCI_INST (controller), aed->tail);
+		free ((void *)aed);
+	}
+	free ((void *)OHCI_INST (controller)->td_pool);
+#if CONFIG_WII
+	if (OHCI_INST (controller)->bounce)
+		free (OHCI_INST (controller)->bounce);
+#endif
 	free ((void *)OHCI_INST (controller)->periodic_ed);
 	free (OHCI_INST (controller));
 	free (controller);
@@ -314,90 +435,286 @@ ohci_stop (hci_t *controller)
 // TODO: turn off all operation of OHCI
 }
 
+/*
+ * Looks up the ED for an endpoint, creating and linking a new one on first use.
+ * Returns NULL if a new ED can't be allocated.
+ */
+static async_ed_t *
+ohci_get_async_ed (ohci_t *const ohci, const u32 key)
+{
+	const int control = ((key & ED_DIR_MASK) >> ED_DIR_SHIFT) == OHCI_FROM_TD;
+	async_ed_t **const list = control ? &ohci->control_eds : &ohci->bulk_eds;
+	async_ed_t *aed;
+
+	for (aed = *list; aed; aed = aed->next) {
+		if (aed->key == key)
+			return aed;
+	}
+
+	if (ofmem_posix_memalign((void **)&aed, sizeof(ed_t), sizeof(*aed)))
+		return NULL;
+	memset((void *)aed, 0, sizeof(*aed));
+	aed->key = key;
+	aed->tail = ohci_alloc_td(ohci);
+	if (!aed->tail) {
+		free((void *)aed);
+		return NULL;
+	}
+	DC_FLUSH(aed->tail, sizeof (*aed->tail));
+
+	aed->ed.config = __cpu_to_le32(key);
+	aed->ed.tail_pointer = __cpu_to_le32(virt_to_phys(aed->tail));
+	aed->ed.head_pointer = aed->ed.tail_pointer;
+	aed->ed.next_ed = *list ? __cpu_to_le32(virt_to_phys(&(*list)->ed)) : 0;
+	DC_FLUSH(&aed->ed, sizeof (aed->ed));
+
+	/* The HC picks up a new list head at its next pass, no need to stop it. */
+	if (control)
+		ohci->opreg->HcControlHeadED = CPU_TO_USBHC(virt_to_phys(&aed->ed));
+	else
+		ohci->opreg->HcBulkHeadED = CPU_TO_USBHC(virt_to_phys(&aed->ed));
+	aed->next = *list;
+	*list = aed;
+
+	usb_debug("ohci: new ED %lx for %x\n", virt_to_phys(&aed->ed), key);
+	return aed;
+}
+
+/* Sets up an idle ED for the next transfer. The HC doesn't write back EDs without TDs. */
+static void
+ohci_prepare_ed (async_ed_t *const aed, const u32 config, const int toggle)
+{
+	aed->ed.config = __cpu_to_le32(config);
+	aed->ed.head_pointer = __cpu_to_le32(virt_to_phys(aed->tail) | (toggle ? ED_TOGGLE : 0));
+	DC_FLUSH(&aed->ed, sizeof (aed->ed));
+}
+
+/*
+ * Takes back the TDs still queued on an ED after an error or timeout. The
+ * list is stopped for a frame first, so the HC no longer works on the ED.
+ */
+static void
+ohci_cancel_ed (ohci_t *const ohci, async_ed_t *const aed, const u32 list_enable)
+{
+	ohci->opreg->HcControl &= CPU_TO_USBHC(~list_enable);
+	ohci_wait_frames(ohci, 1);
+
+	DC_INVALIDATE(&aed->ed, sizeof (aed->ed));
+	u32 head = __le32_to_cpu(aed->ed.head_pointer);
+	while ((head & ~0xf) != virt_to_phys(aed->tail)) {
+		td_t *const cur_td = (td_t *)phys_to_virt(head & ~0xf);
+		DC_INVALIDATE(cur_td, sizeof (*cur_td));
+		head = __le32_to_cpu(cur_td->next_td) | (head & ED_TOGGLE);
+		ohci_free_td(ohci, cur_td);
+	}
+	/* Restart at the dummy TD, which also clears the halted flag. */
+	aed->ed.head_pointer = __cpu_to_le32(head & ~ED_HALTED);
+	DC_FLUSH(&aed->ed, sizeof (aed->ed));
+
+	ohci->opreg->HcControl |= CPU_TO_USBHC(list_enable);
+}
+
+/*
+ * Appends the TDs prepared in front of new_tail to the ED and waits until the
+ * HC has worked through them. Retired TDs go back to the pool through the
+ * done queue.
+ */
 static int
-wait_for_ed(usbdev_t *dev, ed_t *head, int pages)
+ohci_run_ed (ohci_t *const ohci, async_ed_t *const aed, td_t *const new_tail,
+	     const u32 list_filled, const u32 list_enable, const int pages)
 {
-	usb_debug("Waiting for %d pages on dev %p with head %p\n", pages, dev, head);
-	/* wait for results */
+	const u32 tail = virt_to_phys(new_tail);
+	u32 head;
+	int failure = 0;
+
+	DC_FLUSH(new_tail, sizeof (*new_tail));
+	aed->tail = new_tail;
+	aed->ed.tail_pointer = __cpu_to_le32(tail);
+	DC_FLUSH(&aed->ed, sizeof (aed->ed));
+	ohci->opreg->HcCommandStatus = CPU_TO_USBHC(list_filled);
+
+#ifdef USB_DEBUG_ED
+	dump_ed(&aed->ed);
+#endif
+
 	/* TOTEST: how long to wait?
 	 *         give 2s per TD (2 pages) plus another 2s for now
 	 */
-	int timeout = pages*1000 + 2000;
-	DC_INVALIDATE(head, sizeof (*head));
-	while (((__le32_to_cpu(head->head_pointer) & ~3) != __le32_to_cpu(head->tail_pointer)) &&
-		!(__le32_to_cpu(head->head_pointer) & 1) &&
-		((__le32_to_cpu((((td_t*)phys_to_virt(__le32_to_cpu(head->head_pointer) & ~3)))->config)
-		& TD_CC_MASK) >= TD_CC_NOACCESS) && timeout--) {
-		/* don't log every ms */
-		if (!(timeout % 100))
-		usb_debug("intst: %x; ctrl: %x; cmdst: %x; head: %x -> %x, tail: %x, condition: %x\n",
-			  READ_OPREG(OHCI_INST(dev->controller), HcInterruptStatus),
-			  READ_OPREG(OHCI_INST(dev->controller), HcControl),
-			  READ_OPREG(OHCI_INST(dev->controller), HcCommandStatus),
-			__le32_to_cpu(head->head_pointer),
-			__le32_to_cpu(((td_t*)phys_to_virt(__le32_to_cpu(head->head_pointer) & ~3))->next_td),
-			__le32_to_cpu(head->tail_pointer),
-			(__le32_to_cpu(((td_t*)phys_to_virt(__le32_to_cpu(head->head_pointer) & ~3))->config) & TD_CC_MASK) >> TD_CC_SHIFT);
-		mdelay(1);
-		DC_INVALIDATE(head, sizeof (*head));
-	}
-	if (timeout < 0)
-		usb_debug("Error: ohci: endpoint "
-			"descriptor processing timed out.\n");
-	/* Clear the done queue. */
-	ohci_process_done_queue(OHCI_INST(dev->controller), 1);
-
-	if (__le32_to_cpu(head->head_pointer) & 1) {
-		usb_debug("HALTED!\n");
-		return 1;
+	const int timeout = pages*1000 + 2000;
+	u16 last_frame = ohci_frame_number(ohci);
+	int frames = 0;
+	while (1) {
+		DC_INVALIDATE(&aed->ed, sizeof (aed->ed));
+		head = __le32_to_cpu(aed->ed.head_pointer);
+		/* An error in the last TD both halts the ED and empties it. */
+		if (head & ED_HALTED) {
+			usb_debug("HALTED!\n");
+			failure = 1;
+			break;
+		}
+		if ((head & ~0xf) == tail)
+			break;
+
+		const u16 frame = ohci_frame_number(ohci);
+		frames += (u16)(frame - last_frame);
+		last_frame = frame;
+		if (frames > timeout) {
+			usb_debug("Error: ohci: endpoint "
+				"descriptor processing timed out.\n");
+			failure = 1;
+			break;
+		}
+		udelay(10);
 	}
-	return 0;
+	if (failure)
+		ohci_cancel_ed(ohci, aed, list_enable);
+
+	/* Recycle the TDs retired so far. */
+	ohci_process_done_queue(ohci, 0);
+
+	return failure;
 }
 
+/* Unlinks and frees all EDs of a device that went away. */
 static void
-ohci_free_ed (ed_t *const head)
+ohci_destroy_eds (ohci_t *const ohci, async_ed_t **const list, const u32 list_enable,
+		  const int devaddr)
 {
-	/* In case the transfer canceled, we have to free unprocessed TDs. */
-	DC_INVALIDATE(head, sizeof (*head));
-	while ((__le32_to_cpu(head->head_pointer) & ~0x3) != __le32_to_cpu(head->tail_pointer)) {
-		/* Save current TD pointer. */
-		td_t *const cur_td =
-			(td_t*)phys_to_virt(__le32_to_cpu(head->head_pointer) & ~0x3);
-		/* Advance head pointer. */
-		DC_INVALIDATE(cur_td, sizeof (*cur_td));
-		head->head_pointer = cur_td->next_td;
-		/* Free current TD. */
-		free((void *)cur_td);
+	async_ed_t *aed, *prev;
+	int found = 0;
+
+	for (aed = *list; aed; aed = aed->next) {
+		if (((aed->key & ED_FUNC_MASK) >> ED_FUNC_SHIFT) == devaddr)
+			found = 1;
+	}
+	if (!found)
+		return;
+
+	/* Stop the list for a frame, so the HC holds no reference to the EDs. */
+	ohci->opreg->HcControl &= CPU_TO_USBHC(~list_enable);
+	ohci_wait_frames(ohci, 1);
+
+	prev = NULL;
+	aed = *list;
+	while (aed) {
+		async_ed_t *const next = aed->next;
+
+		if (((aed->key & ED_FUNC_MASK) >> ED_FUNC_SHIFT) != devaddr) {
+			prev = aed;
+			aed = next;
+			continue;
+		}
+
+		/* Unlink from the HC list... */
+		if (prev) {
+			prev->ed.next_ed = aed->ed.next_ed;
+			DC_FLUSH(&prev->ed, sizeof (prev->ed));
+			prev->next = next;
+		} else {
+			if (list_enable == ControlListEnable)
+				ohci->opreg->HcControlHeadED = CPU_TO_USBHC(__le32_to_cpu(aed->ed.next_ed));
+			else
+				ohci->opreg->HcBulkHeadED = CPU_TO_USBHC(__le32_to_cpu(aed->ed.next_ed));
+			*list = next;
+		}
+
+		/* ...and give back its TDs. */
+		DC_INVALIDATE(&aed->ed, sizeof (aed->ed));
+		u32 head = __le32_to_cpu(aed->ed.head_pointer) & ~0xf;
+		while (head != virt_to_phys(aed->tail)) {
+			td_t *const cur_td = (td_t *)phys_to_virt(head);
+			DC_INVALIDATE(cur_td, sizeof (*cur_td));
+			head = __le32_to_cpu(cur_td->next_td) & ~0xf;
+			ohci_free_td(ohci, cur_td);
+		}
+		ohci_free_td(ohci, aed->tail);
+		free((void *)aed);
+		aed = next;
+	}
+
+	if (list_enable == ControlListEnable)
+		ohci->opreg->HcControlCurrentED = 0;
+	else
+		ohci->opreg->HcBulkCurrentED = 0;
+	ohci->opreg->HcControl |= CPU_TO_USBHC(list_enable);
+}
+
+static void
+ohci_destroy_device (hci_t *controller, int devaddr)
+{
+	ohci_destroy_eds(OHCI_INST(controller), &OHCI_INST(controller)->control_eds,
+			 ControlListEnable, devaddr);
+	ohci_destroy_eds(OHCI_INST(controller), &OHCI_INST(controller)->bulk_eds,
+			 BulkListEnable, devaddr);
+}
+
+/*
+ * On the Wii the HC sees memory behind the CPU caches. A buffer the HC writes
+ * to must own whole cache lines, otherwise the invalidate after the transfer
+ * would also drop neighbouring data, so such buffers go through a bounce copy.
+ * Returns NULL if the bounce buffer can't be grown.
+ */
+static u8 *
+ohci_map_buffer (ohci_t *const ohci, u8 *const data, const int dalen)
+{
+#if CONFIG_WII
+	u8 *buf = data;
+
+	if (dalen == 0)
+		return data;
+
+	if ((((unsigned long)data | dalen) & 0x1F) != 0) {
+		if (dalen > ohci->bounce_size) {
+			const int size = (dalen + 0x1F) & ~0x1F;
+			u8 *bounce;
+
+			if (ofmem_posix_memalign((void **)&bounce, 0x20, size))
+				return NULL;
+			if (ohci->bounce)
+				free(ohci->bounce);
+			ohci->bounce = bounce;
+			ohci->bounce_size = size;
+		}
+		buf = ohci->bounce;
+		memcpy(buf, data, dalen);
 	}
+	DC_FLUSH(buf, dalen);
+	return buf;
+#else
+	return data;
+#endif
+}
 
-	/* Always free the dummy TD */
-	if ((__le32_to_cpu(head->head_pointer) & ~0x3) == __le32_to_cpu(head->tail_pointer))
-		free(phys_to_virt(__le32_to_cpu(head->head_pointer) & ~0x3));
-	/* and the ED. */
-	free((void *)head);
+static void
+ohci_unmap_buffer (u8 *const data, u8 *const buf, const int dalen)
+{
+#if CONFIG_WII
+	if (dalen == 0)
+		return;
+
+	DC_INVALIDATE(buf, dalen);
+	if (buf != data) {
+		// Copy data back to original buffer.
+		memcpy(data, buf, dalen);
+	}
+#endif
 }
 
 static int
 ohci_control (usbdev_t *dev, direction_t dir, int drlen, void *devreq, int dalen,
 	      unsigned char *data)
 {
+	ohci_t *const ohci = OHCI_INST(dev->controller);
 	td_t *cur;
+	unsigned char *const orig_data = data;
+	const int dataLen = dalen;
 
-#if CONFIG_WII
-	unsigned char *dataAlignedBuf;
-	unsigned char *dataBuf;
-	int dataLen;
-
-	// Ok to flush request, but data must be aligned to 32 bytes.
+	// Ok to flush request, data is bounced if not aligned to 32 bytes.
 	DC_FLUSH(devreq, drlen);
-	ofmem_posix_memalign((void **)&dataAlignedBuf, 0x20, (dalen + 0x20) & ~(0x1F));
-	memcpy(dataAlignedBuf, data, dalen);
-	DC_FLUSH(dataAlignedBuf, dalen);
-
-	dataBuf = data;
-	dataLen = dalen;
-	data = dataAlignedBuf;
-#endif
+	data = ohci_map_buffer(ohci, data, dalen);
+	if (!data && dalen)
+		return 1;
+	unsigned char *const dataBuf = data;
 
 	// pages are specified as 4K in OHCI, so don't use getpagesize()
 	int first_page = (unsigned long)data / 4096;
@@ -405,10 +722,17 @@ ohci_control (usbdev_t *dev, direction_t dir, int drlen, void *devreq, int dalen
 	if (last_page < first_page) last_page = first_page;
 	int pages = (dalen==0)?0:(last_page - first_page + 1);
 
-	/* First TD. */
-	td_t *const first_td;
-        ofmem_posix_memalign((void **)&first_td, sizeof(td_t), sizeof(td_t));
-	memset((void *)first_td, 0, sizeof(*first_td));
+	const u32 config = (dev->address << ED_FUNC_SHIFT) |
+		(0 << ED_EP_SHIFT) |
+		(OHCI_FROM_TD << ED_DIR_SHIFT) |
+		(dev->speed?ED_LOWSPEED:0) |
+		(dev->endpoints[0].maxpacketsize << ED_MPS_SHIFT);
+	async_ed_t *const aed = ohci_get_async_ed(ohci, config & ED_KEY_MASK);
+	if (!aed)
+		return 1;
+
+	/* First TD, takes the place of the ED's dummy. */
+	td_t *const first_td = aed->tail;
 	cur = first_td;
 
 	cur->config = __cpu_to_le32(TD_DIRECTION_SETUP |
@@ -421,9 +745,11 @@ ohci_control (usbdev_t *dev, direction_t dir, int drlen, void *devreq, int dalen
 
 	while (pages > 0) {
 		/* One more TD. */
-		td_t *const next;
-		ofmem_posix_memalign((void **)&next, sizeof(td_t), sizeof(td_t));
-		memset((void *)next, 0, sizeof(*next));
+		td_t *const next = ohci_alloc_td(ohci);
+		if (!next) {
+			ohci_drop_tds(ohci, first_td, cur);
+			return 1;
+		}
 		/* Linked to the previous. */
 		cur->next_td = __cpu_to_le32(virt_to_phys(next));
 		DC_FLUSH(cur, sizeof (*cur));
@@ -457,9 +783,11 @@ ohci_control (usbdev_t *dev, direction_t dir, int drlen, void *devreq, int dalen
 	}
 
 	/* One more TD. */
-	td_t *const next_td;
-	ofmem_posix_memalign((void **)&next_td, sizeof(td_t), sizeof(td_t));
-	memset((void *)next_td, 0, sizeof(*next_td));
+	td_t *const next_td = ohci_alloc_td(ohci);
+	if (!next_td) {
+		ohci_drop_tds(ohci, first_td, cur);
+		return 1;
+	}
 	/* Linked to the previous. */
 	cur->next_td = __cpu_to_le32(virt_to_phys(next_td));
 	DC_FLUSH(cur, sizeof (*cur));
@@ -474,54 +802,24 @@ ohci_control (usbdev_t *dev, direction_t dir, int drlen, void *devreq, int dalen
 	cur->buffer_end = 0;
 
 	/* Final dummy TD. */
-	td_t *const final_td;
-	ofmem_posix_memalign((void **)&final_td, sizeof(td_t), sizeof(td_t));
-	memset((void *)final_td, 0, sizeof(*final_td));
+	td_t *const final_td = ohci_alloc_td(ohci);
+	if (!final_td) {
+		ohci_drop_tds(ohci, first_td, cur);
+		return 1;
+	}
 	/* Linked to the previous. */
 	cur->next_td = __cpu_to_le32(virt_to_phys(final_td));
-	DC_FLUSH(final_td, sizeof (*final_td));
 	DC_FLUSH(cur, sizeof (*cur));
 
-	/* Data structures */
-	ed_t *head;
-	ofmem_posix_memalign((void **)&head, sizeof(ed_t), sizeof(ed_t));
-	memset((void*)head, 0, sizeof(*head));
-	head->config = __cpu_to_le32((dev->address << ED_FUNC_SHIFT) |
-		(0 << ED_EP_SHIFT) |
-		(OHCI_FROM_TD << ED_DIR_SHIFT) |
-		(dev->speed?ED_LOWSPEED:0) |
-		(dev->endpoints[0].maxpacketsize << ED_MPS_SHIFT));
-	head->tail_pointer = __cpu_to_le32(virt_to_phys(final_td));
-	head->head_pointer = __cpu_to_le32(virt_to_phys(first_td));
-	DC_FLUSH(head, sizeof (*head));
+	ohci_prepare_ed(aed, config, 0);
 
-	usb_debug("ohci_control(): doing transfer with %x. first_td at %x\n",
-		__le32_to_cpu(head->config) & ED_FUNC_MASK, __le32_to_cpu(head->head_pointer));
-#ifdef USB_DEBUG_ED
-	dump_ed(head);
-#endif
+	usb_debug("ohci_control(): doing transfer with %x. first_td at %lx\n",
+		config & ED_FUNC_MASK, virt_to_phys(first_td));
 
-	/* activate schedule */
-	OHCI_INST(dev->controller)->opreg->HcControlHeadED = CPU_TO_USBHC(virt_to_phys(head));
-	OHCI_INST(dev->controller)->opreg->HcControl |= CPU_TO_USBHC(ControlListEnable);
-	OHCI_INST(dev->controller)->opreg->HcCommandStatus = CPU_TO_USBHC(ControlListFilled);
+	int failure = ohci_run_ed(ohci, aed, final_td, ControlListFilled, ControlListEnable,
+			(dataLen==0)?0:(last_page - first_page + 1));
 
-	int failure = wait_for_ed(dev, head,
-			(dalen==0)?0:(last_page - first_page + 1));
-	/* Wait some frames before and one after disabling list access. */
-	mdelay(4);
-	OHCI_INST(dev->controller)->opreg->HcControl &= CPU_TO_USBHC(~ControlListEnable);
-	mdelay(1);
-
-#if CONFIG_WII
-	// Copy data back to original buffer.
-	DC_INVALIDATE(dataAlignedBuf, dataLen);
-	memcpy(dataBuf, dataAlignedBuf, dataLen);
-	free(dataAlignedBuf);
-#endif
-
-	/* free memory */
-	ohci_free_ed(head);
+	ohci_unmap_buffer(orig_data, dataBuf, dataLen);
 
 	return failure;
 }
@@ -530,25 +828,18 @@ ohci_control (usbdev_t *dev, direction_t dir, int drlen, void *devreq, int dalen
 static int
 ohci_bulk (endpoint_t *ep, int dalen, u8 *data, int finalize)
 {
+	ohci_t *const ohci = OHCI_INST(ep->dev->controller);
 	int i;
 	usb_debug("bulk: %x bytes from %p, finalize: %x, maxpacketsize: %x\n", dalen, data, finalize, ep->maxpacketsize);
 
 	td_t *cur, *next;
+	u8 *const orig_data = data;
+	const int dataLen = dalen;
 
-#if CONFIG_WII
-	unsigned char *dataAlignedBuf;
-	unsigned char *dataBuf;
-	int dataLen;
-
-	// Data must be aligned to 32 bytes.
-	ofmem_posix_memalign((void **)&dataAlignedBuf, 0x20, (dalen + 0x20) & ~(0x1F));
-	memcpy(dataAlignedBuf, data, dalen);
-	DC_FLUSH(dataAlignedBuf, dalen);
-
-	dataBuf = data;
-	dataLen = dalen;
-	data = dataAlignedBuf;
-#endif
+	data = ohci_map_buffer(ohci, data, dalen);
+	if (!data && dalen)
+		return 1;
+	u8 *const dataBuf = data;
 
 	// pages are specified as 4K in OHCI, so don't use getpagesize()
 	int first_page = (unsigned long)data / 4096;
@@ -560,11 +851,20 @@ ohci_bulk (endpoint_t *ep, int dalen, u8 *data, int finalize)
 	if (finalize && ((dalen % ep->maxpacketsize) == 0)) {
 		td_count++;
 	}
+	if (td_count == 0)
+		return 0;
 
-	/* First TD. */
-	td_t *const first_td;
-	ofmem_posix_memalign((void **)&first_td, sizeof(td_t), sizeof(td_t));
-	memset((void *)first_td, 0, sizeof(*first_td));
+	const u32 config = (ep->dev->address << ED_FUNC_SHIFT) |
+		((ep->endpoint & 0xf) << ED_EP_SHIFT) |
+		(((ep->direction==IN)?OHCI_IN:OHCI_OUT) << ED_DIR_SHIFT) |
+		(ep->dev->speed?ED_LOWSPEED:0) |
+		(ep->maxpacketsize << ED_MPS_SHIFT);
+	async_ed_t *const aed = ohci_get_async_ed(ohci, config & ED_KEY_MASK);
+	if (!aed)
+		return 1;
+
+	/* First TD, takes the place of the ED's dummy. */
+	td_t *const first_td = aed->tail;
 	cur = next = first_td;
 
 	for (i = 0; i < td_count; ++i) {
@@ -601,9 +901,11 @@ ohci_bulk (endpoint_t *ep, int dalen, u8 *data, int finalize)
 			data += second_page_size;
 		}
 		/* One more TD. */
-		ofmem_posix_memalign((void **)&next, sizeof(td_t), sizeof(td_t));
-		memset((void *)next, 0, sizeof(*next));
-		DC_FLUSH(next, sizeof (*next));
+		next = ohci_alloc_td(ohci);
+		if (!next) {
+			ohci_drop_tds(ohci, first_td, cur);
+			return 1;
+		}
 		/* Linked to the previous. */
 		cur->next_td = __cpu_to_le32(virt_to_phys(next));
 		DC_FLUSH(cur, sizeof (*cur));
@@ -612,50 +914,21 @@ ohci_bulk (endpoint_t *ep, int dalen, u8 *data, int finalize)
 	/* Write done head after last TD. */
 	cur->config &= __cpu_to_le32(~TD_DELAY_INTERRUPT_MASK);
 	DC_FLUSH(cur, sizeof (*cur));
-	/* Advance to final, dummy TD. */
-	cur = next;
-
-	/* Data structures */
-	ed_t *head;
-	ofmem_posix_memalign((void **)&head, sizeof(ed_t), sizeof(ed_t));
-	memset((void*)head, 0, sizeof(*head));
-	head->config = __cpu_to_le32((ep->dev->address << ED_FUNC_SHIFT) |
-		((ep->endpoint & 0xf) << ED_EP_SHIFT) |
-		(((ep->direction==IN)?OHCI_IN:OHCI_OUT) << ED_DIR_SHIFT) |
-		(ep->dev->speed?ED_LOWSPEED:0) |
-		(ep->maxpacketsize << ED_MPS_SHIFT));
-	head->tail_pointer = __cpu_to_le32(virt_to_phys(cur));
-	head->head_pointer = __cpu_to_le32(virt_to_phys(first_td) | (ep->toggle?ED_TOGGLE:0));
-	DC_FLUSH(head, sizeof (*head));
+
+	ohci_prepare_ed(aed, config, ep->toggle);
 
 	usb_debug("doing bulk transfer with %x(%x). first_td at %lx, last %lx\n",
-		__le32_to_cpu(head->config) & ED_FUNC_MASK,
-		(__le32_to_cpu(head->config) & ED_EP_MASK) >> ED_EP_SHIFT,
-		virt_to_phys(first_td), virt_to_phys(cur));
-
-	/* activate schedule */
-	OHCI_INST(ep->dev->controller)->opreg->HcBulkHeadED = CPU_TO_USBHC(virt_to_phys(head));
-	OHCI_INST(ep->dev->controller)->opreg->HcControl |= CPU_TO_USBHC(BulkListEnable);
-	OHCI_INST(ep->dev->controller)->opreg->HcCommandStatus = CPU_TO_USBHC(BulkListFilled);
-
-	int failure = wait_for_ed(ep->dev, head,
-			(dalen==0)?0:(last_page - first_page + 1));
-	/* Wait some frames before and one after disabling list access. */
-	mdelay(4);
-	OHCI_INST(ep->dev->controller)->opreg->HcControl &= CPU_TO_USBHC(~BulkListEnable);
-	mdelay(1);
+		config & ED_FUNC_MASK,
+		(config & ED_EP_MASK) >> ED_EP_SHIFT,
+		virt_to_phys(first_td), virt_to_phys(next));
 
-#if CONFIG_WII
-	// Copy data back to original buffer.
-	DC_INVALIDATE(dataAlignedBuf, dataLen);
-	memcpy(dataBuf, dataAlignedBuf, dataLen);
-	free(dataAlignedBuf);
-#endif
+	/* The last TD allocated becomes the ED's new dummy. */
+	int failure = ohci_run_ed(ohci, aed, next, BulkListFilled, BulkListEnable,
+			(dataLen==0)?0:(last_page - first_page + 1));
 
-	ep->toggle = __le32_to_cpu(head->head_pointer) & ED_TOGGLE;
+	ohci_unmap_buffer(orig_data, dataBuf, dataLen);
 
-	/* free memory */
-	ohci_free_ed(head);
+	ep->toggle = __le32_to_cpu(aed->ed.head_pointer) & ED_TOGGLE;
 
 	if (failure) {
 		/* try cleanup */
@@ -921,8 +1194,8 @@ ohci_process_done_queue(ohci_t *const ohci, const int spew_debug)
 
 		switch (__le32_to_cpu(done_td->config) & TD_QUEUETYPE_MASK) {
 		case TD_QUEUETYPE_ASYNC:
-			/* Free processed async TDs. */
-                  free((void *)done_td);
+			/* Return processed async TDs to the pool. */
+			ohci_free_td(ohci, done_td);
 			break;
 		case TD_QUEUETYPE_INTR: {
 			intrq_td_t *const td = INTRQ_TD_FROM_TD(done_td);
@@ -997,6 +1270,7 @@ int ob_usb_ohci_init (const char *path, uint32_t addr)
 
 	/* Init ports */
 	usb_poll();
+	usb_set_enum_property(ctrl, path);
 
 	/* Look for a keyboard */
 	/*for (i = 0; i < 128; i++) {
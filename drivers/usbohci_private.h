@@ -37,24 +37,6 @@
 #include "libc/byteorder.h"
 #include "usb.h"
 
-//
-// The Wii and Wii U do byteswapping on the bus side, all bus reads must be big endian.
-//
-#ifdef CONFIG_WII
-extern void flush_dcache_range(char *start, char *stop);
-extern void invalidate_dcache_range(char *start, char *stop);
-
-#define USBHC_TO_CPU(x)				__be32_to_cpu(x)
-#define CPU_TO_USBHC(x)				__cpu_to_be32(x)
-#define DC_FLUSH(b,l)				flush_dcache_range((char*)b, ((char*)b) + l)
-#define DC_INVALIDATE(b,l)			invalidate_dcache_range((char*)b, ((char*)b) + l)
-#else
-#define USBHC_TO_CPU(x)				__le32_to_cpu(x)
-#define CPU_TO_USBHC(x)				__cpu_to_le32(x)
-#define DC_FLUSH(b,l)
-#define DC_INVALIDATE(b,l)
-#endif
-
 #define READ_OPREG(ohci, field) (USBHC_TO_CPU((ohci)->opreg->field))
 #define MASK(startbit, lenbit) (((1<<(lenbit))-1)<<(startbit))
 
@@ -282,11 +264,25 @@ extern void invalidate_dcache_range(char *start, char *stop);
 
 #define OHCI_INST(controller) ((ohci_t*)((controller)->instance))
 
+/* TDs kept for async transfers, each covers up to 8K */
+#define OHCI_TD_POOL_SIZE 64
+
+	struct _async_ed;
+
 	typedef struct ohci {
 		opreg_t *opreg;
 		hcca_t *hcca;
 		usbdev_t *roothub;
 		ed_t *periodic_ed;
+		/* Persistent EDs, in the same order as on the HC lists. */
+		struct _async_ed *control_eds;
+		struct _async_ed *bulk_eds;
+		td_t *td_pool;
+		td_t *td_free;
+#if CONFIG_WII
+		u8 *bounce;
+		int bounce_size;
+#endif
 	} ohci_t;
 
 	typedef enum { OHCI_SETUP=0, OHCI_OUT=1, OHCI_IN=2, OHCI_FROM_TD=3 } ohci_pid_t;
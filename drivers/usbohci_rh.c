@@ -39,6 +39,7 @@
 typedef struct {
 	int numports;
 	int *port;
+	int *scan;	/* ports found changed by a poll */
 } rh_inst_t;
 
 #define RH_INST(dev) ((rh_inst_t*)(dev)->data)
@@ -98,30 +99,33 @@ ohci_rh_disable_port (usbdev_t *dev, int port)
 	}
 }
 
-static void
-ohci_rh_scanport (usbdev_t *dev, int port)
+static int
+ohci_rh_port_status_changed (usbdev_t *dev, int port)
 {
-	if (port >= RH_INST(dev)->numports) {
-		usb_debug("Invalid port %d\n", port);
-		return;
-	}
+	ohci_t *const ohcic = OHCI_INST (dev->controller);
 
-	/* device registered, and device change logged, so something must have happened */
-	if (RH_INST (dev)->port[port] != -1) {
-		usb_detach_device(dev->controller, RH_INST (dev)->port[port]);
-		RH_INST (dev)->port[port] = -1;
-	}
+	if (!(READ_OPREG(ohcic, HcRhPortStatus[port]) & ConnectStatusChange))
+		return 0;
+	ohcic->opreg->HcRhPortStatus[port] = CPU_TO_USBHC(ConnectStatusChange);
+	return 1;
+}
 
-	/* no device attached
-	   previously registered devices are detached, nothing left to do */
-	if (!(READ_OPREG(OHCI_INST(dev->controller), HcRhPortStatus[port]) & CurrentConnectStatus))
+static int
+ohci_rh_port_connected (usbdev_t *dev, int port)
+{
+	return (READ_OPREG(OHCI_INST(dev->controller), HcRhPortStatus[port]) & CurrentConnectStatus) != 0;
+}
+
+static void
+ohci_rh_attach_port (usbdev_t *dev, int port)
+{
+	if (!ohci_rh_port_connected (dev, port))
 		return;
 
-	// clear port state change
-	OHCI_INST(dev->controller)->opreg->HcRhPortStatus[port] = CPU_TO_USBHC(ConnectStatusChange);
 	ohci_rh_enable_port (dev, port);
 
-	mdelay(100); // wait for signal to stabilize
+	/* reset recovery time (usb20 spec 7.1.7.5) */
+	usb_delay_ms (dev->controller, 10);
 
 	if (!(READ_OPREG(OHCI_INST(dev->controller), HcRhPortStatus[port]) & PortEnableStatus)) {
 		usb_debug ("port enable failed\n");
@@ -132,24 +136,36 @@ ohci_rh_scanport (usbdev_t *dev, int port)
 	RH_INST (dev)->port[port] = usb_attach_device(dev->controller, dev->address, port, speed);
 }
 
-static int
-ohci_rh_report_port_changes (usbdev_t *dev)
+/*
+ * Detaches whatever was on the given ports and attaches what is there now.
+ * The ports are debounced together, then reset and addressed one by one:
+ * a device answers at address 0 until it got its own, so only one port
+ * may come out of reset at a time.
+ */
+static void
+ohci_rh_scanports (usbdev_t *dev, int *ports, int count)
 {
-	ohci_t *const ohcic = OHCI_INST (dev->controller);
+	int i, connected = 0;
 
-	int i;
-
-	for (i = 0; i < RH_INST(dev)->numports; i++) {
-		// maybe detach+attach happened between two scans?
-		if (READ_OPREG(ohcic, HcRhPortStatus[i]) & ConnectStatusChange) {
-			ohcic->opreg->HcRhPortStatus[i] = CPU_TO_USBHC(ConnectStatusChange);
-			usb_debug("attachment change on port %d\n", i);
-			return i;
+	for (i = 0; i < count; i++) {
+		/* device registered, and device change logged, so something must have happened */
+		if (RH_INST (dev)->port[ports[i]] != -1) {
+			usb_detach_device(dev->controller, RH_INST (dev)->port[ports[i]]);
+			RH_INST (dev)->port[ports[i]] = -1;
 		}
+
+		/* previously registered devices are detached, nothing left to do
+		   if no device is attached */
+		if (ohci_rh_port_connected (dev, ports[i]))
+			ports[connected++] = ports[i];
 	}
 
-	// no change
-	return -1;
+	if (usb_debounce_ports (dev, ports, connected,
+				ohci_rh_port_status_changed, ohci_rh_port_connected) < 0)
+		return;
+
+	for (i = 0; i < connected; i++)
+		ohci_rh_attach_port (dev, ports[i]);
 }
 
 static void
@@ -158,6 +174,8 @@ ohci_rh_destroy (usbdev_t *dev)
 	int i;
 	for (i = 0; i < RH_INST (dev)->numports; i++)
 		ohci_rh_disable_port (dev, i);
+	free (RH_INST (dev)->scan);
+	free (RH_INST (dev)->port);
 	free (RH_INST (dev));
 }
 
@@ -166,7 +184,7 @@ ohci_rh_poll (usbdev_t *dev)
 {
 	ohci_t *const ohcic = OHCI_INST (dev->controller);
 
-	int port;
+	int port, count = 0;
 
 	/* Check if anything changed. */
 	if (!(READ_OPREG(ohcic, HcInterruptStatus) & RootHubStatusChange))
@@ -174,9 +192,15 @@ ohci_rh_poll (usbdev_t *dev)
 	ohcic->opreg->HcInterruptStatus = CPU_TO_USBHC(RootHubStatusChange);
 	usb_debug("root hub status change\n");
 
-	/* Scan ports with changed connection status. */
-	while ((port = ohci_rh_report_port_changes (dev)) != -1)
-		ohci_rh_scanport (dev, port);
+	/* Scan all ports with changed connection status at once.
+	   Maybe detach+attach happened between two scans? */
+	for (port = 0; port < RH_INST(dev)->numports; port++) {
+		if (ohci_rh_port_status_changed (dev, port)) {
+			usb_debug("attachment change on port %d\n", port);
+			RH_INST (dev)->scan[count++] = port;
+		}
+	}
+	ohci_rh_scanports (dev, RH_INST (dev)->scan, count);
 }
 
 void
@@ -195,12 +219,12 @@ ohci_rh_init (usbdev_t *dev)
 
 	RH_INST (dev)->numports = READ_OPREG(OHCI_INST(dev->controller), HcRhDescriptorA) & NumberDownstreamPortsMask;
 	RH_INST (dev)->port = malloc(sizeof(int) * RH_INST (dev)->numports);
+	RH_INST (dev)->scan = malloc(sizeof(int) * RH_INST (dev)->numports);
 	usb_debug("%d ports registered\n", RH_INST (dev)->numports);
 
-	for (i = 0; i < RH_INST (dev)->numports; i++) {
-		ohci_rh_enable_port (dev, i);
+	/* Ports are reset when a device on them is attached by the first poll. */
+	for (i = 0; i < RH_INST (dev)->numports; i++)
 		RH_INST (dev)->port[i] = -1;
-	}
 
 	/* we can set them here because a root hub _really_ shouldn't
 	   appear elsewhere */
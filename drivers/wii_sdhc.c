@@ -30,6 +30,11 @@ do { printk("SDHC - %s: " fmt, __func__ , ##args); } while (0)
 extern void flush_dcache_range(char *start, char *stop);
 extern void invalidate_dcache_range(char *start, char *stop);
 
+/* From drivers/timer.c */
+extern unsigned long timer_freq;
+
+static sdhc_device_t *sdhc_stats_device;
+
 DECLARE_UNNAMED_NODE( ob_wii_sdhc, 0, sizeof(sdhc_device_t*) );
 
 static inline uint16_t sdhc_calc_power(uint8_t exp) {
@@ -165,6 +170,29 @@ static int sdhc_init(sdhc_device_t *sdhc) {
   return 0;
 }
 
+//
+// Switches the controller to ADMA2 if it is supported, otherwise SDMA is used.
+//
+static void sdhc_init_adma(sdhc_device_t *sdhc) {
+  uint32_t hcCaps = sdhc_read32(sdhc, kSDHCRegCapabilities);
+
+  sdhc->max_transfer = SDHC_MAX_TRANSFER_SIZE;
+  if (sdhc_get_version(sdhc) < kSDHCVersion2_00 || (hcCaps & kSDHCRegCapabilitiesADMA2Supported) == 0) {
+    SDHC_DPRINTF("ADMA2 is not supported, using SDMA\n");
+    return;
+  }
+
+  ofmem_posix_memalign((void **)&sdhc->adma_table, kSDHCDMAAlignment, kSDHCADMA2DescCount * sizeof (sdhc_adma2_desc_t));
+  if (sdhc->adma_table == NULL) {
+    return;
+  }
+
+  sdhc_write8(sdhc, kSDHCRegHostControl1,
+              (sdhc_read8(sdhc, kSDHCRegHostControl1) & ~kSDHCRegHostControl1DMASelectMask) | kSDHCRegHostControl1DMASelectADMA2);
+  sdhc->max_transfer = SDHC_ADMA_MAX_TRANSFER_SIZE;
+  SDHC_DPRINTF("Using ADMA2 with %u descriptors\n", kSDHCADMA2DescCount);
+}
+
 //
 // Sets the controller clock rate.
 //
@@ -175,6 +203,7 @@ static int sdhc_set_clock(sdhc_device_t *sdhc, uint32_t speedHz) {
   // Clear existing clock register.
   //
   sdhc_write16(sdhc, kSDHCRegClockControl, 0);
+  sdhc->clock_hz = 0;
   if (speedHz == 0) {
     return 0;
   }
@@ -191,19 +220,23 @@ static int sdhc_set_clock(sdhc_device_t *sdhc, uint32_t speedHz) {
   SDHC_DPRINTF("Base clock is %u MHz\n", baseClock / MHz);
 
   //
-  // Calculate clock divisor.
+  // Calculate clock divisor. FreqSelect N gives SDCLK = base / (2 * N), or the base clock for N = 0,
+  // so a power of two divisor is programmed as half its value. Version 1 controllers divide by 256 at most.
   //
   uint32_t clockDiv;
-  for (clockDiv = 1; (baseClock / clockDiv) > speedHz; clockDiv <<= 1);
+  uint32_t maxClockDiv = sdhc_get_version(sdhc) >= kSDHCVersion3_00 ? 1024 : 256;
+  for (clockDiv = 1; (baseClock / clockDiv) > speedHz && clockDiv < maxClockDiv; clockDiv <<= 1);
+  uint32_t freqSelect = clockDiv >> 1;
+  sdhc->clock_hz = freqSelect == 0 ? baseClock : baseClock / (2 * freqSelect);
   SDHC_DPRINTF("Clock will be set to %u %s using divisor %u\n",
-                speedHz >= MHz ? (baseClock / clockDiv) / MHz : (baseClock / clockDiv) / kHz,
+                speedHz >= MHz ? sdhc->clock_hz / MHz : sdhc->clock_hz / kHz,
                 speedHz >= MHz ? "MHz" : "kHz", clockDiv);
 
   //
   // Set clock divisor and enable internal clock.
   //
-  uint16_t newClockDiv = ((clockDiv << kSDHCRegClockControlFreqSelectLowShift) & kSDHCRegClockControlFreqSelectLowMask)
-    | ((clockDiv >> kSDHCRegClockControlFreqSelectHighRhShift) & kSDHCRegClockControlFreqSelectHighMask);
+  uint16_t newClockDiv = ((freqSelect << kSDHCRegClockControlFreqSelectLowShift) & kSDHCRegClockControlFreqSelectLowMask)
+    | ((freqSelect >> kSDHCRegClockControlFreqSelectHighRhShift) & kSDHCRegClockControlFreqSelectHighMask);
   sdhc_write16(sdhc, kSDHCRegClockControl, sdhc_read16(sdhc, kSDHCRegClockControl) | newClockDiv | kSDHCRegClockControlIntClockEnable);
 
   //
@@ -284,28 +317,184 @@ static void sdhc_set_bus_width(sdhc_device_t *sdhc, sdhc_bus_width_t busWidth) {
     SDHC_DPRINTF("Setting controller bus width to 1-bit mode\n");
   }
   sdhc_write16(sdhc, kSDHCRegHostControl1, hcControl);
+  sdhc->bus_width = busWidth;
 }
 
-static int sdhc_command(sdhc_device_t *sdhc, uint8_t commandIndex, uint8_t responseType, uint32_t argument,
-                        void *buffer, uint16_t blockCount, int bufferRead, sd_cmd_response_t *outResponse) {
-  uint32_t  timeout;
+//
+// Sets the controller high speed bit.
+//
+static void sdhc_set_high_speed(sdhc_device_t *sdhc, int enabled) {
+  uint16_t hcControl = sdhc_read16(sdhc, kSDHCRegHostControl1) & ~kSDHCRegHostControl1HighSpeedEnable;
+  if (enabled) {
+    hcControl |= kSDHCRegHostControl1HighSpeedEnable;
+  }
+  sdhc_write16(sdhc, kSDHCRegHostControl1, hcControl);
+  sdhc->is_high_speed = enabled;
+}
+
+//
+// Gets the time base in microseconds.
+//
+static uint64_t sdhc_get_time_us(void) {
+  return _get_ticks() / (timer_freq / 1000000);
+}
+
+//
+// Polls a register until any of the bits in mask are set, or until all of them are clear.
+// Spins for 1 uS first and backs off up to 1 MS, so short commands complete without a millisecond sleep.
+//
+static int sdhc_poll32(sdhc_device_t *sdhc, uint32_t offset, uint32_t mask, int set, uint32_t timeoutUS, uint32_t *outData) {
+  uint32_t data;
+  uint32_t delay = 1;
+
+  while (1) {
+    data = sdhc_read32(sdhc, offset);
+    if (((data & mask) != 0) == (set != 0)) {
+      break;
+    }
+
+    if (timeoutUS == 0) {
+      return 1;
+    }
+    if (delay > timeoutUS) {
+      delay = timeoutUS;
+    }
+    udelay(delay);
+    timeoutUS -= delay;
+    if (delay < kSDHCPollMaxDelayUS) {
+      delay <<= 1;
+    }
+  }
+
+  if (outData != NULL) {
+    *outData = data;
+  }
+  return 0;
+}
+
+//
+// Waits for an interrupt status bit, aborting early on any error interrupt.
+//
+static int sdhc_wait_int_status(sdhc_device_t *sdhc, uint32_t bits, uint32_t timeoutUS, uint32_t *outStatus) {
+  uint32_t intStatus;
+
+  if (sdhc_poll32(sdhc, kSDHCRegNormalIntStatus, bits | kSDHCRegNormalIntStatusErrorInterrupt, 1, timeoutUS, &intStatus)) {
+    return 1;
+  }
+
+  if (intStatus & kSDHCRegNormalIntStatusErrorInterrupt) {
+    SDHC_DPRINTF("Error interrupt status 0x%X\n", intStatus >> 16);
+    sdhc_write32(sdhc, kSDHCRegNormalIntStatus, -1);
+    sdhc_reset(sdhc, kSDHCRegSoftwareResetCmd | kSDHCRegSoftwareResetDat);
+    return 1;
+  }
+
+  sdhc_write32(sdhc, kSDHCRegNormalIntStatus, intStatus & bits);
+  if (outStatus != NULL) {
+    *outStatus = intStatus;
+  }
+  return 0;
+}
+
+//
+// Gets the physical address of a buffer for DMA.
+// Buffers mapped by the client may not follow the linear firmware mapping.
+//
+static uint32_t sdhc_dma_addr(void *buffer) {
+  ucell       mode;
+  phys_addr_t phys;
+
+  phys = ofmem_translate(pointer2cell(buffer), &mode);
+  if (phys == (phys_addr_t)-1) {
+    phys = virt_to_phys(buffer);
+  }
+  return (uint32_t)phys;
+}
+
+//
+// Checks if a buffer can be used for DMA directly.
+// It must be cache line aligned so invalidating it cannot discard neighbouring data.
+// SDMA only follows the address it was started with, so without ADMA2 it must also be physically contiguous.
+//
+static int sdhc_can_dma_direct(sdhc_device_t *sdhc, void *buffer, uint32_t length) {
+  unsigned long start = (unsigned long)buffer;
+
+  if ((start | length) & (kSDHCDMAAlignment - 1)) {
+    return 0;
+  }
+  if (sdhc->adma_table != NULL) {
+    return 1;
+  }
+  return sdhc_dma_addr(buffer) + length - 1 == sdhc_dma_addr((char*)buffer + length - 1);
+}
+
+//
+// Builds the ADMA2 descriptor table for a buffer, merging physically contiguous pages.
+//
+static int sdhc_adma_build(sdhc_device_t *sdhc, void *buffer, uint32_t length) {
+  sdhc_adma2_desc_t *desc = NULL;
+  unsigned long     virt  = (unsigned long)buffer;
+  uint32_t          count = 0;
+  uint32_t          descLength = 0;
+  uint32_t          piece;
+  uint32_t          addr;
+  uint32_t          descAddr = 0;
+
+  while (length) {
+    piece = PAGE_SIZE - (virt & (PAGE_SIZE - 1));
+    if (piece > length) {
+      piece = length;
+    }
+
+    addr = sdhc_dma_addr((void*)virt);
+    if (desc != NULL && descAddr + descLength == addr && descLength + piece <= kSDHCADMA2MaxLength) {
+      descLength += piece;
+    } else {
+      if (desc != NULL) {
+        desc->attributes = __cpu_to_le32((descLength << kSDHCADMA2DescLengthShift) | kSDHCADMA2DescValid | kSDHCADMA2DescActTran);
+      }
+      if (count == kSDHCADMA2DescCount) {
+        SDHC_DPRINTF("Buffer needs more than %u descriptors\n", kSDHCADMA2DescCount);
+        return 1;
+      }
+
+      desc = &sdhc->adma_table[count++];
+      desc->address = __cpu_to_le32(addr);
+      descAddr = addr;
+      descLength = piece;
+    }
+
+    virt   += piece;
+    length -= piece;
+  }
+
+  if (desc == NULL) {
+    return 1;
+  }
+  desc->attributes = __cpu_to_le32((descLength << kSDHCADMA2DescLengthShift) | kSDHCADMA2DescValid | kSDHCADMA2DescActTran | kSDHCADMA2DescEnd);
+
+  flush_dcache_range((char*)sdhc->adma_table, (char*)&sdhc->adma_table[count]);
+  return 0;
+}
+
+static int sdhc_command_blocks(sdhc_device_t *sdhc, uint8_t commandIndex, uint8_t responseType, uint32_t argument,
+                               void *buffer, uint16_t blockSize, uint16_t blockCount, int bufferRead, sd_cmd_response_t *outResponse) {
   uint16_t  commandValue;
   uint16_t  transferMode;
   uint32_t  intStatus;
+  uint32_t  length;
+  uint64_t  startTime;
+  int       direct;
+  unsigned char *dmaBuffer;
+  sdhc_transfer_stats_t *stats;
 
   //WIIDBGLOG("Command: 0x%X, rspType: 0x%X, arg: 0x%X", commandIndex, responseType, argument);
 
   //
   // Wait for controller to be ready.
   //
-  for (timeout = kSDHCCommandTimeoutMS; timeout > 0; timeout--) {
-    if ((sdhc_get_present_state(sdhc) & (kSDHCRegPresentStateCmdInhibit | kSDHCRegPresentStateDatInhibit)) == 0) {
-      break;
-    }
-    mdelay(1);
-  }
-
-  if (timeout == 0) {
+  if (sdhc_poll32(sdhc, kSDHCRegPresentState, kSDHCRegPresentStateCmdInhibit | kSDHCRegPresentStateDatInhibit, 0,
+                  kSDHCCommandTimeoutMS, NULL)) {
     SDHC_DPRINTF("Timed out waiting for command inhibit\n");
     return 1;
   }
@@ -322,23 +511,51 @@ static int sdhc_command(sdhc_device_t *sdhc, uint8_t commandIndex, uint8_t respo
   //
   // Configure DMA if there's a buffer.
   //
+  length    = blockCount * blockSize;
+  direct    = 0;
+  dmaBuffer = sdhc->buffer;
+  stats     = NULL;
+  startTime = 0;
   if (buffer != NULL) {
     //
-    // Copy to temp buffer.
+    // DMA straight to or from the caller's buffer when possible, otherwise go through the temp buffer.
     //
-    if (!bufferRead) {
-        memcpy(sdhc->buffer, buffer, blockCount * kSDBlockSize);
-        flush_dcache_range((char*)sdhc->buffer, (char*)sdhc->buffer + (blockCount * kSDBlockSize));
+    direct = sdhc_can_dma_direct(sdhc, buffer, length);
+    if (direct) {
+      dmaBuffer = buffer;
+      stats = &sdhc->direct_stats;
+    } else {
+      if (length > SDHC_BUFFER_SIZE) {
+        SDHC_DPRINTF("Unaligned transfer of %u bytes is too large\n", length);
+        return 1;
+      }
+      stats = &sdhc->bounce_stats;
+    }
+    startTime = sdhc_get_time_us();
+
+    if (!bufferRead && !direct) {
+        memcpy(sdhc->buffer, buffer, length);
     }
+    flush_dcache_range((char*)dmaBuffer, (char*)dmaBuffer + length);
 
     commandValue   |= kSDHCRegCommandDataPresent;
-    transferMode    = kSDHCRegTransferModeDMAEnable | kSDHCRegTransferModeBlockCountEnable | kSDHCRegTransferModeMultipleBlock | kSDHCRegTransferModeAutoCMD12;
+    transferMode    = kSDHCRegTransferModeDMAEnable | kSDHCRegTransferModeBlockCountEnable;
+    if (commandIndex == kSDCommandReadMultipleBlock || commandIndex == kSDCommandWriteMultipleBlock) {
+      transferMode |= kSDHCRegTransferModeMultipleBlock | kSDHCRegTransferModeAutoCMD12;
+    }
     if (bufferRead) {
       transferMode |= kSDHCRegTransferModeDataTransferRead;
     }
 
-    sdhc_write32(sdhc, kSDHCRegSDMA, virt_to_phys(sdhc->buffer));
-    sdhc_write16(sdhc, kSDHCRegBlockSize, kSDBlockSize | kSDHCRegBlockSizeDMA512K);
+    if (sdhc->adma_table != NULL) {
+      if (sdhc_adma_build(sdhc, dmaBuffer, length)) {
+        return 1;
+      }
+      sdhc_write32(sdhc, kSDHCRegADMASystemAddress, sdhc_dma_addr(sdhc->adma_table));
+    } else {
+      sdhc_write32(sdhc, kSDHCRegSDMA, sdhc_dma_addr(dmaBuffer));
+    }
+    sdhc_write16(sdhc, kSDHCRegBlockSize, blockSize | kSDHCRegBlockSizeDMA512K);
     sdhc_write16(sdhc, kSDHCRegBlockCount, blockCount);
   } else {
     transferMode = 0;
@@ -355,15 +572,7 @@ static int sdhc_command(sdhc_device_t *sdhc, uint8_t commandIndex, uint8_t respo
   //
   // Wait for command to complete.
   //
-  for (timeout = kSDHCCommandTimeoutMS * 2; timeout > 0; timeout--) {
-    if ((sdhc_read32(sdhc, kSDHCRegNormalIntStatus) & kSDHCRegNormalIntStatusCommandComplete) != 0) {
-      sdhc_write32(sdhc, kSDHCRegNormalIntStatus, kSDHCRegNormalIntStatusCommandComplete);
-      break;
-    }
-    mdelay(1);
-  }
-
-  if (timeout == 0) {
+  if (sdhc_wait_int_status(sdhc, kSDHCRegNormalIntStatusCommandComplete, kSDHCCommandTimeoutMS * 2, NULL)) {
     SDHC_DPRINTF("Timed out waiting for command to complete\n");
     return 1;
   }
@@ -386,16 +595,8 @@ static int sdhc_command(sdhc_device_t *sdhc, uint8_t commandIndex, uint8_t respo
     //
     // Wait for transfer to complete or a DMA interrupt to occur.
     //
-    for (timeout = (kSDHCCommandTimeoutMS * 10); timeout > 0; timeout--) {
-      intStatus = sdhc_read32(sdhc, kSDHCRegNormalIntStatus);
-      if ((intStatus & (kSDHCRegNormalIntStatusTransferComplete | kSDHCRegNormalIntStatusDMAInterrupt)) != 0) {
-        sdhc_write32(sdhc, kSDHCRegNormalIntStatus, intStatus);
-        break;
-      }
-      mdelay(1);
-    }
-
-    if (timeout == 0) {
+    if (sdhc_wait_int_status(sdhc, kSDHCRegNormalIntStatusTransferComplete | kSDHCRegNormalIntStatusDMAInterrupt,
+                             kSDHCCommandTimeoutMS * 10, &intStatus)) {
       SDHC_DPRINTF("Timed out waiting for data to complete\n");
       return 1;
     }
@@ -409,6 +610,7 @@ static int sdhc_command(sdhc_device_t *sdhc, uint8_t commandIndex, uint8_t respo
 
     //
     // Rewrite the SDMA register to continue the transfer.
+    // ADMA2 runs through the whole descriptor table and never stops at a boundary.
     //
     sdhc_write32(sdhc, kSDHCRegSDMA, sdhc_read32(sdhc, kSDHCRegSDMA));
   }
@@ -417,13 +619,24 @@ static int sdhc_command(sdhc_device_t *sdhc, uint8_t commandIndex, uint8_t respo
   // Invalidate the buffer.
   //
   if (bufferRead) {
-    invalidate_dcache_range((char*)sdhc->buffer, (char*)sdhc->buffer + (blockCount * kSDBlockSize));
-    memcpy(buffer, sdhc->buffer, blockCount * kSDBlockSize);
+    invalidate_dcache_range((char*)dmaBuffer, (char*)dmaBuffer + length);
+    if (!direct) {
+      memcpy(buffer, sdhc->buffer, length);
+    }
   }
 
+  stats->commands++;
+  stats->bytes += length;
+  stats->time_us += sdhc_get_time_us() - startTime;
+
   return 0;
 }
 
+static int sdhc_command(sdhc_device_t *sdhc, uint8_t commandIndex, uint8_t responseType, uint32_t argument,
+                        void *buffer, uint16_t blockCount, int bufferRead, sd_cmd_response_t *outResponse) {
+  return sdhc_command_blocks(sdhc, commandIndex, responseType, argument, buffer, kSDBlockSize, blockCount, bufferRead, outResponse);
+}
+
 //
 // Sends an SD app command.
 //
@@ -649,6 +862,199 @@ static int sdhc_set_block_length(sdhc_device_t *sdhc, uint16_t block_size) {
   return result;
 }
 
+//
+// Gets the maximum default speed clock from the CSD TRAN_SPEED field.
+//
+static uint32_t sdhc_get_csd_clock(sdhc_device_t *sdhc) {
+  static const uint32_t units[] = { 100 * kHz, 1 * MHz, 10 * MHz, 100 * MHz };
+  // Time values are in tenths.
+  static const uint8_t values[] = { 0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80 };
+  uint8_t tranSpeed = sdhc->csd.sd1.tranSpeed;
+  uint32_t clock;
+
+  if ((tranSpeed & kSDCSDTranSpeedUnitMask) >= sizeof (units) / sizeof (units[0])) {
+    return kSDHCNormalSpeedClock25MHz;
+  }
+
+  clock = (units[tranSpeed & kSDCSDTranSpeedUnitMask] / 10) * values[(tranSpeed & kSDCSDTranSpeedValueMask) >> kSDCSDTranSpeedValueShift];
+  if (clock == 0 || clock > kSDHCNormalSpeedClock25MHz) {
+    clock = kSDHCNormalSpeedClock25MHz;
+  }
+  return clock;
+}
+
+//
+// Reads the card's SCR register.
+//
+static int sdhc_read_scr(sdhc_device_t *sdhc) {
+  sd_cmd_response_t appResponse;
+  int               result;
+
+  result = sdhc_command(sdhc, kSDCommandAppCommand, kSDHCResponseTypeR1, (sdhc->card_addr << kSDRelativeAddressShift), NULL, 0, 0, &appResponse);
+  if (result) {
+    return result;
+  }
+
+  result = sdhc_command_blocks(sdhc, kSDAppCommandSendSCR, kSDHCResponseTypeR1, 0, sdhc->scr, sizeof (sdhc->scr), 1, 1, NULL);
+  if (result) {
+    return result;
+  }
+  SDHC_DPRINTF("SCR: 0x%02X%02X%02X%02X%02X%02X%02X%02X\n", sdhc->scr[0], sdhc->scr[1], sdhc->scr[2], sdhc->scr[3],
+               sdhc->scr[4], sdhc->scr[5], sdhc->scr[6], sdhc->scr[7]);
+  return 0;
+}
+
+//
+// Sends SWITCH_FUNC for the access mode group.
+//
+static int sdhc_switch_function(sdhc_device_t *sdhc, int set, uint8_t function, uint8_t *status) {
+  uint32_t argument = kSDSwitchFunctionGroupsDefault | function;
+  if (set) {
+    argument |= kSDSwitchFunctionModeSet;
+  }
+
+  return sdhc_command_blocks(sdhc, kSDCommandSwitchFunction, kSDHCResponseTypeR1, argument, status, kSDSwitchStatusLength, 1, 1, NULL);
+}
+
+//
+// Switches the card and controller to 4-bit mode if both support it.
+// The SCR is read again to check the new mode, going back to 1-bit if that fails.
+//
+static void sdhc_negotiate_bus_width(sdhc_device_t *sdhc, int haveSCR) {
+  if (haveSCR && (sdhc->scr[kSDSCRBusWidthsByte] & kSDSCRBusWidth4Bit) == 0) {
+    SDHC_DPRINTF("Card does not support 4-bit mode\n");
+    return;
+  }
+
+  if (sdhc_set_card_bus_width(sdhc, kSDBusWidth4)) {
+    return;
+  }
+
+  if (haveSCR && sdhc_read_scr(sdhc)) {
+    SDHC_DPRINTF("4-bit mode failed, going back to 1-bit mode\n");
+    sdhc_set_card_bus_width(sdhc, kSDBusWidth1);
+    sdhc_set_bus_width(sdhc, kSDBusWidth1);
+  }
+}
+
+//
+// Switches the card and controller to high speed mode if both support it.
+// The SCR is read again at the new clock, going back to default speed on errors.
+//
+static void sdhc_negotiate_high_speed(sdhc_device_t *sdhc, uint32_t defaultClock) {
+  uint8_t status[kSDSwitchStatusLength];
+
+  if ((sdhc_read32(sdhc, kSDHCRegCapabilities) & kSDHCRegCapabilitiesHighSpeedSupported) == 0) {
+    SDHC_DPRINTF("Controller does not support high speed mode\n");
+    return;
+  }
+  if ((sdhc->scr[kSDSCRSpecByte] & kSDSCRSpecMask) < kSDSCRSpecVersion1_10 || (sdhc->csd.sd1.ccc & kSDCSDClassSwitch) == 0) {
+    SDHC_DPRINTF("Card does not support SWITCH_FUNC\n");
+    return;
+  }
+
+  if (sdhc_switch_function(sdhc, 0, kSDSwitchFunctionHighSpeed, status)) {
+    return;
+  }
+  if ((status[kSDSwitchStatusGroup1SupportByte] & kSDSwitchStatusGroup1HighSpeed) == 0) {
+    SDHC_DPRINTF("Card does not support high speed mode\n");
+    return;
+  }
+
+  if (sdhc_switch_function(sdhc, 1, kSDSwitchFunctionHighSpeed, status)) {
+    return;
+  }
+  if ((status[kSDSwitchStatusGroup1ResultByte] & kSDSwitchStatusGroup1ResultMask) != kSDSwitchFunctionHighSpeed) {
+    SDHC_DPRINTF("Card did not switch to high speed mode\n");
+    return;
+  }
+
+  sdhc_set_high_speed(sdhc, 1);
+  if (sdhc_set_clock(sdhc, kSDHCHighSpeedClock50MHz) == 0 && sdhc_read_scr(sdhc) == 0) {
+    SDHC_DPRINTF("Card is now in high speed mode\n");
+    return;
+  }
+
+  SDHC_DPRINTF("High speed mode failed, going back to default speed\n");
+  sdhc_set_high_speed(sdhc, 0);
+  sdhc_set_clock(sdhc, defaultClock);
+}
+
+//
+// Negotiates the fastest bus width and speed, and publishes the result on the controller node.
+//
+static void sdhc_negotiate_bus(sdhc_device_t *sdhc, phandle_t ph, uint32_t defaultClock) {
+  const char  *speedMode;
+  int         haveSCR;
+
+  haveSCR = sdhc_read_scr(sdhc) == 0;
+  sdhc_negotiate_bus_width(sdhc, haveSCR);
+  if (haveSCR) {
+    sdhc_negotiate_high_speed(sdhc, defaultClock);
+  }
+
+  SDHC_DPRINTF("Bus is %u-bit at %u kHz, %s speed\n", sdhc->bus_width == kSDBusWidth4 ? 4 : 1,
+               sdhc->clock_hz / kHz, sdhc->is_high_speed ? "high" : "default");
+
+  set_int_property(ph, "bus-width", sdhc->bus_width == kSDBusWidth4 ? 4 : 1);
+  set_int_property(ph, "bus-frequency", sdhc->clock_hz);
+  speedMode = sdhc->is_high_speed ? "high-speed" : "default-speed";
+  set_property(ph, "speed-mode", speedMode, strlen(speedMode) + 1);
+}
+
+//
+// Gets the command argument for a block, standard capacity cards are byte addressed.
+//
+static inline uint32_t sdhc_block_arg(sdhc_device_t *sdhc, uint32_t block) {
+  return sdhc->is_card_high_capacity ? block : block * kSDBlockSize;
+}
+
+//
+// Waits for the card to finish programming and return to the transfer state.
+//
+static int sdhc_wait_card_ready(sdhc_device_t *sdhc) {
+  sd_cmd_response_t sdResponse;
+  uint32_t          timeout;
+
+  //
+  // The card holds DAT0 low while busy.
+  //
+  if (sdhc_poll32(sdhc, kSDHCRegPresentState, kSDHCRegPresentStateDat0Level, 1, kSDHCCommandTimeoutMS, NULL)) {
+    SDHC_DPRINTF("Timed out waiting for DAT0 to be released\n");
+    return 1;
+  }
+
+  for (timeout = kSDHCCommandTimeoutMS / MS_MICROSECONDS; timeout > 0; timeout--) {
+    if (sdhc_command(sdhc, kSDCommandSendStatus, kSDHCResponseTypeR1, sdhc->card_addr << kSDRelativeAddressShift, NULL, 0, 0, &sdResponse)) {
+      return 1;
+    }
+    if ((sdResponse.r1 & kSDCardStatusReadyForData)
+        && ((sdResponse.r1 & kSDCardStatusStateMask) >> kSDCardStatusStateShift) == kSDCardStateTransfer) {
+      return 0;
+    }
+    mdelay(1);
+  }
+
+  SDHC_DPRINTF("Timed out waiting for card to become ready, status 0x%X\n", sdResponse.r1);
+  return 1;
+}
+
+//
+// Writes blocks to the card.
+// The card is told how many blocks follow so it can pre-erase them, the count is only a hint.
+//
+static int sdhc_write_blocks(sdhc_device_t *sdhc, uint32_t block, void *buffer, uint16_t blockCount) {
+  if (sdhc_is_sdcard(sdhc)) {
+    sdhc_app_command(sdhc, kSDAppCommandSetWrBlkEraseCount, kSDHCResponseTypeR1, blockCount, NULL, 0, 0, NULL);
+  }
+
+  if (sdhc_command(sdhc, kSDCommandWriteMultipleBlock, kSDHCResponseTypeR1, sdhc_block_arg(sdhc, block), buffer, blockCount, 0, NULL)) {
+    return 1;
+  }
+
+  return sdhc_wait_card_ready(sdhc);
+}
+
 //
 // OpenBIOS interface functions.
 //
@@ -657,8 +1063,9 @@ static int sdhc_set_block_length(sdhc_device_t *sdhc, uint16_t block_size) {
 // OF: Get max transfer size.
 //
 static void ob_wii_sdhc_max_transfer(int *idx) {
-    SDHC_DPRINTF("max_transfer %x\n", SDHC_BUFFER_SIZE);
-    PUSH(SDHC_BUFFER_SIZE);
+    sdhc_device_t *sdhc = *(sdhc_device_t **)idx;
+    SDHC_DPRINTF("max_transfer %x\n", sdhc->max_transfer);
+    PUSH(sdhc->max_transfer);
 }
 
 //
@@ -675,10 +1082,14 @@ static void ob_wii_sdhc_read_blocks(int *idx) {
 
     while (n) {
         int len = n;
-        if (len > (SDHC_BUFFER_SIZE / kSDBlockSize))
+        if (len > (sdhc->max_transfer / kSDBlockSize))
+            len = sdhc->max_transfer / kSDBlockSize;
+
+        /* Buffers that can't be DMAed into directly go through the temp buffer */
+        if (!sdhc_can_dma_direct(sdhc, dest, len * kSDBlockSize) && len > (SDHC_BUFFER_SIZE / kSDBlockSize))
             len = SDHC_BUFFER_SIZE / kSDBlockSize;
 
-        if (sdhc_command(sdhc, kSDCommandReadMultipleBlock, kSDHCResponseTypeR1, blk, dest, len, 1, NULL)) {
+        if (sdhc_command(sdhc, kSDCommandReadMultipleBlock, kSDHCResponseTypeR1, sdhc_block_arg(sdhc, blk), dest, len, 1, NULL)) {
             SDHC_DPRINTF("ob_wii_sdhc_read_blocks: error\n");
             RET(0);
         }
@@ -691,6 +1102,54 @@ static void ob_wii_sdhc_read_blocks(int *idx) {
     PUSH(cnt);
 }
 
+//
+// OF: Write blocks.
+//
+static void ob_wii_sdhc_write_blocks(int *idx) {
+    cell n = POP(), cnt=n;
+    ucell blk = POP();
+    unsigned char *src = (unsigned char *)cell2pointer(POP());
+    sdhc_device_t *sdhc = *(sdhc_device_t **)idx;
+
+    SDHC_DPRINTF("ob_wii_sdhc_write_blocks %lx block=%ld n=%ld\n",
+                (unsigned long)src, (unsigned long)blk, (long)n);
+
+    if (shdc_is_card_write_protected(sdhc)) {
+        SDHC_DPRINTF("ob_wii_sdhc_write_blocks: card is write protected\n");
+        RET(0);
+    }
+
+    while (n) {
+        int len = n;
+        if (len > (sdhc->max_transfer / kSDBlockSize))
+            len = sdhc->max_transfer / kSDBlockSize;
+
+        /* Buffers that can't be DMAed from directly go through the temp buffer */
+        if (!sdhc_can_dma_direct(sdhc, src, len * kSDBlockSize) && len > (SDHC_BUFFER_SIZE / kSDBlockSize))
+            len = SDHC_BUFFER_SIZE / kSDBlockSize;
+
+        if (sdhc_write_blocks(sdhc, blk, src, len)) {
+            SDHC_DPRINTF("ob_wii_sdhc_write_blocks: error\n");
+            RET(cnt - n);
+        }
+
+        src += len * sdhc->block_size;
+        n -= len;
+        blk += len;
+    }
+
+    PUSH(cnt);
+}
+
+//
+// OF: Flush, returns once the card has committed all written data.
+//
+static void ob_wii_sdhc_flush(int *idx) {
+    sdhc_device_t *sdhc = *(sdhc_device_t **)idx;
+
+    PUSH(sdhc_wait_card_ready(sdhc) ? 0 : -1);
+}
+
 //
 // OF: Gets the block size.
 //
@@ -756,6 +1215,8 @@ NODE_METHODS(ob_wii_sdhc) = {
     { "open",		ob_wii_sdhc_open		},
     { "close",		ob_wii_sdhc_close		},
     { "read-blocks",	ob_wii_sdhc_read_blocks	    },
+    { "write-blocks",	ob_wii_sdhc_write_blocks    },
+    { "flush",		ob_wii_sdhc_flush		},
     { "block-size",		ob_wii_sdhc_block_size	    },
     { "max-transfer",	ob_wii_sdhc_max_transfer	},
     { "dma-alloc",		ob_wii_sdhc_dma_alloc	    },
@@ -765,6 +1226,30 @@ NODE_METHODS(ob_wii_sdhc) = {
     { "dma-sync",		ob_wii_sdhc_dma_sync		},
 };
 
+static void sdhc_print_stats(const char *name, sdhc_transfer_stats_t *stats)
+{
+    /* bytes per microsecond is MB/s */
+    uint64_t rate = stats->time_us ? (stats->bytes * 100) / stats->time_us : 0;
+
+    printk("%s: %u commands, %lu KB, %lu us, %lu.%02lu MB/s\n", name, stats->commands,
+           (unsigned long)(stats->bytes / kByte), (unsigned long)stats->time_us,
+           (unsigned long)(rate / 100), (unsigned long)(rate % 100));
+}
+
+/* ( -- ) */
+static void sdhc_stats(void)
+{
+    sdhc_device_t *sdhc = sdhc_stats_device;
+
+    if (sdhc == NULL) {
+        printk("no SD card\n");
+        return;
+    }
+
+    sdhc_print_stats("direct DMA", &sdhc->direct_stats);
+    sdhc_print_stats("bounce buffer", &sdhc->bounce_stats);
+}
+
 static void set_hd_alias(const char *path)
 {
     phandle_t aliases;
@@ -781,8 +1266,10 @@ static void set_hd_alias(const char *path)
 int ob_wii_shdc_init(const char *path, unsigned long mmio_base) {
     phandle_t dnode;
     sdhc_device_t *sdhc;
+    uint32_t clock;
 
     sdhc = malloc(sizeof (*sdhc));
+    memset(sdhc, 0, sizeof (*sdhc));
     ofmem_posix_memalign((void **)&sdhc->buffer, SDHC_BUFFER_SIZE, SDHC_BUFFER_SIZE);
 
     sdhc->mmio_base = mmio_base;
@@ -794,6 +1281,7 @@ int ob_wii_shdc_init(const char *path, unsigned long mmio_base) {
         SDHC_DPRINTF("Failed to init SDHC");
         return 1;
     }
+    sdhc_init_adma(sdhc);
 
     //
     // Check if card is present.
@@ -816,7 +1304,8 @@ int ob_wii_shdc_init(const char *path, unsigned long mmio_base) {
         return 1;
     }
 
-    if (sdhc_set_clock(sdhc, kSDHCNormalSpeedClock25MHz)) {
+    clock = sdhc_get_csd_clock(sdhc);
+    if (sdhc_set_clock(sdhc, clock)) {
         return 1;
     }
 
@@ -824,9 +1313,7 @@ int ob_wii_shdc_init(const char *path, unsigned long mmio_base) {
         return 1;
     }
 
-    if (sdhc_set_card_bus_width(sdhc, kSDBusWidth4)) {
-        return 1;
-    }
+    sdhc_negotiate_bus(sdhc, find_dev(path), clock);
 
     if (sdhc_set_block_length(sdhc, kSDBlockSize)) {
         return 1;
@@ -857,5 +1344,8 @@ int ob_wii_shdc_init(const char *path, unsigned long mmio_base) {
 
     set_hd_alias(get_path_from_ph(dnode));
 
+    sdhc_stats_device = sdhc;
+    bind_func(".sdhc-stats", sdhc_stats);
+
     return 0;
 }
@@ -59,6 +59,9 @@
 #define kSDHCClockTimeoutMS     (2000 * MS_MICROSECONDS)
 #define kSDHCCommandTimeoutMS   (5000 * MS_MICROSECONDS)
 
+// Longest sleep between polls of a status register.
+#define kSDHCPollMaxDelayUS     MS_MICROSECONDS
+
 #define kSDBlockSize              512
 
 //
@@ -78,6 +81,7 @@ typedef enum {
 #define kSDHCNormalSpeedClock25MHz        (25 * MHz)
 #define kSDHCNormalSpeedClock26MHz        (26 * MHz)
 #define kSDHCHighSpeedClock25MHz          (50 * MHz)
+#define kSDHCHighSpeedClock50MHz          (50 * MHz)
 
 //
 // Bus widths.
@@ -167,12 +171,15 @@ typedef struct {
 #define kSDHCRegPresentStateCardInserted        BIT16
 #define kSDHCRegPresentStateCardStable          BIT17
 #define kSDHCRegPresentStateCardWriteable       BIT19
+#define kSDHCRegPresentStateDat0Level           BIT20
 // Host control register.
 #define kSDHCRegHostControl1                    0x28
 #define kSDHCRegHostControl1LEDOn               BIT0
 #define kSDHCRegHostControl1DataWidth4Bit       BIT1
 #define kSDHCRegHostControl1HighSpeedEnable     BIT2
 #define kSDHCRegHostControl1DataWidth8Bit       BIT5
+#define kSDHCRegHostControl1DMASelectADMA2      BIT4
+#define kSDHCRegHostControl1DMASelectMask       (BIT3 | BIT4)
 #define kSDHCRegHostControl1DataWidthMask       (kSDHCRegHostControl1DataWidth4Bit | kSDHCRegHostControl1DataWidth8Bit)
 // Power control register.
 #define kSDHCRegPowerControl                    0x29
@@ -223,6 +230,7 @@ typedef struct {
 #define kSDHCRegErrorIntStatusDataEndBit          BIT6
 #define kSDHCRegErrorIntStatusCurrentLimit        BIT7
 #define kSDHCRegErrorIntStatusAutoCMD12           BIT8
+#define kSDHCRegErrorIntStatusADMA                BIT9
 // Interrupt enable.
 #define kSDHCRegNormalIntStatusEnable             0x34
 // Error interrupt enable.
@@ -241,6 +249,7 @@ typedef struct {
 #define kSDHCRegCapabilitiesBaseClockShift        8
 #define kSDHCRegCapabilitiesMaxBlockLength1024    BIT16
 #define kSDHCRegCapabilitiesMaxBlockLength2048    BIT17
+#define kSDHCRegCapabilitiesADMA2Supported        BIT19
 #define kSDHCRegCapabilitiesHighSpeedSupported    BIT21
 #define kSDHCRegCapabilitiesSDMASupported         BIT22
 #define kSDHCRegCapabilitiesSuspendSupported      BIT23
@@ -249,6 +258,10 @@ typedef struct {
 #define kSDHCRegCapabilitiesVoltage1_8Supported   BIT26
 // Maximum power current capabilities.
 #define kSDHCRegMaxCurrentCapabilities            0x48
+// ADMA error status.
+#define kSDHCRegADMAErrorStatus                   0x54
+// ADMA system address.
+#define kSDHCRegADMASystemAddress                 0x58
 // Slot interrupt status.
 #define kSDHCRegHostControllerSlotIntStatus   0xFC
 // Controller version.
@@ -265,6 +278,45 @@ typedef struct {
 
 #define kSDRelativeAddressShift   16
 
+//
+// Card status bits (R1 response).
+//
+#define kSDCardStatusReadyForData   BIT8
+#define kSDCardStatusStateMask      (BIT9 | BIT10 | BIT11 | BIT12)
+#define kSDCardStatusStateShift     9
+#define kSDCardStateTransfer        4
+
+//
+// SCR bits, in the byte order sent by the card.
+//
+#define kSDSCRSpecByte            0
+#define kSDSCRSpecMask            0x0F
+#define kSDSCRSpecVersion1_10     1
+#define kSDSCRBusWidthsByte       1
+#define kSDSCRBusWidth1Bit        BIT0
+#define kSDSCRBusWidth4Bit        BIT2
+
+//
+// SWITCH_FUNC argument and status.
+// Only the access mode group (group 1) is switched, all others are left as is.
+//
+#define kSDSwitchFunctionModeSet                BIT31
+#define kSDSwitchFunctionGroupsDefault          0x00FFFFF0
+#define kSDSwitchFunctionHighSpeed              1
+#define kSDSwitchStatusLength                   64
+#define kSDSwitchStatusGroup1SupportByte        13
+#define kSDSwitchStatusGroup1HighSpeed          BIT1
+#define kSDSwitchStatusGroup1ResultByte         16
+#define kSDSwitchStatusGroup1ResultMask         0x0F
+
+//
+// CSD fields.
+//
+#define kSDCSDTranSpeedUnitMask   0x07
+#define kSDCSDTranSpeedValueMask  0x78
+#define kSDCSDTranSpeedValueShift 3
+#define kSDCSDClassSwitch         BIT10
+
 //
 // SD commands.
 //
@@ -276,6 +328,7 @@ typedef enum {
   kSDCommandAllSendCID            = 2,
   kSDCommandSendRelativeAddress   = 3,
   kSDCommandSetDSR                = 4,
+  kSDCommandSwitchFunction        = 6,
   kSDCommandSelectDeselectCard    = 7,
   kSDCommandSendIfCond            = 8,
   kSDCommandSendCSD               = 9,
@@ -486,6 +539,37 @@ typedef union {
 #pragma pack(pop)
 
 #define SDHC_BUFFER_SIZE        4096
+#define SDHC_MAX_TRANSFER_SIZE  (512 * kByte)
+#define SDHC_ADMA_MAX_TRANSFER_SIZE (4096 * kByte)
+
+// SDMA buffers must also be cache line aligned to be used directly.
+#define kSDHCDMAAlignment       32
+
+//
+// ADMA2 descriptor for 32-bit addressing.
+// Fields are little endian as the controller fetches them by DMA, unlike the byte-swapped registers.
+//
+typedef struct {
+  uint32_t  attributes;
+  uint32_t  address;
+} sdhc_adma2_desc_t;
+
+#define kSDHCADMA2DescValid         BIT0
+#define kSDHCADMA2DescEnd           BIT1
+#define kSDHCADMA2DescInterrupt     BIT2
+#define kSDHCADMA2DescActTran       BIT5
+#define kSDHCADMA2DescActLink       (BIT4 | BIT5)
+#define kSDHCADMA2DescLengthShift   16
+#define kSDHCADMA2MaxLength         (32 * kByte)
+
+// Enough for a maximum sized transfer scattered over every page.
+#define kSDHCADMA2DescCount         ((SDHC_ADMA_MAX_TRANSFER_SIZE >> PAGE_SHIFT) + 1)
+
+typedef struct {
+    uint32_t commands;
+    uint64_t bytes;
+    uint64_t time_us;
+} sdhc_transfer_stats_t;
 
 typedef struct {
     uint32_t mmio_base;
@@ -500,8 +584,18 @@ typedef struct {
 
     sd_cid_register_t  cid;
     sd_csd_register_t  csd;
+    uint8_t            scr[8];
+
+    sdhc_bus_width_t  bus_width;
+    int               is_high_speed;
+    uint32_t          clock_hz;
 
     unsigned char *buffer;
+    sdhc_adma2_desc_t *adma_table;
+    uint32_t          max_transfer;
+
+    sdhc_transfer_stats_t direct_stats;
+    sdhc_transfer_stats_t bounce_stats;
 } sdhc_device_t;
 
 #endif
@@ -145,7 +145,7 @@ variable locals-dict-buf
 : >body ( xt -- a-addr )  /n 1 lshift + ;
 : body> ( a-addr -- xt )  /n 1 lshift - ;
 
-: reveal latest @ last ! ;
+: reveal latest @ last ! last (index-wordlist) ;
 : recursive reveal ; immediate
 : recurse latest @ /n +  , ; immediate
 
@@ -940,14 +940,14 @@ variable #out  0 #out  !
   vocabularies? if
     #order @ 0 ?do
       i cells context + @
-      find-wordlist
+      (find-wordlist)
       ?dup if
         unloop exit
       then
     loop
     false
   else
-    forth-last find-wordlist
+    forth-last (find-wordlist)
   then
   ;
 
@@ -958,7 +958,12 @@ variable #out  0 #out  !
   else
     forth-last
   then
-  find-wordlist
+  \ the locals dictionary is rebuilt in place, so keep it out of the index
+  dup locals-dict-buf @ = if
+    find-wordlist
+  else
+    (find-wordlist)
+  then
   ;
 
   
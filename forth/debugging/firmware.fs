@@ -40,6 +40,15 @@
 \   \ Implemented in forth bootstrap.
 \   ;
 
+: .dict-stats    ( -- )
+  base @ >r decimal
+  (dict-stats) >r swap
+  ." dictionary lookups: " u. cr
+  ." name comparisons: " u. cr
+  ." indexed words: " r> u. cr
+  r> base !
+  ;
+
   
 \ 7.5.3.2    Decompiler
 
@@ -67,7 +67,7 @@
 
 : find-method ( method-str method-len phandle -- false | xt true )
   \ should we search the private wordlist too? I don't think so...
-  >dn.methods @ find-wordlist if
+  >dn.methods @ (find-wordlist) if
     true
   else
     2drop false
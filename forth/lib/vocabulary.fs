@@ -20,7 +20,7 @@ create vocabularies #vocs cells allot \ word lists
   \ list identified by wid. If the definition is not found, return zero. 
   \ If the definition is found, return its execution token xt and
   \ one (1) if the definition is immediate, minus-one (-1) otherwise.
-  find-wordlist
+  (find-wordlist)
   if
     true over immediate? if
       negate
@@ -11,11 +11,18 @@
 
 #include "ext2_fs.h"
 
+/* Number of indirect, extent and inode table blocks kept per volume */
+#define EXT2_META_CACHE	16
+
 typedef struct ext2_VOLUME {
         int fd;
 	struct ext2_super_block *super;
 	unsigned int current;
 	char *buffer;
+	char *meta;				/* EXT2_META_CACHE blocks */
+	unsigned int meta_block[EXT2_META_CACHE];
+	unsigned int meta_lru[EXT2_META_CACHE];
+	unsigned int meta_tick;
 } ext2_VOLUME;
 
 typedef struct ext2_DIR {
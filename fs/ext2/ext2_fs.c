@@ -33,6 +33,9 @@ typedef struct {
 
 DECLARE_NODE( ext2, 0, sizeof(ext2_info_t), "+/packages/ext2-files" );
 
+/* Statistics for the last load */
+static unsigned long load_bytes, load_reads;
+
 
 static const int days_month[12] =
 	{ 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
@@ -178,6 +181,7 @@ static void
 ext2_files_load( ext2_info_t *mi )
 {
 	char *buf = (char *)cell2pointer(POP());
+	unsigned long reads = ext2_read_count;
 	int count;
 
 	ext2_COMMON *common = mi->common;
@@ -189,7 +193,21 @@ ext2_files_load( ext2_info_t *mi )
 	count = common->file->offset;
 	ext2_lseek(common->file, 0, SEEK_SET);
 
-	RET ( ext2_read( common->file, buf, count ) );
+	count = ext2_read( common->file, buf, count );
+	load_bytes = count;
+	load_reads = ext2_read_count - reads;
+
+	RET ( count );
+}
+
+/* ( -- ) */
+static void
+ext2_print_stats( void )
+{
+	forth_printf("last load: %lu bytes in %lu reads\n",
+		     load_bytes, load_reads);
+	forth_printf("total: %lu reads, metadata cache %lu hits, %lu misses\n",
+		     ext2_read_count, ext2_meta_hits, ext2_meta_misses);
 }
 
 /* ( -- cstr ) */
@@ -306,4 +324,5 @@ void
 ext2_init( void )
 {
 	REGISTER_NODE( ext2 );
+	bind_func( ".ext2-stats", ext2_print_stats );
 }
@@ -121,7 +121,10 @@ struct ext2_group_desc
  * Macro-instructions used to manage group descriptors
  */
 # define EXT2_BLOCKS_PER_GROUP(s)	((s)->s_blocks_per_group)
-# define EXT2_DESC_PER_BLOCK(s)		(EXT2_BLOCK_SIZE(s) / sizeof (struct ext2_group_desc))
+# define EXT2_DESC_SIZE(s)		(((s)->s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) && \
+					 (s)->s_desc_size ? (s)->s_desc_size : \
+					 sizeof (struct ext2_group_desc))
+# define EXT2_DESC_PER_BLOCK(s)		(EXT2_BLOCK_SIZE(s) / EXT2_DESC_SIZE(s))
 # define EXT2_INODES_PER_GROUP(s)	((s)->s_inodes_per_group)
 
 /*
@@ -158,6 +161,7 @@ struct ext2_group_desc
 #define EXT2_DIRSYNC_FL			FS_DIRSYNC_FL	/* dirsync behaviour (directories only) */
 #define EXT2_TOPDIR_FL			FS_TOPDIR_FL	/* Top of directory hierarchies*/
 #define EXT2_RESERVED_FL		FS_RESERVED_FL	/* reserved for ext2 lib */
+#define EXT4_EXTENTS_FL			0x00080000	/* Inode uses extents */
 
 #define EXT2_FL_USER_VISIBLE		FS_FL_USER_VISIBLE	/* User visible flags */
 #define EXT2_FL_USER_MODIFIABLE		FS_FL_USER_MODIFIABLE	/* User modifiable flags */
@@ -380,7 +384,7 @@ struct ext2_super_block {
 	uint32_t	s_hash_seed[4];		/* HTREE hash seed */
 	uint8_t	s_def_hash_version;	/* Default hash version to use */
 	uint8_t	s_reserved_char_pad;
-	uint16_t	s_reserved_word_pad;
+	uint16_t	s_desc_size;		/* Group descriptor size (64bit) */
 	uint32_t	s_default_mount_opts;
  	uint32_t	s_first_meta_bg; 	/* First metablock block group */
 	uint32_t	s_reserved[190];	/* Padding to the end of the block */
@@ -447,11 +451,17 @@ struct ext2_super_block {
 #define EXT3_FEATURE_INCOMPAT_RECOVER		0x0004
 #define EXT3_FEATURE_INCOMPAT_JOURNAL_DEV	0x0008
 #define EXT2_FEATURE_INCOMPAT_META_BG		0x0010
+#define EXT3_FEATURE_INCOMPAT_EXTENTS		0x0040
+#define EXT4_FEATURE_INCOMPAT_64BIT		0x0080
+#define EXT4_FEATURE_INCOMPAT_FLEX_BG		0x0200
 #define EXT2_FEATURE_INCOMPAT_ANY		0xffffffff
 
 #define EXT2_FEATURE_COMPAT_SUPP	EXT2_FEATURE_COMPAT_EXT_ATTR
 #define EXT2_FEATURE_INCOMPAT_SUPP	(EXT2_FEATURE_INCOMPAT_FILETYPE| \
-					 EXT2_FEATURE_INCOMPAT_META_BG)
+					 EXT2_FEATURE_INCOMPAT_META_BG| \
+					 EXT3_FEATURE_INCOMPAT_EXTENTS| \
+					 EXT4_FEATURE_INCOMPAT_64BIT| \
+					 EXT4_FEATURE_INCOMPAT_FLEX_BG)
 #define EXT2_FEATURE_RO_COMPAT_SUPP	(EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER| \
 					 EXT2_FEATURE_RO_COMPAT_LARGE_FILE| \
 					 EXT2_FEATURE_RO_COMPAT_BTREE_DIR)
@@ -478,6 +488,36 @@ struct ext2_super_block {
 #define EXT3_DEFM_JMODE_ORDERED	0x0040
 #define EXT3_DEFM_JMODE_WBACK	0x0060
 
+/*
+ * Structure of the ext4 extent tree. The header is at the start of
+ * i_block and of each tree block, followed by index entries in
+ * inner nodes and by extents in leaves.
+ */
+#define EXT4_EXT_MAGIC		0xf30a
+#define EXT4_EXT_INIT_MAX_LEN	32768	/* longer extents are uninitialized */
+
+struct ext4_extent_header {
+	uint16_t	eh_magic;		/* EXT4_EXT_MAGIC */
+	uint16_t	eh_entries;		/* Number of valid entries */
+	uint16_t	eh_max;			/* Capacity of the node */
+	uint16_t	eh_depth;		/* 0 for leaves */
+	uint32_t	eh_generation;
+};
+
+struct ext4_extent_idx {
+	uint32_t	ei_block;		/* First logical block covered */
+	uint32_t	ei_leaf_lo;		/* Block of the next level */
+	uint16_t	ei_leaf_hi;
+	uint16_t	ei_unused;
+};
+
+struct ext4_extent {
+	uint32_t	ee_block;		/* First logical block */
+	uint16_t	ee_len;			/* Number of blocks */
+	uint16_t	ee_start_hi;
+	uint32_t	ee_start_lo;		/* First physical block */
+};
+
 /*
  * Structure of a directory entry
  */
@@ -17,6 +17,7 @@ ext2_VOLUME* ext2_mount(int fd)
 	ext2_VOLUME *volume;
 	struct ext2_super_block *super;
 	char *buffer;
+	int i;
 
 	super = (struct ext2_super_block*)malloc(sizeof(struct ext2_super_block));
 	if (super == NULL)
@@ -41,6 +42,19 @@ ext2_VOLUME* ext2_mount(int fd)
 		return NULL;
 	}
 
+	volume->meta = (char*)malloc(EXT2_META_CACHE * EXT2_BLOCK_SIZE(super));
+	if (volume->meta == NULL) {
+		free(super);
+		free(buffer);
+		free(volume);
+		return NULL;
+	}
+	for (i = 0; i < EXT2_META_CACHE; i++) {
+		volume->meta_block[i] = -1;
+		volume->meta_lru[i] = 0;
+	}
+	volume->meta_tick = 0;
+
 	volume->buffer = buffer;
 	volume->fd = fd;
 	volume->super = super;
@@ -57,6 +71,7 @@ int ext2_umount(ext2_VOLUME* volume)
 		return -1;
 	free(volume->super);
 	free(volume->buffer);
+	free(volume->meta);
 	free(volume);
 	return 0;
 }
@@ -77,20 +77,60 @@ void ext2_get_super(int fd, struct ext2_super_block *super)
 	super->s_default_mount_opts =
 				__le32_to_cpu(super->s_default_mount_opts);
 	super->s_first_meta_bg = __le32_to_cpu(super->s_first_meta_bg);
+	super->s_desc_size = __le16_to_cpu(super->s_desc_size);
 }
 
-void ext2_read_block(ext2_VOLUME* volume, unsigned int fsblock)
+unsigned long ext2_read_count, ext2_meta_hits, ext2_meta_misses;
+
+/* Read count blocks starting at fsblock with a single request */
+static int ext2_read_blocks(ext2_VOLUME* volume, unsigned int fsblock,
+			    char *buffer, unsigned int count)
 {
-	long long offset;
+	int blocksize = EXT2_BLOCK_SIZE(volume->super);
+
+	ext2_read_count++;
+	seek_io(volume->fd, (long long)fsblock * blocksize);
+	if (read_io(volume->fd, buffer, count * blocksize) != (int)(count * blocksize))
+		return -1;
+	return 0;
+}
 
+void ext2_read_block(ext2_VOLUME* volume, unsigned int fsblock)
+{
 	if (fsblock == volume->current)
 		return;
 
 	volume->current = fsblock;
-	offset = fsblock * EXT2_BLOCK_SIZE(volume->super);
+	ext2_read_blocks(volume, fsblock, volume->buffer, 1);
+}
+
+/* Return a metadata block (group descriptors, inode table, indirect
+ * or extent tree block). These are cached apart from volume->buffer,
+ * so reading file data does not evict them. The result is valid
+ * until the next call. */
+char *ext2_read_meta(ext2_VOLUME* volume, unsigned int fsblock)
+{
+	int blocksize = EXT2_BLOCK_SIZE(volume->super);
+	int i, victim = 0;
+
+	volume->meta_tick++;
+	for (i = 0; i < EXT2_META_CACHE; i++) {
+		if (volume->meta_block[i] == fsblock) {
+			ext2_meta_hits++;
+			volume->meta_lru[i] = volume->meta_tick;
+			return volume->meta + i * blocksize;
+		}
+		if (volume->meta_lru[i] < volume->meta_lru[victim])
+			victim = i;
+	}
 
-	seek_io(volume->fd, offset);
-	read_io(volume->fd, volume->buffer, EXT2_BLOCK_SIZE(volume->super));
+	ext2_meta_misses++;
+	volume->meta_block[victim] = -1;
+	if (ext2_read_blocks(volume, fsblock, volume->meta + victim * blocksize, 1))
+		return NULL;
+	volume->meta_block[victim] = fsblock;
+	volume->meta_lru[victim] = volume->meta_tick;
+	return volume->meta + victim * blocksize;
 }
 
 void ext2_get_group_desc(ext2_VOLUME* volume,
@@ -98,15 +138,20 @@ void ext2_get_group_desc(ext2_VOLUME* volume,
 {
 	unsigned int block, offset;
 	struct ext2_group_desc *le_gdp;
+	char *buffer;
 
 	block = 1 + volume->super->s_first_data_block;
 	block += group_id / EXT2_DESC_PER_BLOCK(volume->super);
-	ext2_read_block(volume,  block);
+	buffer = ext2_read_meta(volume,  block);
+	if (buffer == NULL) {
+		memset(gdp, 0, sizeof(*gdp));
+		return;
+	}
 
 	offset = group_id % EXT2_DESC_PER_BLOCK(volume->super);
-	offset *= sizeof(*gdp);
+	offset *= EXT2_DESC_SIZE(volume->super);
 
-	le_gdp = (struct ext2_group_desc *)(volume->buffer + offset);
+	le_gdp = (struct ext2_group_desc *)(buffer + offset);
 
 	gdp->bg_block_bitmap = __le32_to_cpu(le_gdp->bg_block_bitmap);
 	gdp->bg_inode_bitmap = __le32_to_cpu(le_gdp->bg_inode_bitmap);
@@ -124,6 +169,7 @@ int ext2_get_inode(ext2_VOLUME* volume,
 	unsigned int group_id;
 	unsigned int offset;
 	struct ext2_inode *le_inode;
+	char *buffer;
 	int i;
 
 	ino--;
@@ -136,13 +182,15 @@ int ext2_get_inode(ext2_VOLUME* volume,
 	block = desc.bg_inode_table;
 	block += ino / (EXT2_BLOCK_SIZE(volume->super) /
 			EXT2_INODE_SIZE(volume->super));
-	ext2_read_block(volume, block);
+	buffer = ext2_read_meta(volume, block);
+	if (buffer == NULL)
+		return -1;
 
 	offset = ino % (EXT2_BLOCK_SIZE(volume->super) /
 			EXT2_INODE_SIZE(volume->super));
 	offset *= EXT2_INODE_SIZE(volume->super);
 
-	le_inode = (struct ext2_inode *)(volume->buffer + offset);
+	le_inode = (struct ext2_inode *)(buffer + offset);
 
 	inode->i_mode = __le16_to_cpu(le_inode->i_mode);
 	inode->i_uid = __le16_to_cpu(le_inode->i_uid);
@@ -155,7 +203,8 @@ int ext2_get_inode(ext2_VOLUME* volume,
 	inode->i_links_count = __le16_to_cpu(le_inode->i_links_count);
 	inode->i_blocks = __le32_to_cpu(le_inode->i_blocks);
 	inode->i_flags = __le32_to_cpu(le_inode->i_flags);
-	if (S_ISLNK(inode->i_mode)) {
+	if (S_ISLNK(inode->i_mode) || (inode->i_flags & EXT4_EXTENTS_FL)) {
+		/* symlink target or extent tree, kept in disk order */
 		memcpy(inode->i_block, le_inode->i_block, EXT2_N_BLOCKS * 4);
 	} else {
 		for (i = 0; i < EXT2_N_BLOCKS; i++)
@@ -174,8 +223,19 @@ int ext2_get_inode(ext2_VOLUME* volume,
 	return 0;
 }
 
-unsigned int ext2_get_block_addr(ext2_VOLUME* volume, struct ext2_inode *inode,
-				 unsigned int logical)
+static unsigned int ext2_get_indirect(ext2_VOLUME* volume, unsigned int block,
+				      unsigned int index)
+{
+	unsigned int *table = (unsigned int *)ext2_read_meta(volume, block);
+
+	if (table == NULL)
+		return 0;
+	return __le32_to_cpu(table[index]);
+}
+
+static unsigned int ext2_get_block_map(ext2_VOLUME* volume,
+				       struct ext2_inode *inode,
+				       unsigned int logical)
 {
 	unsigned int physical;
 	unsigned int addr_per_block;
@@ -193,8 +253,9 @@ unsigned int ext2_get_block_addr(ext2_VOLUME* volume, struct ext2_inode *inode,
 
 	addr_per_block = EXT2_ADDR_PER_BLOCK (volume->super);
 	if (logical < addr_per_block) {
-		ext2_read_block(volume, inode->i_block[EXT2_IND_BLOCK]);
-		physical = __le32_to_cpu(((unsigned int *)volume->buffer)[logical]);
+		physical = ext2_get_indirect(volume,
+					     inode->i_block[EXT2_IND_BLOCK],
+					     logical);
 		return physical;
 	}
 
@@ -203,33 +264,129 @@ unsigned int ext2_get_block_addr(ext2_VOLUME* volume, struct ext2_inode *inode,
 	logical -=  addr_per_block;
 
 	if (logical < addr_per_block * addr_per_block) {
-		ext2_read_block(volume, inode->i_block[EXT2_DIND_BLOCK]);
-		physical = __le32_to_cpu(((unsigned int *)volume->buffer)
-						[logical / addr_per_block]);
-		ext2_read_block(volume, physical);
-		physical = __le32_to_cpu(((unsigned int *)volume->buffer)
-						[logical % addr_per_block]);
+		physical = ext2_get_indirect(volume,
+					     inode->i_block[EXT2_DIND_BLOCK],
+					     logical / addr_per_block);
+		if (physical == 0)
+			return 0;
+		physical = ext2_get_indirect(volume, physical,
+					     logical % addr_per_block);
 		return physical;
 	}
 
 	/* triple indirect */
 
 	logical -= addr_per_block * addr_per_block;
-	ext2_read_block(volume, inode->i_block[EXT2_DIND_BLOCK]);
-	physical = __le32_to_cpu(((unsigned int *)volume->buffer)
-				[logical / (addr_per_block * addr_per_block)]);
-	ext2_read_block(volume, physical);
+	physical = ext2_get_indirect(volume, inode->i_block[EXT2_TIND_BLOCK],
+				logical / (addr_per_block * addr_per_block));
+	if (physical == 0)
+		return 0;
 	logical = logical % (addr_per_block * addr_per_block);
-	physical = __le32_to_cpu(((unsigned int *)volume->buffer)[logical / addr_per_block]);
-	ext2_read_block(volume, physical);
-	physical = __le32_to_cpu(((unsigned int *)volume->buffer)[logical % addr_per_block]);
+	physical = ext2_get_indirect(volume, physical, logical / addr_per_block);
+	if (physical == 0)
+		return 0;
+	physical = ext2_get_indirect(volume, physical, logical % addr_per_block);
+	return physical;
+}
+
+/* Find logical in the extent tree of inode. *count is clipped to the
+ * number of blocks that follow contiguously, holes return 0. Block
+ * numbers are 32 bits here, so extents of 64bit file systems that lie
+ * above that return EXT2_BLOCK_ERROR. */
+static unsigned int ext4_get_extent(ext2_VOLUME* volume,
+				    struct ext2_inode *inode,
+				    unsigned int logical, unsigned int *count)
+{
+	struct ext4_extent_header *eh;
+	struct ext4_extent_idx *ei;
+	struct ext4_extent *ex;
+	unsigned int start, len;
+	int i, n, uninit;
+
+	eh = (struct ext4_extent_header *)inode->i_block;
+	while (1) {
+		if (__le16_to_cpu(eh->eh_magic) != EXT4_EXT_MAGIC)
+			return 0;
+		n = __le16_to_cpu(eh->eh_entries);
+		if (n == 0 || eh->eh_depth == 0)
+			break;
+
+		/* last index entry starting at or before logical */
+		ei = (struct ext4_extent_idx *)(eh + 1);
+		for (i = 1; i < n; i++)
+			if (__le32_to_cpu(ei[i].ei_block) > logical)
+				break;
+		if (ei[i - 1].ei_leaf_hi)
+			return EXT2_BLOCK_ERROR;
+		eh = (struct ext4_extent_header *)
+			ext2_read_meta(volume, __le32_to_cpu(ei[i - 1].ei_leaf_lo));
+		if (eh == NULL)
+			return 0;
+	}
+
+	ex = (struct ext4_extent *)(eh + 1);
+	for (i = n - 1; i >= 0; i--)
+		if (__le32_to_cpu(ex[i].ee_block) <= logical)
+			break;
+
+	if (i >= 0) {
+		start = __le32_to_cpu(ex[i].ee_block);
+		len = __le16_to_cpu(ex[i].ee_len);
+		uninit = len > EXT4_EXT_INIT_MAX_LEN;
+		if (uninit)
+			len -= EXT4_EXT_INIT_MAX_LEN;
+
+		if (logical - start < len) {
+			*count = MIN(*count, start + len - logical);
+			if (uninit)
+				return 0;	/* allocated but unwritten */
+			if (ex[i].ee_start_hi)
+				return EXT2_BLOCK_ERROR;
+			return __le32_to_cpu(ex[i].ee_start_lo) +
+			       (logical - start);
+		}
+	}
+
+	/* hole up to the next extent, or one block if unknown */
+	if (i + 1 < n)
+		*count = MIN(*count, __le32_to_cpu(ex[i + 1].ee_block) - logical);
+	else
+		*count = 1;
+	return 0;
+}
+
+/* Map logical to a physical block, 0 for a hole. On return *count
+ * holds how many of the next *count blocks are physically contiguous
+ * (or all holes), so they can be read with one request. */
+unsigned int ext2_get_block_run(ext2_VOLUME* volume, struct ext2_inode *inode,
+				unsigned int logical, unsigned int *count)
+{
+	unsigned int physical, n;
+
+	if (inode->i_flags & EXT4_EXTENTS_FL)
+		return ext4_get_extent(volume, inode, logical, count);
+
+	physical = ext2_get_block_map(volume, inode, logical);
+	for (n = 1; n < *count; n++)
+		if (ext2_get_block_map(volume, inode, logical + n) !=
+		    (physical ? physical + n : 0))
+			break;
+	*count = n;
 	return physical;
 }
 
+unsigned int ext2_get_block_addr(ext2_VOLUME* volume, struct ext2_inode *inode,
+				 unsigned int logical)
+{
+	unsigned int count = 1;
+
+	return ext2_get_block_run(volume, inode, logical, &count);
+}
+
 int ext2_read_data(ext2_VOLUME* volume, struct ext2_inode *inode,
 		   off_t offset, char *buffer, size_t length)
 {
-	unsigned int logical, physical;
+	unsigned int logical, physical, count;
 	int blocksize = EXT2_BLOCK_SIZE(volume->super);
 	int shift;
 	size_t read;
@@ -244,37 +401,43 @@ int ext2_read_data(ext2_VOLUME* volume, struct ext2_inode *inode,
 	logical = offset / blocksize;
 	shift = offset % blocksize;
 
-	if (shift) {
-		physical = ext2_get_block_addr(volume, inode, logical);
-		ext2_read_block(volume, physical);
-
-		if (length < blocksize - shift) {
-			memcpy(buffer, volume->buffer + shift, length);
-			return length;
-		}
-		read += blocksize - shift;
-		memcpy(buffer, volume->buffer + shift, read);
-
-		buffer += read;
-		length -= read;
-		logical++;
-	}
-
 	while (length) {
-		physical = ext2_get_block_addr(volume, inode, logical);
-		ext2_read_block(volume, physical);
-
-		if (length < blocksize) {
-			memcpy(buffer, volume->buffer, length);
-			read += length;
-			return read;
+		/* whole blocks go straight to the caller, one request per run */
+		if (!shift && length >= blocksize) {
+			count = length / blocksize;
+			physical = ext2_get_block_run(volume, inode, logical, &count);
+			if (physical == EXT2_BLOCK_ERROR)
+				return read ? read : -1;
+			if (physical == 0)
+				memset(buffer, 0, count * blocksize);
+			else if (ext2_read_blocks(volume, physical, buffer, count))
+				return read ? read : -1;
+
+			buffer += count * blocksize;
+			length -= count * blocksize;
+			read += count * blocksize;
+			logical += count;
+			continue;
 		}
-		memcpy(buffer, volume->buffer, blocksize);
 
-		buffer += blocksize;
-		length -= blocksize;
-		read += blocksize;
+		/* partial block, through volume->buffer */
+		physical = ext2_get_block_addr(volume, inode, logical);
+		if (physical == EXT2_BLOCK_ERROR)
+			return read ? read : -1;
+		if (physical == 0) {
+			memset(volume->buffer, 0, blocksize);
+			volume->current = -1;
+		} else
+			ext2_read_block(volume, physical);
+
+		count = MIN(length, blocksize - shift);
+		memcpy(buffer, volume->buffer + shift, count);
+
+		buffer += count;
+		length -= count;
+		read += count;
 		logical++;
+		shift = 0;
 	}
 
 	return read;
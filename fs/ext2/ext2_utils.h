@@ -38,11 +38,20 @@
 
 extern int ext2_probe(int fd, long long offset);
 extern void ext2_get_super(int fd, struct ext2_super_block *super);
+extern unsigned long ext2_read_count, ext2_meta_hits, ext2_meta_misses;
+
 extern void ext2_read_block(ext2_VOLUME* volume, unsigned int fsblock);
+extern char *ext2_read_meta(ext2_VOLUME* volume, unsigned int fsblock);
 extern void ext2_get_group_desc(ext2_VOLUME* volume,
 				int group_id, struct ext2_group_desc *gdp);
 extern int ext2_get_inode(ext2_VOLUME* volume,
 			  unsigned int ino, struct ext2_inode *inode);
+/* returned by the block mapping for blocks beyond 32 bits */
+#define EXT2_BLOCK_ERROR	0xffffffffU
+
+extern unsigned int ext2_get_block_run(ext2_VOLUME* volume,
+				       struct ext2_inode *inode,
+				       unsigned int logical, unsigned int *count);
 extern unsigned int ext2_get_block_addr(ext2_VOLUME* volume,
 					struct ext2_inode *inode,
 					unsigned int logical);
@@ -21,6 +21,11 @@
 //
 unsigned long fatfs_disk_offset = 0;
 
+//
+// Number of read requests issued to the device.
+//
+unsigned long fatfs_read_count = 0;
+
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
 /*-----------------------------------------------------------------------*/
@@ -58,8 +63,10 @@ DRESULT disk_read (
 	UINT count		/* Number of sectors to read */
 )
 {
-	os_seek_offset(pdrv, sector * (1 << FAT_BLOCKSZ_BITS) + fatfs_disk_offset);
-	os_read(pdrv, buff, count, FAT_BLOCKSZ_BITS);
+	os_seek_offset(pdrv, (long long)sector * (1 << FAT_BLOCKSZ_BITS) + fatfs_disk_offset);
+	fatfs_read_count++;
+	if (os_read(pdrv, buff, count, FAT_BLOCKSZ_BITS) != count)
+		return RES_ERROR;
 	return RES_OK;
 }
 
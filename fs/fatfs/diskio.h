@@ -10,6 +10,7 @@ extern "C" {
 #endif
 
 extern unsigned long fatfs_disk_offset;
+extern unsigned long fatfs_read_count;
 
 /* Status of Disk Functions */
 typedef BYTE	DSTATUS;
@@ -37,6 +37,12 @@ typedef struct {
 
 DECLARE_NODE( fatfs, 0, sizeof (fatfs_info_t), "+/packages/fatfs-files" );
 
+/* Initial size of a cluster link map table, in items */
+#define FATFS_CLMT_ITEMS    64
+
+/* Statistics for the last load */
+static unsigned long load_bytes, load_reads;
+
 static void
 print_date(WORD fdate, WORD ftime)
 {
@@ -54,6 +60,93 @@ print_date(WORD fdate, WORD ftime)
                 year, month, day, hour, minute, second);
 }
 
+/*
+ * Build a cluster link map table for the open file, so cluster lookups
+ * no longer walk the FAT and contiguous cluster runs are known up front.
+ */
+static int
+fatfs_create_clmt(fatfs_info_t *mi)
+{
+    DWORD   *tbl;
+    DWORD   items = FATFS_CLMT_ITEMS;
+    FRESULT res;
+
+    if (mi->file.cltbl) {
+        return 0;
+    }
+
+    for (;;) {
+        tbl = malloc(items * sizeof (DWORD));
+        if (!tbl) {
+            return -1;
+        }
+        tbl[0] = items;
+        mi->file.cltbl = tbl;
+
+        res = f_lseek(&mi->file, CREATE_LINKMAP);
+        if (res == FR_OK) {
+            return 0;
+        }
+
+        /* On FR_NOT_ENOUGH_CORE, tbl[0] holds the required size */
+        items = tbl[0];
+        mi->file.cltbl = NULL;
+        free(tbl);
+        if (res != FR_NOT_ENOUGH_CORE) {
+            return -1;
+        }
+    }
+}
+
+/*
+ * Read the first size bytes of the file using the cluster link map table.
+ * Each contiguous run of clusters is read with a single request straight
+ * into the destination buffer; only a trailing partial sector goes through
+ * the file's sector buffer.
+ */
+static int
+fatfs_load_clmt(fatfs_info_t *mi, char *buf, FSIZE_t size)
+{
+    FATFS   *fs = &mi->fs;
+    FIL     *fp = &mi->file;
+    DWORD   *tbl = fp->cltbl + 1;
+    FSIZE_t done = 0, len;
+    DWORD   ncl, clst;
+    LBA_t   sect;
+    UINT    nsect;
+
+    while (done < size && tbl[0]) {
+        ncl = *tbl++;
+        clst = *tbl++;
+        if (clst < 2 || clst - 2 >= fs->n_fatent - 2) {
+            return -1;
+        }
+        sect = fs->database + (LBA_t)fs->csize * (clst - 2);
+        len = MIN((FSIZE_t)ncl * fs->csize * FF_MAX_SS, size - done);
+
+        nsect = len / FF_MAX_SS;
+        if (nsect) {
+            if (disk_read(fs->pdrv, (BYTE *)buf + done, sect, nsect) != RES_OK) {
+                return -1;
+            }
+            done += (FSIZE_t)nsect * FF_MAX_SS;
+        }
+        if (len % FF_MAX_SS) {
+            if (disk_read(fs->pdrv, fp->buf, sect + nsect, 1) != RES_OK) {
+                return -1;
+            }
+            fp->sect = sect + nsect;
+            memcpy(buf + done, fp->buf, len % FF_MAX_SS);
+            done += len % FF_MAX_SS;
+        }
+    }
+
+    if (done != size) {
+        return -1;
+    }
+    return (f_lseek(fp, size) == FR_OK) ? 0 : -1;
+}
+
 /* ( -- success? ) */
 static void
 fatfs_files_open(fatfs_info_t *mi)
@@ -102,6 +195,7 @@ static void
 fatfs_files_close(fatfs_info_t *mi)
 {
     if (mi->type == FAT_FILE) {
+        free(mi->file.cltbl);
         f_close(&mi->file);
     } else if (mi->type == FAT_DIR) {
         f_closedir(&mi->dir);
@@ -123,6 +217,9 @@ fatfs_files_read(fatfs_info_t *mi)
         RET(-1);
     }
 
+    /* Without a link map FatFs follows the FAT chain for every seek */
+    fatfs_create_clmt(mi);
+
     if (f_read(&mi->file, buf, count, &br) != FR_OK) {
         RET(-1);
     }
@@ -149,19 +246,36 @@ static void
 fatfs_files_load(fatfs_info_t *mi)
 {
     char *buf = (char*)cell2pointer(POP());
+    unsigned long reads = fatfs_read_count;
     UINT br;
 
     if (mi->type != FAT_FILE) {
         RET(-1);
     }
 
-    f_lseek(&mi->file, 0);
-    if (f_read(&mi->file, buf, f_size(&mi->file), &br) != FR_OK) {
-        RET(-1);
+    if (fatfs_create_clmt(mi) == 0 &&
+        fatfs_load_clmt(mi, buf, f_size(&mi->file)) == 0) {
+        br = f_size(&mi->file);
+    } else {
+        f_lseek(&mi->file, 0);
+        if (f_read(&mi->file, buf, f_size(&mi->file), &br) != FR_OK) {
+            RET(-1);
+        }
     }
+
+    load_bytes = br;
+    load_reads = fatfs_read_count - reads;
     RET(br);
 }
 
+/* ( -- ) */
+static void
+fatfs_print_stats(void)
+{
+    forth_printf("last load: %lu bytes in %lu reads\n", load_bytes, load_reads);
+    forth_printf("total reads: %lu\n", fatfs_read_count);
+}
+
 /* static method, ( pathstr len ihandle -- ) */
 static void
 fatfs_files_dir(fatfs_info_t *dummy)
@@ -274,4 +388,5 @@ void
 fatfs_init(void)
 {
     REGISTER_NODE( fatfs );
+    bind_func(".fatfs-stats", fatfs_print_stats);
 }
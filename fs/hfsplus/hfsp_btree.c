@@ -82,31 +82,41 @@ static void* btree_readhead(btree_head* head, void *p)
  * Should be the average number of keys per node but these vary. */
 #define DEPTH_FACTOR	1000
 
-/* Cache size is height of tree + this value
- * Really big numbers wont help in case of ls -R
- */
+/* Minimum cache size is height of tree + this value */
 #define EXTRA_CACHESIZE	3
 
+#ifndef CONFIG_HFSP_NODE_CACHE
+#define CONFIG_HFSP_NODE_CACHE	32
+#endif
+
 /* Not in use by now ... */
 #define CACHE_DIRTY 0x0001
 
+unsigned long btree_cache_hits, btree_cache_misses, btree_cache_prefetched;
+
 /* Intialize cache with default cache Size,
  * must call node_cache_close to deallocate memory */
 static int node_cache_init(node_cache* cache, btree* tree, int size)
 {
-    int nodebufsize;
+    int nodebufsize, i;
     char * buf;
 
     cache->size		= size;
-    cache->currindex	= 0;
+    cache->tick		= 0;
+    for (cache->hashsize = 1; cache->hashsize < size; cache->hashsize <<= 1)
+	;
     nodebufsize = tree->head.node_size + sizeof(node_buf);
-    buf = malloc(size *(sizeof(node_entry) + nodebufsize));
+    buf = malloc(size *(sizeof(node_entry) + nodebufsize)
+		 + cache->hashsize * sizeof(int));
     if (!buf)
 	return -1;
     cache -> nodebufsize = nodebufsize;
     cache -> entries = (node_entry*) buf;
-    cache -> buffers = (char*) &cache->entries[size];
+    cache -> hash = (int*) &cache->entries[size];
+    cache -> buffers = (char*) &cache->hash[cache->hashsize];
     bzero(cache->entries, size*sizeof(node_entry));
+    for (i = 0; i < cache->hashsize; i++)
+	cache->hash[i] = -1;
     return 0;
 }
 
@@ -116,6 +126,11 @@ static inline node_buf* node_buf_get(node_cache* cache, int i)
     return (node_buf*) (cache->buffers + (i * cache->nodebufsize));
 }
 
+static inline int* node_cache_bucket(node_cache* cache, UInt32 index)
+{
+    return &cache->hash[index & (cache->hashsize - 1)];
+}
+
 /* flush the node at index */
 static void node_cache_flush_node(node_cache* cache, int index)
 {
@@ -130,83 +145,168 @@ static void node_cache_close(node_cache* cache)
     free(cache->entries);
 }
 
-/* Load the cach node indentified by index with
- * the node identified by node_index */
+/* Return the cache entry holding node_index, or -1 */
+static int node_cache_find(node_cache* cache, UInt32 node_index)
+{
+    int i;
+
+    for (i = *node_cache_bucket(cache, node_index); i >= 0;
+	 i = cache->entries[i].next)
+	if (cache->entries[i].index == node_index)
+	    return i;
+    return -1;
+}
 
-static node_buf* node_cache_load_buf
-    (btree* bt, node_cache* cache, int index, UInt16 node_index)
+/* Free the entry to be replaced next, never the entry keep */
+static int node_cache_evict(node_cache* cache, int keep)
 {
-    node_buf	*result	    = node_buf_get(cache ,index);
-    UInt32	blkpernode  = bt->blkpernode;
-    UInt32	block	    = node_index * blkpernode;
-    void*	p	    = volume_readfromfork(bt->vol, result->node, bt->fork,
-			     block, blkpernode, HFSP_EXTENT_DATA, bt->cnid);
-    node_entry	*e	    = &cache->entries[index];
+    node_entry	*e;
+    int		i, *pp, lruindex = -1;
+    UInt32	prio, best = UINT_MAX;
 
-    if (!p)
-	return NULL;	// evil ...
+    for (i = 0; i < cache->size; i++)
+    {
+	e = &cache->entries[i];
+	if (i == keep)
+	    continue;
+	if (!e->index)
+	    return i;	// empty entry, use it
+	prio = e->lru + e->height * DEPTH_FACTOR;
+	if (lruindex < 0 || prio < best)
+	{
+	    lruindex = i;
+	    best = prio;
+	}
+    }
+
+    e = &cache->entries[lruindex];
+    for (pp = node_cache_bucket(cache, e->index); *pp != lruindex;
+	 pp = &cache->entries[*pp].next)
+	;
+    *pp = e->next;
+    if (e->flags & CACHE_DIRTY)
+	node_cache_flush_node(cache, lruindex);
+    e->index = 0;
+    return lruindex;
+}
+
+/* Enter the node just read into the buffer of entry index */
+static node_buf* node_cache_enter(node_cache* cache, int index, UInt32 node_index)
+{
+    node_buf	*result	    = node_buf_get(cache, index);
+    node_entry	*e	    = &cache->entries[index];
+    int		*bucket	    = node_cache_bucket(cache, node_index);
 
     result->index   = node_index;
-    btree_readnode(&result->desc, p);
+    btree_readnode(&result->desc, result->node);
 
-    e -> priority   = result->desc.height * DEPTH_FACTOR;
+    e -> lru	    = cache->tick;
+    e -> height	    = result->desc.height;
     e -> index	    = node_index;
+    e -> next	    = *bucket;
+    *bucket	    = index;
     return result;
 }
 
-/* Read node at given index, using cache.
- */
-node_buf* btree_node_by_index(btree* bt, UInt16 index)
+/* Read count nodes starting at first into a temporary buffer with
+ * one request and enter them into the cache, never replacing keep. */
+static void btree_prefetch_run(btree* bt, UInt32 first, int count, int keep)
 {
-    node_cache*	cache = &bt->cache;
-    int		oldindex, lruindex;
-    int		currindex = cache->currindex;
-    UInt32	prio;
-    node_entry	*e;
+    node_cache*	cache	    = &bt->cache;
+    UInt16	node_size   = bt->head.node_size;
+    char	*buf	    = malloc(count * node_size);
+    int		i, index;
 
-    // Shortcut acces to current node, will not change priorities
-    if (cache->entries[currindex].index == index)
-	return node_buf_get(cache ,currindex);
-    oldindex = currindex;
-    if (currindex == 0)
-	currindex = cache->size;
-    currindex--;
-    lruindex = oldindex;	    // entry to be flushed when needed
-    prio     = 0;		    // current priority
-    while (currindex != oldindex)   // round robin
+    if (!buf)
+	return;
+    if (volume_readfromfork(bt->vol, buf, bt->fork, first * bt->blkpernode,
+		count * bt->blkpernode, HFSP_EXTENT_DATA, bt->cnid))
     {
-	e = &cache->entries[currindex];
-	if (e->index == index)	    // got it
+	for (i = 0; i < count; i++)
 	{
-	    if (e->priority != 0)   // already top, uuh
-		e->priority--;
-	    cache->currindex = currindex;
-	    return node_buf_get(cache ,currindex);
+	    index = node_cache_evict(cache, keep);
+	    memcpy(node_buf_get(cache, index)->node, buf + i * node_size, node_size);
+	    node_cache_enter(cache, index, first + i);
 	}
-	else
+	btree_cache_prefetched += count;
+    }
+    free(buf);
+}
+
+/* Prefetch children of the index node in entry index. Only children
+ * stored in runs of consecutive nodes are read, one request per run,
+ * and at most a quarter of the cache is replaced. */
+static void btree_prefetch_children(btree* bt, int index)
+{
+    node_cache*	cache	= &bt->cache;
+    node_buf*	buf	= node_buf_get(cache, index);
+    char	curr_key[bt->head.max_key_len];
+    int		budget	= cache->size / 4;
+    UInt32	child, first = 0;
+    int		i, count = 0;
+    void	*p;
+
+    for (i = 0; i <= buf->desc.num_rec && budget >= 2; i++)
+    {
+	child = 0;
+	if (i < buf->desc.num_rec)
 	{
-	    if (!e->index)
+	    p = btree_key_by_index(bt, buf, i);
+	    if (!p || !(p = bt->kread(p, curr_key)))
+		return;
+	    child = bswabU32_inc(p);
+	    if (child && child < bt->head.node_count
+		&& count < budget && node_cache_find(cache, child) < 0
+		&& (count == 0 || child == first + count))
 	    {
-		lruindex = currindex;
-		break;	// empty entry, load it
+		if (!count)
+		    first = child;
+		count++;
+		continue;
 	    }
-	    if (e->priority != UINT_MAX) // already least, uuh
-		e->priority++;
 	}
-	if (prio < e->priority)
+	if (count >= 2)
+	{
+	    btree_prefetch_run(bt, first, count, index);
+	    budget -= count;
+	}
+	count = 0;
+	if (child && child < bt->head.node_count && node_cache_find(cache, child) < 0)
 	{
-	    lruindex = currindex;
-	    prio = e->priority;
+	    first = child;
+	    count = 1;
 	}
-	if (currindex == 0)
-	    currindex = cache->size;
-	currindex--;
     }
-    e = &cache->entries[lruindex];
-    cache->currindex = lruindex;
-    if (e->flags & CACHE_DIRTY)
-           node_cache_flush_node(    cache, lruindex);
-    return node_cache_load_buf  (bt, cache, lruindex, index);
+}
+
+/* Read node at given index, using cache.
+ */
+node_buf* btree_node_by_index(btree* bt, UInt32 index)
+{
+    node_cache*	cache = &bt->cache;
+    node_buf*	result;
+    int		i;
+
+    cache->tick++;
+    i = node_cache_find(cache, index);
+    if (i >= 0)
+    {
+	btree_cache_hits++;
+	cache->entries[i].lru = cache->tick;
+	return node_buf_get(cache, i);
+    }
+
+    btree_cache_misses++;
+    i = node_cache_evict(cache, -1);
+    result = node_buf_get(cache, i);
+    if (!volume_readfromfork(bt->vol, result->node, bt->fork,
+		index * bt->blkpernode, bt->blkpernode, HFSP_EXTENT_DATA, bt->cnid))
+	return NULL;	// evil ...
+    result = node_cache_enter(cache, i, index);
+
+    if (result->desc.kind == HFSP_NODE_NDX)
+	btree_prefetch_children(bt, i);
+    return result;
 }
 
 /** intialize the btree with the first entry in the fork */
@@ -235,7 +335,11 @@ static int btree_init(btree* bt, volume* vol, hfsp_fork_raw* fork)
 	    bt->blkpernode != node_size)
 	return -1;  // should never happen ...
 
-    node_cache_init(&bt->cache, bt, bt->head.depth + EXTRA_CACHESIZE);
+    if (node_cache_init(&bt->cache, bt,
+	    MAX(CONFIG_HFSP_NODE_CACHE, bt->head.depth + EXTRA_CACHESIZE)))
+	return -1;
+    bzero(bt->threads, sizeof(bt->threads));
+    bt->thread_next = 0;
 
     // Allocate buffer
     // bt->buf = malloc(node_size);
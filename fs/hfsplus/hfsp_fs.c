@@ -21,6 +21,7 @@
 #include "libhfsp.h"
 #include "volume.h"
 #include "record.h"
+#include "btree.h"
 #include "unicode.h"
 #include "blockiter.h"
 #include "libc/diskio.h"
@@ -43,6 +44,8 @@ typedef struct {
 	record		rec;
 	char		*path;
 	off_t		pos;
+	blockiter	iter;		/* data fork cursor, kept between reads */
+	int		iter_valid;
 } hfsp_file_t;
 
 typedef struct {
@@ -52,6 +55,9 @@ typedef struct {
 
 DECLARE_NODE( hfsp, 0, sizeof(hfsp_info_t), "+/packages/hfsplus-files" );
 
+/* Statistics for the last load */
+static unsigned long load_bytes, load_blocks, load_reads;
+
 
 /************************************************************************/
 /*	Search implementation						*/
@@ -109,20 +115,26 @@ root_search_files( volume *vol, int recursive, match_proc_t proc, const void *ma
 }
 
 static int
-match_file( record *r, record *parent, const void *match_data, hfsp_file_t *pt )
+match_type( record *r, record *par, const void *match_data, hfsp_file_t *pt )
 {
-        const char *p = (const char*)match_data;
-	char name[256];
-	int ret=1;
+	UInt32 type = *(const UInt32*)match_data;
 
-	if( r->record.type != HFSP_FILE )
+	if( r->record.type != HFSP_FILE || r->record.u.file.user_info.fdType != type )
 		return 1;
-
-	(void) unicode_uni2asc(name, &r->key.name, sizeof(name));
-	if( !(ret=strcasecmp(p, name)) && pt )
+	if( pt )
 		pt->rec = *r;
+	return 0;
+}
 
-	return ret;
+/* Look up the file name in the folder par, 0 if found */
+static int
+lookup_file( record *par, const char *name )
+{
+	record r;
+
+	if( record_init_string_parent(&r, par, name) )
+		return 1;
+	return r.record.type != HFSP_FILE;
 }
 
 static int
@@ -134,8 +146,7 @@ match_rom( record *r, record *par, const void *match_data, hfsp_file_t *pt )
 	char buf[256];
 
 	if( r->record.type == HFSP_FILE && fi->fdCreator == MAC_OS_ROM_CREATOR && fi->fdType == MAC_OS_ROM_TYPE ) {
-		ret = search_files( par, 0, match_file, "System", NULL )
-			|| search_files( par, 0, match_file, "Finder", NULL );
+		ret = lookup_file( par, "System" ) || lookup_file( par, "Finder" );
 
 		(void) unicode_uni2asc(buf, &r->key.name, sizeof(buf));
 		if( !strcasecmp("BootX", buf) )
@@ -147,56 +158,168 @@ match_rom( record *r, record *par, const void *match_data, hfsp_file_t *pt )
 	return ret;
 }
 
+/* Return path\name, path may be NULL and is freed */
+static char *
+path_append( char *path, const char *name )
+{
+	const char *s = path ? path : "";
+	char *p = malloc( strlen(s) + strlen(name) + 2 );
+
+	strcpy( p, s );
+	if( strlen(s) )
+		strcat( p, "\\" );
+	strcat( p, name );
+	if( path )
+		free( path );
+	return p;
+}
+
+/* Resolve path below the folder par with one catalog lookup per
+ * component, instead of scanning each folder. A last component of
+ * the form :tbxi matches the first file of that type. */
 static int
-match_path( record *r, record *par, const void *match_data, hfsp_file_t *pt )
+lookup_path( record *par, const char *path, hfsp_file_t *pt )
 {
-	char name[256], *s, *next, *org;
-	int ret=1;
-
- 	next = org = strdup( (char*)match_data );
-	while( (s=strsep( &next, "\\/" )) && !strlen(s) )
-		;
-	if( !s ) {
-		free( org );
-		return 1;
-	}
+	char name[256], *s, *next, *org, *found = NULL;
+	hfsp_file_t t;
+	record r = *par;
+	int i, ret = 1;
+
+	next = org = strdup( path );
+	while( (s=strsep( &next, "\\/" )) ) {
+		if( !strlen(s) )
+			continue;
 
-	if( *s == ':' && strlen(s) == 5 ) {
-		if( r->record.type == HFSP_FILE && !next ) {
+		if( *s == ':' && strlen(s) == 5 && !next ) {
 			/* match type */
-			hfsp_cat_file *file = &r->record.u.file;
-			FInfo *fi = &file->user_info;
-			int i, type=0;
+			UInt32 type = 0;
 			for( i=1; s[i] && i<=4; i++ )
 				type = (type << 8) | s[i];
-			/* printk("fi->fdType: %s / %s\n", s+1, b ); */
-			if( fi->fdType == type ) {
-				if( pt )
-					pt->rec = *r;
-				ret = 0;
-			}
+			t.path = NULL;
+			if( search_files( &r, 0, match_type, &type, &t ) )
+				break;
+			r = t.rec;
+			free( t.path );
+		} else if( record_init_string_parent( &r, &r, s ) ) {
+			break;
 		}
-	} else {
-		(void) unicode_uni2asc(name, &r->key.name, sizeof(name));
-
-		if( !strcasecmp(s, name) ) {
-			if( r->record.type == HFSP_FILE && !next ) {
-				if( pt )
-					pt->rec = *r;
-				ret = 0;
-			} else /* must be a directory */
-				ret = search_files( r, 0, match_path, next, pt );
+
+		(void) unicode_uni2asc(name, &r.key.name, sizeof(name));
+		found = path_append( found, name );
+
+		if( r.record.type == HFSP_FILE ) {
+			ret = (next != NULL);
+			break;
 		}
+		if( r.record.type != HFSP_FOLDER )
+			break;
+	}
+
+	if( !ret && pt ) {
+		pt->rec = r;
+		pt->path = found;
+	} else if( found ) {
+		free( found );
 	}
 	free( org );
 	return ret;
 }
 
+/* Search the blessed folders (see hfsp_files_open) without recursion.
+ * The path is built from the folder threads up to the root. */
+static int
+blessed_search_files( volume *vol, match_proc_t proc, const void *match_data, hfsp_file_t *pt )
+{
+	static const int blessed[] = { 0, 3, 5 };
+	int *p = (int*)&vol->vol.finder_info[0];
+	char name[256], *path;
+	UInt32 cnid;
+	record r;
+	int i;
+
+	for( i=0; i<3; i++ ) {
+		cnid = p[blessed[i]];
+		if( !cnid || record_init_cnid(&r, &vol->catalog, cnid) )
+			continue;
+		if( search_files( &r, 0, proc, match_data, pt ) )
+			continue;
+
+		while( cnid != HFSP_ROOT_CNID ) {
+			if( record_init_cnid(&r, &vol->catalog, cnid) )
+				break;
+			(void) unicode_uni2asc(name, &r.record.u.thread.nodeName, sizeof(name));
+			path = path_append( strdup(name), pt->path );
+			free( pt->path );
+			pt->path = path;
+			cnid = r.record.u.thread.parentID;
+		}
+		return 0;
+	}
+	return 1;
+}
+
 
 /************************************************************************/
 /*	Standard package methods						*/
 /************************************************************************/
 
+/************************************************************************/
+/*	File data							*/
+/************************************************************************/
+
+/* Move the cursor of t to block blk of the data fork. Seeking forward
+ * steps over whole extents; only seeking backwards restarts the walk. */
+static int
+hfsp_seek_block( hfsp_file_t *t, UInt32 blk )
+{
+	volume *vol = t->rec.tree->vol;
+	hfsp_cat_file *file = &t->rec.record.u.file;
+
+	if( !t->iter_valid || blk < t->iter.curr_block ) {
+		blockiter_init( &t->iter, vol, &file->data_fork, HFSP_EXTENT_DATA, file->id );
+		t->iter_valid = 1;
+	}
+	if( blk > t->iter.curr_block && blockiter_skip(&t->iter, blk - t->iter.curr_block) ) {
+		t->iter_valid = 0;
+		return -1;
+	}
+	return 0;
+}
+
+/* Read count bytes at pos from the data fork. Whole blocks are read
+ * straight into buf, one request per contiguous part of an extent. */
+static int
+hfsp_read_data( hfsp_file_t *t, char *buf, UInt64 pos, int count )
+{
+	volume *vol = t->rec.tree->vol;
+	UInt32 blksize = vol->blksize;
+	char buf2[blksize];
+	int act_count = 0, size;
+	UInt32 offs, n;
+
+	while( act_count < count ) {
+		if( hfsp_seek_block(t, pos >> vol->blksize_bits) )
+			break;
+
+		offs = pos & (blksize - 1);
+		if( !offs && count - act_count >= blksize ) {
+			n = MIN( t->iter.e->block_count - t->iter.block,
+				 (UInt32)(count - act_count) >> vol->blksize_bits );
+			if( volume_readblocks( vol, buf + act_count, blockiter_curr(&t->iter), n ) )
+				break;
+			size = n << vol->blksize_bits;
+		} else {
+			if( volume_readinbuf( vol, buf2, blockiter_curr(&t->iter) ) )
+				break;
+			size = MIN( blksize - offs, (UInt32)(count - act_count) );
+			memcpy( buf + act_count, &buf2[offs], size );
+		}
+		act_count += size;
+		pos += size;
+	}
+	return act_count;
+}
+
 /* ( -- success? ) */
 static void
 hfsp_files_open( hfsp_info_t *mi )
@@ -221,6 +344,8 @@ hfsp_files_open( hfsp_info_t *mi )
 	}
 
 	mi->hfspfile = malloc( sizeof(hfsp_file_t) );
+	mi->hfspfile->path = NULL;
+	mi->hfspfile->iter_valid = 0;
 	
 	/* Leading \\ means system folder. The finder info block has
 	 * the following meaning.
@@ -240,7 +365,7 @@ hfsp_files_open( hfsp_info_t *mi )
 		record_init_root( &(mi->hfspfile->rec), &(mi->vol)->catalog );
 	}
 
-	if( !search_files(&(mi->hfspfile->rec), 0, match_path, path, mi->hfspfile ) )
+	if( !lookup_path(&(mi->hfspfile->rec), path, mi->hfspfile ) )
 		RET ( -1 );
 	
 	RET ( -1 );
@@ -265,43 +390,18 @@ hfsp_files_read( hfsp_info_t *mi )
 	char *buf = (char *)cell2pointer(POP());
 
 	hfsp_file_t *t = mi->hfspfile;
-	volume *vol = t->rec.tree->vol;
-	UInt32 blksize = vol->blksize;
 	hfsp_cat_file *file = &t->rec.record.u.file;
-	blockiter iter;
-	char buf2[blksize];
-	int act_count, curpos=0;
-
-	blockiter_init( &iter, vol, &file->data_fork, HFSP_EXTENT_DATA, file->id );
-	while( curpos + blksize < t->pos ) {
-		if( blockiter_next( &iter ) ) {
-			RET ( -1 );
-			return;
-		}
-		curpos += blksize;
-	}
-	act_count = 0;
-
-	while( act_count < count ){
-		UInt32 block = blockiter_curr(&iter);
-		int max = blksize, add = 0, size;
-
-		if( volume_readinbuf( vol, buf2, block ) )
-			break;
-
-		if( curpos < t->pos ){
-			add += t->pos - curpos;
-			max -= t->pos - curpos;
-		}
-		size = (count-act_count > max)? max : count-act_count;
-		memcpy( (char *)buf + act_count, &buf2[add], size );
+	UInt64 total = file->data_fork.total_size;
+	int act_count;
 
-		curpos += blksize;
-		act_count += size;
+	if( t->pos >= total )
+		RET ( 0 );
+	if( count > total - t->pos )
+		count = total - t->pos;
 
-		if( blockiter_next( &iter ) )
-			break;
-	}
+	act_count = hfsp_read_data( t, buf, t->pos, count );
+	if( !act_count && count )
+		RET ( -1 );
 
 	t->pos += act_count;
 
@@ -351,37 +451,32 @@ hfsp_files_load( hfsp_info_t *mi )
 	char *buf = (char *)cell2pointer(POP());
 
 	hfsp_file_t *t = mi->hfspfile;
-	volume *vol = t->rec.tree->vol;
-	UInt32 blksize = vol->blksize;
 	hfsp_cat_file *file = &t->rec.record.u.file;
 	int total = file->data_fork.total_size;
-	blockiter iter;
-	char buf2[blksize];
+	unsigned long reads = volume_read_count, blocks = volume_block_count;
 	int act_count;
 
-	blockiter_init( &iter, vol, &file->data_fork, HFSP_EXTENT_DATA, file->id );
-
-	act_count = 0;
-
-	while( act_count < total ){
-		UInt32 block = blockiter_curr(&iter);
-		int max = blksize, size;
-
-		if( volume_readinbuf( vol, buf2, block ) )
-			break;
+	act_count = hfsp_read_data( t, buf, 0, total );
 
-		size = (total-act_count > max)? max : total-act_count;
-		memcpy( (char *)buf + act_count, &buf2, size );
-
-		act_count += size;
-
-		if( blockiter_next( &iter ) )
-			break;
-	}
+	load_bytes = act_count;
+	load_blocks = volume_block_count - blocks;
+	load_reads = volume_read_count - reads;
 
 	RET ( act_count );
 }
 
+/* ( -- ) */
+static void
+hfsp_print_stats( void )
+{
+	forth_printf("last load: %lu bytes, %lu blocks in %lu reads\n",
+		     load_bytes, load_blocks, load_reads);
+	forth_printf("total: %lu blocks in %lu reads\n",
+		     volume_block_count, volume_read_count);
+	forth_printf("node cache: %lu hits, %lu misses, %lu prefetched\n",
+		     btree_cache_hits, btree_cache_misses, btree_cache_prefetched);
+}
+
 /* ( -- cstr ) */
 static void
 hfsp_files_get_fstype( hfsp_info_t *mi )
@@ -410,9 +505,13 @@ hfsp_files_get_path( hfsp_info_t *mi )
 static void
 hfsp_files_open_nwrom( hfsp_info_t *mi )
 {
-	/* Switch to an existing ROM image file on the fs! */
-	if( !root_search_files(mi->vol, 1, match_rom, NULL, mi->hfspfile) )
+	/* Switch to an existing ROM image file on the fs! It is
+	 * usually in a blessed folder, so look there first. */
+	if( !blessed_search_files(mi->vol, match_rom, NULL, mi->hfspfile)
+	    || !root_search_files(mi->vol, 1, match_rom, NULL, mi->hfspfile) ) {
+		mi->hfspfile->iter_valid = 0;
 		RET ( -1 );
+	}
 
 	RET ( 0 );
 }
@@ -627,4 +726,5 @@ void
 hfsp_init( void )
 {
 	REGISTER_NODE( hfsp );
+	bind_func( ".hfsp-stats", hfsp_print_stats );
 }
@@ -302,15 +302,26 @@ int record_extent_key_compare(void* k1, void* k2)
     return diff;
 }
 
+/* Compare a cat_key with a key whose name was folded by unicode_fold */
+static int record_folded_key_compare(void* k1, void* k2)
+{
+    hfsp_cat_key* key1 = (hfsp_cat_key*) k1;
+    hfsp_cat_key* key2 = (hfsp_cat_key*) k2;
+    int diff = key2->parent_cnid - key1->parent_cnid;
+    if (!diff) // same parent
+	diff = fast_unicode_compare_folded(&key1->name, &key2->name);
+    return diff;
+}
+
 /* Position node in btree so that key might be inside */
-static node_buf* record_find_node(btree* tree, void *key)
+static node_buf* record_find_node(btree* tree, void *key,
+				  hfsp_key_compare key_compare)
 {
     int			start, end, mid, comp;  // components of a binary search
     void		*p = NULL;
     char		curr_key[tree->head.max_key_len];
 		    // The current key under examination
     hfsp_key_read	readkey	    = tree->kread;
-    hfsp_key_compare	key_compare = tree->kcomp;
     UInt32		index;
     node_buf*		node = btree_node_by_index(tree, tree->head.root);
     if (!node)
@@ -366,9 +377,10 @@ static node_buf* record_find_node(btree* tree, void *key)
  * key was found (or could be inserted.)
  */
 static void *
-record_find_key(btree* tree, void* key, int* keyind, UInt16* node_index)
+record_find_key(btree* tree, void* key, hfsp_key_compare key_compare,
+		int* keyind, UInt16* node_index)
 {
-    node_buf* buf = record_find_node(tree, key);
+    node_buf* buf = record_find_node(tree, key, key_compare);
     if (buf)
     {
 	int		    comp  = -1;
@@ -378,7 +390,6 @@ record_find_key(btree* tree, void* key, int* keyind, UInt16* node_index)
 	void		    *p    = NULL;
 	char		    curr_key[tree->head.max_key_len];
 	hfsp_key_read	    readkey	= tree->kread;
-	hfsp_key_compare    key_compare = tree->kcomp;
 	while (start < end)
 	{
 	    mid = (start + end) >> 1;
@@ -417,7 +428,7 @@ record_init_key(record* r, btree* tree, hfsp_cat_key* key)
 {
     int	    keyind;
     UInt16  node_index;
-    void    *p = record_find_key(tree, key, &keyind, &node_index);
+    void    *p = record_find_key(tree, key, tree->kcomp, &keyind, &node_index);
 
     if (p)
     {
@@ -445,7 +456,7 @@ int record_init_file(extent_record* r, btree* tree,
     int		    keyind;
     UInt16	    node_index;
     hfsp_extent_key key = { 10, forktype, 0, fileId, blockindex };
-    void	    *p = record_find_key(tree, &key, &keyind, &node_index);
+    void	    *p = record_find_key(tree, &key, tree->kcomp, &keyind, &node_index);
 
     if (p)
     {
@@ -467,12 +478,35 @@ int record_init_file(extent_record* r, btree* tree,
 int record_init_cnid(record* r, btree* tree, UInt32 cnid)
 {
     hfsp_cat_key    thread_key;	    // the thread is the first record
+    thread_entry*   e;
+    node_buf*	    buf;
+    int		    i;
+
+    // The volume is read only, so a thread never moves in the tree
+    for (i = 0; i < HFSP_THREAD_CACHE; i++)
+    {
+	e = &tree->threads[i];
+	if (e->cnid != cnid)
+	    continue;
+	buf = btree_node_by_index(tree, e->node_index);
+	if (buf && !record_init(r, tree, buf, e->keyind))
+	    return 0;
+	e->cnid = 0;
+	break;
+    }
 
     thread_key.key_length = 6;	    // null name (like '.' in unix )
     thread_key.parent_cnid = cnid;
     thread_key.name.strlen = 0;
 
-    return record_init_key(r, tree, &thread_key);
+    if (record_init_key(r, tree, &thread_key))
+	return -1;
+
+    e = &tree->threads[tree->thread_next++ % HFSP_THREAD_CACHE];
+    e->cnid	  = cnid;
+    e->node_index = r->node_index;
+    e->keyind	  = r->keyind;
+    return 0;
 }
 
 /* intialize the record to the first record of the parent.
@@ -573,24 +607,48 @@ int record_next_extent(extent_record* r)
  *
  * parent and r may be the same.
  */
-int record_init_string_parent(record* r, record* parent, char* name)
+int record_init_string_parent(record* r, record* parent, const char* name)
 {
-    hfsp_cat_key key;
+    UInt32	cnid;
 
     if (parent->record.type == HFSP_FOLDER)
-	key.parent_cnid = parent->record.u.folder.id;
+	cnid = parent->record.u.folder.id;
     else if(parent->record.type == HFSP_FOLDER_THREAD)
-	key.parent_cnid = parent->key.parent_cnid;
+	cnid = parent->key.parent_cnid;
     else
 	HFSP_ERROR(-1, "record_init_string_parent: parent is not a folder.");
 
-    key.key_length = 6 + unicode_asc2uni(&key.name,name); // 6 for minumum size
-    return record_init_key(r, parent->tree, &key);
+    return record_init_name(r, parent->tree, cnid, name);
 
   fail:
     return -1;
 }
 
+/* intialize the record by looking up the given string in the folder cnid.
+ *
+ * The name is case folded once here, so the search only folds the keys
+ * of the tree. r receives the key as found in the tree.
+ */
+int record_init_name(record* r, btree* tree, UInt32 cnid, const char* name)
+{
+    hfsp_cat_key    key;
+    int		    keyind;
+    UInt16	    node_index;
+    node_buf*	    buf;
+
+    key.parent_cnid = cnid;
+    key.key_length = 6 + 2 * unicode_asc2uni(&key.name, name);
+    unicode_fold(&key.name);
+
+    if (!record_find_key(tree, &key, record_folded_key_compare,
+			 &keyind, &node_index))
+	return -1;
+    buf = btree_node_by_index(tree, node_index);
+    if (!buf)
+	return -1;
+    return record_init(r, tree, buf, keyind);
+}
+
 /* move record up in folder hierarchy (if possible) */
 int record_up(record* r)
 {
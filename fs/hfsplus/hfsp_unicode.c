@@ -114,6 +114,58 @@ SInt32 fast_unicode_compare ( const hfsp_unistr255 *ustr1,
 }
 
 
+void unicode_fold (hfsp_unistr255 *ustr)
+{
+    const UInt16*	lowerCaseTable = gLowerCaseTable;
+    UInt16		c, temp, i, len = 0;
+
+    for (i = 0; i < ustr->strlen; i++) {
+        c = ustr->name[i];
+        if ((temp = lowerCaseTable[c>>8]) != 0)
+            c = lowerCaseTable[temp + (c & 0x00FF)];
+        if (c)
+            ustr->name[len++] = c;
+    }
+    ustr->strlen = len;
+}
+
+/* Only the first string is folded on the fly, ustr2 must have
+   been passed through unicode_fold before. */
+SInt32 fast_unicode_compare_folded ( const hfsp_unistr255 *ustr1,
+				     const hfsp_unistr255 *ustr2)
+{
+    register UInt16     c1,c2;
+    register SInt32	diff;
+    register UInt16     temp;
+    register UInt16	length1 = ustr1->strlen;
+    register UInt16	length2 = ustr2->strlen;
+    register const UInt16* lowerCaseTable = gLowerCaseTable;
+    register const UInt16* str1 = ustr1->name;
+    register const UInt16* str2 = ustr2->name;
+
+    while (1) {
+        c1 = 0;
+        while (length1 && c1 == 0) {
+            c1 = *(str1++);
+            --length1;
+            if ((temp = lowerCaseTable[c1>>8]) != 0)
+                c1 = lowerCaseTable[temp + (c1 & 0x00FF)];
+        }
+        c2 = 0;
+        if (length2) {
+            c2 = *(str2++);
+            --length2;
+        }
+	diff = c2-c1;
+        if (diff)
+            break;
+        if (c1 == 0)
+            return 0;
+    }
+    return diff;
+}
+
+
 /*  The lower case table consists of a 256-entry high-byte table followed by
     some number of 256-entry subtables. The high-byte table contains either an
     offset to the subtable for characters with that high byte or zero, which
@@ -36,18 +36,32 @@
 #include "hfstime.h"
 
 
+/* Device read requests and blocks read, for all volumes */
+unsigned long volume_read_count, volume_block_count;
+
 /* Fill a given buffer with the given block in volume.
  */
 int
 volume_readinbuf(volume * vol,void* buf, long block)
+{
+	return volume_readblocks(vol, buf, block, 1);
+}
+
+/* Fill a given buffer with count consecutive blocks in volume,
+ * using a single device request.
+ */
+int
+volume_readblocks(volume * vol, void* buf, long block, UInt32 count)
 {
 	UInt16 blksize_bits;
-	ASSERT( block < vol->maxblocks);
+	ASSERT( block + count <= vol->maxblocks);
 
 	blksize_bits = vol->blksize_bits;
 	block	+= vol->startblock;
+	volume_read_count++;
+	volume_block_count += count;
 	if( os_seek(vol->os_fd, block, blksize_bits) == block)
-		if( 1 == os_read(vol->os_fd, buf, 1, blksize_bits))
+		if( count == os_read(vol->os_fd, buf, count, blksize_bits))
 			return 0;
 	return -1;
 }
@@ -63,17 +77,20 @@ volume_readfromfork(volume* vol, void* buf,
 {
 	blockiter iter;
 	char *cbuf = buf;
+	UInt32 n;
 
 	blockiter_init(&iter, vol, f, forktype, fileId);
 	if( blockiter_skip(&iter, block))
 		return NULL;
 
+	/* one request per extent run */
 	while( count > 0) {
-		--count;
-		if( volume_readinbuf(vol, cbuf, blockiter_curr(&iter)))
+		n = MIN(count, iter.e->block_count - iter.block);
+		if( volume_readblocks(vol, cbuf, blockiter_curr(&iter), n))
 			return NULL;
-		cbuf += vol->blksize;
-		if( count > 0 && blockiter_next(&iter))
+		cbuf += n << vol->blksize_bits;
+		count -= n;
+		if( count > 0 && blockiter_skip(&iter, n))
 			return NULL;
 	}
 	return buf;
@@ -39,7 +39,10 @@ extern int btree_init_extent(btree* bt, volume* vol, hfsp_fork_raw* fork);
 extern void btree_close(btree* bt);
 
 /* Read node at given index */
-extern node_buf* btree_node_by_index(btree* bt, UInt16 index);
+extern node_buf* btree_node_by_index(btree* bt, UInt32 index);
+
+/* Node cache statistics, for all btrees */
+extern unsigned long btree_cache_hits, btree_cache_misses, btree_cache_prefetched;
 
 /* returns pointer to key given by index in current node */
 extern void* btree_key_by_index(btree* bt, node_buf* buf, UInt16 index);
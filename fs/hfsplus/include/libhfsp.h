@@ -91,21 +91,19 @@ typedef void* (*hfsp_key_read) (void* p, void* key);
 
 struct volume; /* foreward declaration for btree needed */
 
-/* Structures for a node cache. The cache is an array
- * with linear search. (So making it to big may make
- * things slower). It is searched in a round robin
- * fashion.
+/* Structures for a node cache. Nodes are found through a
+ * hash table on the node index. A miss replaces the entry
+ * used least recently, where index nodes count as more
+ * recent the higher they are in the tree.
  */
 
 typedef struct
 {
-    UInt32		priority;
-	// as lower this number as higher the priority.
-	// decremetned on any sucessfull usage
-	// incremented else, intial value height*DEPTHFACTOR
-    UInt16		index;	// of node in fork
+    UInt32		lru;	// cache tick of the last use
+    UInt32		index;	// of node in fork
 	// 0 means empty, since first node is node header
-	// contents of node in original byte order
+    int			next;	// next entry in the hash bucket, -1 ends
+    UInt16		height;	// height of the node in the tree
     UInt16		flags;	// like DIRTY etc.
 } node_entry;
 
@@ -120,12 +118,24 @@ typedef struct
 typedef struct
 {
     int		size;	     // number of nodes in the cache
-    int		currindex;   // round robin index
+    int		hashsize;    // number of hash buckets, a power of 2
     int		nodebufsize; // size of complete node_buf, including node
+    UInt32	tick;	     // incremented on every lookup
     node_entry	*entries;
+    int		*hash;	     // first entry in each bucket, -1 if empty
     char	*buffers;   // actually *node_buf
 } node_cache;
 
+/* Number of folder threads remembered per btree, see record_init_cnid */
+#define HFSP_THREAD_CACHE	8
+
+typedef struct
+{
+    UInt32		cnid;	    // folder the thread belongs to, 0 if empty
+    UInt32		node_index; // node holding the thread record
+    UInt16		keyind;	    // index of the record in that node
+} thread_entry;
+
 typedef struct
 {
     struct volume*	vol;	/* pointer to volume this tree is part of */
@@ -140,6 +150,8 @@ typedef struct
     UInt16		blkpernode;
 	 /* Number of volume blocks per node (usually 1-4) */
     node_cache		cache;
+    thread_entry	threads[HFSP_THREAD_CACHE];
+    int			thread_next; /* next entry to replace */
     /* Warning all functions of btrees and records may modify
        the following values ! */
     // UInt16		node_index; /* index of node in fork */
@@ -55,7 +55,12 @@ extern int record_init_parent(record* r, record* parent);
  *
  * parent and r may be the same.
  */
-extern int record_init_string_parent(record* r, record* parent, char* key);
+extern int record_init_string_parent(record* r, record* parent, const char* key);
+
+/* intialize the record by searching for the given string in the folder
+ * given by cnid. The string is compared case insensitive.
+ */
+extern int record_init_name(record* r, btree* tree, UInt32 cnid, const char* name);
 
 /* move record up in folder hierarchy (if possible) */
 extern int record_up(record* r);
@@ -26,3 +26,13 @@ int unicode_uni2asc(char *astr, const hfsp_unistr255 *ustr, int maxlen);
 
 SInt32 fast_unicode_compare (const hfsp_unistr255 *ustr1,
 			     const hfsp_unistr255 *ustr2);
+
+/* case fold ustr in place and drop ignorable characters, so
+ * it can be compared with fast_unicode_compare_folded */
+
+void unicode_fold (hfsp_unistr255 *ustr);
+
+/* like fast_unicode_compare, but ustr2 was already folded */
+
+SInt32 fast_unicode_compare_folded (const hfsp_unistr255 *ustr1,
+				    const hfsp_unistr255 *ustr2);
@@ -43,6 +43,13 @@ extern void* volume_readfromfork(volume* vol, void* buf,
  */
 int volume_readinbuf(volume * vol,void* buf, long block);
 
+/* Fill a given buffer with count consecutive blocks in volume.
+ */
+int volume_readblocks(volume * vol, void* buf, long block, UInt32 count);
+
+/* Device read requests and blocks read, for all volumes */
+extern unsigned long volume_read_count, volume_block_count;
+
 /* invalidat cache hold in volume, will be removed when
  * caching strategy is clear to me. */
 /*
@@ -146,6 +146,15 @@ void ob_virtio_init(const char *path, const char *dev_name, uint64_t common_cfg,
                     uint64_t device_cfg, uint64_t notify_base, uint32_t notify_mult,
                     int idx);
 #endif
+#ifdef CONFIG_WII
+/* arch/ppc/wii/ipc.c */
+void wii_ipc_send(uint32_t msg);
+void wii_ipc_kick(void);
+void wii_ipc_flush(void);
+void wii_ipc_print(int c);
+void wii_ipc_print_flush(void);
+void wii_ipc_stats(void);
+#endif
 #ifdef CONFIG_DRIVER_FLIPPER_VI
 int ob_flipper_vi_init(const char *path, unsigned long xfb_base, unsigned long fb_base);
 #endif
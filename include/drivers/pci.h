@@ -244,5 +244,6 @@ extern const pci_arch_t *arch;
 #define PCI_DEVICE_ID_INTEL_82378        0x0484
 #define PCI_DEVICE_ID_INTEL_E1000        0x100e
 #define PCI_DEVICE_ID_INTEL_82441        0x1237
+#define PCI_DEVICE_ID_INTEL_82801DB_EHCI 0x24cd
 
 #endif	/* _H_PCI */
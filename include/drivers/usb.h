@@ -2,7 +2,9 @@
 #define USB_H
 
 int ob_usb_ohci_init(const char *path, uint32_t addr);
+int ob_usb_ehci_init(const char *path, uint32_t addr);
 void ob_usb_hid_add_keyboard(const char *path);
+void usb_msc_stats(void);
 int usb_exit(void);
 
 #endif /* USB_H */
@@ -0,0 +1,9 @@
+#ifndef ADLER32_H
+#define ADLER32_H
+
+uint32_t adler32(uint32_t adler, const unsigned char *buf, unsigned long len);
+
+/* ( adler buf len -- checksum ) */
+void forth_adler32(void);
+
+#endif /* ADLER32_H */
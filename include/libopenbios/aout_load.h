@@ -19,9 +19,11 @@
 
 #include "arch/common/a.out.h"
 #include "libopenbios/sys_info.h"
+#include "libopenbios/load.h"
 
 extern int is_aout(struct exec *ehdr);
-extern int aout_load(struct sys_info *info, ihandle_t dev);
+extern long find_aout(unsigned char *buf, unsigned long len);
+extern int aout_load(struct sys_info *info, ihandle_t dev, struct load_header *hdr);
 extern void aout_init_program(void);
 
 #endif   /* _H_AOUTLOAD */
@@ -20,12 +20,14 @@
 #include "arch/common/elf.h"
 #include "asm/elf.h"
 #include "libopenbios/sys_info.h"
+#include "libopenbios/load.h"
 
-extern int 		elf_load(struct sys_info *info, ihandle_t dev, const char *cmdline, void **boot_notes);
+extern int 		elf_load(struct sys_info *info, ihandle_t dev, const char *cmdline, void **boot_notes,
+				 struct load_header *hdr);
 extern void 		elf_init_program(void);
 extern int		is_elf(Elf_ehdr *ehdr);
-extern int		find_elf(Elf_ehdr *ehdr);
+extern long		find_elf(unsigned char *buf, unsigned long len);
 
-extern Elf_phdr *	elf_readhdrs(int offset, Elf_ehdr *ehdr);
+extern Elf_phdr *	elf_readhdrs(int offset, Elf_ehdr *ehdr, struct load_header *hdr);
 
 #endif   /* _H_ELFLOAD */
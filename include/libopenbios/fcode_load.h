@@ -17,8 +17,11 @@
 #ifndef _H_FCODELOAD
 #define _H_FCODELOAD
 
+#include "libopenbios/load.h"
+
 extern int is_fcode(unsigned char *fcode);
-extern int fcode_load(ihandle_t dev);
+extern long find_fcode(unsigned char *buf, unsigned long len);
+extern int fcode_load(ihandle_t dev, struct load_header *hdr);
 extern void fcode_init_program(void);
 
 #endif   /* _H_FCODELOAD */
@@ -17,8 +17,11 @@
 #ifndef _H_FORTHLOAD
 #define _H_FORTHLOAD
 
+#include "libopenbios/load.h"
+
 extern int is_forth(char *forth);
-extern int forth_load(ihandle_t dev);
+extern long find_forth(unsigned char *buf, unsigned long len);
+extern int forth_load(ihandle_t dev, struct load_header *hdr);
 extern void forth_init_program(void);
 
 #endif   /* _H_FORTHLOAD */
@@ -17,6 +17,18 @@
 #ifndef _H_LOAD
 #define _H_LOAD
 
+/* The first LOAD_HEADER_SIZE bytes of an image are read once by load()
+   and handed to each loader, which look for their magic within it
+   rather than probing the device themselves */
+#define LOAD_HEADER_SIZE	(16 * 512)
+
+struct load_header {
+	unsigned char	*buf;
+	unsigned long	len;		/* bytes actually read into buf */
+	unsigned long	offset;		/* offset of the matching header */
+};
+
 extern void 	load(ihandle_t dev);
+extern void	load_print_stats(void);
 
 #endif   /* _H_LOAD */
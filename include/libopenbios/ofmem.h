@@ -24,6 +24,15 @@ typedef struct alloc_desc {
 	ucell			size;			/* size (including) this struct */
 } alloc_desc_t;
 
+/* number of size classes used for small malloc blocks */
+#define OFMEM_NUM_BINS		12
+
+typedef struct alloc_stats {
+	ucell			live;			/* blocks in use */
+	ucell			peak;			/* highest number of blocks in use */
+	ucell			cached;			/* free blocks held by the class */
+} alloc_stats_t;
+
 typedef struct mem_range {
 	struct mem_range	*next;
 	phys_addr_t		start;			/* sizeof(phys) >= sizeof(virt), e.g SPARC32 */
@@ -42,7 +51,11 @@ typedef struct trans {
 typedef struct {
 	ucell			ramsize;
 	char 			*next_malloc;
-	alloc_desc_t	*mfree;		/* list of free malloc blocks */
+	alloc_desc_t	*mfree;		/* address sorted list of free malloc blocks */
+	alloc_desc_t	*bins[OFMEM_NUM_BINS];	/* free lists of the small size classes */
+	alloc_stats_t	bin_stats[OFMEM_NUM_BINS];
+	ucell			large_live;	/* bytes in use by blocks outside the size classes */
+	ucell			large_peak;
 
 	range_t			*phys_range;
 	range_t			*virt_range;
@@ -19,9 +19,11 @@
 
 #include "arch/common/xcoff.h"
 #include "libopenbios/sys_info.h"
+#include "libopenbios/load.h"
 
 extern int is_xcoff(COFF_filehdr_t *fhdr);
-extern int xcoff_load(ihandle_t dev);
+extern long find_xcoff(unsigned char *buf, unsigned long len);
+extern int xcoff_load(ihandle_t dev, struct load_header *hdr);
 extern void xcoff_init_program(void);
 
 #endif   /* _H_XCOFFLOAD */
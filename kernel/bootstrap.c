@@ -89,7 +89,8 @@ static const char *wordnames[] = {
 	"here", "here!", "dobranch", "do?branch", "unaligned-w@",
 	"unaligned-w!", "unaligned-l@", "unaligned-l!", "ioc@", "iow@",
 	"iol@", "ioc!", "iow!", "iol!", "i", "j", "call", "sys-debug",
-	"$include", "$encode-file", "(debug", "(debug-off)"
+	"$include", "$encode-file", "(debug", "(debug-off)",
+	"(find-wordlist)", "(index-wordlist)", "(dict-stats)"
 };
 
 /*
@@ -1022,6 +1023,7 @@ static void run_dictionary(char *basedict, char *confile)
 		return;
 
 	read_dictionary(basedict);
+	dict_hash_init();
 	PC = (ucell)findword("initialize");
 
 	if (!PC) {
@@ -1059,6 +1061,7 @@ static void run_dictionary(char *basedict, char *confile)
 static void new_dictionary(const char *source)
 {
 	build_dictionary();
+	dict_hash_init();
 
 	interpret_source((char *)source);
 
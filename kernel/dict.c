@@ -67,53 +67,323 @@ static int to_lower(int c)
 	return ((c >= 'A') && (c <= 'Z')) ? (c - 'A' + 'a') : c;
 }
 
-/* fstrcmp - compare null terminated string with forth string. */
+/* fstrncpy - copy a forth string to a destination (with NULL termination) */
 
-static int fstrcmp(const char *s1, ucell fstr)
+void fstrncpy(char *dest, ucell src, unsigned int maxlen)
+{
+	int len = fstrlen(src);
+
+	if (fstrlen(src) >= maxlen) len = maxlen - 1;
+	memcpy(dest, cell2pointer(src), len);
+	*(dest + len) = '\0';
+} 
+
+
+/* fstrncmp - compare counted string with forth string, ignoring case. */
+
+static int fstrncmp(const char *s1, ucell len, ucell fstr)
 {
 	char *s2 = (char*)cell2pointer(fstr);
-	while (*s1) {
+	while (len--) {
 		if ( to_lower(*(s1++)) != to_lower(*(s2++)) )
 			return -1;
 	}
 	return 0;
 }
 
-/* fstrncpy - copy a forth string to a destination (with NULL termination) */
 
-void fstrncpy(char *dest, ucell src, unsigned int maxlen)
+/* lookup statistics, reported by (dict-stats) */
+
+static ucell dict_lookups = 0;
+static ucell dict_probes = 0;
+
+/* match_word - compare a name against the name field of a word. */
+
+static int match_word(const char *s1, ucell len, ucell lfa)
 {
-	int len = fstrlen(src);
+	ucell nfa = lfa2nfa(lfa);
 
-	if (fstrlen(src) >= maxlen) len = maxlen - 1;
-	memcpy(dest, cell2pointer(src), len);
-	*(dest + len) = '\0';
-} 
+	dict_probes++;
+	return (len == fstrlen(nfa) && !fstrncmp(s1, len, nfa));
+}
 
 
-/* findword
- * looks up a given word in the dictionary. This function
- * is used by the c based interpreter and to find the "initialize"
- * word.
+#ifdef CONFIG_DICT_HASH
+
+/* Hashed name index
+ *
+ * Every wordlist that has been searched through findword_wordlist()
+ * gets a slot in dict_lists, remembering the head it was indexed at.
+ * Its words are kept in dict_buckets, hashed by case-folded name and
+ * sorted by descending lfa, so the first match in a chain is the most
+ * recent definition. A changed wordlist head is resynchronized on the
+ * next reveal or lookup: new words are appended, anything else (forget)
+ * makes us reindex the whole wordlist.
  */
 
-xt_t findword(const char *s1)
+#define DICT_HASH_BUCKETS	1024
+#define DICT_HASH_ENTRIES	8192
+#define DICT_HASH_LISTS		256
+#define DICT_HASH_NIL		0xffff
+
+struct dict_hash_entry {
+	u32	lfa;		/* offset from dict */
+	u16	next;
+	u16	list;
+};
+
+struct dict_hash_list {
+	ucell	wordlist;
+	ucell	head;
+	int	linear;	/* not indexable, walk it instead */
+};
+
+static struct dict_hash_entry dict_entries[DICT_HASH_ENTRIES];
+static u16 dict_buckets[DICT_HASH_BUCKETS];
+static struct dict_hash_list dict_lists[DICT_HASH_LISTS];
+static u16 dict_free;
+static ucell dict_words;
+static int dict_hash_ready = 0;
+
+static unsigned int dict_hash(const char *s, ucell len)
 {
-	ucell tmplfa, len;
+	unsigned int h = 0;
 
-	if (!last)
+	while (len--)
+		h = h * 31 + to_lower(*(s++));
+
+	return h & (DICT_HASH_BUCKETS - 1);
+}
+
+static struct dict_hash_list *dict_hash_list(ucell wordlist, int create)
+{
+	unsigned int i, slot = (wordlist / sizeof(cell)) % DICT_HASH_LISTS;
+
+	for (i = 0; i < DICT_HASH_LISTS; i++) {
+		struct dict_hash_list *l = &dict_lists[slot];
+
+		if (l->wordlist == wordlist)
+			return l;
+		if (!l->wordlist) {
+			if (!create)
+				return NULL;
+			l->wordlist = wordlist;
+			l->head = 0;
+			l->linear = 0;
+			return l;
+		}
+		slot = (slot + 1) % DICT_HASH_LISTS;
+	}
+
+	return NULL;
+}
+
+static int dict_hash_insert(ucell lfa, struct dict_hash_list *l)
+{
+	ucell nfa = lfa2nfa(lfa);
+	ucell len = fstrlen(nfa);
+	u32 off = lfa - pointer2cell(dict);
+	u16 e, *p;
+
+	/* nameless words can't be looked up */
+	if (!len)
 		return 0;
 
-	tmplfa = read_ucell(last);
+	/* words outside the dictionary (e.g. in alloc-mem'd wordlists)
+	 * must fit our 32bit offsets.
+	 */
+	if (lfa < pointer2cell(dict))
+		return -1;
+#if BITS > 32
+	if ((u64)(lfa - pointer2cell(dict)) > 0xffffffffULL)
+		return -1;
+#endif
+
+	if (dict_free == DICT_HASH_NIL)
+		return -1;
 
-	len = strlen(s1);
+	e = dict_free;
+	dict_free = dict_entries[e].next;
 
-	while (tmplfa) {
-		ucell nfa = lfa2nfa(tmplfa);
+	dict_entries[e].lfa = off;
+	dict_entries[e].list = l - dict_lists;
 
-		if (len == fstrlen(nfa) && !fstrcmp(s1, nfa)) {
-			return lfa2cfa(tmplfa);
+	p = &dict_buckets[dict_hash(cell2pointer(nfa), len)];
+	while (*p != DICT_HASH_NIL && dict_entries[*p].lfa > off)
+		p = &dict_entries[*p].next;
+
+	dict_entries[e].next = *p;
+	*p = e;
+	dict_words++;
+
+	return 0;
+}
+
+static void dict_hash_drop(struct dict_hash_list *l)
+{
+	unsigned int i;
+	u16 *p, e;
+
+	for (i = 0; i < DICT_HASH_BUCKETS; i++) {
+		p = &dict_buckets[i];
+		while (*p != DICT_HASH_NIL) {
+			e = *p;
+			if (dict_entries[e].list == l - dict_lists) {
+				*p = dict_entries[e].next;
+				dict_entries[e].next = dict_free;
+				dict_free = e;
+				dict_words--;
+			} else {
+				p = &dict_entries[e].next;
+			}
 		}
+	}
+
+	l->head = 0;
+}
+
+static void dict_hash_sync(struct dict_hash_list *l)
+{
+	ucell head = read_ucell(cell2pointer(l->wordlist));
+	ucell tmplfa;
+
+	if (l->linear || head == l->head)
+		return;
+
+	/* common case: new words were revealed on top of the indexed ones */
+	for (tmplfa = head; tmplfa > l->head;
+	     tmplfa = read_ucell(cell2pointer(tmplfa))) {
+		if (dict_hash_insert(tmplfa, l))
+			goto unindexed;
+	}
+
+	if (tmplfa != l->head) {
+		/* the wordlist was cut back, start over */
+		dict_hash_drop(l);
+		for (tmplfa = head; tmplfa;
+		     tmplfa = read_ucell(cell2pointer(tmplfa))) {
+			if (dict_hash_insert(tmplfa, l))
+				goto unindexed;
+		}
+	}
+
+	l->head = head;
+	return;
+
+ unindexed:
+	/* out of entries or not indexable, walk this wordlist instead */
+	dict_hash_drop(l);
+	l->linear = 1;
+}
+
+static ucell dict_hash_find(const char *s1, ucell len, struct dict_hash_list *l)
+{
+	u16 e = dict_buckets[dict_hash(s1, len)];
+
+	while (e != DICT_HASH_NIL) {
+		if (dict_entries[e].list == l - dict_lists) {
+			ucell lfa = dict_entries[e].lfa + pointer2cell(dict);
+
+			if (match_word(s1, len, lfa))
+				return lfa;
+		}
+		e = dict_entries[e].next;
+	}
+
+	return 0;
+}
+
+static void dict_hash_reset(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < DICT_HASH_ENTRIES; i++)
+		dict_entries[i].next = (i + 1 < DICT_HASH_ENTRIES) ? i + 1 : DICT_HASH_NIL;
+	dict_free = 0;
+	dict_words = 0;
+
+	for (i = 0; i < DICT_HASH_BUCKETS; i++)
+		dict_buckets[i] = DICT_HASH_NIL;
+
+	memset(dict_lists, 0, sizeof(dict_lists));
+	dict_hash_ready = 1;
+}
+
+/* dict_hash_init
+ * (re)builds the name index for the forth wordlist after
+ * the dictionary has been loaded.
+ */
+
+void dict_hash_init(void)
+{
+	dict_hash_reset();
+
+	if (last)
+		dict_hash_sync(dict_hash_list(pointer2cell(last), 1));
+}
+
+/* dict_hash_reveal
+ * called by reveal to keep an already indexed wordlist up to date
+ */
+
+void dict_hash_reveal(ucell wordlist)
+{
+	struct dict_hash_list *l = dict_hash_list(wordlist, 0);
+
+	if (l)
+		dict_hash_sync(l);
+}
+
+#else
+
+void dict_hash_init(void)
+{
+}
+
+void dict_hash_reveal(ucell wordlist)
+{
+}
+
+#endif
+
+
+/* findword_wordlist
+ * looks up a counted string in the given wordlist and returns
+ * the xt of the most recent matching definition, or 0.
+ */
+
+ucell findword_wordlist(const char *s1, ucell len, ucell wordlist)
+{
+	ucell tmplfa;
+
+	if (!wordlist)
+		return 0;
+
+	dict_lookups++;
+
+#ifdef CONFIG_DICT_HASH
+	if (len) {
+		struct dict_hash_list *l;
+
+		if (!dict_hash_ready)
+			dict_hash_reset();
+
+		l = dict_hash_list(wordlist, 1);
+		if (l) {
+			dict_hash_sync(l);
+			if (!l->linear) {
+				tmplfa = dict_hash_find(s1, len, l);
+				return tmplfa ? lfa2cfa(tmplfa) : 0;
+			}
+		}
+	}
+#endif
+
+	tmplfa = read_ucell(cell2pointer(wordlist));
+
+	while (tmplfa) {
+		if (match_word(s1, len, tmplfa))
+			return lfa2cfa(tmplfa);
 
 		tmplfa = read_ucell(cell2pointer(tmplfa));
 	}
@@ -122,6 +392,37 @@ xt_t findword(const char *s1)
 }
 
 
+/* findword
+ * looks up a given word in the dictionary. This function
+ * is used by the c based interpreter and to find the "initialize"
+ * word.
+ */
+
+xt_t findword(const char *s1)
+{
+	if (!last)
+		return 0;
+
+	return findword_wordlist(s1, strlen(s1), pointer2cell(last));
+}
+
+
+/* dict_stats
+ * returns the number of lookups, name comparisons and indexed words
+ */
+
+void dict_stats(ucell *lookups, ucell *probes, ucell *words)
+{
+	*lookups = dict_lookups;
+	*probes = dict_probes;
+#ifdef CONFIG_DICT_HASH
+	*words = dict_words;
+#else
+	*words = 0;
+#endif
+}
+
+
 /* findsemis_wordlist
  * Given a DOCOL xt and a wordlist, find the address of the semis
  * word at the end of the word definition. We do this by finding
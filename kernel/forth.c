@@ -73,6 +73,7 @@ static ucell *trampoline = t;
 void forth_init(void)
 {
     init_trampoline(trampoline);
+    dict_hash_init();
 }
 #endif
 
@@ -127,6 +128,9 @@ static inline void next(void)
     processxt(read_ucell(cell2pointer(read_ucell(cell2pointer(PC)))));
 }
 
+#ifdef CONFIG_FAST_DISPATCH
+static void enterforth_fast(cell tmp);
+#endif
 static inline void next_dbg(void);
 
 int enterforth(xt_t xt)
@@ -150,6 +154,11 @@ int enterforth(xt_t xt)
     PC = pointer2cell(_cfa);
 
     while (rstackcnt > tmp && !(interruptforth & FORTH_INTSTAT_STOP)) {
+#ifdef CONFIG_FAST_DISPATCH
+        if (debug_xt_list->next == NULL) {
+            enterforth_fast(tmp);
+        } else
+#endif
         if (debug_xt_list->next == NULL) {
             while (rstackcnt > tmp && !interruptforth) {
                 dbg_interp_printk("enterforth: NEXT\n");
@@ -1848,6 +1857,52 @@ static void loop_j(void)
 	PUSH(rstack[rstackcnt - 2]);
 }
 
+/*
+ *   (find-wordlist)  ( name-str name-len wid -- xt true | name-str name-len false )
+ */
+
+static void findwordlist(void)
+{
+	const ucell wid = POP();
+	const ucell len = GETTOS();
+	const ucell str = GETITEM(1);
+	ucell xt = findword_wordlist((const char *)cell2pointer(str), len, wid);
+
+	if (xt) {
+		POP();
+		POP();
+		PUSH(xt);
+		PUSH(-1);
+	} else {
+		PUSH(0);
+	}
+}
+
+
+/*
+ *   (index-wordlist) ( wid -- )
+ */
+
+static void indexwordlist(void)
+{
+	dict_hash_reveal(POP());
+}
+
+
+/*
+ *   (dict-stats)     ( -- lookups probes words )
+ */
+
+static void dictstats(void)
+{
+	ucell lookups, probes, nwords;
+
+	dict_stats(&lookups, &probes, &nwords);
+	PUSH(lookups);
+	PUSH(probes);
+	PUSH(nwords);
+}
+
 /* words[] is a function array of all native code functions used by
  * the dictionary, i.e. CFAs and primitives.
  * Any change here needs a matching change in the primitive word's
@@ -1856,111 +1911,433 @@ static void loop_j(void)
  * NOTE: THIS LIST SHALL NOT CHANGE (EXCEPT MANDATORY ADDITIONS AT
  * THE END). ANY OTHER CHANGE WILL BREAK COMPATIBILITY TO OLDER
  * BINARY DICTIONARIES.
- */
+ *
+ * The list is kept in FORTH_WORDS so that code which needs the index
+ * of a word uses W_<function> instead of a hard-coded number.
+ */
+#define FORTH_WORDS(X)                              \
+    /* CFAs and special words */                    \
+    X(semis)                                        \
+    X(docol)                                        \
+    X(lit)                                          \
+    X(docon)                                        \
+    X(dovar)                                        \
+    X(dodefer)                                      \
+    X(dodoes)                                       \
+    X(dodo)                                         \
+    X(doisdo)                                       \
+    X(doloop)                                       \
+    X(doplusloop)                                   \
+    X(doival)                                       \
+    X(doivar)                                       \
+    X(doidefer)                                     \
+                                                    \
+    /* primitives */                                \
+    X(fdup)                 /* dup     */           \
+    X(twodup)               /* 2dup    */           \
+    X(isdup)                /* ?dup    */           \
+    X(over)                 /* over    */           \
+    X(twoover)              /* 2over   */           \
+    X(pick)                 /* pick    */           \
+    X(drop)                 /* drop    */           \
+    X(twodrop)              /* 2drop   */           \
+    X(nip)                  /* nip     */           \
+    X(roll)                 /* roll    */           \
+    X(rot)                  /* rot     */           \
+    X(minusrot)             /* -rot    */           \
+    X(swap)                 /* swap    */           \
+    X(twoswap)              /* 2swap   */           \
+    X(tor)                  /* >r      */           \
+    X(rto)                  /* r>      */           \
+    X(rfetch)               /* r@      */           \
+    X(depth)                /* depth   */           \
+    X(depthwrite)           /* depth!  */           \
+    X(rdepth)               /* rdepth  */           \
+    X(rdepthwrite)          /* rdepth! */           \
+    X(plus)                 /* +       */           \
+    X(minus)                /* -       */           \
+    X(mult)                 /* *       */           \
+    X(umult)                /* u*      */           \
+    X(mudivmod)             /* mu/mod  */           \
+    X(forthabs)             /* abs     */           \
+    X(negate)               /* negate  */           \
+    X(max)                  /* max     */           \
+    X(min)                  /* min     */           \
+    X(lshift)               /* lshift  */           \
+    X(rshift)               /* rshift  */           \
+    X(rshifta)              /* >>a     */           \
+    X(and)                  /* and     */           \
+    X(or)                   /* or      */           \
+    X(xor)                  /* xor     */           \
+    X(invert)               /* invert  */           \
+    X(dplus)                /* d+      */           \
+    X(dminus)               /* d-      */           \
+    X(mmult)                /* m*      */           \
+    X(ummult)               /* um*     */           \
+    X(fetch)                /* @       */           \
+    X(cfetch)               /* c@      */           \
+    X(wfetch)               /* w@      */           \
+    X(lfetch)               /* l@      */           \
+    X(store)                /* !       */           \
+    X(plusstore)            /* +!      */           \
+    X(cstore)               /* c!      */           \
+    X(wstore)               /* w!      */           \
+    X(lstore)               /* l!      */           \
+    X(equals)               /* =       */           \
+    X(greater)              /* >       */           \
+    X(less)                 /* <       */           \
+    X(ugreater)             /* u>      */           \
+    X(uless)                /* u<      */           \
+    X(spfetch)              /* sp@     */           \
+    X(fmove)                /* move    */           \
+    X(ffill)                /* fill    */           \
+    X(emit)                 /* emit    */           \
+    X(iskey)                /* key?    */           \
+    X(key)                  /* key     */           \
+    X(execute)              /* execute */           \
+    X(here)                 /* here    */           \
+    X(herewrite)            /* here!   */           \
+    X(dobranch)             /* dobranch     */      \
+    X(docbranch)            /* do?branch    */      \
+    X(unalignedwordread)    /* unaligned-w@ */      \
+    X(unalignedwordwrite)   /* unaligned-w! */      \
+    X(unalignedlongread)    /* unaligned-l@ */      \
+    X(unalignedlongwrite)   /* unaligned-l! */      \
+    X(iocfetch)             /* ioc@    */           \
+    X(iowfetch)             /* iow@    */           \
+    X(iolfetch)             /* iol@    */           \
+    X(iocstore)             /* ioc!    */           \
+    X(iowstore)             /* iow!    */           \
+    X(iolstore)             /* iol!    */           \
+    X(loop_i)               /* i       */           \
+    X(loop_j)               /* j       */           \
+    X(call)                 /* call    */           \
+    X(sysdebug)             /* sys-debug */         \
+    X(do_include)           /* $include */          \
+    X(do_encode_file)       /* $encode-file */      \
+    X(do_debug_xt)          /* (debug  */           \
+    X(do_debug_off)         /* (debug-off) */       \
+    X(findwordlist)         /* (find-wordlist) */   \
+    X(indexwordlist)        /* (index-wordlist) */  \
+    X(dictstats)            /* (dict-stats) */
+
+/* words[] indices */
+enum {
+#define WORD_INDEX(w)   W_##w,
+    FORTH_WORDS(WORD_INDEX)
+#undef WORD_INDEX
+};
+
+/* dict.h numbers the CFAs the same way, fail the build if they differ */
+typedef char words_cfa_check[W_semis == DOSEMIS && W_docol == DOCOL && W_lit == DOLIT &&
+                             W_docon == DOCON && W_dovar == DOVAR ? 1 : -1];
+
 static forth_word * const words[] = {
-    /*
-     * CFAs and special words
-     */
-    semis,
-    docol,
-    lit,
-    docon,
-    dovar,
-    dodefer,
-    dodoes,
-    dodo,
-    doisdo,
-    doloop,
-    doplusloop,
-    doival,
-    doivar,
-    doidefer,
-
-    /*
-     * primitives
-     */
-    fdup,                   /* dup     */
-    twodup,                 /* 2dup    */
-    isdup,                  /* ?dup    */
-    over,                   /* over    */
-    twoover,                /* 2over   */
-    pick,                   /* pick    */
-    drop,                   /* drop    */
-    twodrop,                /* 2drop   */
-    nip,                    /* nip     */
-    roll,                   /* roll    */
-    rot,                    /* rot     */
-    minusrot,               /* -rot    */
-    swap,                   /* swap    */
-    twoswap,                /* 2swap   */
-    tor,                    /* >r      */
-    rto,                    /* r>      */
-    rfetch,                 /* r@      */
-    depth,                  /* depth   */
-    depthwrite,             /* depth!  */
-    rdepth,                 /* rdepth  */
-    rdepthwrite,            /* rdepth! */
-    plus,                   /* +       */
-    minus,                  /* -       */
-    mult,                   /* *       */
-    umult,                  /* u*      */
-    mudivmod,               /* mu/mod  */
-    forthabs,               /* abs     */
-    negate,                 /* negate  */
-    max,                    /* max     */
-    min,                    /* min     */
-    lshift,                 /* lshift  */
-    rshift,                 /* rshift  */
-    rshifta,                /* >>a     */
-    and,                    /* and     */
-    or,                     /* or      */
-    xor,                    /* xor     */
-    invert,                 /* invert  */
-    dplus,                  /* d+      */
-    dminus,                 /* d-      */
-    mmult,                  /* m*      */
-    ummult,                 /* um*     */
-    fetch,                  /* @       */
-    cfetch,                 /* c@      */
-    wfetch,                 /* w@      */
-    lfetch,                 /* l@      */
-    store,                  /* !       */
-    plusstore,              /* +!      */
-    cstore,                 /* c!      */
-    wstore,                 /* w!      */
-    lstore,                 /* l!      */
-    equals,                 /* =       */
-    greater,                /* >       */
-    less,                   /* <       */
-    ugreater,               /* u>      */
-    uless,                  /* u<      */
-    spfetch,                /* sp@     */
-    fmove,                  /* move    */
-    ffill,                  /* fill    */
-    emit,                   /* emit    */
-    iskey,                  /* key?    */
-    key,                    /* key     */
-    execute,                /* execute */
-    here,                   /* here    */
-    herewrite,              /* here!   */
-    dobranch,               /* dobranch     */
-    docbranch,              /* do?branch    */
-    unalignedwordread,      /* unaligned-w@ */
-    unalignedwordwrite,     /* unaligned-w! */
-    unalignedlongread,      /* unaligned-l@ */
-    unalignedlongwrite,     /* unaligned-l! */
-    iocfetch,               /* ioc@    */
-    iowfetch,               /* iow@    */
-    iolfetch,               /* iol@    */
-    iocstore,               /* ioc!    */
-    iowstore,               /* iow!    */
-    iolstore,               /* iol!    */
-    loop_i,                 /* i       */
-    loop_j,                 /* j       */
-    call,                   /* call    */
-    sysdebug,               /* sys-debug */
-    do_include,             /* $include */
-    do_encode_file,         /* $encode-file */
-    do_debug_xt,            /* (debug  */
-    do_debug_off,           /* (debug-off) */
+#define WORD_ENTRY(w)   w,
+    FORTH_WORDS(WORD_ENTRY)
+#undef WORD_ENTRY
 };
+
+#ifdef CONFIG_FAST_DISPATCH
+/*
+ * Fast dispatch engine
+ *
+ * Used by enterforth() while no debug xts are set. The PC and both
+ * stack pointers are kept in locals, the most frequent CFAs and
+ * primitives are handled inline (through a computed goto table with
+ * GCC, a switch otherwise) and a few common sequences are folded into
+ * superinstructions at dispatch time. The threaded code itself is
+ * never rewritten, so the stepper, the tracer and "see" are not
+ * affected. All other words go through words[] just like next().
+ */
+
+/* words[] indices of the words handled inline */
+enum {
+    T_SEMIS     = W_semis,
+    T_DOCOL     = W_docol,
+    T_LIT       = W_lit,
+    T_DOCON     = W_docon,
+    T_DOVAR     = W_dovar,
+    T_DODO      = W_dodo,
+    T_DOLOOP    = W_doloop,
+    T_DUP       = W_fdup,
+    T_OVER      = W_over,
+    T_DROP      = W_drop,
+    T_SWAP      = W_swap,
+    T_TOR       = W_tor,
+    T_RTO       = W_rto,
+    T_RFETCH    = W_rfetch,
+    T_PLUS      = W_plus,
+    T_MINUS     = W_minus,
+    T_AND       = W_and,
+    T_OR        = W_or,
+    T_FETCH     = W_fetch,
+    T_CFETCH    = W_cfetch,
+    T_STORE     = W_store,
+    T_EQUALS    = W_equals,
+    T_GREATER   = W_greater,
+    T_LESS      = W_less,
+    T_DOBRANCH  = W_dobranch,
+    T_DOCBRANCH = W_docbranch,
+    T_I         = W_loop_i,
+};
+
+#define FAST_TOKEN(pc) \
+    read_ucell(cell2pointer(read_ucell(cell2pointer(pc))))
+
+#define TOS     dstack[sp]
+#define NOS     dstack[sp - 1]
+#define TORS    rstack[rp]
+
+/* Fold a comparison with a following do?branch */
+#define FAST_CBRANCH(flag)                                      \
+    do {                                                        \
+        n = (flag) ? -1 : 0;                                    \
+        if (FAST_TOKEN(pc + sizeof(ucell)) == T_DOCBRANCH) {    \
+            sp -= 2;                                            \
+            pc += 2 * sizeof(ucell);                            \
+            if (!n)                                             \
+                pc += read_cell(cell2pointer(pc));              \
+        } else {                                                \
+            NOS = n;                                            \
+            sp--;                                               \
+        }                                                       \
+    } while (0)
+
+#ifdef __GNUC__
+#define FAST_OP(t)      op_##t
+#define FAST_NEXT()                                             \
+    do {                                                        \
+        if (rp <= tmp || interruptforth)                        \
+            goto out;                                           \
+        pc += sizeof(ucell);                                    \
+        token = FAST_TOKEN(pc);                                 \
+        goto *dispatch[token];                                  \
+    } while (0)
+#else
+#define FAST_OP(t)      case t
+#define FAST_NEXT()     continue
+#endif
+
+static void enterforth_fast(cell tmp)
+{
+    ucell pc = PC, token;
+    int sp = dstackcnt, rp = rstackcnt;
+    cell n;
+
+#ifdef __GNUC__
+    static void *dispatch[sizeof(words) / sizeof(words[0])];
+
+    if (!dispatch[0]) {
+        for (token = 0; token < sizeof(dispatch) / sizeof(dispatch[0]); token++)
+            dispatch[token] = &&op_call;
+        dispatch[T_SEMIS] = &&op_T_SEMIS;
+        dispatch[T_DOCOL] = &&op_T_DOCOL;
+        dispatch[T_LIT] = &&op_T_LIT;
+        dispatch[T_DOCON] = &&op_T_DOCON;
+        dispatch[T_DOVAR] = &&op_T_DOVAR;
+        dispatch[T_DODO] = &&op_T_DODO;
+        dispatch[T_DOLOOP] = &&op_T_DOLOOP;
+        dispatch[T_DUP] = &&op_T_DUP;
+        dispatch[T_OVER] = &&op_T_OVER;
+        dispatch[T_DROP] = &&op_T_DROP;
+        dispatch[T_SWAP] = &&op_T_SWAP;
+        dispatch[T_TOR] = &&op_T_TOR;
+        dispatch[T_RTO] = &&op_T_RTO;
+        dispatch[T_RFETCH] = &&op_T_RFETCH;
+        dispatch[T_PLUS] = &&op_T_PLUS;
+        dispatch[T_MINUS] = &&op_T_MINUS;
+        dispatch[T_AND] = &&op_T_AND;
+        dispatch[T_OR] = &&op_T_OR;
+        dispatch[T_FETCH] = &&op_T_FETCH;
+        dispatch[T_CFETCH] = &&op_T_CFETCH;
+        dispatch[T_STORE] = &&op_T_STORE;
+        dispatch[T_EQUALS] = &&op_T_EQUALS;
+        dispatch[T_GREATER] = &&op_T_GREATER;
+        dispatch[T_LESS] = &&op_T_LESS;
+        dispatch[T_DOBRANCH] = &&op_T_DOBRANCH;
+        dispatch[T_DOCBRANCH] = &&op_T_DOCBRANCH;
+        dispatch[T_I] = &&op_T_I;
+    }
+
+    FAST_NEXT();
+#else
+    for (;;) {
+        if (rp <= tmp || interruptforth)
+            goto out;
+        pc += sizeof(ucell);
+        token = FAST_TOKEN(pc);
+
+        switch (token) {
+#endif
+
+    FAST_OP(T_SEMIS):
+        pc = rstack[rp--];
+        FAST_NEXT();
+
+    FAST_OP(T_DOCOL):
+        rstack[++rp] = pc;
+        pc = read_ucell(cell2pointer(pc));
+        FAST_NEXT();
+
+    FAST_OP(T_LIT):
+        /* (lit) n + and (lit) n - */
+        pc += sizeof(cell);
+        n = read_cell(cell2pointer(pc));
+        token = FAST_TOKEN(pc + sizeof(ucell));
+        if (token == T_PLUS) {
+            pc += sizeof(ucell);
+            TOS += n;
+        } else if (token == T_MINUS) {
+            pc += sizeof(ucell);
+            TOS -= n;
+        } else {
+            dstack[++sp] = n;
+        }
+        FAST_NEXT();
+
+    FAST_OP(T_DOCON):
+        dstack[++sp] = read_ucell(cell2pointer(read_ucell(cell2pointer(pc)) + sizeof(ucell)));
+        FAST_NEXT();
+
+    FAST_OP(T_DOVAR):
+        dstack[++sp] = read_ucell(cell2pointer(pc)) + sizeof(ucell);
+        FAST_NEXT();
+
+    FAST_OP(T_DODO):
+        rstack[++rp] = NOS;
+        rstack[++rp] = TOS;
+        sp -= 2;
+        FAST_NEXT();
+
+    FAST_OP(T_DOLOOP):
+        n = TORS + 1;
+        pc += sizeof(cell);
+        if (n < rstack[rp - 1]) {
+            pc += read_cell(cell2pointer(pc));
+            TORS = n;
+        } else {
+            rp -= 2;
+        }
+        FAST_NEXT();
+
+    FAST_OP(T_DUP):
+        n = TOS;
+        dstack[++sp] = n;
+        FAST_NEXT();
+
+    FAST_OP(T_OVER):
+        n = NOS;
+        dstack[++sp] = n;
+        FAST_NEXT();
+
+    FAST_OP(T_DROP):
+        sp--;
+        FAST_NEXT();
+
+    FAST_OP(T_SWAP):
+        n = TOS;
+        TOS = NOS;
+        NOS = n;
+        FAST_NEXT();
+
+    FAST_OP(T_TOR):
+        rstack[++rp] = dstack[sp--];
+        FAST_NEXT();
+
+    FAST_OP(T_RTO):
+        dstack[++sp] = rstack[rp--];
+        FAST_NEXT();
+
+    FAST_OP(T_RFETCH):
+    FAST_OP(T_I):
+        n = TORS;
+        dstack[++sp] = n;
+        FAST_NEXT();
+
+    FAST_OP(T_PLUS):
+        NOS += TOS;
+        sp--;
+        FAST_NEXT();
+
+    FAST_OP(T_MINUS):
+        NOS -= TOS;
+        sp--;
+        FAST_NEXT();
+
+    FAST_OP(T_AND):
+        NOS &= TOS;
+        sp--;
+        FAST_NEXT();
+
+    FAST_OP(T_OR):
+        NOS |= TOS;
+        sp--;
+        FAST_NEXT();
+
+    FAST_OP(T_FETCH):
+        TOS = read_ucell(cell2pointer(TOS));
+        FAST_NEXT();
+
+    FAST_OP(T_CFETCH):
+        TOS = read_byte(cell2pointer(TOS));
+        FAST_NEXT();
+
+    FAST_OP(T_STORE):
+        write_ucell(cell2pointer(TOS), NOS);
+        sp -= 2;
+        FAST_NEXT();
+
+    FAST_OP(T_EQUALS):
+        FAST_CBRANCH(NOS == TOS);
+        FAST_NEXT();
+
+    FAST_OP(T_GREATER):
+        FAST_CBRANCH(NOS > TOS);
+        FAST_NEXT();
+
+    FAST_OP(T_LESS):
+        FAST_CBRANCH(NOS < TOS);
+        FAST_NEXT();
+
+    FAST_OP(T_DOBRANCH):
+        /* jump straight through a branch to a branch */
+        pc += sizeof(cell);
+        pc += read_cell(cell2pointer(pc));
+        if (FAST_TOKEN(pc + sizeof(ucell)) == T_DOBRANCH) {
+            pc += 2 * sizeof(cell);
+            pc += read_cell(cell2pointer(pc));
+        }
+        FAST_NEXT();
+
+    FAST_OP(T_DOCBRANCH):
+        pc += sizeof(cell);
+        if (!dstack[sp--])
+            pc += read_cell(cell2pointer(pc));
+        FAST_NEXT();
+
+#ifdef __GNUC__
+    op_call:
+#else
+        default:
+#endif
+        PC = pc;
+        dstackcnt = sp;
+        rstackcnt = rp;
+        processxt(token);
+        pc = PC;
+        sp = dstackcnt;
+        rp = rstackcnt;
+        FAST_NEXT();
+
+#ifndef __GNUC__
+        }
+    }
+#endif
+
+ out:
+    PC = pc;
+    dstackcnt = sp;
+    rstackcnt = rp;
+}
+#endif
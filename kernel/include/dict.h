@@ -44,6 +44,10 @@ void fstrncpy(char *dest, ucell src, unsigned int maxlen);
 ucell findsemis(ucell xt);
 ucell findxtfromcell_wordlist(ucell incell, ucell wordlist);
 ucell findxtfromcell(ucell incell);
+ucell findword_wordlist(const char *s1, ucell len, ucell wordlist);
+void dict_hash_init(void);
+void dict_hash_reveal(ucell wordlist);
+void dict_stats(ucell *lookups, ucell *probes, ucell *words);
 
 /* program counter */
 extern ucell 		PC;
@@ -0,0 +1,75 @@
+/*
+ *	<adler32.c>
+ *
+ *	Adler-32 checksum, shared by the PPC targets
+ *
+ *   Adapted from Mark Adler's original implementation (zlib license)
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   version 2
+ *
+ */
+
+#include "config.h"
+#include "kernel/kernel.h"
+#include "libopenbios/bindings.h"
+#include "libopenbios/adler32.h"
+
+#define BASE	65521U	/* largest prime smaller than 65536 */
+#define NMAX	5552	/* largest n such that 255n(n+1)/2 + (n+1)(BASE-1) <= 2^32-1 */
+
+#define DO1(buf,i)  {s1 += buf[i]; s2 += s1;}
+#define DO2(buf,i)  DO1(buf,i); DO1(buf,i+1);
+#define DO4(buf,i)  DO2(buf,i); DO2(buf,i+2);
+#define DO8(buf,i)  DO4(buf,i); DO4(buf,i+4);
+#define DO16(buf)   DO8(buf,0); DO8(buf,8);
+
+uint32_t
+adler32(uint32_t adler, const unsigned char *buf, unsigned long len)
+{
+	uint32_t s1 = adler & 0xffff;
+	uint32_t s2 = (adler >> 16) & 0xffff;
+	unsigned long k;
+
+	while (len > 0) {
+		k = (len < NMAX ? len : NMAX);
+		len -= k;
+
+		while (k >= 16) {
+			DO16(buf);
+			buf += 16;
+			k -= 16;
+		}
+		while (k) {
+			s1 += *buf++;
+			s2 += s1;
+			k--;
+		}
+
+		s1 %= BASE;
+		s2 %= BASE;
+	}
+
+	return s2 << 16 | s1;
+}
+
+/*
+ * adler32        ( adler buf len -- checksum )
+ *
+ * Both OS 9 and BootX require this word for payload validation.
+ */
+
+void
+forth_adler32(void)
+{
+	unsigned long len = POP();
+	const unsigned char *buf = cell2pointer(POP());
+	uint32_t adler = (uint32_t)POP();
+
+	if (buf == NULL) {
+		RET(-1);
+	}
+
+	RET(adler32(adler, buf, len));
+}
@@ -68,8 +68,23 @@ is_aout(struct exec *ehdr)
 		|| (ehdr->a_info & 0xffff) == QMAGIC);
 }
 
+long
+find_aout(unsigned char *buf, unsigned long len)
+{
+    unsigned long offset;
+
+    for (offset = 0; offset + sizeof(struct exec) <= len
+             && offset < 16 * 512; offset += 512) {
+        if (is_aout((struct exec *)(buf + offset)))
+            return offset;
+    }
+
+    debug("Not a bootable a.out image\n");
+    return -1;
+}
+
 int 
-aout_load(struct sys_info *info, ihandle_t dev)
+aout_load(struct sys_info *info, ihandle_t dev, struct load_header *hdr)
 {
     int retval = -1;
     struct exec ehdr;
@@ -86,16 +101,8 @@ aout_load(struct sys_info *info, ihandle_t dev)
 	goto out;
     }
 
-    for (offset = 0; offset < 16 * 512; offset += 512) {
-        seek_io(fd, offset);
-        if (read_io(fd, &ehdr, sizeof ehdr) != sizeof ehdr) {
-            debug("Can't read a.out header\n");
-            retval = LOADER_NOT_SUPPORT;
-            goto out;
-        }
-        if (is_aout(&ehdr))
-            break;
-    }
+    offset = hdr->offset;
+    memcpy(&ehdr, hdr->buf + offset, sizeof(ehdr));
 
     if (!is_aout(&ehdr)) {
 	debug("Not a bootable a.out image\n");
@@ -138,60 +138,101 @@ static unsigned long process_image_notes(Elf_phdr *phdr, int phnum,
 	}
     }
 out:
-    close_io(fd);
     if (buf)
 	free(buf);
     return retval;
 }
 
+/* Segments are read, checksummed and flushed in pieces of this size (or the
+   device's max-transfer) so that each piece is handled while still in cache */
+#define CHUNK_SIZE	(64 * 1024)
+
+static unsigned long segment_chunk_size(ihandle_t dev)
+{
+    unsigned long size = 0;
+    xt_t xt;
+
+    xt = find_ih_method("max-transfer", dev);
+    if (xt) {
+        call_package(xt, dev);
+        size = POP();
+    }
+
+    return size ? size : CHUNK_SIZE;
+}
+
+/* Clear the part of the 2-byte image checksum field that falls into the
+   chunk of file data [start, start + len) now at addr */
+static void clear_checksum(char *addr, unsigned long start, unsigned long len,
+                           unsigned long checksum_offset)
+{
+    unsigned long i;
+
+    for (i = checksum_offset; i < checksum_offset + 2; i++) {
+        if (i >= start && i < start + len)
+            addr[i - start] = 0;
+    }
+}
+
 static int load_segments(Elf_phdr *phdr, int phnum,
                          unsigned long checksum_offset,
-                         unsigned int offset, unsigned long *bytes)
+                         unsigned int offset, unsigned long chunk,
+                         unsigned long *bytes, unsigned short *sum)
 {
-    //unsigned int start_time, time;
-    int i;
+    unsigned long pos, len, sum_offset;
+    int i, has_checksum;
+    char *addr;
 
     *bytes = 0;
-    // start_time = currticks();
+    *sum = 0;
+    sum_offset = 0;
     for (i = 0; i < phnum; i++) {
 	if (phdr[i].p_type != PT_LOAD)
 	    continue;
 	debug("segment %d addr:" FMT_elf " file:" FMT_elf " mem:" FMT_elf " ",
               i, addr_fixup(phdr[i].p_paddr), phdr[i].p_filesz, phdr[i].p_memsz);
+	addr = phys_to_virt(addr_fixup(phdr[i].p_paddr));
+	has_checksum = phdr[i].p_offset <= checksum_offset
+		&& phdr[i].p_offset + phdr[i].p_filesz >= checksum_offset+2;
+
 	seek_io(fd, offset + phdr[i].p_offset);
 	debug("loading... ");
-	if ((size_t)read_io(fd, phys_to_virt(addr_fixup(phdr[i].p_paddr)), phdr[i].p_filesz)
-		!= phdr[i].p_filesz) {
-	    printf("Can't read program segment %d\n", i);
-	    return 0;
+	for (pos = 0; pos < phdr[i].p_filesz; pos += len) {
+	    len = MIN(chunk, phdr[i].p_filesz - pos);
+	    if ((size_t)read_io(fd, addr + pos, len) != len) {
+		printf("Can't read program segment %d\n", i);
+		return 0;
+	    }
+
+	    if (checksum_offset) {
+		if (has_checksum)
+		    clear_checksum(addr + pos, phdr[i].p_offset + pos, len,
+				   checksum_offset);
+		*sum = add_ipchksums(sum_offset + pos, *sum,
+				     ipchksum(addr + pos, len));
+	    }
+#ifdef CONFIG_PPC
+	    flush_icache_range(addr + pos, addr + pos + len);
+#endif
 	}
-	bytes += phdr[i].p_filesz;
+	*bytes += phdr[i].p_filesz;
+
+	/* The zeroed tail adds nothing to the checksum */
 	debug("clearing... ");
-	memset(phys_to_virt(addr_fixup(phdr[i].p_paddr) + phdr[i].p_filesz), 0,
-		phdr[i].p_memsz - phdr[i].p_filesz);
-	if (phdr[i].p_offset <= checksum_offset
-		&& phdr[i].p_offset + phdr[i].p_filesz >= checksum_offset+2) {
-	    debug("clearing checksum... ");
-	    memset(phys_to_virt(addr_fixup(phdr[i].p_paddr) + checksum_offset
-			- phdr[i].p_offset), 0, 2);
-	}
+	memset(addr + phdr[i].p_filesz, 0, phdr[i].p_memsz - phdr[i].p_filesz);
+	sum_offset += phdr[i].p_memsz;
 	debug("ok\n");
-
     }
-    // time = currticks() - start_time;
-    //debug("Loaded %lu bytes in %ums (%luKB/s)\n", bytes, time,
-    //	    time? bytes/time : 0);
     debug("Loaded %lu bytes \n", *bytes);
 
     return 1;
 }
 
 static int verify_image(Elf_ehdr *ehdr, Elf_phdr *phdr, int phnum,
-	unsigned short image_sum)
+	unsigned short segments_sum, unsigned short image_sum)
 {
     unsigned short sum, part_sum;
     unsigned long offset;
-    int i;
 
     sum = 0;
     offset = 0;
@@ -204,13 +245,8 @@ static int verify_image(Elf_ehdr *ehdr, Elf_phdr *phdr, int phnum,
     sum = add_ipchksums(offset, sum, part_sum);
     offset += phnum * sizeof(*phdr);
 
-    for (i = 0; i < phnum; i++) {
-	if (phdr[i].p_type != PT_LOAD)
-	    continue;
-	part_sum = ipchksum(phys_to_virt(addr_fixup(phdr[i].p_paddr)), phdr[i].p_memsz);
-	sum = add_ipchksums(offset, sum, part_sum);
-	offset += phdr[i].p_memsz;
-    }
+    /* The segments were summed as they were loaded */
+    sum = add_ipchksums(offset, sum, segments_sum);
 
     if (sum != image_sum) {
 	printf("Verify FAILED (image:%#04x vs computed:%#04x)\n",
@@ -329,37 +365,43 @@ is_elf(Elf_ehdr *ehdr)
         && ehdr->e_phentsize == sizeof(Elf_phdr));
 }
 
-int
-find_elf(Elf_ehdr *ehdr)
+long
+find_elf(unsigned char *buf, unsigned long len)
 {
-   int offset;
+   unsigned long offset;
 
    for (offset = 0; offset < MAX_HEADERS * BS; offset += BS) {
-        if ((size_t)read_io(fd, ehdr, sizeof ehdr) != sizeof ehdr) {
+        if (offset + sizeof(Elf_ehdr) > len) {
             debug("Can't read ELF header\n");
-            return 0;
+            break;
         }
 
-        if (is_elf(ehdr)) {
-            debug("Found ELF header at offset %d\n", offset);
+        if (is_elf((Elf_ehdr *)(buf + offset))) {
+            debug("Found ELF header at offset %lu\n", offset);
 	    return offset;
         }
-
-        seek_io(fd, offset);
     }
 
     debug("Not a bootable ELF image\n");
-    return 0;
+    return -1;
 }
 
 Elf_phdr *
-elf_readhdrs(int offset, Elf_ehdr *ehdr)
+elf_readhdrs(int offset, Elf_ehdr *ehdr, struct load_header *hdr)
 {
     unsigned long phdr_size;
     Elf_phdr *phdr;
 
     phdr_size = ehdr->e_phnum * sizeof(Elf_phdr);
     phdr = malloc(phdr_size);
+
+    /* The program headers usually follow the ELF header closely enough
+       to already be in the header buffer */
+    if (offset + ehdr->e_phoff + phdr_size <= hdr->len) {
+        memcpy(phdr, hdr->buf + offset + ehdr->e_phoff, phdr_size);
+        return phdr;
+    }
+
     seek_io(fd, offset + ehdr->e_phoff);
     if ((size_t)read_io(fd, phdr, phdr_size) != phdr_size) {
 	printf("Can't read program header\n");
@@ -370,12 +412,13 @@ elf_readhdrs(int offset, Elf_ehdr *ehdr)
 }
 
 int 
-elf_load(struct sys_info *info, ihandle_t dev, const char *cmdline, void **boot_notes)
+elf_load(struct sys_info *info, ihandle_t dev, const char *cmdline, void **boot_notes,
+         struct load_header *hdr)
 {
     Elf_ehdr ehdr;
     Elf_phdr *phdr = NULL;
     unsigned long checksum_offset, file_size;
-    unsigned short checksum = 0;
+    unsigned short checksum = 0, segments_sum;
     int retval = -1;
     unsigned int offset;
 
@@ -389,11 +432,13 @@ elf_load(struct sys_info *info, ihandle_t dev, const char *cmdline, void **boot_
 	goto out;
     }
 
-    offset = find_elf(&ehdr);
-    if (!offset) {
+    /* find_elf() matched at hdr->offset, which is 0 for a plain ELF file */
+    offset = hdr->offset;
+    if (offset + sizeof(ehdr) > hdr->len) {
 	retval = LOADER_NOT_SUPPORT;
         goto out;
     }
+    memcpy(&ehdr, hdr->buf + offset, sizeof(ehdr));
 
 #if DEBUG
 	printk("ELF header:\n");
@@ -415,7 +460,7 @@ elf_load(struct sys_info *info, ihandle_t dev, const char *cmdline, void **boot_
 	goto out;
     }
 
-    phdr = elf_readhdrs(offset, &ehdr);
+    phdr = elf_readhdrs(offset, &ehdr, hdr);
     if (!phdr)
         goto out;
 
@@ -429,11 +474,12 @@ elf_load(struct sys_info *info, ihandle_t dev, const char *cmdline, void **boot_
 	printf(" version %s", image_version);
     printf("...\n");
 
-    if (!load_segments(phdr, ehdr.e_phnum, checksum_offset, offset, &file_size))
+    if (!load_segments(phdr, ehdr.e_phnum, checksum_offset, offset,
+                       segment_chunk_size(dev), &file_size, &segments_sum))
 	goto out;
 
     if (checksum_offset) {
-	if (!verify_image(&ehdr, phdr, ehdr.e_phnum, checksum))
+	if (!verify_image(&ehdr, phdr, ehdr.e_phnum, segments_sum, checksum))
 	    goto out;
     }
 
@@ -444,7 +490,7 @@ elf_load(struct sys_info *info, ihandle_t dev, const char *cmdline, void **boot_
         *boot_notes = (void *)virt_to_phys(build_boot_notes(info, cmdline));
         feval("elf-boot load-state >ls.file-type !");
         PUSH((ucell)*boot_notes);
-        feval("elf-boot load-state >ls.param !");
+        feval("load-state >ls.param !");
     } else {
         feval("elf load-state >ls.file-type !");
     }
@@ -24,8 +24,22 @@ is_fcode(unsigned char *fcode)
 		|| fcode[0] == 0xfd);	// version1
 }
 
+long
+find_fcode(unsigned char *buf, unsigned long len)
+{
+    unsigned long offset;
+
+    for (offset = 0; offset + 8 <= len && offset < 16 * 512; offset += 512) {
+        if (is_fcode(buf + offset))
+            return offset;
+    }
+
+    debug("Not a bootable FCode image\n");
+    return -1;
+}
+
 int 
-fcode_load(ihandle_t dev)
+fcode_load(ihandle_t dev, struct load_header *hdr)
 {
     int retval = -1;
     uint8_t fcode_header[8];
@@ -40,24 +54,9 @@ fcode_load(ihandle_t dev)
         goto out;
     }
 
-    for (offset = 0; offset < 16 * 512; offset += 512) {
-        seek_io(fd, offset);
-        if (read_io(fd, &fcode_header, sizeof(fcode_header))
-            != sizeof(fcode_header)) {
-            debug("Can't read FCode header from ihandle " FMT_ucellx "\n", dev);
-            retval = LOADER_NOT_SUPPORT;
-            goto out;
-        }
-
-	if (is_fcode(fcode_header))
-            goto found;
-    }
-
-    debug("Not a bootable FCode image\n");
-    retval = LOADER_NOT_SUPPORT;
-    goto out;
+    offset = hdr->offset;
+    memcpy(fcode_header, hdr->buf + offset, sizeof(fcode_header));
 
- found:
     size = (fcode_header[4] << 24) | (fcode_header[5] << 16) |
         (fcode_header[6] << 8) | fcode_header[7];
 
@@ -23,9 +23,18 @@ int is_forth(char *forth)
 	return (forth[0] == '\\' && forth[1] == ' ');
 }
 
-int forth_load(ihandle_t dev)
+long find_forth(unsigned char *buf, unsigned long len)
+{
+	if (len < 2 || !is_forth((char *)buf)) {
+		debug("No forth source image\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+int forth_load(ihandle_t dev, struct load_header *hdr)
 {
-    char magic[2];
     unsigned long forthsize;
     ucell *forthtext;
     int retval = -1;
@@ -38,18 +47,6 @@ int forth_load(ihandle_t dev)
 	goto out;
     }
 
-    if (read_io(fd, magic, 2) != 2) {
-	debug("Can't read magic header\n");
-	retval = LOADER_NOT_SUPPORT;
-	goto out;
-    }
-
-    if (!is_forth(magic)) {
-	debug("No forth source image\n");
-	retval = LOADER_NOT_SUPPORT;
-	goto out;
-    }
-
     /* Calculate the file size by seeking to the end of the file */
     seek_io(fd, -1);
     forthsize = tell(fd);
@@ -59,7 +56,10 @@ int forth_load(ihandle_t dev)
     forthtext = (void *)POP();
     
     printk("Loading forth source ...");
-    if ((size_t)read_io(fd, forthtext, forthsize) != forthsize) {
+    if (forthsize <= hdr->len) {
+	/* Small scripts are already in the header buffer */
+	memcpy(forthtext, hdr->buf, forthsize);
+    } else if ((size_t)read_io(fd, forthtext, forthsize) != forthsize) {
 	printk("Can't read forth text\n");
 	goto out;
     }
@@ -19,6 +19,7 @@
 #include "libopenbios/openbios.h"
 #include "libopenbios/bindings.h"
 #include "libopenbios/initprogram.h"
+#include "libopenbios/load.h"
 #define NO_QEMU_PROTOS
 #include "arch/common/fw_cfg.h"
 
@@ -82,6 +83,9 @@ openbios_init( void )
 	
 	// Bind the C implementation of (go) into Forth
 	bind_func("(go)", go);
+
+	// Bind the loader statistics
+	bind_func(".load-stats", load_print_stats);
 	
 	// Bind the LE access words
 	bind_func("le-w!", lewstore);
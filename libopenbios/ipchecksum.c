@@ -1,38 +1,98 @@
 /* Taken from Etherboot */
 
+#include "config.h"
 #include "libopenbios/ipchecksum.h"
 
-unsigned short ipchksum(const void *data, unsigned long length)
+/* Aligned loads from the caller's buffer, whatever its declared type */
+typedef uint16_t __attribute__((may_alias)) ipchk_half_t;
+typedef uint32_t __attribute__((may_alias)) ipchk_word_t;
+
+static uint32_t fold32(uint64_t sum)
+{
+	sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+	sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+	return (uint32_t) sum;
+}
+
+static uint16_t fold16(uint32_t sum)
+{
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	return (uint16_t) sum;
+}
+
+/* Ones' complement sum of the buffer taken as 16-bit words in host byte
+ * order, with a trailing odd byte padded as the first byte of a word.
+ * The words are added 32 bits at a time into a 64-bit accumulator, so
+ * the carries only need folding back in once at the end.
+ */
+static uint16_t do_csum(const unsigned char *ptr, unsigned long length)
 {
-	unsigned long sum;
-	unsigned long i;
-	const unsigned char *ptr;
+	const ipchk_word_t *wp;
+	uint64_t sum = 0;
+	uint16_t result;
 	union {
 	    unsigned char byte[2];
-	    unsigned short word;
+	    uint16_t word;
 	} u;
+	int odd;
+
+	if (!length)
+		return 0;
+
+	/* An odd start address puts every byte in the other half of its
+	 * word: sum from the next byte on, then swap the result back */
+	odd = (uintptr_t)ptr & 1;
+	if (odd) {
+		u.byte[0] = 0;
+		u.byte[1] = *ptr;
+		sum += u.word;
+		ptr++;
+		length--;
+	}
+
+	if (length >= 2 && ((uintptr_t)ptr & 2)) {
+		sum += *(const ipchk_half_t *)(const void *)ptr;
+		ptr += 2;
+		length -= 2;
+	}
+
+	wp = (const ipchk_word_t *)(const void *)ptr;
+	while (length >= 16) {
+		sum += wp[0];
+		sum += wp[1];
+		sum += wp[2];
+		sum += wp[3];
+		wp += 4;
+		length -= 16;
+	}
+	while (length >= 4) {
+		sum += *wp++;
+		length -= 4;
+	}
+	ptr = (const unsigned char *)wp;
+
+	if (length >= 2) {
+		sum += *(const ipchk_half_t *)(const void *)ptr;
+		ptr += 2;
+		length -= 2;
+	}
+	if (length) {
+		u.byte[0] = *ptr;
+		u.byte[1] = 0;
+		sum += u.word;
+	}
+
+	result = fold16(fold32(sum));
+	if (odd)
+		result = (result << 8) | (result >> 8);
+
+	return result;
+}
 
-	/* In the most straight forward way possible,
-	 * compute an ip style checksum.
-	 */
-	sum = 0;
-	ptr = data;
-	for(i = 0; i < length; i++) {
-		unsigned long value;
-		value = ptr[i];
-		if (i & 1) {
-			value <<= 8;
-		}
-		/* Add the new value */
-		sum += value;
-		/* Wrap around the carry */
-		if (sum > 0xFFFF) {
-			sum = (sum + (sum >> 16)) & 0xFFFF;
-		}
-	}
-	u.byte[0] = (unsigned char) sum;
-	u.byte[1] = (unsigned char) (sum >> 8);
-	return (unsigned short) ~u.word;
+unsigned short ipchksum(const void *data, unsigned long length)
+{
+	return (unsigned short) ~do_csum(data, length);
 }
 
 unsigned short add_ipchksums(unsigned long offset, unsigned short sum, unsigned short new)
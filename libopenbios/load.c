@@ -20,6 +20,8 @@
 #include "libopenbios/initprogram.h"
 #include "libopenbios/sys_info.h"
 #include "libopenbios/load.h"
+#include "libc/diskio.h"
+#include "libc/vsprintf.h"
 
 #ifdef CONFIG_LOADER_ELF
 #include "libopenbios/elf_load.h"
@@ -53,19 +55,27 @@
 struct sys_info sys_info;
 void *elf_boot_notes = NULL;
 
-/* ( addr -- size ) */
+struct loader {
+	const char *name;
+	/* Returns the offset of the loader's magic in the header buffer, or -1.
+	   Loaders without a magic number (NULL) are tried on every image. */
+	long (*find)(unsigned char *buf, unsigned long len);
+	int (*load)(ihandle_t dev, struct load_header *hdr);
+	/* Statistics */
+	unsigned long tries;
+	unsigned long hits;
+	unsigned long detect_ms;
+	unsigned long load_ms;
+};
+
+static unsigned long header_reads, header_bytes, header_ms;
 
-void load(ihandle_t dev)
+#ifdef CONFIG_LOADER_ELF
+static int
+load_elf(ihandle_t dev, struct load_header *hdr)
 {
-	/* Invoke the loaders on the specified device */
 	char *param;
 
-	/* TODO: Currently the internal loader APIs use load-base directly, so
-	   drop the address */
-	POP();
-
-#ifdef CONFIG_LOADER_ELF
-
 	/* Grab the boot arguments */
 	push_str("bootargs");
 	push_str("/chosen");
@@ -75,55 +85,149 @@ void load(ihandle_t dev)
 	POP();
 	param = pop_fstr_copy();
 
-	if (elf_load(&sys_info, dev, param, &elf_boot_notes) != LOADER_NOT_SUPPORT) {
-            feval("load-state >ls.file-size @");
-            return;
-        }
+	return elf_load(&sys_info, dev, param, &elf_boot_notes, hdr);
+}
 #endif
 
 #ifdef CONFIG_LOADER_AOUT
-	if (aout_load(&sys_info, dev) != LOADER_NOT_SUPPORT) {
-            feval("load-state >ls.file-size @");
-            return;
-        }
+static int
+load_aout(ihandle_t dev, struct load_header *hdr)
+{
+	return aout_load(&sys_info, dev, hdr);
+}
 #endif
 
-#ifdef CONFIG_LOADER_FCODE
-	if (fcode_load(dev) != LOADER_NOT_SUPPORT) {
-            feval("load-state >ls.file-size @");
-            return;
-        }
+#ifdef CONFIG_LOADER_BOOTCODE
+static int
+load_bootcode(ihandle_t dev, __attribute__((unused)) struct load_header *hdr)
+{
+	/* Check for a "raw" %BOOT bootcode payload */
+	return bootcode_load(dev);
+}
 #endif
 
-#ifdef CONFIG_LOADER_FORTH
-	if (forth_load(dev) != LOADER_NOT_SUPPORT) {
-            feval("load-state >ls.file-size @");
-            return;
-        }
+#ifdef CONFIG_LOADER_PREP
+static int
+load_prep(ihandle_t dev, __attribute__((unused)) struct load_header *hdr)
+{
+	return prep_load(dev);
+}
 #endif
 
+/* In order of preference, as each image is offered to them in turn */
+static struct loader loaders[] = {
+#ifdef CONFIG_LOADER_ELF
+	{ "elf",	find_elf,	load_elf	},
+#endif
+#ifdef CONFIG_LOADER_AOUT
+	{ "aout",	find_aout,	load_aout	},
+#endif
+#ifdef CONFIG_LOADER_FCODE
+	{ "fcode",	find_fcode,	fcode_load	},
+#endif
+#ifdef CONFIG_LOADER_FORTH
+	{ "forth",	find_forth,	forth_load	},
+#endif
 #ifdef CONFIG_LOADER_XCOFF
-	if (xcoff_load(dev) != LOADER_NOT_SUPPORT) {
-            feval("load-state >ls.file-size @");
-            return;
-        }
+	{ "xcoff",	find_xcoff,	xcoff_load	},
 #endif
-
 #ifdef CONFIG_LOADER_BOOTCODE
-	/* Check for a "raw" %BOOT bootcode payload */
-	if (bootcode_load(dev) != LOADER_NOT_SUPPORT) {
-            feval("load-state >ls.file-size @");
-            return;
-        }
+	{ "bootcode",	NULL,		load_bootcode	},
 #endif
-
 #ifdef CONFIG_LOADER_PREP
-	if (prep_load(dev) != LOADER_NOT_SUPPORT) {
-            feval("load-state >ls.file-size @");
-            return;
-        }
+	{ "prep",	NULL,		load_prep	},
 #endif
+	{ NULL,		NULL,		NULL		}
+};
+
+static ucell
+load_msecs(void)
+{
+	fword("get-msecs");
+	return POP();
+}
+
+/* ( addr -- size ) */
+
+void load(ihandle_t dev)
+{
+	/* Invoke the loaders on the specified device */
+	struct load_header hdr;
+	struct loader *l;
+	ucell start, detect;
+	long offset;
+	int fd, count, retval;
+
+	/* TODO: Currently the internal loader APIs use load-base directly, so
+	   drop the address */
+	POP();
+
+	/* Read the start of the image once, rather than have every loader
+	   seek around the device looking for its own header */
+	hdr.buf = malloc(LOAD_HEADER_SIZE);
+	if (!hdr.buf) {
+		printk("load: no memory for image header\n");
+		PUSH(0);
+		return;
+	}
+	hdr.len = 0;
+
+	start = load_msecs();
+	fd = open_ih(dev);
+	if (fd != -1) {
+		seek_io(fd, 0);
+		count = read_io(fd, hdr.buf, LOAD_HEADER_SIZE);
+		if (count > 0)
+			hdr.len = count;
+		close_io(fd);
+	}
+	detect = load_msecs() - start;
+
+	header_reads++;
+	header_bytes += hdr.len;
+	header_ms += detect;
+
+	for (l = loaders; l->name; l++) {
+		start = load_msecs();
+		offset = 0;
+		if (l->find)
+			offset = l->find(hdr.buf, hdr.len);
+		detect += load_msecs() - start;
+		if (offset < 0)
+			continue;
+
+		hdr.offset = offset;
+		l->tries++;
+		l->detect_ms += detect;
+		detect = 0;
+
+		start = load_msecs();
+		retval = l->load(dev, &hdr);
+		l->load_ms += load_msecs() - start;
+
+		if (retval != LOADER_NOT_SUPPORT) {
+			l->hits++;
+			free(hdr.buf);
+			feval("load-state >ls.file-size @");
+			return;
+		}
+	}
+
+	free(hdr.buf);
 
         /* Didn't load anything, so return zero size */
         PUSH(0);
 }
+
+/* ( -- ) */
+void load_print_stats(void)
+{
+	struct loader *l;
+
+	forth_printf("headers: %lu reads, %lu bytes, %lu ms\n",
+		     header_reads, header_bytes, header_ms);
+	for (l = loaders; l->name; l++) {
+		forth_printf("%-8s: %lu tries, %lu loads, detect %lu ms, load %lu ms\n",
+			     l->name, l->tries, l->hits, l->detect_ms, l->load_ms);
+	}
+}
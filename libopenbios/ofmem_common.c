@@ -89,77 +89,203 @@ print_trans( void )
 /* OF private allocations                                               */
 /************************************************************************/
 
-int ofmem_posix_memalign( void **memptr, size_t alignment, size_t size )
+/*
+ * Small requests are served from segregated size classes. Each class
+ * keeps a LIFO list of free blocks, so allocating and freeing the many
+ * small, same-size objects drivers like OHCI use is O(1). Class blocks
+ * are not split or merged while they belong to a class; their payload is
+ * aligned to OFMEM_BIN_ALIGN and their descriptor holds the class index
+ * next to the block size. Once a class has no live blocks, any free
+ * blocks beyond OFMEM_BIN_KEEP go back to mfree, where they coalesce, so
+ * a burst of small allocations doesn't fragment the heap for good. All
+ * classes are also emptied before an allocation gives up.
+ *
+ * Everything else is carved from the heap top or taken first-fit from
+ * the address sorted mfree list. Freed blocks are merged with their
+ * neighbours and a free block ending at the heap top is handed back.
+ */
+
+static const ucell ofmem_bin_sizes[OFMEM_NUM_BINS] = {
+	32, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+
+#define OFMEM_BIN_ALIGN		32
+#define OFMEM_BIN_FLAG		1
+#define OFMEM_BIN_SHIFT		5		/* block size goes above flag and class */
+#define OFMEM_BIN_KEEP		16		/* free blocks an idle class holds on to */
+#define OFMEM_MIN_BLOCK		(sizeof(alloc_desc_t) + 32)
+
+#define OFMEM_BIN_CLASS(d)	(((d)->size >> 1) & 0xf)
+#define OFMEM_BIN_BLOCK(d)	((d)->size >> OFMEM_BIN_SHIFT)
+
+static int ofmem_bin_index( size_t size )
 {
-	ofmem_t *ofmem = ofmem_arch_get_private();
-	alloc_desc_t *d, **pp;
-	void *ret;
-	ucell top;
-	phys_addr_t pa;
-	size_t total_size;
+	int i;
 
-	if( !size )
-		return ENOMEM;
+	for( i = 0; i < OFMEM_NUM_BINS; i++ )
+		if( size <= ofmem_bin_sizes[i] )
+			return i;
+	return -1;
+}
 
-	if( !ofmem->next_malloc )
-		ofmem->next_malloc = (char*)ofmem_arch_get_malloc_base();
+static ucell ofmem_payload_size( alloc_desc_t *d )
+{
+	if( d->size & OFMEM_BIN_FLAG )
+		return ofmem_bin_sizes[OFMEM_BIN_CLASS(d)];
+	return d->size - sizeof(alloc_desc_t);
+}
 
-	total_size = align_size(size + sizeof(alloc_desc_t), alignment);
+/* Return an aligned payload address for a block starting at start. Any
+ * space skipped in front of the descriptor is large enough to be freed. */
+static char *ofmem_place( char *start, size_t alignment )
+{
+	char *ret;
 
-	/* look in the freelist */
-	for( pp=&ofmem->mfree; *pp && (**pp).size < total_size; pp = &(**pp).next ) {
+	ret = (char *)pa2va(align_ptr(va2pa((uintptr_t)start + sizeof(alloc_desc_t)), alignment));
+	if( ret - sizeof(alloc_desc_t) != start &&
+	    ret - sizeof(alloc_desc_t) - start < OFMEM_MIN_BLOCK ) {
+		ret = (char *)pa2va(align_ptr(va2pa((uintptr_t)start + OFMEM_MIN_BLOCK +
+						    sizeof(alloc_desc_t)), alignment));
 	}
+	return ret;
+}
 
-	/* If there is a freelist entry that matches the alignment/size, take it */
-	/* TODO: Original implementation fails to use freelist effectively, OHCI driver does a lot of small, same-size allocs/frees */
-	if( *pp && ((**pp).size == total_size)) {
-		/* Alignment should be on physical not virtual address */
-		pa = va2pa((uintptr_t)*pp + sizeof(alloc_desc_t));
-		if (pa == align_ptr(pa, alignment)) {
-			ret = (void *)pa2va(pa);
+/* Insert a free block into mfree, merging it with adjacent free blocks */
+static void ofmem_release_block( ofmem_t *ofmem, alloc_desc_t *d )
+{
+	alloc_desc_t **pp, **pprev = NULL;
 
-			d = *pp;
-			*pp = d->next;
-			d->next = NULL;
+	for( pp=&ofmem->mfree; *pp && *pp < d; pp = &(**pp).next )
+		pprev = pp;
 
-			memset( ret, 0, size );
-			
-			*memptr = ret;
-			return 0;
-		}
+	d->next = *pp;
+	if( d->next && (char *)d + d->size == (char *)d->next ) {
+		d->size += d->next->size;
+		d->next = d->next->next;
 	}
+	*pp = d;
 
-	/* waste at most 4K by taking an entry from the freelist */
-	if( *pp && (**pp).size > total_size + 0x1000 ) {
-		/* Alignment should be on physical not virtual address */
-		pa = va2pa((uintptr_t)*pp + sizeof(alloc_desc_t));
-		pa = align_ptr(pa, alignment);
-		ret = (void *)pa2va(pa);
+	if( pprev && (char *)*pprev + (**pprev).size == (char *)d ) {
+		(**pprev).size += d->size;
+		(**pprev).next = d->next;
+		pp = pprev;
+		d = *pp;
+	}
 
-		memset( ret, 0, size );
-		*pp = (**pp).next;
+	if( (char *)d + d->size == ofmem->next_malloc ) {
+		ofmem->next_malloc = (char *)d;
+		*pp = d->next;
+	}
+}
 
-		*memptr = ret;
-		return 0;
+/* Hand the free blocks of a size class back to mfree */
+static int ofmem_release_bin( ofmem_t *ofmem, int i )
+{
+	alloc_desc_t *d;
+	int n = 0;
+
+	while( (d = ofmem->bins[i]) ) {
+		ofmem->bins[i] = d->next;
+		d->size = OFMEM_BIN_BLOCK(d);
+		ofmem_release_block( ofmem, d );
+		n++;
 	}
+	ofmem->bin_stats[i].cached = 0;
+	return n;
+}
 
-	top = ofmem_arch_get_heap_top();
+/* Allocate a block with an aligned payload of (at least) size bytes */
+static void *ofmem_alloc_block( ofmem_t *ofmem, size_t alignment, size_t size )
+{
+	alloc_desc_t *d, **pp;
+	char *start, *end, *ret;
+	int i, n;
+
+	alignment = MAX(alignment, sizeof(alloc_desc_t));
+	size = align_size(size, sizeof(alloc_desc_t));
+
+ retry:
+	/* first fit from the freelist */
+	for( pp=&ofmem->mfree; *pp; pp = &(**pp).next ) {
+		start = (char *)*pp;
+		end = start + (**pp).size;
+		ret = ofmem_place( start, alignment );
+		if( ret + size <= end ) {
+			*pp = (**pp).next;
+			goto found;
+		}
+	}
+
+	start = ofmem->next_malloc;
+	ret = ofmem_place( start, alignment );
+	end = ret + size;
+	if( pointer2cell(end) > ofmem_arch_get_heap_top() ) {
+		/* the size classes may hold enough free memory */
+		for( i = 0, n = 0; i < OFMEM_NUM_BINS; i++ )
+			n += ofmem_release_bin( ofmem, i );
+		if( n )
+			goto retry;
+		printk("out of malloc memory (%x)!\n", (int)size );
+		return NULL;
+	}
+	ofmem->next_malloc = end;
 
-	/* Alignment should be on physical not virtual address */
-	pa = va2pa((uintptr_t)ofmem->next_malloc + sizeof(alloc_desc_t));
-	pa = align_ptr(pa, alignment);
-	ret = (void *)pa2va(pa);
+ found:
+	d = (alloc_desc_t *)(ret - sizeof(alloc_desc_t));
+	if( (char *)d != start ) {
+		((alloc_desc_t *)start)->size = (char *)d - start;
+		ofmem_release_block( ofmem, (alloc_desc_t *)start );
+	}
+	if( end - (ret + size) >= OFMEM_MIN_BLOCK ) {
+		((alloc_desc_t *)(ret + size))->size = end - (ret + size);
+		ofmem_release_block( ofmem, (alloc_desc_t *)(ret + size) );
+		end = ret + size;
+	}
+	d->next = NULL;
+	d->size = end - (char *)d;
+	return ret;
+}
 
-	if( pointer2cell(ret) + total_size > top ) {
-		printk("out of malloc memory (%x)!\n", total_size );
+int ofmem_posix_memalign( void **memptr, size_t alignment, size_t size )
+{
+	ofmem_t *ofmem = ofmem_arch_get_private();
+	alloc_desc_t *d;
+	alloc_stats_t *st;
+	void *ret;
+	int i;
+
+	if( !size )
 		return ENOMEM;
-	}
 
-	d = (alloc_desc_t*)((uintptr_t)ret - sizeof(alloc_desc_t));
-	ofmem->next_malloc += total_size;
+	if( !ofmem->next_malloc )
+		ofmem->next_malloc = (char*)ofmem_arch_get_malloc_base();
 
-	d->next = NULL;
-	d->size = total_size;
+	i = ofmem_bin_index( size );
+	if( alignment <= OFMEM_BIN_ALIGN && i >= 0 ) {
+		st = &ofmem->bin_stats[i];
+		if( (d = ofmem->bins[i]) ) {
+			ofmem->bins[i] = d->next;
+			st->cached--;
+			ret = (char *)d + sizeof(alloc_desc_t);
+		} else {
+			ret = ofmem_alloc_block( ofmem, OFMEM_BIN_ALIGN, ofmem_bin_sizes[i] );
+			if( !ret )
+				return ENOMEM;
+			d = (alloc_desc_t *)((char *)ret - sizeof(alloc_desc_t));
+			d->size = (d->size << OFMEM_BIN_SHIFT) | (i << 1) | OFMEM_BIN_FLAG;
+		}
+		d->next = NULL;
+		if( ++st->live > st->peak )
+			st->peak = st->live;
+	} else {
+		ret = ofmem_alloc_block( ofmem, alignment, size );
+		if( !ret )
+			return ENOMEM;
+		d = (alloc_desc_t *)((char *)ret - sizeof(alloc_desc_t));
+		ofmem->large_live += d->size;
+		if( ofmem->large_live > ofmem->large_peak )
+			ofmem->large_peak = ofmem->large_live;
+	}
 
 	memset( ret, 0, size );
 
@@ -185,20 +311,26 @@ void* ofmem_malloc( size_t size )
 void ofmem_free( void *ptr )
 {
 	ofmem_t *ofmem = ofmem_arch_get_private();
-	alloc_desc_t **pp, *d;
+	alloc_desc_t *d;
+	int i;
 
 	/* it is legal to free NULL pointers (size zero allocations) */
 	if( !ptr )
 		return;
 
-	/* Locate entry immediately after this new one */
 	d = (alloc_desc_t*)((char *)ptr - sizeof(alloc_desc_t));
-	for( pp=&ofmem->mfree; *pp && *pp < d; pp = &(**pp).next ) {
+	if( d->size & OFMEM_BIN_FLAG ) {
+		i = OFMEM_BIN_CLASS(d);
+		d->next = ofmem->bins[i];
+		ofmem->bins[i] = d;
+		ofmem->bin_stats[i].live--;
+		if( ++ofmem->bin_stats[i].cached > OFMEM_BIN_KEEP && !ofmem->bin_stats[i].live )
+			ofmem_release_bin( ofmem, i );
+		return;
 	}
 
-	/* Insert into the list, now sorted */
-	d->next = *pp;
-	*pp = d;
+	ofmem->large_live -= d->size;
+	ofmem_release_block( ofmem, d );
 }
 
 void* ofmem_realloc( void *ptr, size_t size )
@@ -213,11 +345,48 @@ void* ofmem_realloc( void *ptr, size_t size )
 		return NULL;
 	}
 	p = malloc( size );
-	memcpy( p, ptr, MIN(d->size - sizeof(alloc_desc_t),size) );
+	if( !p )
+		return NULL;
+	memcpy( p, ptr, MIN(ofmem_payload_size(d),size) );
 	free( ptr );
 	return p;
 }
 
+/* ( -- ) */
+static void ofmem_print_stats( void )
+{
+	ofmem_t *ofmem = ofmem_arch_get_private();
+	alloc_stats_t *st;
+	alloc_desc_t *d;
+	ucell free_bytes = 0, free_blocks = 0, largest = 0;
+	ucell base, top;
+	int i;
+
+	printk("  size     live     peak   cached\n");
+	for( i = 0; i < OFMEM_NUM_BINS; i++ ) {
+		st = &ofmem->bin_stats[i];
+		printk("%6lu %8lu %8lu %8lu\n", (unsigned long)ofmem_bin_sizes[i],
+		       (unsigned long)st->live, (unsigned long)st->peak, (unsigned long)st->cached);
+	}
+
+	for( d = ofmem->mfree; d; d = d->next ) {
+		free_bytes += d->size;
+		free_blocks++;
+		largest = MAX(largest, d->size);
+	}
+	printk("large blocks: %lu bytes live, %lu peak\n",
+	       (unsigned long)ofmem->large_live, (unsigned long)ofmem->large_peak);
+	printk("free list: %lu bytes in %lu blocks, largest %lu, fragmentation %lu%%\n",
+	       (unsigned long)free_bytes, (unsigned long)free_blocks, (unsigned long)largest,
+	       free_bytes ? (unsigned long)(100 - largest * 100 / free_bytes) : 0UL);
+
+	base = pointer2cell(ofmem_arch_get_malloc_base());
+	top = ofmem_arch_get_heap_top();
+	printk("heap: %lu of %lu bytes used\n",
+	       (unsigned long)(ofmem->next_malloc ? pointer2cell(ofmem->next_malloc) - base : 0),
+	       (unsigned long)(top - base));
+}
+
 
 /************************************************************************/
 /* "translations" and "available" property tracking                     */
@@ -1006,4 +1175,6 @@ void ofmem_register( phandle_t ph_memory, phandle_t ph_mmu )
 	virt_range_prop = malloc(virt_range_prop_size);
 
 	ofmem_update_translations();
+
+	bind_func(".ofmem-stats", ofmem_print_stats);
 }
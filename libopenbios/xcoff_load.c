@@ -45,8 +45,23 @@ is_xcoff(COFF_filehdr_t *fhdr)
 	    || fhdr->f_magic == U802TOMAGIC);
 }
 
+long
+find_xcoff(unsigned char *buf, unsigned long len)
+{
+	unsigned long offset;
+
+	for (offset = 0; offset + sizeof(COFF_filehdr_t) <= len
+		     && offset < 16 * 512; offset += 512) {
+		if (is_xcoff((COFF_filehdr_t *)(buf + offset)))
+			return offset;
+	}
+
+	DPRINTF("Not an XCOFF image\n");
+	return -1;
+}
+
 int 
-xcoff_load(ihandle_t dev)
+xcoff_load(ihandle_t dev, struct load_header *hdr)
 {
 	COFF_filehdr_t fhdr;
 	COFF_aouthdr_t ahdr;
@@ -65,17 +80,7 @@ xcoff_load(ihandle_t dev)
 		goto out;
 	}
 	
-	for (offset = 0; offset < 16 * 512; offset += 512) {
-		seek_io(fd, offset);
-		if (read_io(fd, &fhdr, sizeof fhdr) != sizeof fhdr) {
-			DPRINTF("Can't read XCOFF header\n");
-			retval = LOADER_NOT_SUPPORT;
-			goto out;
-		}
-		
-		if (is_xcoff(&fhdr))
-			break;
-	}
+	memcpy(&fhdr, hdr->buf + hdr->offset, sizeof(fhdr));
 	
 	/* Is it executable ? */
 	if (fhdr.f_magic != 0x01DF &&
@@ -90,8 +95,12 @@ xcoff_load(ihandle_t dev)
 		return LOADER_NOT_SUPPORT;
 	}
 	
-	seek_io(fd, sizeof(COFF_filehdr_t));
-	read_io(fd, &ahdr, sizeof(COFF_aouthdr_t));
+	if (sizeof(COFF_filehdr_t) + sizeof(COFF_aouthdr_t) <= hdr->len) {
+		memcpy(&ahdr, hdr->buf + sizeof(COFF_filehdr_t), sizeof(ahdr));
+	} else {
+		seek_io(fd, sizeof(COFF_filehdr_t));
+		read_io(fd, &ahdr, sizeof(COFF_aouthdr_t));
+	}
 	
 	/* check a.out magic number */
 	if (ahdr.magic != AOUT_MAGIC) {
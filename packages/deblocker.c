@@ -27,10 +27,505 @@ typedef struct {
 	int	max_xfer;
 	int	blksize;
 	char	*buf;
+
+	phandle_t dev;			/* parent device node, keys the cache and write generations */
+	ucell	nblocks;		/* device size in blocks, 0 if unknown */
+	int	cache_bpl;		/* blocks per cache line, 0 if uncached */
+	ucell	ra_line;		/* line following the last cache fill */
+
+	ucell	seq_hi, seq_lo;		/* byte position following the last read */
+	int	seq_count;		/* number of back to back sequential reads */
+	char	*stream_buf;
+	int	stream_size;		/* stream window size in blocks */
+	ucell	win_blk;		/* first block in the stream window */
+	int	win_n;			/* valid blocks in the stream window */
+	ucell	win_gen;		/* device write generation of the window */
 } deblk_info_t;
 
 DECLARE_NODE( deblocker, 0, sizeof(deblk_info_t), "+/packages/deblocker" );
 
+
+#define DO_IO( xt, buf, blk, n )	\
+	({ PUSH3(pointer2cell(buf), blk, n); call_parent(xt); POP(); })
+
+static ucell stream_bytes;
+
+/************************************************************************/
+/*	block cache							*/
+/************************************************************************/
+
+/*
+ * LRU cache of device blocks shared by all deblocker instances and
+ * keyed by (device node, line). Small reads go through it, so
+ * filesystem probing doesn't hit the media again for blocks that were
+ * already read. A miss on the line following the previous fill reads
+ * several lines ahead in one request. Writes go to the device and drop
+ * the lines they touch. A device's lines are dropped when its first
+ * instance opens, as the media may have been changed in between.
+ */
+
+#if defined(CONFIG_DEBLOCKER_CACHE_SIZE) && CONFIG_DEBLOCKER_CACHE_SIZE > 0
+
+#define CACHE_LINE_SIZE		4096
+#define CACHE_LINES		((CONFIG_DEBLOCKER_CACHE_SIZE * 1024) / CACHE_LINE_SIZE)
+#define CACHE_HASH_SIZE		256
+#define CACHE_RA_LINES		8		/* read-ahead window */
+#define CACHE_BYPASS		(CACHE_RA_LINES * CACHE_LINE_SIZE)
+#define CACHE_ALIGN		32		/* keep buffers usable for DMA */
+#define CACHE_OPEN_DEVS		16		/* devices with open instances tracked */
+
+typedef struct cache_line {
+	struct cache_line *hnext;		/* hash chain */
+	struct cache_line *prev, *next;		/* LRU list, most recent first */
+	phandle_t	dev;
+	ucell		line;
+	int		nblks;			/* valid blocks, 0 if unused */
+	char		*data;
+} cache_line_t;
+
+static struct {
+	cache_line_t	*lines;
+	cache_line_t	*hash[CACHE_HASH_SIZE];
+	cache_line_t	*head, *tail;
+	char		*staging;
+	int		failed;
+
+	struct {
+		phandle_t	dev;
+		int		count;
+	} open[CACHE_OPEN_DEVS];
+
+	ucell		hits, misses, readahead, bytes;
+} cache;
+
+static inline unsigned int
+cache_hash( phandle_t dev, ucell line )
+{
+	return (line ^ (dev >> 4)) & (CACHE_HASH_SIZE - 1);
+}
+
+static int
+cache_init( void )
+{
+	char *mem;
+	int i;
+
+	if( cache.lines )
+		return 0;
+	if( cache.failed || CACHE_LINES < 2 * CACHE_RA_LINES )
+		return -1;
+
+	cache.lines = malloc( CACHE_LINES * sizeof(cache_line_t) );
+	mem = malloc( (CACHE_LINES + CACHE_RA_LINES) * CACHE_LINE_SIZE + CACHE_ALIGN );
+	if( !cache.lines || !mem ) {
+		printk("deblocker: no memory for block cache\n");
+		free( cache.lines );
+		free( mem );
+		cache.lines = NULL;
+		cache.failed = 1;
+		return -1;
+	}
+	mem = (char*)(((unsigned long)mem + CACHE_ALIGN - 1) & ~(unsigned long)(CACHE_ALIGN - 1));
+	cache.staging = mem + CACHE_LINES * CACHE_LINE_SIZE;
+
+	memset( cache.lines, 0, CACHE_LINES * sizeof(cache_line_t) );
+	for( i=0; i<CACHE_LINES; i++ ) {
+		cache.lines[i].data = mem + i * CACHE_LINE_SIZE;
+		cache.lines[i].prev = i ? &cache.lines[i-1] : NULL;
+		cache.lines[i].next = i < CACHE_LINES - 1 ? &cache.lines[i+1] : NULL;
+	}
+	cache.head = &cache.lines[0];
+	cache.tail = &cache.lines[CACHE_LINES - 1];
+	return 0;
+}
+
+static void
+cache_unlink( cache_line_t *l )
+{
+	if( l->prev )
+		l->prev->next = l->next;
+	else
+		cache.head = l->next;
+	if( l->next )
+		l->next->prev = l->prev;
+	else
+		cache.tail = l->prev;
+}
+
+static void
+cache_touch( cache_line_t *l )
+{
+	if( cache.head == l )
+		return;
+	cache_unlink( l );
+	l->prev = NULL;
+	l->next = cache.head;
+	cache.head->prev = l;
+	cache.head = l;
+}
+
+static cache_line_t *
+cache_lookup( phandle_t dev, ucell line )
+{
+	cache_line_t *l;
+
+	for( l=cache.hash[cache_hash(dev, line)]; l; l=l->hnext )
+		if( l->line == line && l->dev == dev )
+			return l;
+	return NULL;
+}
+
+/* take a line out of the hash and move it to the LRU end for reuse */
+static void
+cache_drop( cache_line_t *l )
+{
+	cache_line_t **pp;
+
+	if( l->nblks ) {
+		for( pp=&cache.hash[cache_hash(l->dev, l->line)]; *pp; pp=&(*pp)->hnext ) {
+			if( *pp == l ) {
+				*pp = l->hnext;
+				break;
+			}
+		}
+		l->nblks = 0;
+	}
+	if( cache.tail == l )
+		return;
+	cache_unlink( l );
+	l->next = NULL;
+	l->prev = cache.tail;
+	cache.tail->next = l;
+	cache.tail = l;
+}
+
+static cache_line_t *
+cache_insert( phandle_t dev, ucell line, const char *data, int nblks )
+{
+	cache_line_t *l = cache.tail;
+	unsigned int h = cache_hash(dev, line);
+
+	cache_drop( l );
+	l->dev = dev;
+	l->line = line;
+	l->nblks = nblks;
+	memcpy( l->data, data, CACHE_LINE_SIZE );
+	l->hnext = cache.hash[h];
+	cache.hash[h] = l;
+	cache_touch( l );
+	return l;
+}
+
+/*
+ * Read a missing line, and the lines after it if the access is sequential.
+ * Reads stop at the end of the device if its size is known; otherwise a
+ * failed read-ahead is retried for the requested line alone.
+ */
+static cache_line_t *
+cache_fill( deblk_info_t *di, ucell line )
+{
+	cache_line_t *l = NULL;
+	ucell first = line * di->cache_bpl;
+	int i, n, nblks, nlines = 1;
+
+	if( di->nblocks && first >= di->nblocks )
+		return NULL;
+
+	if( line == di->ra_line ) {
+		nlines = MIN( CACHE_RA_LINES, di->max_xfer / CACHE_LINE_SIZE );
+		for( i=1; i<nlines; i++ ) {
+			if( cache_lookup(di->dev, line + i) ) {
+				nlines = i;
+				break;
+			}
+		}
+	}
+
+	nblks = nlines * di->cache_bpl;
+	if( di->nblocks && di->nblocks - first < (ucell)nblks )
+		nblks = di->nblocks - first;
+	n = DO_IO( di->read_xt, cache.staging, first, nblks );
+	if( n <= 0 && nblks > di->cache_bpl )
+		n = DO_IO( di->read_xt, cache.staging, first, di->cache_bpl );
+	if( n <= 0 )
+		return NULL;
+	cache.bytes += (ucell)n * di->blksize;
+
+	for( i=0; i * di->cache_bpl < n; i++ ) {
+		cache_line_t *t = cache_insert( di->dev, line + i, cache.staging + i * CACHE_LINE_SIZE,
+						MIN(di->cache_bpl, n - i * di->cache_bpl) );
+		if( !i )
+			l = t;
+	}
+	if( i > 1 )
+		cache.readahead += i - 1;
+
+	/* keep the requested line most recent */
+	cache_touch( l );
+	di->ra_line = line + i;
+	return l;
+}
+
+static int
+cache_read( deblk_info_t *di, char *buf, ucell blk, int n )
+{
+	cache_line_t *l;
+	int offs, cnt, done = 0;
+
+	if( !di->cache_bpl || n * di->blksize > CACHE_BYPASS ) {
+		done = DO_IO( di->read_xt, buf, blk, n );
+		if( done > 0 )
+			cache.bytes += (ucell)done * di->blksize;
+		return done;
+	}
+
+	while( done < n ) {
+		ucell line = (blk + done) / di->cache_bpl;
+		offs = (blk + done) % di->cache_bpl;
+
+		if( (l=cache_lookup(di->dev, line)) ) {
+			cache.hits++;
+			cache_touch( l );
+		} else {
+			cache.misses++;
+			if( !(l=cache_fill(di, line)) ) {
+				/* e.g. a line running past the end of the device */
+				cnt = DO_IO( di->read_xt, buf + done * di->blksize, blk + done, n - done );
+				if( cnt > 0 ) {
+					cache.bytes += (ucell)cnt * di->blksize;
+					done += cnt;
+				}
+				break;
+			}
+		}
+
+		cnt = MIN( l->nblks - offs, n - done );
+		if( cnt <= 0 )
+			break;
+		memcpy( buf + done * di->blksize, l->data + offs * di->blksize, cnt * di->blksize );
+		done += cnt;
+		if( l->nblks < di->cache_bpl )
+			break;
+	}
+	return done;
+}
+
+static void
+cache_invalidate( deblk_info_t *di, ucell blk, int n )
+{
+	ucell line;
+	cache_line_t *l;
+
+	if( !di->cache_bpl || n <= 0 )
+		return;
+	for( line = blk / di->cache_bpl; line <= (blk + n - 1) / di->cache_bpl; line++ )
+		if( (l=cache_lookup(di->dev, line)) )
+			cache_drop( l );
+}
+
+/* drop all lines of a device */
+static void
+cache_forget( phandle_t dev )
+{
+	int i;
+
+	if( !cache.lines )
+		return;
+	for( i=0; i<CACHE_LINES; i++ )
+		if( cache.lines[i].nblks && cache.lines[i].dev == dev )
+			cache_drop( &cache.lines[i] );
+}
+
+static void
+cache_open( deblk_info_t *di )
+{
+	int i, slot = -1;
+
+	/* the first instance on a device may see different media */
+	for( i=0; i<CACHE_OPEN_DEVS; i++ ) {
+		if( cache.open[i].count && cache.open[i].dev == di->dev )
+			break;
+		if( !cache.open[i].count && slot < 0 )
+			slot = i;
+	}
+	if( i < CACHE_OPEN_DEVS ) {
+		cache.open[i].count++;
+	} else {
+		cache_forget( di->dev );
+		if( slot >= 0 ) {
+			cache.open[slot].dev = di->dev;
+			cache.open[slot].count = 1;
+		}
+	}
+
+	di->cache_bpl = 0;
+	di->ra_line = -1;
+	if( di->blksize <= 0 || di->blksize > CACHE_LINE_SIZE || CACHE_LINE_SIZE % di->blksize )
+		return;
+	/* a line must be readable in one request */
+	if( di->max_xfer < CACHE_LINE_SIZE )
+		return;
+	if( cache_init() )
+		return;
+	di->cache_bpl = CACHE_LINE_SIZE / di->blksize;
+}
+
+static void
+cache_close( deblk_info_t *di )
+{
+	int i;
+
+	for( i=0; i<CACHE_OPEN_DEVS; i++ ) {
+		if( cache.open[i].count && cache.open[i].dev == di->dev ) {
+			cache.open[i].count--;
+			break;
+		}
+	}
+}
+
+/* ( -- hits misses readahead bytes ) */
+static void
+deblk_cache_stats( void )
+{
+	PUSH( cache.hits );
+	PUSH( cache.misses );
+	PUSH( cache.readahead );
+	PUSH( cache.bytes );
+}
+
+/* ( -- ) */
+static void
+deblk_print_cache_stats( void )
+{
+	printk("block cache: %d KB, %d lines\n", CONFIG_DEBLOCKER_CACHE_SIZE, cache.lines ? CACHE_LINES : 0);
+	printk("hits: %lu misses: %lu read-ahead lines: %lu\n",
+	       (unsigned long)cache.hits, (unsigned long)cache.misses, (unsigned long)cache.readahead);
+	printk("bytes read from media: %lu\n", (unsigned long)cache.bytes);
+	printk("bytes streamed: %lu\n", (unsigned long)stream_bytes);
+}
+
+#else
+
+#define cache_open( di )			do { } while( 0 )
+#define cache_close( di )			do { } while( 0 )
+#define cache_invalidate( di, blk, n )		do { } while( 0 )
+#define cache_read( di, buf, blk, n )		DO_IO( (di)->read_xt, buf, blk, n )
+
+#endif
+
+/************************************************************************/
+/*	sequential streaming						*/
+/************************************************************************/
+
+/*
+ * Once an instance has done STREAM_TRIGGER reads in a row that each
+ * start where the previous one ended, reads are served from a stream
+ * window. The window is refilled with max-transfer sized requests
+ * (capped at STREAM_MAX), so small read_io() calls from filesystems
+ * and loaders are coalesced into few large device reads. If the rest
+ * of a request is at least a window in size, it is read straight into
+ * the caller's buffer with a single request. Streamed data bypasses
+ * the block cache so large loads don't evict filesystem metadata.
+ */
+
+#define STREAM_TRIGGER		2
+#define STREAM_MAX		(128 * 1024)
+#define STREAM_GEN_SLOTS	16
+
+/* write generations shared by all instances, hashed by device */
+static ucell stream_gen[STREAM_GEN_SLOTS];
+
+static inline ucell *
+stream_gen_slot( deblk_info_t *di )
+{
+	return &stream_gen[(di->dev >> 4) & (STREAM_GEN_SLOTS - 1)];
+}
+
+static void
+stream_update( deblk_info_t *di, ducell mark )
+{
+	if( mark == (((ducell)di->seq_hi << BITS) | di->seq_lo) ) {
+		if( di->seq_count < STREAM_TRIGGER )
+			di->seq_count++;
+	} else {
+		di->seq_count = 0;
+		di->win_n = 0;
+	}
+}
+
+static int
+stream_start( deblk_info_t *di )
+{
+	if( di->stream_buf )
+		return 0;
+
+	di->stream_size = MIN( di->max_xfer, STREAM_MAX ) / di->blksize;
+	if( di->stream_size < 2 )
+		return -1;
+	di->stream_buf = malloc( di->stream_size * di->blksize );
+	if( !di->stream_buf )
+		return -1;
+	di->win_n = 0;
+	return 0;
+}
+
+static int
+stream_read( deblk_info_t *di, char *buf, ucell blk, int n )
+{
+	int cnt, done = 0;
+
+	/* drop the window if any instance wrote to the device since it was read */
+	if( di->win_gen != *stream_gen_slot(di) )
+		di->win_n = 0;
+
+	while( done < n ) {
+		ucell b = blk + done;
+
+		if( b >= di->win_blk && b < di->win_blk + di->win_n ) {
+			cnt = MIN( di->win_blk + di->win_n - b, (ucell)(n - done) );
+			memcpy( buf + done * di->blksize,
+				di->stream_buf + (b - di->win_blk) * di->blksize, cnt * di->blksize );
+			done += cnt;
+			continue;
+		}
+
+		if( n - done >= di->stream_size ) {
+			/* coalesce the rest of the request into one direct read */
+			cnt = DO_IO( di->read_xt, buf + done * di->blksize, b, n - done );
+			if( cnt > 0 ) {
+				stream_bytes += (ucell)cnt * di->blksize;
+				done += cnt;
+			}
+			break;
+		}
+
+		cnt = di->stream_size;
+		if( di->nblocks && b < di->nblocks && di->nblocks - b < (ucell)cnt )
+			cnt = di->nblocks - b;
+		cnt = DO_IO( di->read_xt, di->stream_buf, b, cnt );
+		if( cnt <= 0 ) {
+			/* e.g. a window running past the end of the device */
+			cnt = cache_read( di, buf + done * di->blksize, b, n - done );
+			if( cnt > 0 )
+				done += cnt;
+			break;
+		}
+		stream_bytes += (ucell)cnt * di->blksize;
+		di->win_blk = b;
+		di->win_n = cnt;
+		di->win_gen = *stream_gen_slot(di);
+	}
+	return done;
+}
+
+static int
+deblk_read_blocks( deblk_info_t *di, char *buf, ucell blk, int n )
+{
+	if( di->seq_count >= STREAM_TRIGGER && !stream_start(di) )
+		return stream_read( di, buf, blk, n );
+	return cache_read( di, buf, blk, n );
+}
+
 /* ( -- flag ) */
 static void
 deblk_open( deblk_info_t *di )
@@ -56,6 +551,17 @@ deblk_open( deblk_info_t *di )
 	   di->blksize, di->max_xfer, di->write_xt, di->read_xt ); */
 
 	di->buf = malloc( di->blksize );
+	di->seq_hi = di->seq_lo = -1;
+	di->seq_count = 0;
+	di->stream_buf = NULL;
+	di->win_n = 0;
+	di->nblocks = 0;
+	if( (xt=find_parent_method("#blocks")) ) {
+		call_parent( xt );
+		di->nblocks = POP();
+	}
+	di->dev = ih_to_phandle( my_parent() );
+	cache_open( di );
 	PUSH(-1);
 }
 
@@ -63,6 +569,8 @@ deblk_open( deblk_info_t *di )
 static void
 deblk_close( deblk_info_t *di )
 {
+	cache_close( di );
+	free( di->stream_buf );
 	free( di->buf );
 }
 
@@ -94,10 +602,6 @@ deblk_tell( deblk_info_t *di )
 	PUSH( di->mark_hi );
 }
 
-
-#define DO_IO( xt, buf, blk, n )	\
-	({ PUSH3(pointer2cell(buf), blk, n); call_parent(xt); POP(); })
-
 typedef struct {
 	/* block operation */
 	char	*blk_buf;
@@ -154,16 +658,26 @@ do_readwrite( deblk_info_t *di, int is_write, xt_t xt )
 	blk = mark / di->blksize;
 	split( di, dest, len, w );
 
+	if( !is_write )
+		stream_update( di, mark );
+	else
+		(*stream_gen_slot(di))++;
+
 	for( i=0; !last && i<3; i++ ) {
 		if( !w[i].nblks )
 			continue;
 
 		if( is_write && i != 1 ) {
-			DO_IO( di->read_xt, w[i].blk_buf, blk, w[i].nblks );
+			deblk_read_blocks( di, w[i].blk_buf, blk, w[i].nblks );
 			memcpy( w[i].blk_buf + w[i].offs, w[i].data, w[i].len );
 		}
 
-		n = DO_IO( xt, w[i].blk_buf, blk, w[i].nblks );
+		if( is_write ) {
+			n = DO_IO( xt, w[i].blk_buf, blk, w[i].nblks );
+			cache_invalidate( di, blk, w[i].nblks );
+		} else {
+			n = deblk_read_blocks( di, w[i].blk_buf, blk, w[i].nblks );
+		}
 		if( n < 0 ) {
 			if( !retlen )
 				retlen = -1;
@@ -183,6 +697,10 @@ do_readwrite( deblk_info_t *di, int is_write, xt_t xt )
                 di->mark_hi = mark >> BITS;
                 di->mark_lo = mark & (ucell) -1;
         }
+	if( is_write )
+		mark = (ducell)-1;
+	di->seq_hi = mark >> BITS;
+	di->seq_lo = mark & (ucell) -1;
 	return retlen;
 }
 
@@ -218,4 +736,8 @@ void
 deblocker_init( void )
 {
 	REGISTER_NODE( deblocker );
+#if defined(CONFIG_DEBLOCKER_CACHE_SIZE) && CONFIG_DEBLOCKER_CACHE_SIZE > 0
+	bind_func( "deblocker-stats", deblk_cache_stats );
+	bind_func( ".deblocker-stats", deblk_print_cache_stats );
+#endif
 }